@@ -20,294 +20,470 @@
 #include <string.h>
 
 #include "ast_constructors.h"
+#include "intern.h"
 #include "lex_extras.h"
 #include "misc.h"
 #include "scope.h"
-
-char flbuf[(1 << 16) + 1];
-
-void ast_print(struct ast_node *top, int depth, const char *prefix) {
-  char buf[(1 << 16) + 1];
-  if (top == NULL) {
-    return;
+#include "writer.h"
+
+// The AST dump is produced with an explicit stack of the parts that are still
+// left to print, so that deeply nested expressions and long lists do not use
+// up the native stack. Parts are pushed in reverse so that they are printed in
+// the order they were pushed by the part that contains them.
+
+enum ast_dump_item_type {
+  AST_DUMP_ITEM_NODE,
+  AST_DUMP_ITEM_GKCC_TYPE,
+  AST_DUMP_ITEM_SYMBOL,
+  AST_DUMP_ITEM_SYMBOL_TABLE,
+  AST_DUMP_ITEM_SYMBOL_TABLE_ENTRY,
+  AST_DUMP_ITEM_TEXT,
+};
+
+struct ast_dump_item {
+  enum ast_dump_item_type type;
+  int depth;
+  // prefix is the text printed in front of a node or type. For
+  // AST_DUMP_ITEM_TEXT, it is the text itself.
+  const char *prefix;
+  union {
+    struct ast_node *node;
+    struct gkcc_type *gkcc_type;
+    struct gkcc_symbol *symbol;
+    struct gkcc_symbol_table *symbol_table;
+  };
+};
+
+struct ast_dumper {
+  struct gkcc_writer *writer;
+  struct ast_dump_item *items;
+  size_t count;
+  size_t capacity;
+};
+
+static void ast_dump_push(struct ast_dumper *dumper,
+                          struct ast_dump_item item) {
+  if (dumper->count == dumper->capacity) {
+    dumper->capacity = dumper->capacity == 0 ? 64 : dumper->capacity * 2;
+    dumper->items = realloc(dumper->items,
+                            dumper->capacity * sizeof(struct ast_dump_item));
+    gkcc_assert(dumper->items != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                "Failed to grow the AST dump stack");
   }
+  dumper->items[dumper->count++] = item;
+}
 
-  // Don't want the extra empty newline of AST_NODE_LIST
-  if (prefix != NULL) {
-    int start_of_line = 2 * depth;
-
-    for (int i = 0; i < start_of_line; ++i) {
-      buf[i] = ' ';
-    }
-
-    for (int i = 0; prefix[i] != '\0'; i++) {
-      buf[start_of_line++] = prefix[i];
-    }
-
-    buf[start_of_line] = '\0';
+static void ast_dump_push_node(struct ast_dumper *dumper, struct ast_node *node,
+                               int depth, const char *prefix) {
+  if (node == NULL) return;
+  ast_dump_push(dumper, (struct ast_dump_item){.type = AST_DUMP_ITEM_NODE,
+                                               .depth = depth,
+                                               .prefix = prefix,
+                                               .node = node});
+}
 
-    printf("%s", buf);
+static void ast_dump_push_gkcc_type(struct ast_dumper *dumper,
+                                    struct gkcc_type *gkcc_type, int depth,
+                                    const char *prefix) {
+  if (gkcc_type == NULL) return;
+  ast_dump_push(dumper, (struct ast_dump_item){.type = AST_DUMP_ITEM_GKCC_TYPE,
+                                               .depth = depth,
+                                               .prefix = prefix,
+                                               .gkcc_type = gkcc_type});
+}
 
-    ast_node_string(buf, top, depth + 1);
+static void ast_dump_push_text(struct ast_dumper *dumper, int depth,
+                               const char *text) {
+  ast_dump_push(dumper, (struct ast_dump_item){.type = AST_DUMP_ITEM_TEXT,
+                                               .depth = depth,
+                                               .prefix = text});
+}
 
-    if (buf[0] != '\0')  // Function has handled its own printing
-      printf("%s\n", buf);
-    else
-      printf("\n");
+static void ast_dump_indent(struct gkcc_writer *writer, int depth) {
+  for (int i = 0; i < 2 * depth; i++) {
+    gkcc_writer_char(writer, ' ');
   }
+}
 
-  switch (top->type) {
+// ast_dump_node_header writes the line describing node, without the newline.
+// Nodes of type AST_NODE_GKCC_TYPE and AST_NODE_LIST have no description.
+static void ast_dump_node_header(struct gkcc_writer *writer,
+                                 struct ast_node *node) {
+  switch (node->type) {
     case AST_NODE_BINOP:
-      ast_print(top->binop.left, depth + 1, "expr 1: ");
-      ast_print(top->binop.right, depth + 1, "expr 2: ");
+      gkcc_writer_str(writer, AST_NODE_TYPE_STRING[AST_NODE_BINOP]);
+      gkcc_writer_str(writer, ": ");
+      gkcc_writer_str(writer, ast_binop_type_string(&node->binop));
       break;
-    case AST_NODE_MEMBER_ACCESS:
-      ast_print(top->member_access.struct_or_union, depth + 1, "in: ");
-      ast_print(top->member_access.identifier, depth + 1, "access: ");
     case AST_NODE_CONSTANT:
+      ast_constant_write(writer, &node->constant);
       break;
     case AST_NODE_IDENT:
-      gkcc_symbol_print_string(top->ident.symbol_table_entry, depth + 1);
+      gkcc_writer_str(writer, AST_NODE_TYPE_STRING[AST_NODE_IDENT]);
+      gkcc_writer_str(writer, ": ");
+      gkcc_writer_escaped(writer, node->ident.name, node->ident.length);
       break;
     case AST_NODE_UNARY:
-      ast_print(top->unary.of, depth + 1, "");
+      ast_unary_write(writer, &node->unary);
       break;
     case AST_NODE_TERNARY:
-      ast_print(top->ternary.condition, depth + 1, "condition: ");
-      ast_print(top->ternary.true_expr, depth + 1, "true_expr: ");
-      ast_print(top->ternary.false_expr, depth + 1, "false_expr: ");
-      break;
-    case AST_NODE_DECLARATION:
-      ast_print(top->declaration.identifier, depth + 1, "init_declarator: ");
-      ast_print(top->declaration.type, depth + 1, "type: ");
-      ast_print(top->declaration.assignment, depth + 1, "assignment: ");
+      ast_ternary_write(writer, &node->ternary);
       break;
+    case AST_NODE_GKCC_TYPE:
     case AST_NODE_LIST:
-      ast_print(top->list.node, depth + 1, "list_node: ");
-      ast_print(top->list.next, depth, NULL);
-      break;
-    case AST_NODE_TOP_LEVEL:
-      ast_print(top->top_level.list, depth, NULL);
-      break;
-    case AST_NODE_FUNCTION_CALL:
-      ast_print(top->function_call.name, depth + 1, "function_name: ");
-      ast_print(top->function_call.parameters, depth + 1, "parameters: ");
-      break;
-    case AST_NODE_ENUM_DEFINITION:
-      ast_print(top->enum_definition.enumerators, depth + 1, "enumerators: ");
-      ast_print(top->enum_definition.ident, depth + 1, "ident: ");
       break;
     case AST_NODE_STRUCT_OR_UNION_SPECIFIER:
-      ast_print(top->struct_or_union_specifier.ident, depth + 1, "ident: ");
-      break;
-    case AST_NODE_IF_STATEMENT:
-      ast_print(top->if_statement.condition, depth + 1, "condition: ");
-      ast_print(top->if_statement.then_statement, depth + 1, "then: ");
-      ast_print(top->if_statement.else_statement, depth + 1, "else: ");
+      gkcc_writer_str(writer, AST_NODE_TYPE_STRING[node->type]);
+      gkcc_writer_str(writer, " (type=");
+      gkcc_writer_str(writer, AST_STRUCT_OR_UNION_SPECIFIER_TYPE_STRING
+                                  [node->struct_or_union_specifier.type]);
+      gkcc_writer_str(writer, "): ");
       break;
     case AST_NODE_FOR_LOOP:
-      ast_print(top->for_loop.expr1, depth + 1, "expr1: ");
-      ast_print(top->for_loop.expr2, depth + 1, "expr2: ");
-      ast_print(top->for_loop.expr3, depth + 1, "expr3: ");
-      ast_print(top->for_loop.statements, depth + 1, "do: ");
-      break;
-    case AST_NODE_FUNCTION_RETURN:
-      ast_print(top->function_return.to_return, depth + 1, "returning: ");
+      gkcc_writer_str(writer, AST_NODE_TYPE_STRING[node->type]);
+      gkcc_writer_str(writer, " (is_do_while=");
+      gkcc_writer_str(writer, node->for_loop.is_do_while ? "true" : "false");
+      gkcc_writer_str(writer, "):");
       break;
-    case AST_NODE_SWITCH_CASE_CASE:
-      ast_print(top->switch_case_case.expression, depth + 1, "expression: ");
-      ast_print(top->switch_case_case.statement, depth + 1, "statements: ");
-      break;
-    case AST_NODE_SWITCH_CASE_SWITCH:
-      ast_print(top->switch_case_switch.expression, depth + 1,
-                "constant_expression: ");
-      ast_print(top->switch_case_switch.statements, depth + 1, "statements: ");
+    case AST_NODE_GOTO_NODE:
+      gkcc_writer_str(writer, AST_NODE_TYPE_STRING[node->type]);
+      gkcc_writer_str(writer, ": ");
+      gkcc_writer_str(writer, node->goto_node.ident->ident.name);
       break;
     default:
+      gkcc_writer_str(writer, AST_NODE_TYPE_STRING[node->type]);
+      gkcc_writer_char(writer, ':');
       break;
   }
 }
 
-void ast_node_string(char *buf, struct ast_node *node, int depth) {
-  char extrabuf[8193];
-  switch (node->type) {
+// ast_dump_node prints a node and pushes its children. A node without a
+// prefix is the continuation of a list and is not printed itself.
+static void ast_dump_node(struct ast_dumper *dumper, struct ast_node *top,
+                          int depth, const char *prefix) {
+  struct gkcc_writer *writer = dumper->writer;
+  // The children are pushed last one first
+  switch (top->type) {
     case AST_NODE_BINOP:
-      sprintf(buf, "%s: %s", AST_NODE_TYPE_STRING[AST_NODE_BINOP],
-              ast_binop_type_string(&node->binop));
+      ast_dump_push_node(dumper, top->binop.right, depth + 1, "expr 2: ");
+      ast_dump_push_node(dumper, top->binop.left, depth + 1, "expr 1: ");
       break;
-    case AST_NODE_CONSTANT:
-      strcpy(buf, ast_constant_string(&node->constant));
+    case AST_NODE_MEMBER_ACCESS:
+      ast_dump_push_node(dumper, top->member_access.identifier, depth + 1,
+                         "access: ");
+      ast_dump_push_node(dumper, top->member_access.struct_or_union,
+                         depth + 1, "in: ");
       break;
     case AST_NODE_IDENT:
-      sprint_escaped_string(extrabuf, node->ident.name, node->ident.length);
-      sprintf(buf, "%s: %s", AST_NODE_TYPE_STRING[AST_NODE_IDENT], extrabuf);
+      if (top->ident.symbol_table_entry != NULL) {
+        ast_dump_push(dumper,
+                      (struct ast_dump_item){
+                          .type = AST_DUMP_ITEM_SYMBOL,
+                          .depth = depth + 1,
+                          .symbol = top->ident.symbol_table_entry});
+      }
       break;
     case AST_NODE_UNARY:
-      strcpy(buf, ast_unary_string(&node->unary));
+      ast_dump_push_node(dumper, top->unary.of, depth + 1, "");
       break;
     case AST_NODE_TERNARY:
-      strcpy(buf, ast_ternary_string(&node->ternary));
+      ast_dump_push_node(dumper, top->ternary.false_expr, depth + 1,
+                         "false_expr: ");
+      ast_dump_push_node(dumper, top->ternary.true_expr, depth + 1,
+                         "true_expr: ");
+      ast_dump_push_node(dumper, top->ternary.condition, depth + 1,
+                         "condition: ");
       break;
-    case AST_NODE_GKCC_TYPE:
-      printf("\n");
-      buf[0] = '\0';
-      ast_gkcc_type_string(node->gkcc_type.gkcc_type, depth, "");
+    case AST_NODE_DECLARATION:
+      ast_dump_push_node(dumper, top->declaration.assignment, depth + 1,
+                         "assignment: ");
+      ast_dump_push_node(dumper, top->declaration.type, depth + 1, "type: ");
+      ast_dump_push_node(dumper, top->declaration.identifier, depth + 1,
+                         "init_declarator: ");
       break;
     case AST_NODE_LIST:
-      buf[0] = '\0';
+      ast_dump_push_node(dumper, top->list.next, depth, NULL);
+      ast_dump_push_node(dumper, top->list.node, depth + 1, "list_node: ");
+      break;
+    case AST_NODE_TOP_LEVEL:
+      ast_dump_push_node(dumper, top->top_level.list, depth, NULL);
+      break;
+    case AST_NODE_FUNCTION_CALL:
+      ast_dump_push_node(dumper, top->function_call.parameters, depth + 1,
+                         "parameters: ");
+      ast_dump_push_node(dumper, top->function_call.name, depth + 1,
+                         "function_name: ");
+      break;
+    case AST_NODE_ENUM_DEFINITION:
+      ast_dump_push_node(dumper, top->enum_definition.ident, depth + 1,
+                         "ident: ");
+      ast_dump_push_node(dumper, top->enum_definition.enumerators, depth + 1,
+                         "enumerators: ");
       break;
     case AST_NODE_STRUCT_OR_UNION_SPECIFIER:
-      sprintf(buf, "%s (type=%s): ", AST_NODE_TYPE_STRING[node->type],
-              AST_STRUCT_OR_UNION_SPECIFIER_TYPE_STRING
-                  [node->struct_or_union_specifier.type]);
+      ast_dump_push_node(dumper, top->struct_or_union_specifier.ident,
+                         depth + 1, "ident: ");
+      break;
+    case AST_NODE_IF_STATEMENT:
+      ast_dump_push_node(dumper, top->if_statement.else_statement, depth + 1,
+                         "else: ");
+      ast_dump_push_node(dumper, top->if_statement.then_statement, depth + 1,
+                         "then: ");
+      ast_dump_push_node(dumper, top->if_statement.condition, depth + 1,
+                         "condition: ");
       break;
     case AST_NODE_FOR_LOOP:
-      if (node->for_loop.is_do_while)
-        strcpy(extrabuf, "true");
-      else
-        strcpy(extrabuf, "false");
-      sprintf(buf, "%s (is_do_while=%s):", AST_NODE_TYPE_STRING[node->type],
-              extrabuf);
+      ast_dump_push_node(dumper, top->for_loop.statements, depth + 1, "do: ");
+      ast_dump_push_node(dumper, top->for_loop.expr3, depth + 1, "expr3: ");
+      ast_dump_push_node(dumper, top->for_loop.expr2, depth + 1, "expr2: ");
+      ast_dump_push_node(dumper, top->for_loop.expr1, depth + 1, "expr1: ");
       break;
-    case AST_NODE_GOTO_NODE:
-      sprintf(buf, "%s: %s", AST_NODE_TYPE_STRING[node->type],
-              node->goto_node.ident->ident.name);
+    case AST_NODE_FUNCTION_RETURN:
+      ast_dump_push_node(dumper, top->function_return.to_return, depth + 1,
+                         "returning: ");
+      break;
+    case AST_NODE_SWITCH_CASE_CASE:
+      ast_dump_push_node(dumper, top->switch_case_case.statement, depth + 1,
+                         "statements: ");
+      ast_dump_push_node(dumper, top->switch_case_case.expression, depth + 1,
+                         "expression: ");
+      break;
+    case AST_NODE_SWITCH_CASE_SWITCH:
+      ast_dump_push_node(dumper, top->switch_case_switch.statements,
+                         depth + 1, "statements: ");
+      ast_dump_push_node(dumper, top->switch_case_switch.expression,
+                         depth + 1, "constant_expression: ");
       break;
     default:
-      sprintf(buf, "%s:", AST_NODE_TYPE_STRING[node->type]);
       break;
   }
-}
 
-const char *ast_binop_type_string(struct ast_binop *binop) {
-  return AST_BINOP_TYPE_STRING[binop->type];
+  // Don't want the extra empty newline of AST_NODE_LIST
+  if (prefix == NULL) return;
+
+  ast_dump_indent(writer, depth);
+  gkcc_writer_str(writer, prefix);
+  if (top->type == AST_NODE_GKCC_TYPE) {
+    // The type is printed on the lines after the prefix and followed by an
+    // empty line
+    gkcc_writer_char(writer, '\n');
+    ast_dump_push_text(dumper, 0, "\n");
+    ast_dump_push_gkcc_type(dumper, top->gkcc_type.gkcc_type, depth + 1, "");
+    return;
+  }
+  ast_dump_node_header(writer, top);
+  gkcc_writer_char(writer, '\n');
 }
 
-void print_to_depth(int depth) {
-  for (int i = 0; i < depth; i++) {
-    printf("  ");
+// ast_dump_symbol writes the line that introduces a symbol and pushes its
+// type. Symbols printed as part of an identifier also show their scope.
+static void ast_dump_symbol(struct ast_dumper *dumper,
+                            struct gkcc_symbol *symbol, int depth,
+                            bool with_scope) {
+  struct gkcc_writer *writer = dumper->writer;
+  ast_dump_indent(writer, depth);
+  gkcc_writer_str(writer, "Symbol '");
+  gkcc_writer_str(writer, symbol->symbol_name);
+  gkcc_writer_str(writer, "' defined at ");
+  gkcc_writer_str(writer, symbol->filename);
+  gkcc_writer_char(writer, ':');
+  gkcc_writer_int(writer, symbol->effective_line_number);
+  if (with_scope && symbol->symbol_table_set != NULL) {
+    gkcc_writer_str(writer, " (scope=");
+    gkcc_writer_str(writer,
+                    GKCC_SCOPE_STRING[symbol->symbol_table_set->scope]);
+    gkcc_writer_str(writer, ", stg_class=");
+    gkcc_writer_str(writer, GKCC_STORAGE_CLASS_STRING[symbol->storage_class]);
+    gkcc_writer_char(writer, ')');
   }
+  gkcc_writer_str(writer, " of type:\n");
+
+  ast_dump_push_gkcc_type(dumper, symbol->symbol_type, depth + 1, "");
 }
 
-void ast_gkcc_type_string(struct gkcc_type *gkcc_type, int depth,
-                          char *prefix) {
-  if (gkcc_type == NULL) return;
-  const char *type_type = GKCC_TYPE_TYPE_STRING[gkcc_type->type];
-  int start_of_line = 0;
-  for (int i = 0; i < 2 * depth; i++) {
-    flbuf[start_of_line++] = ' ';
-  }
-  char *writeloc = &flbuf[start_of_line];
+// ast_dump_symbol_location writes where the struct or union of gkcc_type was
+// defined
+static void ast_dump_symbol_location(struct gkcc_writer *writer,
+                                     struct gkcc_type *gkcc_type) {
+  gkcc_writer_char(writer, '\'');
+  gkcc_writer_str(writer, gkcc_type->ident->ident.name);
+  gkcc_writer_str(writer, "' defined at ");
+  gkcc_writer_str(writer,
+                  gkcc_type->ident->ident.symbol_table_entry->filename);
+  gkcc_writer_char(writer, ':');
+  gkcc_writer_int(
+      writer,
+      gkcc_type->ident->ident.symbol_table_entry->effective_line_number);
+}
+
+static void ast_dump_gkcc_type(struct ast_dumper *dumper,
+                               struct gkcc_type *gkcc_type, int depth,
+                               const char *prefix) {
+  struct gkcc_writer *writer = dumper->writer;
+
+  // The type it is of comes after everything else
+  ast_dump_push_gkcc_type(dumper, gkcc_type->of, depth + 1, "");
+
+  ast_dump_indent(writer, depth);
+  gkcc_writer_str(writer, prefix);
+  gkcc_writer_str(writer, "GKCC_TYPE (type=");
+  gkcc_writer_str(writer, GKCC_TYPE_TYPE_STRING[gkcc_type->type]);
   if (gkcc_type->ident != NULL) {
-    writeloc += sprintf(
-        writeloc, "%sGKCC_TYPE (type=%s, scope=%s, stg_class=%s): ", prefix,
-        type_type,
-        GKCC_SCOPE_STRING[gkcc_type->ident->ident.symbol_table_entry
-                              ->symbol_table_set->scope],
-        GKCC_STORAGE_CLASS_STRING[gkcc_type->ident->ident.symbol_table_entry
-                                      ->storage_class]);
-  } else {
-    writeloc += sprintf(writeloc, "%sGKCC_TYPE (type=%s): ", prefix, type_type);
+    struct gkcc_symbol *symbol = gkcc_type->ident->ident.symbol_table_entry;
+    gkcc_writer_str(writer, ", scope=");
+    gkcc_writer_str(writer,
+                    GKCC_SCOPE_STRING[symbol->symbol_table_set->scope]);
+    gkcc_writer_str(writer, ", stg_class=");
+    gkcc_writer_str(writer, GKCC_STORAGE_CLASS_STRING[symbol->storage_class]);
   }
+  gkcc_writer_str(writer, "): ");
 
   switch (gkcc_type->type) {
     case GKCC_TYPE_FUNCTION:
-      printf("%s\n", flbuf);
-      ast_gkcc_type_string(gkcc_type->function_declaration.return_type,
-                           depth + 1, "returns: ");
+      gkcc_writer_char(writer, '\n');
       if (depth < 5) {
-        ast_print(gkcc_type->function_declaration.statements, depth + 1,
-                  "statements:");
+        ast_dump_push_node(dumper, gkcc_type->function_declaration.statements,
+                           depth + 1, "statements:");
       }
+      ast_dump_push_gkcc_type(dumper,
+                              gkcc_type->function_declaration.return_type,
+                              depth + 1, "returns: ");
       break;
     case GKCC_TYPE_ARRAY:
-      printf("%s\n", flbuf);
-      ast_print(gkcc_type->array.size, depth + 1, "size: ");
+      gkcc_writer_char(writer, '\n');
+      ast_dump_push_node(dumper, gkcc_type->array.size, depth + 1, "size: ");
       break;
     case GKCC_TYPE_QUALIFIER:
     case GKCC_TYPE_STORAGE_CLASS_SPECIFIER:
     case GKCC_TYPE_TYPE_SPECIFIER:
-      sprintf(writeloc, "%s\n",
-              GKCC_TYPE_SPECIFIER_TYPE_STRING[gkcc_type->type_specifier.type]);
-      printf("%s", flbuf);
+      gkcc_writer_str(
+          writer,
+          GKCC_TYPE_SPECIFIER_TYPE_STRING[gkcc_type->type_specifier.type]);
+      gkcc_writer_char(writer, '\n');
       break;
     case GKCC_TYPE_STRUCT:
     case GKCC_TYPE_UNION:
-      if (gkcc_type->symbol_table_set->general_namespace->symbol_list == NULL) {
-        sprintf(
-            writeloc, "'%s' defined at %s:%d\n", gkcc_type->ident->ident.name,
-            gkcc_type->ident->ident.symbol_table_entry->filename,
-            gkcc_type->ident->ident.symbol_table_entry->effective_line_number);
-        printf("%s", flbuf);
+      if (gkcc_type->symbol_table_set->general_namespace == NULL ||
+          gkcc_type->symbol_table_set->general_namespace->symbol_count == 0) {
+        ast_dump_symbol_location(writer, gkcc_type);
+        gkcc_writer_char(writer, '\n');
         break;
       }
       if (gkcc_type->ident == NULL) {
-        sprintf(writeloc, "unamed struct with members {\n");
+        gkcc_writer_str(writer, "unamed struct");
       } else {
-        sprintf(
-            writeloc, "'%s' defined at %s:%d with members {\n",
-            gkcc_type->ident->ident.name,
-            gkcc_type->ident->ident.symbol_table_entry->filename,
-            gkcc_type->ident->ident.symbol_table_entry->effective_line_number);
+        ast_dump_symbol_location(writer, gkcc_type);
       }
-      printf("%s", flbuf);
-      gkcc_symbol_table_print(gkcc_type->symbol_table_set->general_namespace,
-                              depth + 1);
-      print_to_depth(depth);
-      printf("}\n");
+      gkcc_writer_str(writer, " with members {\n");
+      ast_dump_push_text(dumper, depth, "}\n");
+      ast_dump_push(
+          dumper,
+          (struct ast_dump_item){
+              .type = AST_DUMP_ITEM_SYMBOL_TABLE,
+              .depth = depth + 1,
+              .symbol_table = gkcc_type->symbol_table_set->general_namespace});
       break;
     default:
-      printf("%s\n", flbuf);
+      gkcc_writer_char(writer, '\n');
       break;
   }
+}
 
-  ast_gkcc_type_string(gkcc_type->of, depth + 1, "");
+void ast_print(struct gkcc_writer *writer, struct ast_node *top, int depth,
+               const char *prefix) {
+  struct ast_dumper dumper = {.writer = writer};
+  if (top != NULL) {
+    ast_dump_push(&dumper, (struct ast_dump_item){.type = AST_DUMP_ITEM_NODE,
+                                                  .depth = depth,
+                                                  .prefix = prefix,
+                                                  .node = top});
+  }
 
-  flbuf[0] = '\0';
+  while (dumper.count > 0) {
+    struct ast_dump_item item = dumper.items[--dumper.count];
+    switch (item.type) {
+      case AST_DUMP_ITEM_NODE:
+        ast_dump_node(&dumper, item.node, item.depth, item.prefix);
+        break;
+      case AST_DUMP_ITEM_GKCC_TYPE:
+        ast_dump_gkcc_type(&dumper, item.gkcc_type, item.depth, item.prefix);
+        break;
+      case AST_DUMP_ITEM_SYMBOL:
+        ast_dump_symbol(&dumper, item.symbol, item.depth, true);
+        break;
+      case AST_DUMP_ITEM_SYMBOL_TABLE:
+        // Newest symbols are printed first, so the oldest is pushed first
+        for (unsigned int i = 0; i < item.symbol_table->symbol_count; i++) {
+          ast_dump_push(
+              &dumper,
+              (struct ast_dump_item){
+                  .type = AST_DUMP_ITEM_SYMBOL_TABLE_ENTRY,
+                  .depth = item.depth,
+                  .symbol = item.symbol_table->symbols[i]});
+        }
+        break;
+      case AST_DUMP_ITEM_SYMBOL_TABLE_ENTRY:
+        ast_dump_symbol(&dumper, item.symbol, item.depth, false);
+        break;
+      case AST_DUMP_ITEM_TEXT:
+        ast_dump_indent(writer, item.depth);
+        gkcc_writer_str(writer, item.prefix);
+        break;
+    }
+  }
+
+  free(dumper.items);
 }
 
-char *ast_constant_string(struct ast_constant *constant) {
-  char local_buf[10000];
+const char *ast_binop_type_string(struct ast_binop *binop) {
+  return AST_BINOP_TYPE_STRING[binop->type];
+}
+
+void ast_constant_write(struct gkcc_writer *writer,
+                        struct ast_constant *constant) {
   switch (constant->type) {
     case AST_CONSTANT_LONGLONG:
-      sprintf(flbuf, "CONSTANT: (type=LONG LONG) %lld", constant->ylonglong);
+      gkcc_writer_printf(writer, "CONSTANT: (type=LONG LONG) %lld",
+                         constant->ylonglong);
       break;
     case AST_CONSTANT_LONG_DOUBLE:
-      sprintf(flbuf, "CONSTANT: (type=LONG DOUBLE) %Lf", constant->ylongdouble);
+      gkcc_writer_printf(writer, "CONSTANT: (type=LONG DOUBLE) %Lf",
+                         constant->ylongdouble);
       break;
     case AST_CONSTANT_DOUBLE:
-      sprintf(flbuf, "CONSTANT: (type=DOUBLE) %f", constant->ydouble);
+      gkcc_writer_printf(writer, "CONSTANT: (type=DOUBLE) %f",
+                         constant->ydouble);
       break;
     case AST_CONSTANT_FLOAT:
-      sprintf(flbuf, "CONSTANT: (type=FLOAT) %f", constant->yfloat);
+      gkcc_writer_printf(writer, "CONSTANT: (type=FLOAT) %f", constant->yfloat);
       break;
     case AST_CONSTANT_LONG:
-      sprintf(flbuf, "CONSTANT: (type=LONG) %ld", constant->ylong);
+      gkcc_writer_printf(writer, "CONSTANT: (type=LONG) %ld", constant->ylong);
       break;
     case AST_CONSTANT_INT:
-      sprintf(flbuf, "CONSTANT: (type=INT) %d", constant->yint);
+      gkcc_writer_printf(writer, "CONSTANT: (type=INT) %d", constant->yint);
       break;
     case AST_CONSTANT_CHAR:
-      sprint_escaped_char(local_buf, constant->ychar);
-      sprintf(flbuf, "CONSTANT: (type=CHAR) '%s'", local_buf);
+      gkcc_writer_str(writer, "CONSTANT: (type=CHAR) '");
+      gkcc_writer_escaped(writer, &constant->ychar, 1);
+      gkcc_writer_char(writer, '\'');
       break;
     case AST_CONSTANT_STRING:
-      sprint_escaped_string(local_buf, constant->ystring.raw,
-                            constant->ystring.length);
-      sprintf(flbuf, "CONSTANT: (type=STRING) \"%s\"", local_buf);
+      gkcc_writer_str(writer, "CONSTANT: (type=STRING) \"");
+      gkcc_writer_escaped(writer, constant->ystring.raw,
+                          constant->ystring.length);
+      gkcc_writer_char(writer, '"');
       break;
   }
-  return flbuf;
 }
 
-char *ast_unary_string(struct ast_unary *node) {
-  sprintf(flbuf, "UNARY OP %s", AST_UNARY_TYPE_STRING[node->type]);
-  return flbuf;
+void ast_unary_write(struct gkcc_writer *writer, struct ast_unary *node) {
+  gkcc_writer_str(writer, "UNARY OP ");
+  gkcc_writer_str(writer, AST_UNARY_TYPE_STRING[node->type]);
 }
 
-char *ast_ternary_string(struct ast_ternary *node) {
-  sprintf(flbuf, "TERNARY:");
-  return flbuf;
+void ast_ternary_write(struct gkcc_writer *writer, struct ast_ternary *node) {
+  gkcc_writer_str(writer, "TERNARY:");
 }
 
 struct ast_node *ast_node_strip_single_list(struct ast_node *node) {
@@ -468,7 +644,7 @@ struct ast_node *ast_node_identifier_set_symbol_if_exists(
 }
 
 enum gkcc_error ast_node_identifier_verify_symbol_exists(struct ast_node *node,
-                                                         char *filename,
+                                                         const char *filename,
                                                          int line_number) {
   gkcc_assert(node->type == AST_NODE_IDENT, GKCC_ERROR_INVALID_ARGUMENTS,
               "ast_node_identifier_verify_symbol_exists() got a node that is "
@@ -515,9 +691,6 @@ struct gkcc_type *ast_node_declaration_specifiers_to_gkcc_data_type(
     }
   }
 
-  struct gkcc_type *type = is_signed ? gkcc_type_new(GKCC_TYPE_SIGNED)
-                                     : gkcc_type_new(GKCC_TYPE_UNSIGNED);
-
   struct gkcc_type *complex_type = NULL;
 
   // Figure out data type
@@ -598,14 +771,19 @@ struct gkcc_type *ast_node_declaration_specifiers_to_gkcc_data_type(
     }
   }
 
-  struct gkcc_type *new_type = gkcc_type_new(gkcc_type_type);
-  new_type->symbol_table_set =
-      (complex_type != NULL) ? complex_type->symbol_table_set : NULL;
-  new_type->ident = (complex_type != NULL) ? complex_type->ident : NULL;
-  if (gkcc_is_gkcc_type_scalar(new_type)) {
-    type = gkcc_type_append(type, new_type);
+  struct gkcc_type *type = NULL;
+  if (complex_type != NULL) {
+    struct gkcc_type *new_type = gkcc_type_new(gkcc_type_type);
+    new_type->symbol_table_set = complex_type->symbol_table_set;
+    new_type->ident = complex_type->ident;
+    type = gkcc_type_canonical(new_type);
   } else {
-    type = new_type;
+    type = gkcc_type_get(gkcc_type_type, NULL);
+  }
+
+  if (gkcc_is_gkcc_type_scalar(type)) {
+    type = gkcc_type_get(is_signed ? GKCC_TYPE_SIGNED : GKCC_TYPE_UNSIGNED,
+                         type);
   }
 
   return type;
@@ -613,13 +791,11 @@ struct gkcc_type *ast_node_declaration_specifiers_to_gkcc_data_type(
 
 struct ast_node *yylval2ast_node_ident(struct _yylval *yylval) {
   struct ast_node *node = ast_node_new(AST_NODE_IDENT);
-  gkcc_assert(yylval->type == YYLVAL_TYPE_STRING, GKCC_ERROR_INVALID_ARGUMENTS,
-              "yylval2ast_node_ident() was given a non-string yylval");
+  gkcc_assert(yylval->type == YYLVAL_TYPE_IDENT, GKCC_ERROR_INVALID_ARGUMENTS,
+              "yylval2ast_node_ident() was given a non-ident yylval");
 
-  node->ident.length = yylval->data.string.length;
-  node->ident.name = malloc(node->ident.length + 1);
-  memcpy(node->ident.name, yylval->data.string.string, node->ident.length);
-  node->ident.name[node->ident.length] = '\0';
+  node->ident.name = yylval->data.ident;
+  node->ident.length = gkcc_intern_length(node->ident.name);
 
   return node;
 }
@@ -639,10 +815,13 @@ struct ast_node *yylval2ast_node(struct _yylval *yylval) {
       node->type = AST_NODE_CONSTANT;
       node->constant.type = AST_CONSTANT_STRING;
 
+      // The lexer already placed the contents in the translation unit arena
       node->constant.ystring.length = yylval->data.string.length;
-      node->constant.ystring.raw = malloc(node->constant.ystring.length);
-      memcpy(node->constant.ystring.raw, yylval->data.string.string,
-             node->constant.ystring.length);
+      node->constant.ystring.raw = yylval->data.string.string;
+      break;
+    case YYLVAL_TYPE_IDENT:
+      gkcc_error_fatal(GKCC_ERROR_INVALID_ARGUMENTS,
+                       "yylval2ast_node() was given an ident yylval");
       break;
   }
   return node;
@@ -21,6 +21,7 @@
 #include "ast/types.h"
 #include "lex_extras.h"
 #include "misc/misc.h"
+#include "misc/writer.h"
 
 // ========================
 // === struct ast_binop ===
@@ -111,7 +112,8 @@ struct ast_unary {
 // ========================
 
 struct ast_ident {
-  char* name;
+  // name is an interned handle so identifiers can be compared by pointer
+  const char* name;
   int length;
   struct gkcc_symbol* symbol_table_entry;
 };
@@ -285,7 +287,7 @@ struct ast_constant {
     int yint;
     char ychar;
     struct ystring {
-      char* raw;
+      const char* raw;
       unsigned int length;
     } ystring;
   };
@@ -349,23 +351,35 @@ struct ast_node {
   };
 };
 
+// =====================================
+// === struct ast_definition_handler ===
+// =====================================
+
+// ast_definition_handler is called by the parser with each function definition
+// as soon as it has been parsed. The body of the function is released once fn
+// returns, so fn must compile it right away. See gkcc_arena_function_begin().
+struct ast_definition_handler {
+  void (*fn)(void* context, struct ast_node* definition);
+  void* context;
+};
+
 // =============================
 // === Function Declarations ===
 // =============================
 
-void ast_print(struct ast_node* top, int depth, const char* prefix);
-
-void ast_node_string(char* buf, struct ast_node* node, int depth);
+void ast_print(struct gkcc_writer* writer, struct ast_node* top, int depth,
+               const char* prefix);
 
 void yynum2ast_node(struct ast_node* node, struct _yynum* yynum);
 
 const char* ast_binop_type_string(struct ast_binop* binop);
 
-char* ast_constant_string(struct ast_constant*);
+void ast_constant_write(struct gkcc_writer* writer,
+                        struct ast_constant* constant);
 
-char* ast_unary_string(struct ast_unary* node);
+void ast_unary_write(struct gkcc_writer* writer, struct ast_unary* node);
 
-char* ast_ternary_string(struct ast_ternary* node);
+void ast_ternary_write(struct gkcc_writer* writer, struct ast_ternary* node);
 
 struct ast_node* ast_node_new_constant_int_node(int val);
 
@@ -376,8 +390,6 @@ struct ast_node* ast_node_new_gkcc_type_specifier_node(
 
 struct ast_node* yylval2ast_node_ident(struct _yylval* yylval);
 
-void ast_gkcc_type_string(struct gkcc_type* gkcc_type, int depth, char* prefix);
-
 struct ast_node* ast_node_append(struct ast_node* parent,
                                  struct ast_node* child);
 
@@ -387,14 +399,12 @@ struct ast_node* ast_node_direct_declarator_to_declarator(
 struct gkcc_type* ast_node_declaration_specifiers_to_gkcc_data_type(
     struct ast_node* declaration_specifiers);
 
-void print_to_depth(int depth);
-
 struct ast_node* ast_node_identifier_set_symbol_if_exists(
     struct gkcc_symbol_table_set* symbol_table_set, struct ast_node* node,
     enum gkcc_namespace namespace);
 
 enum gkcc_error ast_node_identifier_verify_symbol_exists(struct ast_node* node,
-                                                         char* filename,
+                                                         const char* filename,
                                                          int line_number);
 
 struct ast_node* ast_node_strip_single_list(struct ast_node* node);
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "ast.h"
 #include "lex_extras.h"
 #include "misc.h"
@@ -36,8 +37,8 @@ struct ast_node *ast_node_new_if_statement(struct ast_node *condition,
 }
 
 struct ast_node *ast_node_new(enum ast_node_type node_type) {
-  struct ast_node *ast_node = malloc(sizeof(struct ast_node));
-  memset(ast_node, 0, sizeof(struct ast_node));
+  struct ast_node *ast_node =
+      gkcc_arena_alloc(gkcc_arena_tu(), sizeof(struct ast_node));
   ast_node->type = node_type;
   return ast_node;
 }
@@ -131,27 +132,45 @@ struct ast_node *ast_node_new_gkcc_storage_class_specifier_node(
 struct ast_node *ast_node_new_function_definition_node(
     struct ast_node *returns, struct ast_node *function_declaration,
     struct ast_node *parameters, struct ast_node *statements) {
+  // TODO: Deal with parameters
+  ast_node_function_definition_set_return_type(function_declaration, returns);
+  return ast_node_function_definition_set_statements(function_declaration,
+                                                     statements);
+}
+
+// ast_node_function_definition_set_return_type turns the declaration
+// specifiers of a function definition into its return type. The parser calls
+// it before the body is parsed, so the return type is made in the arena of the
+// translation unit rather than that of the body.
+struct ast_node *ast_node_function_definition_set_return_type(
+    struct ast_node *function_declaration, struct ast_node *returns) {
   gkcc_assert(
       function_declaration->type == AST_NODE_DECLARATION,
       GKCC_ERROR_INVALID_ARGUMENTS,
-      "ast_node_new_function_declaration_node() got a function_declaration "
-      "that is not of type AST_NODE DECLARATION");
+      "ast_node_function_definition_set_return_type() got a "
+      "function_declaration that is not of type AST_NODE DECLARATION");
   gkcc_assert(
       function_declaration->declaration.type->gkcc_type.gkcc_type->type ==
           GKCC_TYPE_FUNCTION,
       GKCC_ERROR_INVALID_ARGUMENTS,
-      "ast_node_new_function_declaration_node() got function_declaration with "
-      "a type that is not GKCC_TYPE_FUNCTION");
+      "ast_node_function_definition_set_return_type() got "
+      "function_declaration with a type that is not GKCC_TYPE_FUNCTION");
 
-  // TODO: Deal with parameters
   function_declaration->declaration.type->gkcc_type.gkcc_type
       ->function_declaration.return_type =
       ast_node_declaration_specifiers_to_gkcc_data_type(returns);
-  function_declaration->declaration.type->gkcc_type.gkcc_type
-      ->function_declaration.statements = statements;
   return function_declaration;
 }
 
+// ast_node_function_definition_set_statements replaces the body of a function
+// definition.
+struct ast_node *ast_node_function_definition_set_statements(
+    struct ast_node *function_definition, struct ast_node *statements) {
+  function_definition->declaration.type->gkcc_type.gkcc_type
+      ->function_declaration.statements = statements;
+  return function_definition;
+}
+
 struct ast_node *ast_node_new_goto_node(struct ast_node *ident) {
   struct ast_node *node = ast_node_new(AST_NODE_GOTO_NODE);
   node->goto_node.ident = ident;
@@ -325,7 +344,7 @@ struct ast_node *ast_node_new_struct_or_union_specifier_node(
 
 struct ast_node *ast_node_update_struct_or_union_specifier_node(
     struct ast_node *node, struct ast_node *ident, struct ast_node *members,
-    struct gkcc_symbol_table_set *current_symbol_table, char *filename,
+    struct gkcc_symbol_table_set *current_symbol_table, const char *filename,
     int line_number) {
   gkcc_assert(node->type == AST_NODE_GKCC_TYPE &&
                   node->gkcc_type.gkcc_type->type == GKCC_TYPE_TYPE_SPECIFIER &&
@@ -408,6 +427,8 @@ struct ast_node *ast_node_update_struct_or_union_specifier_node(
                       current_node->declaration.type->gkcc_type.gkcc_type->ident
                           ->ident.symbol_table_entry->fully_defined,
                   GKCC_ERROR_INCOMPLETE_TYPE, buf);
+      current_node->declaration.type->gkcc_type.gkcc_type = gkcc_type_canonical(
+          current_node->declaration.type->gkcc_type.gkcc_type);
       struct gkcc_symbol *symbol =
           gkcc_symbol_new(current_node->declaration.identifier->ident.name,
                           GKCC_STORAGE_CLASS_INVALID,
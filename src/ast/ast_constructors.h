@@ -36,6 +36,12 @@ struct ast_node *ast_node_new_function_definition_node(
     struct ast_node *returns, struct ast_node *function_name,
     struct ast_node *parameters, struct ast_node *statements);
 
+struct ast_node *ast_node_function_definition_set_return_type(
+    struct ast_node *function_declaration, struct ast_node *returns);
+
+struct ast_node *ast_node_function_definition_set_statements(
+    struct ast_node *function_definition, struct ast_node *statements);
+
 struct ast_node *ast_node_new_gkcc_storage_class_specifier_node(
     enum gkcc_storage_class_specifier_type type);
 
@@ -63,7 +69,7 @@ struct ast_node *ast_node_new(enum ast_node_type node_type);
 
 struct ast_node *ast_node_update_struct_or_union_specifier_node(
     struct ast_node *node, struct ast_node *ident, struct ast_node *members,
-    struct gkcc_symbol_table_set *current_symbol_table, char *filename,
+    struct gkcc_symbol_table_set *current_symbol_table, const char *filename,
     int line_number);
 
 struct ast_node *ast_node_new_struct_or_union_specifier_node(
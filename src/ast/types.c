@@ -17,10 +17,61 @@
 
 #include <malloc.h>
 #include <memory.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "misc/arena.h"
+#include "misc/intern.h"
+
+#define GKCC_TYPE_CANONICAL_INITIAL_CAPACITY 256
+
+// gkcc_type_table holds every canonical type of the translation unit. Like the
+// intern table, it is an open addressing hash table with linear probing that
+// is kept at most half full. The types themselves live in the translation unit
+// arena, so like the arena the table is per thread.
+//
+// While the table is shared between threads, only adding types and computing
+// layouts take the lock. Types are never removed, so lookups read the table
+// without it: slots and their contents are published with release stores, and
+// a grown table publishes its slots before its capacity so that a reader never
+// probes past the end. The slots a table outgrows stay allocated in retired
+// until the sharing ends, since a reader may still be probing them.
+struct gkcc_type_table {
+  struct gkcc_type** slots;
+  size_t capacity;
+  size_t count;
+  // lock is set while the table is shared between threads. It also guards
+  // computing the layouts cached on canonical types.
+  pthread_mutex_t* lock;
+  struct gkcc_type*** retired;
+  size_t retired_count;
+};
+
+static _Thread_local struct gkcc_type_table canonical_types;
+// joined_types is the table of another thread whose translation unit this
+// thread is helping with. See gkcc_type_canonical_join().
+static _Thread_local struct gkcc_type_table* joined_types = NULL;
+// function_types holds the canonical types first needed by the function
+// definition being compiled in streaming mode. See
+// gkcc_type_canonical_function_begin().
+static _Thread_local struct gkcc_type_table* function_types = NULL;
+
+static struct gkcc_type_table* gkcc_type_table(void) {
+  return joined_types != NULL ? joined_types : &canonical_types;
+}
+
+static void gkcc_type_table_lock(struct gkcc_type_table* table) {
+  if (table->lock != NULL) pthread_mutex_lock(table->lock);
+}
+
+static void gkcc_type_table_unlock(struct gkcc_type_table* table) {
+  if (table->lock != NULL) pthread_mutex_unlock(table->lock);
+}
 
 struct gkcc_type* gkcc_type_new(enum gkcc_type_type type) {
-  struct gkcc_type* gkcc_type = malloc(sizeof(struct gkcc_type));
-  memset(gkcc_type, 0, sizeof(struct gkcc_type));
+  struct gkcc_type* gkcc_type =
+      gkcc_arena_alloc(gkcc_arena_tu(), sizeof(struct gkcc_type));
   gkcc_type->type = type;
   return gkcc_type;
 }
@@ -36,6 +87,8 @@ struct gkcc_type* gkcc_type_append(struct gkcc_type* parent,
     last_node = last_node->of;
   }
 
+  gkcc_assert(!last_node->canonical, GKCC_ERROR_INVALID_ARGUMENTS,
+              "gkcc_type_append() attempted to modify a canonical type");
   last_node->of = child;
   return parent;
 }
@@ -62,41 +115,458 @@ bool gkcc_is_gkcc_type_scalar(struct gkcc_type* gkcc_type) {
   return false;
 }
 
-struct gkcc_type* gkcc_type_new_signed_int_type(void) {
-  struct gkcc_type* integer_type = gkcc_type_new(GKCC_TYPE_SCALAR_INT);
-  struct gkcc_type* signed_type = gkcc_type_new(GKCC_TYPE_SIGNED);
-  signed_type->of = integer_type;
-  return signed_type;
+// gkcc_type_is_hashable returns whether the given type can be shared.
+// Function types carry their parameters and statements and arrays can have a
+// size that is not known until runtime, so those stay unique.
+static bool gkcc_type_is_hashable(struct gkcc_type* type) {
+  switch (type->type) {
+    case GKCC_TYPE_FUNCTION:
+    case GKCC_TYPE_TYPE_SPECIFIER:
+      return false;
+    case GKCC_TYPE_ARRAY:
+      return type->array.size != NULL &&
+             type->array.size->type == AST_NODE_CONSTANT &&
+             type->array.size->constant.type == AST_CONSTANT_INT;
+    default:
+      return true;
+  }
 }
 
-int gkcc_type_sizeof(struct gkcc_type* type) {
-  // TODO: Make everything not an integer
-  // For now, EVERYTHING IS AN INT
+// gkcc_type_variant returns the part of a type that is specific to its kind.
+// type->of must already be canonical.
+static long long gkcc_type_variant(struct gkcc_type* type) {
+  switch (type->type) {
+    case GKCC_TYPE_QUALIFIER:
+      return type->qualifier.type;
+    case GKCC_TYPE_STORAGE_CLASS_SPECIFIER:
+      return type->storage_class_specifier.type;
+    case GKCC_TYPE_ARRAY:
+      return type->array.size->constant.yint;
+    default:
+      return 0;
+  }
+}
+
+static const char* gkcc_type_ident_name(struct gkcc_type* type) {
+  return type->ident != NULL ? type->ident->ident.name : NULL;
+}
+
+static unsigned int gkcc_type_hash(struct gkcc_type* type) {
+  uintptr_t fields[] = {
+      type->type,
+      (uintptr_t)type->of,
+      (uintptr_t)gkcc_type_variant(type),
+      (uintptr_t)type->symbol_table_set,
+      (uintptr_t)gkcc_type_ident_name(type),
+  };
+  return gkcc_intern_hash_bytes((const char*)fields, sizeof(fields));
+}
+
+static bool gkcc_type_equal(struct gkcc_type* a, struct gkcc_type* b) {
+  return a->type == b->type && a->of == b->of &&
+         gkcc_type_variant(a) == gkcc_type_variant(b) &&
+         a->symbol_table_set == b->symbol_table_set &&
+         gkcc_type_ident_name(a) == gkcc_type_ident_name(b);
+}
+
+static void gkcc_type_canonical_grow(struct gkcc_type_table* table) {
+  size_t new_capacity = table->capacity == 0
+                            ? GKCC_TYPE_CANONICAL_INITIAL_CAPACITY
+                            : table->capacity * 2;
+  struct gkcc_type** new_slots = calloc(new_capacity, sizeof(struct gkcc_type*));
+  gkcc_assert(new_slots != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate canonical type table");
+
+  for (size_t i = 0; i < table->capacity; i++) {
+    struct gkcc_type* type = table->slots[i];
+    if (type == NULL) continue;
+
+    size_t slot = gkcc_type_hash(type) & (new_capacity - 1);
+    while (new_slots[slot] != NULL) slot = (slot + 1) & (new_capacity - 1);
+    new_slots[slot] = type;
+  }
+
+  if (table->lock != NULL && table->slots != NULL) {
+    table->retired =
+        realloc(table->retired,
+                (table->retired_count + 1) * sizeof(struct gkcc_type**));
+    gkcc_assert(table->retired != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                "Failed to grow canonical type table");
+    table->retired[table->retired_count++] = table->slots;
+  } else {
+    free(table->slots);
+  }
+  __atomic_store_n(&table->slots, new_slots, __ATOMIC_RELEASE);
+  __atomic_store_n(&table->capacity, new_capacity, __ATOMIC_RELEASE);
+}
+
+// gkcc_type_table_find returns the type in table that is structurally equal to
+// key or NULL if there is none.
+static struct gkcc_type* gkcc_type_table_find(struct gkcc_type_table* table,
+                                              struct gkcc_type* key,
+                                              unsigned int hash) {
+  size_t capacity = __atomic_load_n(&table->capacity, __ATOMIC_ACQUIRE);
+  if (capacity == 0) return NULL;
+
+  struct gkcc_type** slots = __atomic_load_n(&table->slots, __ATOMIC_ACQUIRE);
+  size_t mask = capacity - 1;
+  struct gkcc_type* type;
+  for (size_t slot = hash & mask;
+       (type = __atomic_load_n(&slots[slot], __ATOMIC_ACQUIRE)) != NULL;
+       slot = (slot + 1) & mask) {
+    if (gkcc_type_equal(type, key)) return type;
+  }
+  return NULL;
+}
+
+// gkcc_type_table_add puts a canonical type into table. No type that is
+// structurally equal to it may be in the table yet.
+static void gkcc_type_table_add(struct gkcc_type_table* table,
+                                struct gkcc_type* type, unsigned int hash) {
+  if (2 * (table->count + 1) > table->capacity) {
+    gkcc_type_canonical_grow(table);
+  }
+
+  size_t mask = table->capacity - 1;
+  size_t slot = hash & mask;
+  while (table->slots[slot] != NULL) slot = (slot + 1) & mask;
+
+  __atomic_store_n(&table->slots[slot], type, __ATOMIC_RELEASE);
+  table->count++;
+}
+
+// gkcc_type_table_insert adds a canonical copy of key to table. key must not
+// be in the table yet.
+static struct gkcc_type* gkcc_type_table_insert(struct gkcc_type_table* table,
+                                                struct gkcc_type* key,
+                                                unsigned int hash) {
+  struct gkcc_type* type = gkcc_type_new(key->type);
+  *type = *key;
+  type->canonical = true;
+
+  gkcc_type_table_add(table, type, hash);
+  return type;
+}
+
+// gkcc_type_lookup returns the canonical type that is structurally equal to
+// key, creating it from a copy of key if there is none yet. key->of must
+// already be canonical.
+static struct gkcc_type* gkcc_type_lookup(struct gkcc_type* key) {
+  struct gkcc_type_table* table = gkcc_type_table();
+  unsigned int hash = gkcc_type_hash(key);
+  // Most lookups find a type that already exists, which needs no lock
+  struct gkcc_type* type = gkcc_type_table_find(table, key, hash);
+  if (type != NULL) return type;
+
+  gkcc_type_table_lock(table);
+  type = gkcc_type_table_find(table, key, hash);
   if (type == NULL) {
-    return sizeof(int);
+    // Inside a function definition compiled in streaming mode, new types go to
+    // the table of the function so that none of them outlive its arena
+    struct gkcc_type_table* new_types =
+        function_types != NULL && joined_types == NULL ? function_types
+                                                       : table;
+    if (new_types != table) type = gkcc_type_table_find(new_types, key, hash);
+    if (type == NULL) type = gkcc_type_table_insert(new_types, key, hash);
   }
-  if (gkcc_is_gkcc_type_scalar(type)) {
-    return sizeof(int);
+  gkcc_type_table_unlock(table);
+  return type;
+}
+
+// gkcc_type_canonical returns the canonical version of the given type chain.
+// Structurally identical canonical types are the same node, so two canonical
+// types are equal if and only if their pointers are equal.
+//
+// Types that cannot be shared (see gkcc_type_is_hashable) are returned as is
+// after the types they refer to have been made canonical.
+struct gkcc_type* gkcc_type_canonical(struct gkcc_type* type) {
+  if (type == NULL || type->canonical) return type;
+
+  struct gkcc_type* of = gkcc_type_canonical(type->of);
+  if (!gkcc_type_is_hashable(type)) {
+    type->of = of;
+    if (type->type == GKCC_TYPE_FUNCTION) {
+      type->function_declaration.return_type =
+          gkcc_type_canonical(type->function_declaration.return_type);
+    }
+    return type;
   }
+
+  struct gkcc_type key = *type;
+  key.of = of;
+  return gkcc_type_lookup(&key);
+}
+
+// gkcc_type_canonical_adopt makes a type that was made canonical by another
+// compiler, such as one mapped in from a precompiled header, one of the
+// canonical types of this translation unit. The types it refers to must have
+// been adopted already and no type that is structurally equal to it may have
+// been made canonical yet.
+void gkcc_type_canonical_adopt(struct gkcc_type* type) {
+  gkcc_assert(type->canonical, GKCC_ERROR_INVALID_ARGUMENTS,
+              "gkcc_type_canonical_adopt() got a type that is not canonical");
+
+  struct gkcc_type_table* table = gkcc_type_table();
+  unsigned int hash = gkcc_type_hash(type);
+  gkcc_type_table_lock(table);
+  gkcc_assert(gkcc_type_table_find(table, type, hash) == NULL,
+              GKCC_ERROR_CONFLICT,
+              "gkcc_type_canonical_adopt() got a type that is already "
+              "canonical");
+  gkcc_type_table_add(table, type, hash);
+  gkcc_type_table_unlock(table);
+}
+
+// gkcc_type_get returns the canonical type of the given kind that has no
+// further attributes, such as the GKCC_TYPE_SCALAR_INT in "signed int".
+struct gkcc_type* gkcc_type_get(enum gkcc_type_type type,
+                                struct gkcc_type* of) {
+  struct gkcc_type key = {.type = type, .of = gkcc_type_canonical(of)};
+  gkcc_assert(gkcc_type_is_hashable(&key), GKCC_ERROR_INVALID_ARGUMENTS,
+              "gkcc_type_get() got a type that cannot be made canonical");
+  return gkcc_type_lookup(&key);
+}
+
+struct gkcc_type* gkcc_type_pointer_to(struct gkcc_type* of) {
+  return gkcc_type_get(GKCC_TYPE_PTR, of);
+}
+
+struct gkcc_type* gkcc_type_signed_int(void) {
+  return gkcc_type_get(GKCC_TYPE_SIGNED,
+                       gkcc_type_get(GKCC_TYPE_SCALAR_INT, NULL));
+}
+
+void gkcc_type_canonical_print_stats(FILE* file) {
+  fprintf(file, "canonical types: %zu\n", gkcc_type_table()->count);
+}
+
+// gkcc_type_canonical_release forgets every canonical type. It must be called
+// whenever the translation unit arena that holds them is released.
+void gkcc_type_canonical_release(void) {
+  free(canonical_types.slots);
+  memset(&canonical_types, 0, sizeof(canonical_types));
+}
+
+// gkcc_type_canonical_function_begin sets aside the canonical types made from
+// now on until gkcc_type_canonical_function_release. It goes along with
+// gkcc_arena_function_begin: the types are allocated in the function arena
+// and may refer to its declarations, so they must be forgotten with it. Types
+// the translation unit already has are still shared.
+void gkcc_type_canonical_function_begin(void) {
+  gkcc_assert(function_types == NULL, GKCC_ERROR_INVALID_ARGUMENTS,
+              "gkcc_type_canonical_function_begin() called inside a function");
+  function_types = calloc(1, sizeof(struct gkcc_type_table));
+  gkcc_assert(function_types != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate canonical type table");
+}
+
+// gkcc_type_canonical_function_release forgets the canonical types made since
+// gkcc_type_canonical_function_begin.
+void gkcc_type_canonical_function_release(void) {
+  if (function_types == NULL) return;
+
+  free(function_types->slots);
+  free(function_types);
+  function_types = NULL;
+}
+
+// gkcc_type_canonical_share guards the canonical types of the calling thread
+// with lock so that other threads can join them with
+// gkcc_type_canonical_join. lock must be recursive, as computing a layout
+// takes it again for the types the layout is made of. A NULL lock ends the
+// sharing and frees the slots the table outgrew meanwhile. Returns the table
+// to join.
+struct gkcc_type_table* gkcc_type_canonical_share(pthread_mutex_t* lock) {
+  canonical_types.lock = lock;
+  if (lock == NULL) {
+    for (size_t i = 0; i < canonical_types.retired_count; i++) {
+      free(canonical_types.retired[i]);
+    }
+    free(canonical_types.retired);
+    canonical_types.retired = NULL;
+    canonical_types.retired_count = 0;
+  }
+  return &canonical_types;
+}
+
+// gkcc_type_canonical_join makes the calling thread use the canonical types
+// of another thread, or its own again if table is NULL.
+void gkcc_type_canonical_join(struct gkcc_type_table* table) {
+  joined_types = table;
+}
+
+static int gkcc_type_align_up(int value, int align) {
+  return (value + align - 1) / align * align;
+}
+
+// gkcc_type_layout_struct_or_union places the members of a struct or union
+// in declaration order and records the offset of each on its symbol.
+static struct gkcc_type_layout gkcc_type_layout_struct_or_union(
+    struct gkcc_type* type) {
+  gkcc_assert(type->ident == NULL ||
+                  type->ident->ident.symbol_table_entry == NULL ||
+                  type->ident->ident.symbol_table_entry->fully_defined,
+              GKCC_ERROR_INCOMPLETE_TYPE,
+              "Attempt to get the layout of an incomplete struct or union");
+
+  struct gkcc_type_layout layout = {.size = 0, .align = 1};
+  struct gkcc_symbol_table* members =
+      type->symbol_table_set != NULL ? type->symbol_table_set->general_namespace
+                                     : NULL;
+  unsigned int member_count = members != NULL ? members->symbol_count : 0;
+  for (unsigned int i = 0; i < member_count; i++) {
+    struct gkcc_symbol* member = members->symbols[i];
+    struct gkcc_type_layout member_layout =
+        gkcc_type_layout(member->symbol_type);
+
+    if (member_layout.align > layout.align) layout.align = member_layout.align;
+    if (type->type == GKCC_TYPE_UNION) {
+      member->offset = 0;
+      if (member_layout.size > layout.size) layout.size = member_layout.size;
+      continue;
+    }
+
+    member->offset = gkcc_type_align_up(layout.size, member_layout.align);
+    layout.size = member->offset + member_layout.size;
+  }
+  layout.size = gkcc_type_align_up(layout.size, layout.align);
+  return layout;
+}
+
+static struct gkcc_type_layout gkcc_type_compute_layout(
+    struct gkcc_type* type) {
+  // TODO: Parameters and other declarations that end up without a type are
+  // treated as int
+  if (type == NULL) {
+    return (struct gkcc_type_layout){.size = 4, .align = 4};
+  }
+
   switch (type->type) {
-    case GKCC_TYPE_ARRAY:
+    case GKCC_TYPE_SCALAR_CHAR:
+      return (struct gkcc_type_layout){.size = 1, .align = 1};
+    case GKCC_TYPE_SCALAR_SHORT:
+      return (struct gkcc_type_layout){.size = 2, .align = 2};
+    case GKCC_TYPE_SCALAR_LONGLONG:
+    case GKCC_TYPE_SCALAR_DOUBLE:
+      return (struct gkcc_type_layout){.size = 8, .align = 4};
+    case GKCC_TYPE_SCALAR_LONG_DOUBLE:
+      return (struct gkcc_type_layout){.size = 12, .align = 4};
+    case GKCC_TYPE_SCALAR_INT:
+    case GKCC_TYPE_SCALAR_LONG:
+    case GKCC_TYPE_SCALAR_FLOAT:
+    case GKCC_TYPE_ENUM:
+    case GKCC_TYPE_PTR:
+    case GKCC_TYPE_UNKNOWN:
+      return (struct gkcc_type_layout){.size = 4, .align = 4};
+    case GKCC_TYPE_SCALAR_VOID:
+    case GKCC_TYPE_FUNCTION:
+      // Like gcc, allow pointer arithmetic on void and function pointers
+      return (struct gkcc_type_layout){.size = 1, .align = 1};
+    case GKCC_TYPE_SIGNED:
+    case GKCC_TYPE_UNSIGNED:
+      // A lone "signed" or "unsigned" is an int
+      if (type->of == NULL) {
+        return (struct gkcc_type_layout){.size = 4, .align = 4};
+      }
+      return gkcc_type_layout(type->of);
+    case GKCC_TYPE_QUALIFIER:
+    case GKCC_TYPE_STORAGE_CLASS_SPECIFIER:
+      return gkcc_type_layout(type->of);
+    case GKCC_TYPE_ARRAY: {
+      gkcc_assert(type->array.size != NULL, GKCC_ERROR_INCOMPLETE_TYPE,
+                  "Attempt to get the size of an array of unknown size");
       gkcc_assert(type->array.size->type == AST_NODE_CONSTANT,
                   GKCC_ERROR_NOT_YET_IMPLEMENTED,
                   "Non immediate constant array sizes are not yet supported");
       gkcc_assert(type->array.size->constant.type == AST_CONSTANT_INT,
                   GKCC_ERROR_NOT_YET_IMPLEMENTED,
                   "Non integer array sizes are not yet supported");
-      return type->array.size->constant.yint * gkcc_type_sizeof(type->of);
+      struct gkcc_type_layout element = gkcc_type_layout(type->of);
+      return (struct gkcc_type_layout){
+          .size = type->array.size->constant.yint * element.size,
+          .align = element.align};
+    }
     case GKCC_TYPE_STRUCT:
-      gkcc_error_fatal(GKCC_ERROR_NOT_YET_IMPLEMENTED,
-                       "sizeof(struct) support is not yet implemented");
-      break;
     case GKCC_TYPE_UNION:
-      gkcc_error_fatal(GKCC_ERROR_NOT_YET_IMPLEMENTED,
-                       "sizeof(union) support is not yet implemented");
+      return gkcc_type_layout_struct_or_union(type);
+    case GKCC_TYPE_TYPE_SPECIFIER:
       break;
+  }
+  gkcc_error_fatal(GKCC_ERROR_UNEXPECTED_VALUE,
+                   "gkcc_type_layout() got a type that has no layout");
+  __builtin_unreachable();
+}
+
+// gkcc_type_layout returns the size and alignment of the given type. The
+// result is computed once per canonical type and cached on it.
+struct gkcc_type_layout gkcc_type_layout(struct gkcc_type* type) {
+  if (type == NULL || !type->canonical) {
+    return gkcc_type_compute_layout(type);
+  }
+
+  // has_layout is set only after the layout has been stored, so a layout
+  // that is there can be read without the lock
+  if (__atomic_load_n(&type->has_layout, __ATOMIC_ACQUIRE)) {
+    return type->layout;
+  }
+
+  struct gkcc_type_table* table = gkcc_type_table();
+  gkcc_type_table_lock(table);
+  if (!type->has_layout) {
+    type->layout = gkcc_type_compute_layout(type);
+    __atomic_store_n(&type->has_layout, true, __ATOMIC_RELEASE);
+  }
+  struct gkcc_type_layout layout = type->layout;
+  gkcc_type_table_unlock(table);
+  return layout;
+}
+
+// gkcc_type_layout_is_known reports whether gkcc_type_layout() can compute the
+// layout of the given type. It has to be kept in step with the checks of
+// gkcc_type_compute_layout().
+bool gkcc_type_layout_is_known(struct gkcc_type* type) {
+  if (type == NULL) return true;
+
+  switch (type->type) {
+    case GKCC_TYPE_SIGNED:
+    case GKCC_TYPE_UNSIGNED:
+    case GKCC_TYPE_QUALIFIER:
+    case GKCC_TYPE_STORAGE_CLASS_SPECIFIER:
+      return gkcc_type_layout_is_known(type->of);
+    case GKCC_TYPE_ARRAY:
+      return type->array.size != NULL &&
+             type->array.size->type == AST_NODE_CONSTANT &&
+             type->array.size->constant.type == AST_CONSTANT_INT &&
+             gkcc_type_layout_is_known(type->of);
+    case GKCC_TYPE_STRUCT:
+    case GKCC_TYPE_UNION: {
+      struct gkcc_symbol* tag =
+          type->ident != NULL ? type->ident->ident.symbol_table_entry : NULL;
+      if (tag != NULL && !tag->fully_defined) return false;
+
+      struct gkcc_symbol_table* members =
+          type->symbol_table_set != NULL
+              ? type->symbol_table_set->general_namespace
+              : NULL;
+      unsigned int member_count = members != NULL ? members->symbol_count : 0;
+      for (unsigned int i = 0; i < member_count; i++) {
+        if (!gkcc_type_layout_is_known(members->symbols[i]->symbol_type)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case GKCC_TYPE_TYPE_SPECIFIER:
+      return false;
     default:
-      break;
+      return true;
   }
-  return sizeof(int);
+}
+
+int gkcc_type_sizeof(struct gkcc_type* type) {
+  return gkcc_type_layout(type).size;
+}
+
+int gkcc_type_alignof(struct gkcc_type* type) {
+  return gkcc_type_layout(type).align;
 }
@@ -16,6 +16,9 @@
 #ifndef GKCC_TYPES_H
 #define GKCC_TYPES_H
 
+#include <pthread.h>
+#include <stdio.h>
+
 #include "ast.h"
 #include "scope.h"
 
@@ -124,6 +127,16 @@ struct gkcc_function_declaration {
   struct ast_node* statements;
 };
 
+// ===============================
+// === struct gkcc_type_layout ===
+// ===============================
+
+// Sizes and alignments follow the i386 System V ABI.
+struct gkcc_type_layout {
+  int size;
+  int align;
+};
+
 // ========================
 // === struct gkcc_type ===
 // ========================
@@ -170,6 +183,13 @@ struct gkcc_type {
   struct gkcc_type* of;
   struct ast_node* ident;
   struct gkcc_symbol_table_set* symbol_table_set;
+  // canonical types are shared, so their structure must never be modified.
+  // See gkcc_type_canonical().
+  bool canonical;
+
+  // layout is computed on first use and only cached on canonical types
+  struct gkcc_type_layout layout;
+  bool has_layout;
 };
 
 // =============================
@@ -183,8 +203,34 @@ struct gkcc_type* gkcc_type_append(struct gkcc_type* parent,
 
 bool gkcc_is_gkcc_type_scalar(struct gkcc_type* gkcc_type);
 
-struct gkcc_type* gkcc_type_new_signed_int_type(void);
+struct gkcc_type* gkcc_type_canonical(struct gkcc_type* type);
+
+struct gkcc_type* gkcc_type_get(enum gkcc_type_type type, struct gkcc_type* of);
+
+struct gkcc_type* gkcc_type_pointer_to(struct gkcc_type* of);
+
+struct gkcc_type* gkcc_type_signed_int(void);
+
+void gkcc_type_canonical_print_stats(FILE* file);
+
+void gkcc_type_canonical_release(void);
+
+void gkcc_type_canonical_function_begin(void);
+
+void gkcc_type_canonical_function_release(void);
+
+struct gkcc_type_table* gkcc_type_canonical_share(pthread_mutex_t* lock);
+
+void gkcc_type_canonical_join(struct gkcc_type_table* table);
+
+void gkcc_type_canonical_adopt(struct gkcc_type* type);
+
+struct gkcc_type_layout gkcc_type_layout(struct gkcc_type* type);
+
+bool gkcc_type_layout_is_known(struct gkcc_type* type);
 
 int gkcc_type_sizeof(struct gkcc_type* type);
 
+int gkcc_type_alignof(struct gkcc_type* type);
+
 #endif  // GKCC_TYPES_H
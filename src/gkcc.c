@@ -0,0 +1,466 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// gkcc is the compiler driver. Every input file goes through the compile
+// stage (gkcc_int, which also preprocesses), then the assemble stage, and
+// all objects are linked at the end. Jobs of all stages share one pool of
+// worker processes, so a file is assembled as soon as it is compiled while
+// other files are still being compiled. Like gcc, files that are not kept
+// are made in $TMPDIR, so the files of the user are never overwritten.
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "misc/misc.h"
+
+extern char** environ;
+
+#define ENUM_GKCC_DRIVER_STAGE(GEN) \
+  GEN(GKCC_DRIVER_STAGE_COMPILE)    \
+  GEN(GKCC_DRIVER_STAGE_ASSEMBLE)   \
+  GEN(GKCC_DRIVER_STAGE_LINK)       \
+  GEN(GKCC_DRIVER_STAGE_DONE)
+
+enum gkcc_driver_stage { ENUM_GKCC_DRIVER_STAGE(ENUM_VALUES) };
+
+static const char* const GKCC_DRIVER_STAGE_NAME[] = {
+    "compile",
+    "assemble",
+    "link",
+};
+
+// gkcc_driver_unit is one input file and the files made from it
+struct gkcc_driver_unit {
+  const char* source;
+  char* assembly;
+  char* object;
+  // Temporary files are removed once they are no longer needed
+  bool assembly_is_temporary;
+  bool object_is_temporary;
+  enum gkcc_driver_stage stage;
+};
+
+// gkcc_driver_job is a running child process
+struct gkcc_driver_job {
+  pid_t pid;
+  enum gkcc_driver_stage stage;
+  // unit is NULL for the link job
+  struct gkcc_driver_unit* unit;
+  // output is removed if the job fails or is cancelled
+  const char* output;
+  struct timespec started;
+};
+
+struct gkcc_driver_stage_time {
+  unsigned int count;
+  double total;
+  double longest;
+};
+
+// Options
+static const char* gkcc_int_path = "gkcc_int";
+// output_path is NULL if no -o was given
+static const char* output_path = NULL;
+static const char** forwarded_args = NULL;
+static size_t forwarded_arg_count = 0;
+static long max_jobs = 0;
+static bool should_link = true;
+static bool should_print_timing = false;
+
+// Scheduler state
+static struct gkcc_driver_unit* units = NULL;
+static size_t unit_count = 0;
+// ready holds the units whose next stage can start, in the order they became
+// ready. Every unit is in it at most once, so unit_count slots are enough.
+static struct gkcc_driver_unit** ready = NULL;
+static size_t ready_head = 0;
+static size_t ready_tail = 0;
+static struct gkcc_driver_job* running = NULL;
+static size_t running_count = 0;
+static size_t linkable_count = 0;
+static struct gkcc_driver_stage_time stage_times[GKCC_DRIVER_STAGE_DONE];
+
+static double gkcc_driver_seconds_since(const struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) +
+         (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// gkcc_driver_with_suffix returns the file name of path with its extension,
+// if it has one, replaced by suffix, so that dir/foo.c becomes foo.o
+static char* gkcc_driver_with_suffix(const char* path, const char* suffix) {
+  const char* slash = strrchr(path, '/');
+  if (slash != NULL) path = slash + 1;
+  size_t length = strlen(path);
+  const char* dot = strrchr(path, '.');
+  if (dot != NULL && dot > path) length = dot - path;
+
+  char* result = malloc(length + strlen(suffix) + 1);
+  gkcc_assert(result != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate path");
+  memcpy(result, path, length);
+  strcpy(result + length, suffix);
+  return result;
+}
+
+static bool gkcc_driver_has_suffix(const char* path, const char* suffix) {
+  size_t length = strlen(path);
+  size_t suffix_length = strlen(suffix);
+  return length >= suffix_length &&
+         strcmp(path + length - suffix_length, suffix) == 0;
+}
+
+static void gkcc_driver_forward(const char* flag, const char* value) {
+  forwarded_args = realloc(forwarded_args,
+                           (forwarded_arg_count + 2) * sizeof(const char*));
+  gkcc_assert(forwarded_args != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to grow forwarded arguments");
+  forwarded_args[forwarded_arg_count++] = flag;
+  forwarded_args[forwarded_arg_count++] = value;
+}
+
+// gkcc_driver_find_gkcc_int looks for gkcc_int next to the driver. If the
+// driver was found through PATH, so is gkcc_int.
+static void gkcc_driver_find_gkcc_int(const char* argv0) {
+  const char* slash = strrchr(argv0, '/');
+  if (slash == NULL) return;
+
+  size_t dir_length = slash - argv0 + 1;
+  char* path = malloc(dir_length + sizeof("gkcc_int"));
+  gkcc_assert(path != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate path");
+  memcpy(path, argv0, dir_length);
+  strcpy(path + dir_length, "gkcc_int");
+  gkcc_int_path = path;
+}
+
+// ==================
+// === SCHEDULING ===
+// ==================
+
+static void gkcc_driver_ready_push(struct gkcc_driver_unit* unit) {
+  ready[ready_tail++ % unit_count] = unit;
+}
+
+static struct gkcc_driver_unit* gkcc_driver_ready_pop(void) {
+  if (ready_head == ready_tail) return NULL;
+  return ready[ready_head++ % unit_count];
+}
+
+// gkcc_driver_cancel stops every running job after one has failed and
+// removes the files they were writing
+static void gkcc_driver_cancel(void) {
+  for (size_t i = 0; i < running_count; i++) kill(running[i].pid, SIGTERM);
+  for (size_t i = 0; i < running_count; i++) {
+    while (waitpid(running[i].pid, NULL, 0) < 0 && errno == EINTR) continue;
+    unlink(running[i].output);
+  }
+  running_count = 0;
+}
+
+// gkcc_driver_remove_intermediates removes the temporary files that are still
+// there. It is called once the link is done or the build has failed.
+static void gkcc_driver_remove_intermediates(void) {
+  for (size_t i = 0; i < unit_count; i++) {
+    struct gkcc_driver_unit* unit = &units[i];
+    if (unit->assembly_is_temporary) {
+      unlink(unit->assembly);
+      unit->assembly_is_temporary = false;
+    }
+    if (unit->object_is_temporary) {
+      unlink(unit->object);
+      unit->object_is_temporary = false;
+    }
+  }
+}
+
+// gkcc_driver_temporary creates an empty file with the given suffix in
+// $TMPDIR, or /tmp if it is not set, and returns its path
+static char* gkcc_driver_temporary(const char* suffix) {
+  const char* dir = getenv("TMPDIR");
+  if (dir == NULL || *dir == '\0') dir = "/tmp";
+
+  size_t size = strlen(dir) + sizeof("/gkccXXXXXX") + strlen(suffix);
+  char* path = malloc(size);
+  gkcc_assert(path != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate path");
+  snprintf(path, size, "%s/gkccXXXXXX%s", dir, suffix);
+
+  int fd = mkstemps(path, strlen(suffix));
+  if (fd < 0) {
+    fprintf(stderr, "gkcc: cannot create a temporary file in %s: %s\n", dir,
+            strerror(errno));
+    gkcc_driver_remove_intermediates();
+    exit(1);
+  }
+  close(fd);
+  return path;
+}
+
+static void gkcc_driver_spawn(enum gkcc_driver_stage stage,
+                              struct gkcc_driver_unit* unit,
+                              const char* output, char** argv) {
+  struct gkcc_driver_job* job = &running[running_count];
+  *job = (struct gkcc_driver_job){
+      .stage = stage, .unit = unit, .output = output};
+  clock_gettime(CLOCK_MONOTONIC, &job->started);
+
+  int error = posix_spawnp(&job->pid, argv[0], NULL, NULL, argv, environ);
+  if (error != 0) {
+    fprintf(stderr, "gkcc: cannot run %s: %s\n", argv[0], strerror(error));
+    gkcc_driver_cancel();
+    gkcc_driver_remove_intermediates();
+    exit(1);
+  }
+  running_count++;
+}
+
+static void gkcc_driver_start_compile(struct gkcc_driver_unit* unit) {
+  const char* argv[forwarded_arg_count + 8];
+  size_t argc = 0;
+  argv[argc++] = gkcc_int_path;
+  for (size_t i = 0; i < forwarded_arg_count; i++) {
+    argv[argc++] = forwarded_args[i];
+  }
+  argv[argc++] = "-p";
+  argv[argc++] = unit->source;
+  argv[argc++] = "-o";
+  argv[argc++] = unit->assembly;
+  argv[argc++] = "assembly";
+  argv[argc] = NULL;
+  gkcc_driver_spawn(GKCC_DRIVER_STAGE_COMPILE, unit, unit->assembly,
+                    (char**)argv);
+}
+
+static void gkcc_driver_start_assemble(struct gkcc_driver_unit* unit) {
+  const char* argv[] = {
+      "gcc", "-m32", "-c", unit->assembly, "-o", unit->object, NULL};
+  gkcc_driver_spawn(GKCC_DRIVER_STAGE_ASSEMBLE, unit, unit->object,
+                    (char**)argv);
+}
+
+static void gkcc_driver_start_link(void) {
+  const char* argv[unit_count + 5];
+  size_t argc = 0;
+  argv[argc++] = "gcc";
+  argv[argc++] = "-m32";
+  for (size_t i = 0; i < unit_count; i++) argv[argc++] = units[i].object;
+  argv[argc++] = "-o";
+  argv[argc++] = output_path;
+  argv[argc] = NULL;
+  gkcc_driver_spawn(GKCC_DRIVER_STAGE_LINK, NULL, output_path, (char**)argv);
+}
+
+// gkcc_driver_start_ready starts jobs until the pool is full or nothing is
+// ready. The link job starts once every object exists.
+static void gkcc_driver_start_ready(void) {
+  while (running_count < (size_t)max_jobs) {
+    struct gkcc_driver_unit* unit = gkcc_driver_ready_pop();
+    if (unit == NULL) break;
+
+    if (unit->stage == GKCC_DRIVER_STAGE_COMPILE) {
+      gkcc_driver_start_compile(unit);
+    } else {
+      gkcc_driver_start_assemble(unit);
+    }
+  }
+
+  if (should_link && linkable_count == unit_count) {
+    linkable_count = 0;
+    gkcc_driver_start_link();
+  }
+}
+
+// gkcc_driver_finish records that the job with the given pid exited. Returns
+// false if it failed.
+static bool gkcc_driver_finish(pid_t pid, int status) {
+  size_t index = 0;
+  while (index < running_count && running[index].pid != pid) index++;
+  if (index == running_count) return true;
+
+  struct gkcc_driver_job job = running[index];
+  running[index] = running[--running_count];
+
+  double seconds = gkcc_driver_seconds_since(&job.started);
+  struct gkcc_driver_stage_time* time = &stage_times[job.stage];
+  time->count++;
+  time->total += seconds;
+  if (seconds > time->longest) time->longest = seconds;
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "gkcc: %s of %s failed\n",
+            GKCC_DRIVER_STAGE_NAME[job.stage],
+            job.unit == NULL ? output_path : job.unit->source);
+    unlink(job.output);
+    return false;
+  }
+
+  if (job.unit == NULL) {
+    gkcc_driver_remove_intermediates();
+    return true;
+  }
+  job.unit->stage++;
+  if (job.unit->stage == GKCC_DRIVER_STAGE_ASSEMBLE) {
+    gkcc_driver_ready_push(job.unit);
+  } else {
+    // The assembly of a C file is only needed until it has been assembled
+    if (job.unit->assembly_is_temporary) {
+      unlink(job.unit->assembly);
+      job.unit->assembly_is_temporary = false;
+    }
+    linkable_count++;
+  }
+  return true;
+}
+
+static void gkcc_driver_print_timing(double wall) {
+  for (int stage = 0; stage < GKCC_DRIVER_STAGE_DONE; stage++) {
+    struct gkcc_driver_stage_time* time = &stage_times[stage];
+    if (time->count == 0) continue;
+    fprintf(stderr, "gkcc: %-8s %4u jobs, %8.3fs total, %8.3fs longest\n",
+            GKCC_DRIVER_STAGE_NAME[stage], time->count, time->total,
+            time->longest);
+  }
+  fprintf(stderr, "gkcc: %ld workers, %.3fs wall\n", max_jobs, wall);
+}
+
+int main(int argc, char** argv) {
+  int opt = 0;
+  while ((opt = getopt(argc, argv, "C:D:I:Z:cj:o:t")) != -1) {
+    switch (opt) {
+      case 'C':
+        gkcc_driver_forward("-C", optarg);
+        break;
+      case 'D':
+        gkcc_driver_forward("-D", optarg);
+        break;
+      case 'I':
+        gkcc_driver_forward("-I", optarg);
+        break;
+      case 'Z':
+        gkcc_driver_forward("-Z", optarg);
+        break;
+      case 'c':
+        should_link = false;
+        break;
+      case 'j':
+        max_jobs = strtol(optarg, NULL, 10);
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 't':
+        should_print_timing = true;
+        break;
+      default:
+        fprintf(stderr,
+                "Usage: %s [-j jobs] [-c] [-t] [-o output] [-I dir] "
+                "[-D name[=value]] [-C cache_dir] [-Z cache_megabytes] "
+                "file...\n",
+                argv[0]);
+        return 255;
+    }
+  }
+
+  unit_count = argc - optind;
+  if (unit_count == 0) {
+    fprintf(stderr, "gkcc: no input files\n");
+    return 255;
+  }
+  if (!should_link && output_path != NULL && unit_count > 1) {
+    fprintf(stderr, "gkcc: cannot use -o with -c and more than one file\n");
+    return 255;
+  }
+  if (should_link && output_path == NULL) output_path = "a.out";
+  if (max_jobs <= 0) max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  if (max_jobs <= 0) max_jobs = 1;
+  gkcc_driver_find_gkcc_int(argv[0]);
+
+  struct timespec started;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+
+  units = calloc(unit_count, sizeof(struct gkcc_driver_unit));
+  ready = calloc(unit_count, sizeof(struct gkcc_driver_unit*));
+  running = calloc(max_jobs, sizeof(struct gkcc_driver_job));
+  gkcc_assert(units != NULL && ready != NULL && running != NULL,
+              GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate driver state");
+
+  // Assembly files skip the compile stage and object files go straight to
+  // the link. With -c the object of foo.c is foo.o in the current directory,
+  // or the -o file, and is kept. Everything else is temporary.
+  for (size_t i = 0; i < unit_count; i++) {
+    struct gkcc_driver_unit* unit = &units[i];
+    unit->source = argv[optind + i];
+    if (gkcc_driver_has_suffix(unit->source, ".o")) {
+      unit->object = (char*)unit->source;
+      unit->stage = GKCC_DRIVER_STAGE_LINK;
+      linkable_count++;
+      continue;
+    }
+    if (should_link) {
+      unit->object = gkcc_driver_temporary(".o");
+      unit->object_is_temporary = true;
+    } else if (output_path != NULL) {
+      unit->object = (char*)output_path;
+    } else {
+      unit->object = gkcc_driver_with_suffix(unit->source, ".o");
+    }
+    if (gkcc_driver_has_suffix(unit->source, ".s")) {
+      unit->assembly = (char*)unit->source;
+      unit->stage = GKCC_DRIVER_STAGE_ASSEMBLE;
+    } else {
+      unit->assembly = gkcc_driver_temporary(".s");
+      unit->assembly_is_temporary = true;
+      unit->stage = GKCC_DRIVER_STAGE_COMPILE;
+    }
+    gkcc_driver_ready_push(unit);
+  }
+
+  gkcc_driver_start_ready();
+  while (running_count > 0) {
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "gkcc: cannot wait for jobs: %s\n", strerror(errno));
+      gkcc_driver_cancel();
+      gkcc_driver_remove_intermediates();
+      return 1;
+    }
+
+    if (!gkcc_driver_finish(pid, status)) {
+      gkcc_driver_cancel();
+      gkcc_driver_remove_intermediates();
+      return 1;
+    }
+    gkcc_driver_start_ready();
+  }
+
+  if (should_print_timing) {
+    gkcc_driver_print_timing(gkcc_driver_seconds_since(&started));
+  }
+  return 0;
+}
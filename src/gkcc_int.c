@@ -13,8 +13,10 @@
 // You should have received a copy of the GNU Affero General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <errno.h>
 #include <getopt.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,7 +25,15 @@
 #include "c.tab.h"
 #include "ir/basic_block.h"
 #include "ir/ir_full.h"
+#include "ir/ir_image.h"
+#include "lex.yy.h"
+#include "misc/arena.h"
+#include "misc/cache.h"
 #include "misc/misc.h"
+#include "misc/parallel.h"
+#include "misc/writer.h"
+#include "preprocessor/preprocessor.h"
+#include "scope/pch.h"
 #include "target_code/x86.h"
 
 enum jobs {
@@ -35,28 +45,246 @@ enum jobs {
   JOB_MAX,
 };
 
+// Options that only have a long name. getopt_long_only() lets them be given
+// with a single dash.
+enum long_options {
+  OPTION_EMIT_IR = 256,
+  OPTION_FROM_IR,
+  OPTION_EMIT_PCH,
+  OPTION_INCLUDE_PCH,
+};
+
+static const struct option long_options[] = {
+    {"emit-ir", no_argument, NULL, OPTION_EMIT_IR},
+    {"from-ir", no_argument, NULL, OPTION_FROM_IR},
+    {"emit-pch", no_argument, NULL, OPTION_EMIT_PCH},
+    {"include-pch", required_argument, NULL, OPTION_INCLUDE_PCH},
+    {NULL, 0, NULL, 0},
+};
+
+// stream_state is the state of compiling a translation unit one function
+// definition at a time
+struct stream_state {
+  struct gkcc_writer* writer;
+  struct gkcc_ir_full* ir_full;
+};
+
+static void stream_definition(void* context, struct ast_node* definition) {
+  struct stream_state* stream = context;
+  struct gkcc_ir_generation_state* gen_state =
+      gkcc_ir_full_lower_definition(stream->ir_full, definition);
+  gkcc_tx86_generate_definition(stream->writer, gen_state);
+  gkcc_ir_generation_state_free(gen_state);
+}
+
+// stream_prefix compiles the function definitions among the declarations of a
+// precompiled header like the parser hands them to stream_definition() when
+// they are parsed
+static void stream_prefix(struct stream_state* stream, struct ast_node* list) {
+  for (struct ast_node* lnode = list; lnode != NULL; lnode = lnode->list.next) {
+    struct ast_node* tnode = lnode->list.node;
+    if (tnode->type != AST_NODE_DECLARATION) continue;
+
+    struct gkcc_type* type = tnode->declaration.type->gkcc_type.gkcc_type;
+    if (type->type != GKCC_TYPE_FUNCTION ||
+        type->function_declaration.statements == NULL) {
+      continue;
+    }
+    stream_definition(stream, tnode);
+    ast_node_function_definition_set_statements(tnode, NULL);
+  }
+}
+
+// list_end returns the last node of a list of top level declarations made by
+// the parser. The parser hands the list out as a copy of its first node, so
+// the end of a list of one declaration is the node that was copied.
+static struct ast_node* list_end(struct ast_node* list) {
+  return list->list.next == NULL ? list : list->list.end;
+}
+
+// read_input reads all of file into a malloc'd buffer, followed by the two NUL
+// bytes the scanner needs
+static char* read_input(FILE* file, size_t* length) {
+  size_t capacity = 1 << 16;
+  size_t used = 0;
+  char* buffer = malloc(capacity);
+  gkcc_assert(buffer != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate input buffer");
+  for (;;) {
+    if (capacity - used <= 2) {
+      capacity *= 2;
+      buffer = realloc(buffer, capacity);
+      gkcc_assert(buffer != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                  "Failed to grow input buffer");
+    }
+    size_t read = fread(&buffer[used], 1, capacity - used - 2, file);
+    if (read == 0) break;
+    used += read;
+  }
+  buffer[used] = '\0';
+  buffer[used + 1] = '\0';
+  *length = used;
+  return buffer;
+}
+
+// parse_megabytes parses the size given to -Z in megabytes into bytes. Returns
+// false if text is not a number of megabytes that fits in 64 bits of bytes.
+static bool parse_megabytes(const char* text, uint64_t* bytes) {
+  if (*text < '0' || *text > '9') return false;
+
+  char* end;
+  errno = 0;
+  unsigned long long megabytes = strtoull(text, &end, 10);
+  if (errno != 0 || *end != '\0' || megabytes > (UINT64_MAX >> 20)) {
+    return false;
+  }
+  *bytes = (uint64_t)megabytes << 20;
+  return true;
+}
+
+static void print_ir(struct gkcc_ir_full* ir_full) {
+  printf(
+      "=========================================\n"
+      "=== Intermediate Representation QUADS ===\n"
+      "=========================================\n\n");
+  struct gkcc_writer* dump_writer = gkcc_writer_new(stdout);
+  gkcc_ir_full_print(dump_writer, ir_full);
+  gkcc_writer_free(dump_writer);
+}
+
+// compile_ir_image generates code for the IR image at path that was written
+// out with -emit-ir, without parsing anything
+static int compile_ir_image(const char* path, FILE* out_file,
+                            bool should_emit_ir, bool should_print_ir,
+                            bool should_print_memory_stats) {
+  struct gkcc_ir_image* image = gkcc_ir_image_map(path);
+  if (image == NULL) {
+    fprintf(stderr, "Cannot read IR from %s\n", path);
+    return 255;
+  }
+
+  if (should_print_ir) print_ir(image->ir_full);
+  if (should_emit_ir) {
+    if (!gkcc_ir_image_write(out_file, image->ir_full)) {
+      fprintf(stderr, "Cannot write an IR image\n");
+      gkcc_ir_image_unmap(image);
+      return 255;
+    }
+  } else {
+    struct gkcc_writer* writer = gkcc_writer_new(out_file);
+    gkcc_tx86_generate_ir_full(writer, image->ir_full);
+    gkcc_writer_free(writer);
+  }
+
+  if (should_print_memory_stats) {
+    gkcc_arena_print_stats(stderr, gkcc_arena_tu(), "translation unit");
+  }
+  gkcc_ir_image_unmap(image);
+  gkcc_arena_tu_release();
+  return 0;
+}
+
+// cache_lookup looks up the assembly of input in the compile cache and writes
+// it to out_file if it is there. Otherwise *entry is set to the file the
+// assembly should also be written to so that it is stored in the cache, or
+// NULL if it cannot be stored.
+static bool cache_lookup(struct gkcc_cache* cache, const char* input,
+                         size_t input_length, bool should_stream,
+                         FILE* out_file, FILE** entry) {
+  *entry = NULL;
+
+  // -j and -o do not change the assembly. -D and -I only change the input.
+  const char* output_flags = should_stream ? "-s assembly" : "assembly";
+  struct gkcc_cache_key key;
+  gkcc_cache_key_init(&key);
+  gkcc_cache_key_add(&key, input, input_length);
+  gkcc_cache_key_add(&key, output_flags, strlen(output_flags));
+  if (!gkcc_cache_key_add_build_id(&key)) return false;
+
+  if (gkcc_cache_fetch(cache, &key, out_file)) return true;
+  *entry = gkcc_cache_store_begin(cache, &key);
+  return false;
+}
+
 int main(int argc, char** argv) {
   setup_segfault_stack_trace();
 
   bool should_print_ast = false;
   bool should_print_ir = false;
+  bool should_print_memory_stats = false;
+  bool should_only_preprocess = false;
+  bool should_stream = false;
+  bool should_emit_ir = false;
+  bool should_load_ir = false;
+  bool should_emit_pch = false;
   FILE* out_file = stdout;
+  const char* input_path = NULL;
+  const char* source_path = NULL;
+  const char* cache_dir = NULL;
+  const char* pch_path = NULL;
+  uint64_t cache_max_size = GKCC_CACHE_DEFAULT_MAX_SIZE;
   int nsecs = 0;
   int flags = 0;
   int tfnd = 0;
   int opt = 0;
 
-  while ((opt = getopt(argc, argv, "adio:")) != -1) {
+  while ((opt = getopt_long_only(argc, argv, "C:D:EI:Z:adf:ij:mo:p:s",
+                                 long_options, NULL)) != -1) {
     switch (opt) {
+      case OPTION_EMIT_IR:
+        should_emit_ir = true;
+        break;
+      case OPTION_FROM_IR:
+        should_load_ir = true;
+        break;
+      case OPTION_EMIT_PCH:
+        should_emit_pch = true;
+        break;
+      case OPTION_INCLUDE_PCH:
+        pch_path = optarg;
+        break;
+      case 'C':
+        cache_dir = optarg;
+        break;
+      case 'D':
+        gkcc_pp_add_definition(optarg);
+        break;
+      case 'E':
+        should_only_preprocess = true;
+        break;
+      case 'I':
+        gkcc_pp_add_include_dir(optarg);
+        break;
+      case 'Z':
+        if (!parse_megabytes(optarg, &cache_max_size)) {
+          fprintf(stderr, "Cannot parse flags\n");
+          return 255;
+        }
+        break;
       case 'a':
         should_print_ast = true;
         break;
       case 'd':
         yydebug = 1;
         break;
+      case 'f':
+        input_path = optarg;
+        break;
       case 'i':
         should_print_ir = true;
         break;
+      case 'j':
+        gkcc_parallel_set_thread_count(atoi(optarg));
+        break;
+      case 'm':
+        should_print_memory_stats = true;
+        break;
+      case 'p':
+        source_path = optarg;
+        break;
+      case 's':
+        should_stream = true;
+        break;
       case 'o':
         if ((strcmp("-", optarg) == 0) || (strcmp("stdout", optarg) == 0)) {
           out_file = stdout;
@@ -85,40 +313,216 @@ int main(int argc, char** argv) {
     return 0;
   }
 
+  // -s compiles every function definition as soon as it has been parsed and
+  // then releases it, so nothing but assembly can be printed
+  if (should_stream &&
+      (should_print_ast || should_print_ir || jobs < JOB_BUILD_ASSEMBLY)) {
+    fprintf(stderr, "-s cannot be combined with -a, -i or a job other than "
+                    "assembly\n");
+    return 255;
+  }
+
+  // -emit-ir writes the IR out to the output file instead of generating code
+  // from it and -from-ir reads IR written out that way from the file given
+  // with -f instead of parsing C. Both need all functions at once.
+  if (should_stream && (should_emit_ir || should_load_ir)) {
+    fprintf(stderr, "-s cannot be combined with -emit-ir or -from-ir\n");
+    return 255;
+  }
+  if (should_load_ir) {
+    if (should_print_ast || source_path != NULL || input_path == NULL ||
+        should_emit_pch || pch_path != NULL) {
+      fprintf(stderr, "-from-ir needs the IR file given with -f and cannot "
+                      "be combined with -a, -p, -emit-pch or -include-pch\n");
+      return 255;
+    }
+    return compile_ir_image(input_path, out_file, should_emit_ir,
+                            should_print_ir, should_print_memory_stats);
+  }
+
+  // -emit-pch writes the state of the parser after parsing the input out to
+  // the output file as a precompiled header instead of compiling it. -s
+  // releases the function definitions it would have to keep.
+  if (should_stream && should_emit_pch) {
+    fprintf(stderr, "-s cannot be combined with -emit-pch\n");
+    return 255;
+  }
+
+  // -C looks the assembly up in a compile cache, which needs all of the input
+  // before anything is parsed. Dumps and debug output need the parser to run.
+  // When the translation unit is not in the cache, the functions that are
+  // still there are spliced in instead of being compiled again, so -emit-ir,
+  // which needs the IR of every function, does not use the cache.
+  bool should_use_cache = cache_dir != NULL && jobs == JOB_BUILD_ASSEMBLY &&
+                          !should_print_ast && !should_print_ir && !yydebug &&
+                          !should_emit_ir && !should_emit_pch;
+
+  yyscan_t scanner = gkcc_lex_new();
+
+  // -p runs the built in preprocessor on a C source file. Otherwise the input
+  // is already preprocessed and read from the file given with -f or stdin.
+  // Precompiled headers are made from and matched against the bytes of the
+  // input, so they need all of it in memory like the compile cache does.
+  char* input = NULL;
+  size_t input_length = 0;
+  if (source_path != NULL) {
+    if (!gkcc_pp_preprocess_file(source_path, &input, &input_length)) {
+      fprintf(stderr, "Cannot read %s\n", source_path);
+      return 255;
+    }
+    if (should_print_memory_stats) gkcc_pp_print_stats(stderr);
+    if (should_only_preprocess) {
+      fwrite(input, 1, input_length, out_file);
+      free(input);
+      return 0;
+    }
+  } else if (should_use_cache || should_emit_pch || pch_path != NULL) {
+    FILE* input_file = input_path == NULL ? stdin : fopen(input_path, "r");
+    if (input_file == NULL) {
+      fprintf(stderr, "Cannot read %s\n", input_path);
+      return 255;
+    }
+    input = read_input(input_file, &input_length);
+    if (input_file != stdin) fclose(input_file);
+  } else if (input_path != NULL && !gkcc_lex_map_file(scanner, input_path)) {
+    fprintf(stderr, "Cannot read %s\n", input_path);
+    return 255;
+  }
+
+  struct gkcc_cache* cache = NULL;
+  FILE* cache_entry = NULL;
+  if (should_use_cache) {
+    cache = gkcc_cache_open(cache_dir, cache_max_size);
+    if (cache == NULL) {
+      fprintf(stderr, "Cannot use cache directory %s\n", cache_dir);
+    }
+  }
+  if (cache != NULL && cache_lookup(cache, input, input_length, should_stream,
+                                    out_file, &cache_entry)) {
+    if (should_print_memory_stats) gkcc_cache_print_stats(stderr, cache);
+    gkcc_cache_close(cache);
+    free(input);
+    gkcc_lex_free(scanner);
+    return 0;
+  }
+
+  // -include-pch starts out with the global scope and the declarations of a
+  // precompiled header that was made from the start of the input and only
+  // parses the rest. A header made from anything else is ignored and the
+  // whole input is parsed.
+  struct gkcc_pch* pch = NULL;
+  if (pch_path != NULL) pch = gkcc_pch_map(pch_path, input, input_length);
+  if (input != NULL) gkcc_lex_scan_preprocessed(scanner, input, input_length);
+  if (pch != NULL) {
+    gkcc_lex_skip(scanner, pch->prefix_length, pch->line_number,
+                  pch->filename);
+  }
+
   struct ast_node ast_node;
   struct gkcc_symbol_table_set* global_symbol_table =
-      gkcc_symbol_table_set_new(NULL, GKCC_SCOPE_GLOBAL);
+      pch != NULL ? pch->global_scope
+                  : gkcc_symbol_table_set_new(NULL, GKCC_SCOPE_GLOBAL);
+
+  struct gkcc_writer* writer = gkcc_writer_new(out_file);
+  if (cache_entry != NULL) gkcc_writer_set_copy(writer, cache_entry);
+  struct stream_state stream = {.writer = writer};
+  struct ast_definition_handler definition_handler = {
+      .fn = stream_definition,
+      .context = &stream,
+  };
+  if (should_stream) {
+    stream.ir_full = gkcc_ir_full_new();
+    stream.ir_full->cache = cache;
+  }
 
-  yyparse(&ast_node, global_symbol_table);
+  if (should_stream && pch != NULL) stream_prefix(&stream, pch->top_level);
+
+  // The grammar needs at least one declaration, so nothing is parsed if the
+  // precompiled header covers all of the input
+  struct ast_node* list = &ast_node;
+  if (pch == NULL || pch->prefix_length < input_length) {
+    yyparse(&ast_node, global_symbol_table,
+            should_stream ? &definition_handler : NULL, scanner);
+  } else {
+    list = NULL;
+  }
+
+  // The declarations of the precompiled header come first
+  if (pch != NULL && pch->top_level != NULL) {
+    if (list != NULL) {
+      list_end(pch->top_level)->list.next = list;
+      pch->top_level->list.end = list_end(list);
+    }
+    list = pch->top_level;
+  }
 
   struct ast_node* top_level = ast_node_new(AST_NODE_TOP_LEVEL);
-  top_level->top_level.list = &ast_node;
+  top_level->top_level.list = list;
 
   if (should_print_ast) {
     printf(
         "============================\n"
         "=== Abstract Syntax Tree ===\n"
         "============================\n\n");
-    ast_print(top_level, 0, "");
+    struct gkcc_writer* dump_writer = gkcc_writer_new(stdout);
+    ast_print(dump_writer, top_level, 0, "");
+    gkcc_writer_free(dump_writer);
+  }
+
+  if (should_emit_pch) {
+    gkcc_writer_free(writer);
+    if (!gkcc_pch_write(out_file, input, input_length, global_symbol_table,
+                        list, yyget_lineno(scanner),
+                        gkcc_lex_filename(scanner))) {
+      fprintf(stderr, "Cannot write a precompiled header\n");
+      return 255;
+    }
+    return 0;
   }
 
   if (jobs < JOB_BUILD_BB) {
+    gkcc_writer_free(writer);
     return 0;
   }
 
-  struct gkcc_ir_full* ir_full = gkcc_ir_build_full(top_level);
+  struct gkcc_ir_full* ir_full = gkcc_ir_build_full(top_level, cache);
 
-  if (should_print_ir) {
-    printf(
-        "=========================================\n"
-        "=== Intermediate Representation QUADS ===\n"
-        "=========================================\n\n");
-    gkcc_ir_full_print(ir_full);
+  if (should_print_ir) print_ir(ir_full);
+
+  if (should_emit_ir) {
+    gkcc_writer_free(writer);
+    if (!gkcc_ir_image_write(out_file, ir_full)) {
+      fprintf(stderr, "Cannot write an IR image\n");
+      return 255;
+    }
+    return 0;
   }
 
   if (jobs < JOB_BUILD_ASSEMBLY) {
+    gkcc_writer_free(writer);
     return 0;
   }
 
-  gkcc_tx86_generate_ir_full(out_file, ir_full);
+  // When streaming, the functions have been written out already and only the
+  // global variables are left
+  gkcc_tx86_generate_ir_full(writer, ir_full);
+  gkcc_writer_free(writer);
+  if (cache != NULL) {
+    gkcc_cache_store_commit(cache);
+    if (should_print_memory_stats) gkcc_cache_print_stats(stderr, cache);
+    gkcc_cache_close(cache);
+  }
+
+  gkcc_symbol_table_set_pop_bindings(global_symbol_table);
+  if (should_print_memory_stats) {
+    gkcc_arena_print_stats(stderr, gkcc_arena_tu(), "translation unit");
+    if (should_stream) {
+      gkcc_arena_print_stats(stderr, gkcc_arena_function_largest(),
+                             "largest function");
+    }
+    gkcc_type_canonical_print_stats(stderr);
+  }
+  gkcc_type_canonical_release();
+  gkcc_arena_tu_release();
+  gkcc_lex_free(scanner);
 }
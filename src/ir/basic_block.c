@@ -17,15 +17,172 @@
 
 #include <malloc.h>
 #include <memory.h>
+#include <pthread.h>
 
 #include "ir/translators.h"
+#include "misc/arena.h"
 #include "misc/misc.h"
 #include "scope/scope.h"
 
-void gkcc_internal_recurse_basic_blocks(
-    struct gkcc_ir_generation_state *gen_state, struct ast_node *nodes,
+// Statuses, the worklist and the quads the translators produce are only needed
+// while the basic blocks of one function are built. Every thread keeps them in
+// a scratch area that is reset and reused for the next function, and freed
+// when the thread exits.
+#define GKCC_BASIC_BLOCK_STATUS_CHUNK_SIZE 256
+
+struct gkcc_basic_block_status_chunk {
+  struct gkcc_basic_block_status_chunk *next;
+  struct gkcc_basic_block_status statuses[GKCC_BASIC_BLOCK_STATUS_CHUNK_SIZE];
+};
+
+// gkcc_basic_block_work is a list of statements that still has to be added to
+// the basic block of bb_status
+struct gkcc_basic_block_work {
+  struct ast_node *nodes;
+  struct gkcc_basic_block_status *bb_status;
+};
+
+struct gkcc_basic_block_scratch {
+  struct gkcc_basic_block_status_chunk *chunks;
+  // current_chunk is NULL until the first status after a reset
+  struct gkcc_basic_block_status_chunk *current_chunk;
+  size_t current_chunk_used;
+
+  struct gkcc_basic_block_work *work;
+  size_t work_count;
+  size_t work_capacity;
+
+  // arena holds registers, quads and quad lists
+  struct gkcc_arena *arena;
+};
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_key_once = PTHREAD_ONCE_INIT;
+
+static void gkcc_basic_block_scratch_free(void *arg) {
+  struct gkcc_basic_block_scratch *scratch = arg;
+  struct gkcc_basic_block_status_chunk *next = NULL;
+  for (struct gkcc_basic_block_status_chunk *chunk = scratch->chunks;
+       chunk != NULL; chunk = next) {
+    next = chunk->next;
+    free(chunk);
+  }
+  free(scratch->work);
+  gkcc_arena_free(scratch->arena);
+  free(scratch);
+}
+
+static void gkcc_basic_block_scratch_key_new(void) {
+  pthread_key_create(&scratch_key, gkcc_basic_block_scratch_free);
+}
+
+static struct gkcc_basic_block_scratch *gkcc_basic_block_scratch(void) {
+  pthread_once(&scratch_key_once, gkcc_basic_block_scratch_key_new);
+  struct gkcc_basic_block_scratch *scratch = pthread_getspecific(scratch_key);
+  if (scratch == NULL) {
+    scratch = calloc(1, sizeof(struct gkcc_basic_block_scratch));
+    gkcc_assert(scratch != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                "Failed to allocate basic block scratch area");
+    scratch->arena = gkcc_arena_new();
+    pthread_setspecific(scratch_key, scratch);
+  }
+  return scratch;
+}
+
+// gkcc_basic_block_scratch_reset gives every status back to the pool and
+// releases the scratch arena
+static void gkcc_basic_block_scratch_reset(
+    struct gkcc_basic_block_scratch *scratch) {
+  scratch->current_chunk = NULL;
+  scratch->current_chunk_used = 0;
+  scratch->work_count = 0;
+  gkcc_arena_reset(scratch->arena);
+}
+
+// gkcc_basic_block_scratch_arena returns the arena that the quads of the
+// function being lowered on this thread are built in. Everything in it is
+// released once the function has been packed.
+struct gkcc_arena *gkcc_basic_block_scratch_arena(void) {
+  return gkcc_basic_block_scratch()->arena;
+}
+
+static void gkcc_basic_block_push_work(
+    struct gkcc_basic_block_scratch *scratch, struct ast_node *nodes,
+    struct gkcc_basic_block_status *bb_status) {
+  if (scratch->work_count == scratch->work_capacity) {
+    scratch->work_capacity =
+        scratch->work_capacity == 0 ? 64 : scratch->work_capacity * 2;
+    scratch->work =
+        realloc(scratch->work, scratch->work_capacity *
+                                   sizeof(struct gkcc_basic_block_work));
+    gkcc_assert(scratch->work != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                "Failed to grow the basic block worklist");
+  }
+  scratch->work[scratch->work_count++] =
+      (struct gkcc_basic_block_work){.nodes = nodes, .bb_status = bb_status};
+}
+
+// gkcc_basic_block_finish ends the basic block of bb_status with the jumps to
+// its successors. last_result is the result of the last statement in it.
+static void gkcc_basic_block_finish(
+    struct gkcc_ir_generation_state *gen_state,
+    struct gkcc_basic_block_status *bb_status,
+    struct gkcc_ir_translation_result last_result) {
+  bb_status->thisBB->true_branch =
+      bb_status->trueBB == NULL ? NULL : bb_status->trueBB->thisBB;
+  bb_status->thisBB->false_branch =
+      bb_status->falseBB == NULL ? NULL : bb_status->falseBB->thisBB;
+
+  if (bb_status->thisBB->true_branch == NULL) {
+    return;
+  }
+
+  // This optimization is creating some issues so commenting out for now
+  //  if (bb_status->thisBB->quads_in_bb == NULL) {
+  //    bb_status->trueBB = bb_status->trueBB->trueBB;
+  //    bb_status->falseBB = bb_status->falseBB->falseBB;
+  //    return;
+  //  }
+
+  if (bb_status->thisBB->true_branch == bb_status->thisBB->false_branch) {
+    struct gkcc_ir_quad *jump_ir = gkcc_ir_quad_new_with_args(
+        GKCC_IR_QUAD_INSTRUCTION_BRANCH, NULL,
+        gkcc_ir_quad_register_new_basic_block(gen_state,
+                                              bb_status->thisBB->true_branch),
+        NULL);
+    bb_status->thisBB->quads_in_bb =
+        gkcc_ir_quad_list_append(bb_status->thisBB->quads_in_bb, jump_ir);
+    return;
+  }
+
+  struct gkcc_ir_quad *true_jump_ir = gkcc_ir_quad_new_with_args(
+      GKCC_IR_QUAD_INSTRUCTION_BRANCH_IF_TRUE, NULL,
+      gkcc_ir_quad_register_new_basic_block(gen_state,
+                                            bb_status->thisBB->true_branch),
+      last_result.result);
+  bb_status->thisBB->quads_in_bb =
+      gkcc_ir_quad_list_append(bb_status->thisBB->quads_in_bb, true_jump_ir);
+
+  struct gkcc_ir_quad *false_jump_ir = gkcc_ir_quad_new_with_args(
+      GKCC_IR_QUAD_INSTRUCTION_BRANCH_IF_FALSE, NULL,
+      gkcc_ir_quad_register_new_basic_block(gen_state,
+                                            bb_status->thisBB->false_branch),
+      last_result.result);
+  bb_status->thisBB->quads_in_bb =
+      gkcc_ir_quad_list_append(bb_status->thisBB->quads_in_bb, false_jump_ir);
+
+  return;
+}
+
+// gkcc_basic_block_add_statements adds nodes to the basic block of bb_status up
+// to the first loop, if or jump. The lists of statements that make up a loop
+// or an if, and the ones that follow it, are pushed to the worklist together
+// with their basic blocks, last one first.
+static void gkcc_basic_block_add_statements(
+    struct gkcc_ir_generation_state *gen_state,
+    struct gkcc_basic_block_scratch *scratch, struct ast_node *nodes,
     struct gkcc_basic_block_status *bb_status) {
-  struct gkcc_ir_translation_result last_result;
+  struct gkcc_ir_translation_result last_result = {0};
   for (struct ast_node *lnode = nodes; lnode != NULL;
        lnode = lnode->list.next) {
     struct ast_node *tnode = lnode->list.node;
@@ -53,21 +210,21 @@ void gkcc_internal_recurse_basic_blocks(
       body_BB_status->trueBB = iter_BB_status;
       body_BB_status->falseBB = iter_BB_status;
 
-      gkcc_internal_recurse_basic_blocks(gen_state, tnode->for_loop.expr3,
-                                         iter_BB_status);
-      gkcc_internal_recurse_basic_blocks(gen_state, tnode->for_loop.expr2,
-                                         cond_BB_status);
-      gkcc_internal_recurse_basic_blocks(gen_state, tnode->for_loop.expr1,
-                                         init_BB_status);
-      gkcc_internal_recurse_basic_blocks(gen_state, tnode->for_loop.statements,
-                                         body_BB_status);
-      gkcc_internal_recurse_basic_blocks(gen_state, lnode->list.next,
-                                         next_BB_status);
+      // Translated in the order iter, cond, init, body, next
+      gkcc_basic_block_push_work(scratch, lnode->list.next, next_BB_status);
+      gkcc_basic_block_push_work(scratch, tnode->for_loop.statements,
+                                 body_BB_status);
+      gkcc_basic_block_push_work(scratch, tnode->for_loop.expr1,
+                                 init_BB_status);
+      gkcc_basic_block_push_work(scratch, tnode->for_loop.expr2,
+                                 cond_BB_status);
+      gkcc_basic_block_push_work(scratch, tnode->for_loop.expr3,
+                                 iter_BB_status);
 
       bb_status->trueBB = init_BB_status;
       bb_status->falseBB = init_BB_status;
 
-      goto CLEANUP_AND_RETURN;
+      break;
     }
 
     if (tnode->type == AST_NODE_IF_STATEMENT) {
@@ -87,19 +244,19 @@ void gkcc_internal_recurse_basic_blocks(
           gkcc_basic_block_status_new(gen_state, NULL, NULL, then_BB_status,
                                       else_BB_status);
 
-      gkcc_internal_recurse_basic_blocks(
-          gen_state, tnode->if_statement.then_statement, then_BB_status);
-      gkcc_internal_recurse_basic_blocks(
-          gen_state, tnode->if_statement.else_statement, else_BB_status);
-      gkcc_internal_recurse_basic_blocks(
-          gen_state, tnode->if_statement.condition, cond_BB_status);
-      gkcc_internal_recurse_basic_blocks(gen_state, lnode->list.next,
-                                         next_BB_status);
+      // Translated in the order then, else, cond, next
+      gkcc_basic_block_push_work(scratch, lnode->list.next, next_BB_status);
+      gkcc_basic_block_push_work(scratch, tnode->if_statement.condition,
+                                 cond_BB_status);
+      gkcc_basic_block_push_work(scratch, tnode->if_statement.else_statement,
+                                 else_BB_status);
+      gkcc_basic_block_push_work(scratch, tnode->if_statement.then_statement,
+                                 then_BB_status);
 
       bb_status->trueBB = cond_BB_status;
       bb_status->falseBB = cond_BB_status;
 
-      goto CLEANUP_AND_RETURN;
+      break;
     }
 
     if (tnode->type == AST_NODE_JUMP_BREAK) {
@@ -107,7 +264,7 @@ void gkcc_internal_recurse_basic_blocks(
                   "Attempted to use 'break' when there is nowhere to break to");
       bb_status->trueBB = bb_status->breakBB;
       bb_status->falseBB = bb_status->breakBB;
-      goto CLEANUP_AND_RETURN;
+      break;
     }
 
     if (tnode->type == AST_NODE_JUMP_CONTINUE) {
@@ -116,7 +273,7 @@ void gkcc_internal_recurse_basic_blocks(
           "Attempted to use 'continue' when there is nowhere to continue to");
       bb_status->trueBB = bb_status->continueBB;
       bb_status->falseBB = bb_status->continueBB;
-      goto CLEANUP_AND_RETURN;
+      break;
     }
 
     // This could be skipped past with a goto if something else does the
@@ -128,48 +285,99 @@ void gkcc_internal_recurse_basic_blocks(
     last_result = translation_result;
   }
 
-CLEANUP_AND_RETURN:
-  bb_status->thisBB->true_branch =
-      bb_status->trueBB == NULL ? NULL : bb_status->trueBB->thisBB;
-  bb_status->thisBB->false_branch =
-      bb_status->falseBB == NULL ? NULL : bb_status->falseBB->thisBB;
+  gkcc_basic_block_finish(gen_state, bb_status, last_result);
+}
 
-  if (bb_status->thisBB->true_branch == NULL) {
-    return;
+// gkcc_internal_build_basic_blocks adds the statements in nodes to the basic
+// block of bb_status and the basic blocks that follow it. Everything is
+// translated in the same order as a recursive walk of the statements, but the
+// walk uses an explicit worklist so that the native stack does not grow with
+// the number of loops and ifs in a function.
+void gkcc_internal_build_basic_blocks(
+    struct gkcc_ir_generation_state *gen_state, struct ast_node *nodes,
+    struct gkcc_basic_block_status *bb_status) {
+  struct gkcc_basic_block_scratch *scratch = gkcc_basic_block_scratch();
+  size_t work_base = scratch->work_count;
+
+  gkcc_basic_block_push_work(scratch, nodes, bb_status);
+  while (scratch->work_count > work_base) {
+    struct gkcc_basic_block_work work = scratch->work[--scratch->work_count];
+    gkcc_basic_block_add_statements(gen_state, scratch, work.nodes,
+                                    work.bb_status);
   }
+}
 
-  // This optimization is creating some issues so commenting out for now
-  //  if (bb_status->thisBB->quads_in_bb == NULL) {
-  //    bb_status->trueBB = bb_status->trueBB->trueBB;
-  //    bb_status->falseBB = bb_status->falseBB->falseBB;
-  //    return;
-  //  }
-
-  if (bb_status->thisBB->true_branch == bb_status->thisBB->false_branch) {
-    struct gkcc_ir_quad *jump_ir = gkcc_ir_quad_new_with_args(
-        GKCC_IR_QUAD_INSTRUCTION_BRANCH, NULL,
-        gkcc_ir_quad_register_new_basic_block(bb_status->thisBB->true_branch),
-        NULL);
-    bb_status->thisBB->quads_in_bb =
-        gkcc_ir_quad_list_append(bb_status->thisBB->quads_in_bb, jump_ir);
-    return;
+// gkcc_basic_block_order_frame is a basic block on the stack of the depth first
+// search done by gkcc_basic_block_compute_order
+struct gkcc_basic_block_order_frame {
+  int block;
+  // successor is the number of successors already visited
+  int successor;
+};
+
+// gkcc_basic_block_successor returns the index'th distinct successor of bb, or
+// NULL if it has fewer. The false branch comes first so that the true branch
+// ends up right after bb in reverse postorder.
+static struct gkcc_basic_block *gkcc_basic_block_successor(
+    struct gkcc_basic_block *bb, int index) {
+  struct gkcc_basic_block *successors[2] = {bb->false_branch, bb->true_branch};
+  if (successors[0] == successors[1] || successors[0] == NULL) {
+    successors[0] = successors[1];
+    successors[1] = NULL;
   }
+  return index < 2 ? successors[index] : NULL;
+}
 
-  struct gkcc_ir_quad *true_jump_ir = gkcc_ir_quad_new_with_args(
-      GKCC_IR_QUAD_INSTRUCTION_BRANCH_IF_TRUE, NULL,
-      gkcc_ir_quad_register_new_basic_block(bb_status->thisBB->true_branch),
-      last_result.result);
-  bb_status->thisBB->quads_in_bb =
-      gkcc_ir_quad_list_append(bb_status->thisBB->quads_in_bb, true_jump_ir);
+// gkcc_basic_block_compute_order fills in fn->block_order with a depth first
+// search from the entrance basic block. It has to be called while bb_number is
+// still the index of a basic block in fn->basic_blocks. The visited set and
+// the search stack are on the heap so that functions with any number of basic
+// blocks can be ordered.
+static void gkcc_basic_block_compute_order(struct gkcc_ir_function *fn) {
+  int basic_block_count = fn->basic_block_count;
+  size_t word_bits = sizeof(unsigned long) * 8;
+  unsigned long *visited = calloc(
+      (basic_block_count + word_bits - 1) / word_bits, sizeof(unsigned long));
+  // Every basic block is pushed at most once
+  struct gkcc_basic_block_order_frame *stack = malloc(
+      basic_block_count * sizeof(struct gkcc_basic_block_order_frame));
+  gkcc_assert(visited != NULL && stack != NULL,
+              GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate the basic block order of a function");
+
+  // Blocks are added from the back as they are finished
+  fn->block_order =
+      gkcc_arena_alloc(gkcc_arena_tu(), basic_block_count * sizeof(int));
+  int finished = basic_block_count;
+
+  int stack_count = 0;
+  int entrance = fn->entrance_basic_block->bb_number;
+  visited[entrance / word_bits] |= 1UL << (entrance % word_bits);
+  stack[stack_count++] =
+      (struct gkcc_basic_block_order_frame){.block = entrance};
+  while (stack_count > 0) {
+    struct gkcc_basic_block_order_frame *frame = &stack[stack_count - 1];
+    struct gkcc_basic_block *next = gkcc_basic_block_successor(
+        fn->basic_blocks[frame->block], frame->successor++);
+    if (next == NULL) {
+      fn->block_order[--finished] = frame->block;
+      stack_count--;
+      continue;
+    }
 
-  struct gkcc_ir_quad *false_jump_ir = gkcc_ir_quad_new_with_args(
-      GKCC_IR_QUAD_INSTRUCTION_BRANCH_IF_FALSE, NULL,
-      gkcc_ir_quad_register_new_basic_block(bb_status->thisBB->false_branch),
-      last_result.result);
-  bb_status->thisBB->quads_in_bb =
-      gkcc_ir_quad_list_append(bb_status->thisBB->quads_in_bb, false_jump_ir);
+    int block = next->bb_number;
+    if (visited[block / word_bits] & (1UL << (block % word_bits))) continue;
+    visited[block / word_bits] |= 1UL << (block % word_bits);
+    stack[stack_count++] =
+        (struct gkcc_basic_block_order_frame){.block = block};
+  }
 
-  return;
+  // Basic blocks that cannot be reached are left out
+  fn->block_order_count = basic_block_count - finished;
+  fn->block_order = &fn->block_order[finished];
+
+  free(visited);
+  free(stack);
 }
 
 struct gkcc_ir_function *gkcc_internal_build_basic_blocks_for_function(
@@ -183,52 +391,96 @@ struct gkcc_ir_function *gkcc_internal_build_basic_blocks_for_function(
   struct gkcc_basic_block_status *bb_status =
       gkcc_basic_block_status_new(gen_state, NULL, NULL, NULL, NULL);
 
-  gkcc_internal_recurse_basic_blocks(gen_state, lnode, bb_status);
+  gkcc_internal_build_basic_blocks(gen_state, lnode, bb_status);
 
   ir_function->entrance_basic_block = bb_status->thisBB;
+  gkcc_ir_function_pack(gen_state);
+  gkcc_basic_block_compute_order(ir_function);
+  gkcc_basic_block_scratch_reset(gkcc_basic_block_scratch());
 
   return ir_function;
 }
 
+// gkcc_basic_block_new returns a new basic block of the function being
+// lowered. It is named when gkcc_basic_block_set_number() gives it its final
+// number.
 struct gkcc_basic_block *gkcc_basic_block_new(
     struct gkcc_ir_generation_state *gen_state) {
-  struct gkcc_basic_block *bb = malloc(sizeof(struct gkcc_basic_block));
-  memset(bb, 0, sizeof(struct gkcc_basic_block));
+  struct gkcc_basic_block *bb =
+      gkcc_arena_alloc(gkcc_arena_tu(), sizeof(struct gkcc_basic_block));
+
+  if (gen_state->current_basic_block_number ==
+      gen_state->basic_blocks_capacity) {
+    gen_state->basic_blocks_capacity =
+        gen_state->basic_blocks_capacity == 0
+            ? 16
+            : gen_state->basic_blocks_capacity * 2;
+    gen_state->basic_blocks =
+        realloc(gen_state->basic_blocks, gen_state->basic_blocks_capacity *
+                                             sizeof(struct gkcc_basic_block *));
+    gkcc_assert(gen_state->basic_blocks != NULL,
+                GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                "Failed to grow the basic blocks of a function");
+  }
   bb->bb_number = gen_state->current_basic_block_number++;
-  char buf[(1 << 12) + 1];
-  size_t len = sprintf(buf, ".BB.%d", bb->bb_number);
-  bb->bb_name = malloc(len + 1);
-  strcpy(bb->bb_name, buf);
+  gen_state->basic_blocks[bb->bb_number] = bb;
   return bb;
 }
 
+void gkcc_basic_block_set_number(struct gkcc_basic_block *bb, int bb_number) {
+  char buf[(1 << 12) + 1];
+  sprintf(buf, ".BB.%d", bb_number);
+  bb->bb_name = gkcc_arena_strdup(gkcc_arena_tu(), buf);
+  bb->bb_number = bb_number;
+}
+
+// gkcc_basic_block_status_new returns a status with a new basic block. Statuses
+// come from a per thread pool and are only valid until the basic blocks of the
+// current function have been built.
 struct gkcc_basic_block_status *gkcc_basic_block_status_new(
     struct gkcc_ir_generation_state *gen_state,
     struct gkcc_basic_block_status *continueBB,
     struct gkcc_basic_block_status *breakBB,
     struct gkcc_basic_block_status *trueBB,
     struct gkcc_basic_block_status *falseBB) {
-  struct gkcc_basic_block_status *bb_status =
-      malloc(sizeof(struct gkcc_basic_block_status));
-  memset(bb_status, 0, sizeof(struct gkcc_basic_block_status));
+  struct gkcc_basic_block_scratch *scratch = gkcc_basic_block_scratch();
+  struct gkcc_basic_block_status_chunk *chunk = scratch->current_chunk;
+  if (chunk == NULL ||
+      scratch->current_chunk_used == GKCC_BASIC_BLOCK_STATUS_CHUNK_SIZE) {
+    struct gkcc_basic_block_status_chunk *next =
+        chunk == NULL ? scratch->chunks : chunk->next;
+    if (next == NULL) {
+      next = malloc(sizeof(struct gkcc_basic_block_status_chunk));
+      gkcc_assert(next != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                  "Failed to allocate basic block statuses");
+      next->next = NULL;
+      if (chunk == NULL) {
+        scratch->chunks = next;
+      } else {
+        chunk->next = next;
+      }
+    }
+    scratch->current_chunk = chunk = next;
+    scratch->current_chunk_used = 0;
+  }
 
-  bb_status->thisBB = gkcc_basic_block_new(gen_state);
-  bb_status->continueBB = continueBB;
-  bb_status->breakBB = breakBB;
-  bb_status->trueBB = trueBB;
-  bb_status->falseBB = falseBB;
+  struct gkcc_basic_block_status *bb_status =
+      &chunk->statuses[scratch->current_chunk_used++];
+  *bb_status = (struct gkcc_basic_block_status){
+      .thisBB = gkcc_basic_block_new(gen_state),
+      .continueBB = continueBB,
+      .breakBB = breakBB,
+      .trueBB = trueBB,
+      .falseBB = falseBB,
+  };
 
   return bb_status;
 }
 
-void gkcc_basic_block_print(bool *printed, struct gkcc_basic_block *bb) {
-  if (bb == NULL) return;
-  if (printed[bb->bb_number]) return;
-
-  printed[bb->bb_number] = true;
-  printf("%s:\n", bb->bb_name);
-  gkcc_ir_quad_print(bb->quads_in_bb);
-  gkcc_basic_block_print(printed, bb->true_branch);
-  if (bb->true_branch != bb->false_branch)
-    gkcc_basic_block_print(printed, bb->false_branch);
+void gkcc_basic_block_print(struct gkcc_writer *writer,
+                            struct gkcc_ir_function *fn,
+                            struct gkcc_basic_block *bb) {
+  gkcc_writer_str(writer, bb->bb_name);
+  gkcc_writer_str(writer, ":\n");
+  gkcc_ir_quad_print(writer, fn, bb);
 }
@@ -27,7 +27,12 @@
 struct gkcc_basic_block {
   char *bb_name;
   int bb_number;
+  // quads_in_bb is only used while the function is lowered. Afterwards the
+  // quads of the basic block are quads[first_quad] up to
+  // quads[first_quad + quad_count - 1] of its function.
   struct gkcc_ir_quad_list *quads_in_bb;
+  int first_quad;
+  int quad_count;
   struct gkcc_ir_quad *comparison;
   struct gkcc_basic_block *true_branch;
   struct gkcc_basic_block *false_branch;
@@ -45,9 +50,13 @@ struct gkcc_basic_block_status {
   struct gkcc_basic_block_status *breakBB;
 };
 
+struct gkcc_arena *gkcc_basic_block_scratch_arena(void);
+
 struct gkcc_basic_block *gkcc_basic_block_new(
     struct gkcc_ir_generation_state *gen_state);
 
+void gkcc_basic_block_set_number(struct gkcc_basic_block *bb, int bb_number);
+
 struct gkcc_basic_block_status *gkcc_basic_block_status_new(
     struct gkcc_ir_generation_state *gen_state,
     struct gkcc_basic_block_status *continueBB,
@@ -55,13 +64,15 @@ struct gkcc_basic_block_status *gkcc_basic_block_status_new(
     struct gkcc_basic_block_status *trueBB,
     struct gkcc_basic_block_status *falseBB);
 
-void gkcc_internal_recurse_basic_blocks(
+void gkcc_internal_build_basic_blocks(
     struct gkcc_ir_generation_state *gen_state, struct ast_node *nodes,
     struct gkcc_basic_block_status *bb_status);
 
 struct gkcc_ir_function *gkcc_internal_build_basic_blocks_for_function(
     struct gkcc_ir_generation_state *gen_state, struct ast_node *function_node);
 
-void gkcc_basic_block_print(bool *printed, struct gkcc_basic_block *bb);
+void gkcc_basic_block_print(struct gkcc_writer *writer,
+                            struct gkcc_ir_function *fn,
+                            struct gkcc_basic_block *bb);
 
 #endif  // GKCC_BASIC_BLOCK_H
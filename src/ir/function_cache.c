@@ -0,0 +1,592 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "ir/function_cache.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast/types.h"
+#include "misc/arena.h"
+#include "scope/scope.h"
+
+// Every function entry starts with a gkcc_function_cache_header. It is
+// followed by the length of each string constant as a uint32_t, the string
+// constants back to back and then the assembly.
+struct gkcc_function_cache_header {
+  int32_t basic_block_count;
+  int32_t string_constant_count;
+};
+
+// ===============
+// === HASHING ===
+// ===============
+
+enum gkcc_function_hash_item_type {
+  GKCC_FUNCTION_HASH_ITEM_NODE,
+  GKCC_FUNCTION_HASH_ITEM_TYPE,
+  GKCC_FUNCTION_HASH_ITEM_SYMBOL,
+};
+
+struct gkcc_function_hash_item {
+  enum gkcc_function_hash_item_type type;
+  union {
+    struct ast_node *node;
+    struct gkcc_type *gkcc_type;
+    struct gkcc_symbol *symbol;
+  };
+};
+
+struct gkcc_function_hash_seen {
+  const void *pointer;
+  long long order;
+};
+
+// gkcc_function_hasher walks a function definition and everything it refers
+// to with an explicit stack, so that deeply nested expressions cannot run out
+// of stack
+struct gkcc_function_hasher {
+  struct gkcc_cache_key *key;
+
+  struct gkcc_function_hash_item *items;
+  size_t count;
+  size_t capacity;
+
+  // seen is an open addressing hash table (linear probing) of the types and
+  // symbols hashed so far along with the order they were first hashed in. Only
+  // the first occurrence is hashed in full and later ones hash the order
+  // instead, which also ends the walk at recursive struct types. seen is kept
+  // at most half full.
+  struct gkcc_function_hash_seen *seen;
+  size_t seen_count;
+  size_t seen_capacity;
+};
+
+// Markers that cannot be mistaken for the kind of a node or type
+#define GKCC_FUNCTION_HASH_NULL (-1)
+#define GKCC_FUNCTION_HASH_SEEN (-2)
+
+static void gkcc_function_hash_int(struct gkcc_function_hasher *hasher,
+                                   long long value) {
+  gkcc_cache_key_add(hasher->key, &value, sizeof(value));
+}
+
+static void gkcc_function_hash_string(struct gkcc_function_hasher *hasher,
+                                      const char *str) {
+  if (str == NULL) {
+    gkcc_function_hash_int(hasher, GKCC_FUNCTION_HASH_NULL);
+    return;
+  }
+  gkcc_cache_key_add(hasher->key, str, strlen(str));
+}
+
+static void gkcc_function_hash_push(struct gkcc_function_hasher *hasher,
+                                    struct gkcc_function_hash_item item) {
+  if (hasher->count == hasher->capacity) {
+    hasher->capacity = hasher->capacity == 0 ? 64 : hasher->capacity * 2;
+    hasher->items = realloc(
+        hasher->items,
+        hasher->capacity * sizeof(struct gkcc_function_hash_item));
+    gkcc_assert(hasher->items != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                "Failed to grow the function hash stack");
+  }
+  hasher->items[hasher->count++] = item;
+}
+
+static void gkcc_function_hash_push_node(struct gkcc_function_hasher *hasher,
+                                         struct ast_node *node) {
+  gkcc_function_hash_push(hasher,
+                          (struct gkcc_function_hash_item){
+                              .type = GKCC_FUNCTION_HASH_ITEM_NODE,
+                              .node = node});
+}
+
+static void gkcc_function_hash_push_type(struct gkcc_function_hasher *hasher,
+                                         struct gkcc_type *gkcc_type) {
+  gkcc_function_hash_push(hasher,
+                          (struct gkcc_function_hash_item){
+                              .type = GKCC_FUNCTION_HASH_ITEM_TYPE,
+                              .gkcc_type = gkcc_type});
+}
+
+static void gkcc_function_hash_push_symbol(
+    struct gkcc_function_hasher *hasher, struct gkcc_symbol *symbol) {
+  gkcc_function_hash_push(hasher,
+                          (struct gkcc_function_hash_item){
+                              .type = GKCC_FUNCTION_HASH_ITEM_SYMBOL,
+                              .symbol = symbol});
+}
+
+static size_t gkcc_function_hash_slot(const void *pointer, size_t capacity) {
+  return (size_t)(((uintptr_t)pointer * 0x9e3779b97f4a7c15ULL) >> 32) &
+         (capacity - 1);
+}
+
+static void gkcc_function_hash_seen_grow(struct gkcc_function_hasher *hasher) {
+  size_t new_capacity =
+      hasher->seen_capacity == 0 ? 256 : hasher->seen_capacity * 2;
+  struct gkcc_function_hash_seen *new_seen =
+      calloc(new_capacity, sizeof(struct gkcc_function_hash_seen));
+  gkcc_assert(new_seen != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to grow the function hash seen set");
+
+  for (size_t i = 0; i < hasher->seen_capacity; i++) {
+    if (hasher->seen[i].pointer == NULL) continue;
+
+    size_t slot = gkcc_function_hash_slot(hasher->seen[i].pointer,
+                                          new_capacity);
+    while (new_seen[slot].pointer != NULL) {
+      slot = (slot + 1) & (new_capacity - 1);
+    }
+    new_seen[slot] = hasher->seen[i];
+  }
+
+  free(hasher->seen);
+  hasher->seen = new_seen;
+  hasher->seen_capacity = new_capacity;
+}
+
+// gkcc_function_hash_seen_before returns true and hashes a reference to the
+// first occurrence if pointer has been hashed before. Otherwise pointer is
+// remembered and has to be hashed in full.
+static bool gkcc_function_hash_seen_before(struct gkcc_function_hasher *hasher,
+                                           const void *pointer) {
+  if ((hasher->seen_count + 1) * 2 > hasher->seen_capacity) {
+    gkcc_function_hash_seen_grow(hasher);
+  }
+
+  size_t slot = gkcc_function_hash_slot(pointer, hasher->seen_capacity);
+  for (; hasher->seen[slot].pointer != NULL;
+       slot = (slot + 1) & (hasher->seen_capacity - 1)) {
+    if (hasher->seen[slot].pointer == pointer) {
+      gkcc_function_hash_int(hasher, GKCC_FUNCTION_HASH_SEEN);
+      gkcc_function_hash_int(hasher, hasher->seen[slot].order);
+      return true;
+    }
+  }
+  hasher->seen[slot] = (struct gkcc_function_hash_seen){
+      .pointer = pointer, .order = hasher->seen_count++};
+  return false;
+}
+
+static void gkcc_function_hash_constant(struct gkcc_function_hasher *hasher,
+                                        struct ast_constant *constant) {
+  gkcc_function_hash_int(hasher, constant->type);
+  gkcc_function_hash_int(hasher, constant->is_unsigned);
+  switch (constant->type) {
+    case AST_CONSTANT_LONGLONG:
+      gkcc_function_hash_int(hasher, constant->ylonglong);
+      break;
+    case AST_CONSTANT_LONG_DOUBLE: {
+      // A long double has padding bytes with no defined value, so the exact
+      // hexadecimal spelling of its value is hashed instead of its bytes
+      char digits[64];
+      int length =
+          snprintf(digits, sizeof(digits), "%La", constant->ylongdouble);
+      gkcc_cache_key_add(hasher->key, digits, length);
+      break;
+    }
+    case AST_CONSTANT_DOUBLE:
+      gkcc_cache_key_add(hasher->key, &constant->ydouble,
+                         sizeof(constant->ydouble));
+      break;
+    case AST_CONSTANT_FLOAT:
+      gkcc_cache_key_add(hasher->key, &constant->yfloat,
+                         sizeof(constant->yfloat));
+      break;
+    case AST_CONSTANT_LONG:
+      gkcc_function_hash_int(hasher, constant->ylong);
+      break;
+    case AST_CONSTANT_INT:
+      gkcc_function_hash_int(hasher, constant->yint);
+      break;
+    case AST_CONSTANT_CHAR:
+      gkcc_function_hash_int(hasher, constant->ychar);
+      break;
+    case AST_CONSTANT_STRING:
+      gkcc_cache_key_add(hasher->key, constant->ystring.raw,
+                         constant->ystring.length);
+      break;
+  }
+}
+
+// gkcc_function_hash_node hashes what is specific to node and pushes its
+// children. Children are pushed last first so that they are hashed in order.
+static void gkcc_function_hash_node(struct gkcc_function_hasher *hasher,
+                                    struct ast_node *node) {
+  if (node == NULL) {
+    gkcc_function_hash_int(hasher, GKCC_FUNCTION_HASH_NULL);
+    return;
+  }
+
+  gkcc_function_hash_int(hasher, node->type);
+  switch (node->type) {
+    case AST_NODE_UNKNOWN:
+    case AST_NODE_JUMP_CONTINUE:
+    case AST_NODE_JUMP_BREAK:
+      break;
+    case AST_NODE_BINOP:
+      gkcc_function_hash_int(hasher, node->binop.type);
+      gkcc_function_hash_push_node(hasher, node->binop.right);
+      gkcc_function_hash_push_node(hasher, node->binop.left);
+      break;
+    case AST_NODE_CONSTANT:
+      gkcc_function_hash_constant(hasher, &node->constant);
+      break;
+    case AST_NODE_IDENT:
+      gkcc_function_hash_string(hasher, node->ident.name);
+      gkcc_function_hash_push_symbol(hasher, node->ident.symbol_table_entry);
+      break;
+    case AST_NODE_UNARY:
+      gkcc_function_hash_int(hasher, node->unary.type);
+      gkcc_function_hash_push_node(hasher, node->unary.of);
+      break;
+    case AST_NODE_TERNARY:
+      gkcc_function_hash_push_node(hasher, node->ternary.false_expr);
+      gkcc_function_hash_push_node(hasher, node->ternary.true_expr);
+      gkcc_function_hash_push_node(hasher, node->ternary.condition);
+      break;
+    case AST_NODE_GKCC_TYPE:
+      gkcc_function_hash_push_type(hasher, node->gkcc_type.gkcc_type);
+      break;
+    case AST_NODE_DECLARATION:
+      gkcc_function_hash_push_node(hasher, node->declaration.assignment);
+      gkcc_function_hash_push_node(hasher, node->declaration.identifier);
+      gkcc_function_hash_push_node(hasher, node->declaration.type);
+      break;
+    case AST_NODE_LIST:
+      gkcc_function_hash_push_node(hasher, node->list.next);
+      gkcc_function_hash_push_node(hasher, node->list.node);
+      break;
+    case AST_NODE_TOP_LEVEL:
+      gkcc_function_hash_push_node(hasher, node->top_level.list);
+      break;
+    case AST_NODE_FUNCTION_CALL:
+      gkcc_function_hash_push_node(hasher, node->function_call.parameters);
+      gkcc_function_hash_push_node(hasher, node->function_call.name);
+      break;
+    case AST_NODE_ENUM_DEFINITION:
+      gkcc_function_hash_push_node(hasher, node->enum_definition.ident);
+      gkcc_function_hash_push_node(hasher, node->enum_definition.enumerators);
+      break;
+    case AST_NODE_STRUCT_OR_UNION_SPECIFIER:
+      gkcc_function_hash_int(hasher, node->struct_or_union_specifier.type);
+      gkcc_function_hash_push_node(hasher,
+                                   node->struct_or_union_specifier.ident);
+      break;
+    case AST_NODE_FOR_LOOP:
+      gkcc_function_hash_int(hasher, node->for_loop.is_do_while);
+      gkcc_function_hash_push_node(hasher, node->for_loop.statements);
+      gkcc_function_hash_push_node(hasher, node->for_loop.expr3);
+      gkcc_function_hash_push_node(hasher, node->for_loop.expr2);
+      gkcc_function_hash_push_node(hasher, node->for_loop.expr1);
+      break;
+    case AST_NODE_IF_STATEMENT:
+      gkcc_function_hash_push_node(hasher, node->if_statement.else_statement);
+      gkcc_function_hash_push_node(hasher, node->if_statement.then_statement);
+      gkcc_function_hash_push_node(hasher, node->if_statement.condition);
+      break;
+    case AST_NODE_MEMBER_ACCESS:
+      gkcc_function_hash_push_node(hasher, node->member_access.identifier);
+      gkcc_function_hash_push_node(hasher,
+                                   node->member_access.struct_or_union);
+      break;
+    case AST_NODE_GOTO_NODE:
+      gkcc_function_hash_push_symbol(hasher, node->goto_node.symbol);
+      gkcc_function_hash_push_node(hasher, node->goto_node.ident);
+      break;
+    case AST_NODE_FUNCTION_RETURN:
+      gkcc_function_hash_push_node(hasher, node->function_return.to_return);
+      break;
+    case AST_NODE_SWITCH_CASE_CASE:
+      gkcc_function_hash_push_node(hasher, node->switch_case_case.statement);
+      gkcc_function_hash_push_node(hasher, node->switch_case_case.expression);
+      break;
+    case AST_NODE_SWITCH_CASE_SWITCH:
+      gkcc_function_hash_push_node(hasher,
+                                   node->switch_case_switch.statements);
+      gkcc_function_hash_push_node(hasher,
+                                   node->switch_case_switch.expression);
+      break;
+  }
+}
+
+// gkcc_function_hash_type hashes a type. Only the signature of function types
+// is hashed, as the statements of a function that is referred to do not
+// change the code that refers to it.
+static void gkcc_function_hash_type(struct gkcc_function_hasher *hasher,
+                                    struct gkcc_type *gkcc_type) {
+  if (gkcc_type == NULL) {
+    gkcc_function_hash_int(hasher, GKCC_FUNCTION_HASH_NULL);
+    return;
+  }
+  if (gkcc_function_hash_seen_before(hasher, gkcc_type)) return;
+
+  gkcc_function_hash_int(hasher, gkcc_type->type);
+  gkcc_function_hash_push_type(hasher, gkcc_type->of);
+  gkcc_function_hash_push_node(hasher, gkcc_type->ident);
+  switch (gkcc_type->type) {
+    case GKCC_TYPE_FUNCTION:
+      gkcc_function_hash_push_type(
+          hasher, gkcc_type->function_declaration.return_type);
+      gkcc_function_hash_push_node(
+          hasher, gkcc_type->function_declaration.parameters);
+      break;
+    case GKCC_TYPE_ARRAY:
+      gkcc_function_hash_push_node(hasher, gkcc_type->array.size);
+      break;
+    case GKCC_TYPE_QUALIFIER:
+      gkcc_function_hash_int(hasher, gkcc_type->qualifier.type);
+      break;
+    case GKCC_TYPE_STORAGE_CLASS_SPECIFIER:
+      gkcc_function_hash_int(hasher, gkcc_type->storage_class_specifier.type);
+      break;
+    case GKCC_TYPE_TYPE_SPECIFIER:
+      gkcc_function_hash_int(hasher, gkcc_type->type_specifier.type);
+      gkcc_function_hash_push_node(hasher, gkcc_type->type_specifier.ident);
+      break;
+    case GKCC_TYPE_STRUCT:
+    case GKCC_TYPE_UNION:
+    case GKCC_TYPE_ENUM: {
+      // The members decide the layout
+      struct gkcc_symbol_table *members =
+          gkcc_type->symbol_table_set != NULL
+              ? gkcc_type->symbol_table_set->general_namespace
+              : NULL;
+      unsigned int member_count = members != NULL ? members->symbol_count : 0;
+      gkcc_function_hash_int(hasher, member_count);
+      for (unsigned int i = member_count; i > 0; i--) {
+        gkcc_function_hash_push_symbol(hasher, members->symbols[i - 1]);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+static void gkcc_function_hash_symbol(struct gkcc_function_hasher *hasher,
+                                      struct gkcc_symbol *symbol) {
+  if (symbol == NULL) {
+    gkcc_function_hash_int(hasher, GKCC_FUNCTION_HASH_NULL);
+    return;
+  }
+  if (gkcc_function_hash_seen_before(hasher, symbol)) return;
+
+  gkcc_function_hash_string(hasher, symbol->symbol_name);
+  gkcc_function_hash_int(hasher, symbol->storage_class);
+  if (symbol->symbol_table_set == NULL) {
+    gkcc_function_hash_int(hasher, GKCC_FUNCTION_HASH_NULL);
+  } else {
+    gkcc_function_hash_int(hasher, symbol->symbol_table_set->scope);
+  }
+  gkcc_function_hash_push_type(hasher, symbol->symbol_type);
+}
+
+// gkcc_function_cache_key computes the key of a function definition. Besides
+// the definition itself, it covers the declarations of everything the
+// definition refers to. Returns false if no key can be made.
+bool gkcc_function_cache_key(struct gkcc_cache_key *key,
+                             struct ast_node *definition) {
+  static const char kind[] = "function";
+  gkcc_cache_key_init(key);
+  gkcc_cache_key_add(key, kind, sizeof(kind) - 1);
+  if (!gkcc_cache_key_add_build_id(key)) return false;
+
+  struct gkcc_function_hasher hasher = {.key = key};
+
+  // The type of the definition only adds its signature, so the statements are
+  // added after it
+  gkcc_function_hash_push_node(
+      &hasher, definition->declaration.type->gkcc_type.gkcc_type
+                   ->function_declaration.statements);
+  gkcc_function_hash_push_node(&hasher, definition);
+
+  while (hasher.count > 0) {
+    struct gkcc_function_hash_item item = hasher.items[--hasher.count];
+    switch (item.type) {
+      case GKCC_FUNCTION_HASH_ITEM_NODE:
+        gkcc_function_hash_node(&hasher, item.node);
+        break;
+      case GKCC_FUNCTION_HASH_ITEM_TYPE:
+        gkcc_function_hash_type(&hasher, item.gkcc_type);
+        break;
+      case GKCC_FUNCTION_HASH_ITEM_SYMBOL:
+        gkcc_function_hash_symbol(&hasher, item.symbol);
+        break;
+    }
+  }
+
+  free(hasher.items);
+  free(hasher.seen);
+  return true;
+}
+
+// ================
+// === ASSEMBLY ===
+// ================
+
+// gkcc_function_cache_relocate writes the assembly of a function to writer
+// with the numbers of its basic block labels and string constants moved by
+// the given amounts
+static void gkcc_function_cache_relocate(struct gkcc_writer *writer,
+                                         const char *assembly, size_t length,
+                                         int basic_block_offset,
+                                         int string_constant_offset) {
+  const char *end = assembly + length;
+  const char *literal = assembly;
+  for (const char *c = assembly; end - c > 4; c++) {
+    int offset;
+    if (memcmp(c, ".BB.", 4) == 0) {
+      offset = basic_block_offset;
+    } else if (memcmp(c, ".STR", 4) == 0) {
+      offset = string_constant_offset;
+    } else {
+      continue;
+    }
+
+    const char *digits = c + 4;
+    const char *digit = digits;
+    long long number = 0;
+    for (; digit != end && isdigit((unsigned char)*digit); digit++) {
+      number = number * 10 + (*digit - '0');
+    }
+    if (digit == digits) continue;
+
+    gkcc_writer_bytes(writer, literal, digits - literal);
+    gkcc_writer_int(writer, number + offset);
+    literal = digit;
+    c = digit - 1;
+  }
+  gkcc_writer_bytes(writer, literal, end - literal);
+}
+
+// gkcc_function_cache_write_assembly writes out a function that was found in
+// the function cache
+void gkcc_function_cache_write_assembly(struct gkcc_writer *writer,
+                                        struct gkcc_ir_function *fn) {
+  gkcc_function_cache_relocate(writer, fn->cached_assembly,
+                               fn->cached_assembly_length,
+                               fn->first_basic_block,
+                               fn->first_string_constant);
+}
+
+// ===============
+// === ENTRIES ===
+// ===============
+
+// gkcc_function_cache_fetch looks up the function definition with the given
+// key. If it is found, it returns a generation state like the one the
+// definition would have been lowered with, with a function that has the
+// cached assembly instead of quads. Returns NULL otherwise.
+struct gkcc_ir_generation_state *gkcc_function_cache_fetch(
+    struct gkcc_cache *cache, struct gkcc_cache_key *key,
+    struct ast_node *definition) {
+  size_t length;
+  char *data = gkcc_cache_read(cache, key, &length);
+  if (data == NULL) return NULL;
+
+  struct gkcc_function_cache_header header;
+  if (length < sizeof(header)) {
+    free(data);
+    return NULL;
+  }
+  memcpy(&header, data, sizeof(header));
+  size_t offset = sizeof(header);
+  if (header.basic_block_count < 0 || header.string_constant_count < 0 ||
+      (length - offset) / sizeof(uint32_t) <
+          (size_t)header.string_constant_count) {
+    free(data);
+    return NULL;
+  }
+
+  // The entry has to live as long as the IR
+  char *entry = gkcc_arena_alloc(gkcc_arena_tu(), length + 1);
+  memcpy(entry, data, length);
+  free(data);
+
+  struct gkcc_ir_generation_state *gen_state = gkcc_ir_generation_state_new();
+  struct gkcc_ir_function *fn =
+      gkcc_ir_function_new(definition->declaration.identifier->ident.name);
+  gen_state->current_function = fn;
+  fn->basic_block_count = header.basic_block_count;
+  fn->cache_key = key;
+
+  const char *string_lengths = &entry[offset];
+  offset += header.string_constant_count * sizeof(uint32_t);
+  for (int i = 0; i < header.string_constant_count; i++) {
+    uint32_t string_length;
+    memcpy(&string_length, &string_lengths[i * sizeof(uint32_t)],
+           sizeof(string_length));
+    if (length - offset < string_length) {
+      gkcc_ir_generation_state_free(gen_state);
+      return NULL;
+    }
+
+    struct ystring *ystring =
+        gkcc_arena_alloc(gkcc_arena_tu(), sizeof(struct ystring));
+    ystring->raw = &entry[offset];
+    ystring->length = string_length;
+    offset += string_length;
+
+    struct gkcc_ir_symbol *is = gkcc_ir_symbol_new(
+        gkcc_symbol_new(NULL, GKCC_STORAGE_CLASS_INVALID, NULL, 0, ""), true);
+    is->ystring = ystring;
+    gen_state->string_constants =
+        gkcc_ir_symbol_list_append(gen_state->string_constants, is);
+    gen_state->current_string_constant_number++;
+  }
+
+  fn->cached_assembly = &entry[offset];
+  fn->cached_assembly_length = length - offset;
+  return gen_state;
+}
+
+// gkcc_function_cache_store stores the assembly generated for fn under its
+// cache key
+void gkcc_function_cache_store(struct gkcc_cache *cache,
+                               struct gkcc_ir_function *fn,
+                               const char *assembly, size_t length) {
+  struct gkcc_function_cache_header header = {
+      .basic_block_count = fn->basic_block_count,
+  };
+  for (struct gkcc_ir_symbol_list *slist = fn->string_constants;
+       slist != NULL; slist = slist->next) {
+    header.string_constant_count++;
+  }
+
+  struct gkcc_writer *entry = gkcc_writer_new(NULL);
+  gkcc_writer_bytes(entry, (const char *)&header, sizeof(header));
+  for (struct gkcc_ir_symbol_list *slist = fn->string_constants;
+       slist != NULL; slist = slist->next) {
+    uint32_t string_length = slist->symbol->ystring->length;
+    gkcc_writer_bytes(entry, (const char *)&string_length,
+                      sizeof(string_length));
+  }
+  for (struct gkcc_ir_symbol_list *slist = fn->string_constants;
+       slist != NULL; slist = slist->next) {
+    gkcc_writer_bytes(entry, slist->symbol->ystring->raw,
+                      slist->symbol->ystring->length);
+  }
+  gkcc_function_cache_relocate(entry, assembly, length,
+                               -fn->first_basic_block,
+                               -fn->first_string_constant);
+
+  gkcc_cache_store(cache, fn->cache_key, entry->buffer, entry->used);
+  gkcc_writer_free(entry);
+}
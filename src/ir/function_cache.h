@@ -0,0 +1,55 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GKCC_FUNCTION_CACHE_H
+#define GKCC_FUNCTION_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ast/ast.h"
+#include "ir/ir_base.h"
+#include "ir/quads.h"
+#include "misc/cache.h"
+#include "misc/writer.h"
+
+// The function cache keeps the assembly of single function definitions in the
+// compile cache, so that a translation unit in which only some functions have
+// changed only has to lower and generate code for those. A function is keyed
+// by a hash of its AST and of the symbols and types it refers to, which
+// covers the signatures of the globals and functions it uses and the layout of
+// every struct it touches.
+//
+// Basic block labels and string constants are numbered across the whole
+// translation unit, so the assembly is stored as if they were numbered from 0
+// in every function and renumbered when it is spliced back in. An entry also
+// keeps the number of basic blocks of the function and its string constants,
+// so that a function found in the cache takes up the same numbers as one that
+// was lowered.
+
+// === FUNCTION DECLARATIONS ===
+
+bool gkcc_function_cache_key(struct gkcc_cache_key *key,
+                             struct ast_node *definition);
+struct gkcc_ir_generation_state *gkcc_function_cache_fetch(
+    struct gkcc_cache *cache, struct gkcc_cache_key *key,
+    struct ast_node *definition);
+void gkcc_function_cache_store(struct gkcc_cache *cache,
+                               struct gkcc_ir_function *fn,
+                               const char *assembly, size_t length);
+void gkcc_function_cache_write_assembly(struct gkcc_writer *writer,
+                                        struct gkcc_ir_function *fn);
+
+#endif  // GKCC_FUNCTION_CACHE_H
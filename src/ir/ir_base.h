@@ -2,17 +2,32 @@
 #define GKCC_IR_BASE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 // =======================================
 // === struct gkcc_ir_generation_state ===
 // =======================================
 
+// Every function is lowered with a generation state of its own, so functions
+// can be lowered concurrently. The basic blocks, pseudoregisters and string
+// constants created for a function are numbered in creation order and given
+// their final numbers by gkcc_ir_build_full() afterwards, continuing from the
+// function before it in the source.
 struct gkcc_ir_generation_state {
   int current_pseudoregister_number;
   int current_basic_block_number;
   int current_string_constant_number;
   struct gkcc_ir_function *current_function;
   struct gkcc_ir_full *ir_full;
+
+  struct gkcc_basic_block **basic_blocks;
+  int basic_blocks_capacity;
+  // operand_pool is a hash table of the constant, symbol and basic block
+  // registers of the function
+  struct gkcc_ir_quad_register **operand_pool;
+  size_t operand_pool_count;
+  size_t operand_pool_capacity;
+  struct gkcc_ir_symbol_list *string_constants;
 };
 
 // =============================
@@ -17,21 +17,233 @@
 
 #include <malloc.h>
 #include <memory.h>
+#include <pthread.h>
 
+#include "ast/types.h"
 #include "ir/basic_block.h"
+#include "ir/function_cache.h"
 #include "ir/quads.h"
+#include "misc/arena.h"
+#include "misc/intern.h"
+#include "misc/parallel.h"
+
+// gkcc_ir_full_parallel_run is the state of one gkcc_ir_full_parallel_for.
+// Every worker allocates from an arena of its own, so allocations do not
+// contend. The calling thread, which is worker 0, keeps using the translation
+// unit arena, and the arenas of the other workers are merged into it after
+// the join.
+struct gkcc_ir_full_parallel_run {
+  void (*fn)(void *context, size_t index);
+  void *context;
+  struct gkcc_arena **arenas;
+  struct gkcc_type_table *types;
+};
+
+static void gkcc_ir_full_parallel_item(void *context, size_t worker,
+                                       size_t index) {
+  struct gkcc_ir_full_parallel_run *run = context;
+  gkcc_arena_tu_join(run->arenas[worker]);
+  gkcc_type_canonical_join(run->types);
+  run->fn(run->context, index);
+  gkcc_arena_tu_join(NULL);
+  gkcc_type_canonical_join(NULL);
+}
+
+// gkcc_ir_full_parallel_for calls fn(context, index) for every index below
+// count using gkcc_parallel_for. fn may allocate from the translation unit
+// arena and create canonical types of the calling thread. Canonical types are
+// guarded by a lock until every call has returned.
+void gkcc_ir_full_parallel_for(size_t count,
+                               void (*fn)(void *context, size_t index),
+                               void *context) {
+  size_t workers = gkcc_parallel_worker_count(count);
+  struct gkcc_arena **arenas = malloc(workers * sizeof(struct gkcc_arena *));
+  gkcc_assert(arenas != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate worker arenas");
+  arenas[0] = gkcc_arena_tu();
+  for (size_t i = 1; i < workers; i++) arenas[i] = gkcc_arena_new();
+
+  pthread_mutexattr_t attributes;
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_t lock;
+  pthread_mutex_init(&lock, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+
+  struct gkcc_ir_full_parallel_run run = {
+      .fn = fn,
+      .context = context,
+      .arenas = arenas,
+      .types = gkcc_type_canonical_share(workers > 1 ? &lock : NULL),
+  };
+  gkcc_parallel_for(count, gkcc_ir_full_parallel_item, &run);
+
+  gkcc_type_canonical_share(NULL);
+  pthread_mutex_destroy(&lock);
+  for (size_t i = 1; i < workers; i++) gkcc_arena_merge(arenas[0], arenas[i]);
+  free(arenas);
+}
+
+static bool gkcc_ir_full_is_function_definition(struct ast_node *tnode) {
+  struct gkcc_type *type = tnode->declaration.type->gkcc_type.gkcc_type;
+  return type->type == GKCC_TYPE_FUNCTION &&
+         type->function_declaration.statements != NULL;
+}
+
+// gkcc_ir_full_cache_key returns the function cache key of a definition, or
+// NULL if the function cache is not used
+static struct gkcc_cache_key *gkcc_ir_full_cache_key(
+    struct gkcc_ir_full *ir_full, struct ast_node *definition) {
+  if (ir_full->cache == NULL) return NULL;
+
+  struct gkcc_cache_key *key =
+      gkcc_arena_alloc(gkcc_arena_tu(), sizeof(struct gkcc_cache_key));
+  return gkcc_function_cache_key(key, definition) ? key : NULL;
+}
+
+// gkcc_ir_full_lowering holds the function definitions of the translation
+// unit and the generation state each one was lowered with. Definitions found
+// in the function cache already have their generation state before the rest
+// are lowered.
+struct gkcc_ir_full_lowering {
+  struct gkcc_ir_full *ir_full;
+  struct ast_node **definitions;
+  struct gkcc_cache_key **keys;
+  struct gkcc_ir_generation_state **gen_states;
+};
+
+static void gkcc_ir_full_key_function(void *context, size_t index) {
+  struct gkcc_ir_full_lowering *lowering = context;
+  lowering->keys[index] = gkcc_ir_full_cache_key(
+      lowering->ir_full, lowering->definitions[index]);
+}
+
+static void gkcc_ir_full_lower_function(void *context, size_t index) {
+  struct gkcc_ir_full_lowering *lowering = context;
+  if (lowering->gen_states[index] != NULL) return;
+
+  struct gkcc_ir_generation_state *gen_state = gkcc_ir_generation_state_new();
+  lowering->gen_states[index] = gen_state;
+  gkcc_internal_build_basic_blocks_for_function(gen_state,
+                                                lowering->definitions[index]);
+  gen_state->current_function->cache_key = lowering->keys[index];
+}
+
+// gkcc_ir_full_number_function gives the basic blocks, pseudoregisters and
+// string constants of a lowered function the numbers they would have gotten
+// had every function been lowered in order with ir_full->gen_state.
+static void gkcc_ir_full_number_function(
+    struct gkcc_ir_full *ir_full, struct gkcc_ir_generation_state *fn_state) {
+  struct gkcc_ir_generation_state *gen_state = ir_full->gen_state;
+  struct gkcc_ir_function *fn = fn_state->current_function;
+
+  // Functions from the function cache only have a basic block count
+  fn->first_basic_block = gen_state->current_basic_block_number;
+  gen_state->current_basic_block_number += fn->basic_block_count;
+  for (int i = 0; i < fn_state->current_basic_block_number; i++) {
+    gkcc_basic_block_set_number(fn_state->basic_blocks[i],
+                                fn->first_basic_block + i);
+  }
+
+  fn->first_pseudoregister = gen_state->current_pseudoregister_number;
+  gen_state->current_pseudoregister_number +=
+      fn_state->current_pseudoregister_number;
+
+  fn->first_string_constant = gen_state->current_string_constant_number;
+  fn->string_constants = fn_state->string_constants;
+  for (struct gkcc_ir_symbol_list *slist = fn_state->string_constants;
+       slist != NULL; slist = slist->next) {
+    char buf[(1 << 12) + 1];
+    sprintf(buf, ".STR%d", gen_state->current_string_constant_number++);
+    slist->symbol->symbol->symbol_name = gkcc_intern_cstr(buf);
+  }
+}
+
+// gkcc_ir_full_lower_definition lowers a single function definition and
+// numbers it after everything lowered into ir_full before. The function and
+// its string constants are left in the returned generation state instead of
+// being added to ir_full, so that they can be emitted and released right away.
+// A definition found in the function cache is not lowered at all.
+struct gkcc_ir_generation_state *gkcc_ir_full_lower_definition(
+    struct gkcc_ir_full *ir_full, struct ast_node *definition) {
+  gkcc_assert(gkcc_ir_full_is_function_definition(definition),
+              GKCC_ERROR_INVALID_ARGUMENTS,
+              "gkcc_ir_full_lower_definition() got a node that is not a "
+              "function definition");
+
+  struct gkcc_cache_key *key = gkcc_ir_full_cache_key(ir_full, definition);
+  struct gkcc_ir_generation_state *gen_state =
+      key != NULL ? gkcc_function_cache_fetch(ir_full->cache, key, definition)
+                  : NULL;
+  if (gen_state == NULL) {
+    gen_state = gkcc_ir_generation_state_new();
+    gkcc_internal_build_basic_blocks_for_function(gen_state, definition);
+    gen_state->current_function->cache_key = key;
+  }
+  gen_state->ir_full = ir_full;
+  gkcc_ir_full_number_function(ir_full, gen_state);
+  return gen_state;
+}
 
-struct gkcc_ir_full *gkcc_ir_build_full(struct ast_node *node) {
+// gkcc_ir_build_full lowers a whole translation unit. If cache is set, it is
+// used as the function cache and only the functions that are not found there
+// are lowered.
+struct gkcc_ir_full *gkcc_ir_build_full(struct ast_node *node,
+                                        struct gkcc_cache *cache) {
   gkcc_assert(node->type == AST_NODE_TOP_LEVEL, GKCC_ERROR_INVALID_ARGUMENTS,
               "gkcc_basic_block_build_basic_blocks() got a node "
               "that is not of type AST_NODE_TOP_LEVEL");
 
-  struct gkcc_ir_generation_state *gen_state = gkcc_ir_generation_state_new();
   struct gkcc_ir_full *ir_full = gkcc_ir_full_new();
-  ir_full->gen_state = gen_state;
-  gen_state->ir_full = ir_full;
+  ir_full->cache = cache;
+
+  // Collect all function definitions. Declarations without a definition are
+  // skipped.
+  size_t definition_count = 0;
+  for (struct ast_node *lnode = node->top_level.list; lnode != NULL;
+       lnode = lnode->list.next) {
+    struct ast_node *tnode = lnode->list.node;
+    if (tnode->type == AST_NODE_DECLARATION &&
+        gkcc_ir_full_is_function_definition(tnode)) {
+      definition_count++;
+    }
+  }
+
+  struct gkcc_ir_full_lowering lowering = {
+      .ir_full = ir_full,
+      .definitions = malloc(definition_count * sizeof(struct ast_node *)),
+      .keys = calloc(definition_count, sizeof(struct gkcc_cache_key *)),
+      .gen_states =
+          calloc(definition_count, sizeof(struct gkcc_ir_generation_state *)),
+  };
+  size_t definition_index = 0;
+  for (struct ast_node *lnode = node->top_level.list; lnode != NULL;
+       lnode = lnode->list.next) {
+    struct ast_node *tnode = lnode->list.node;
+    if (tnode->type == AST_NODE_DECLARATION &&
+        gkcc_ir_full_is_function_definition(tnode)) {
+      lowering.definitions[definition_index++] = tnode;
+    }
+  }
+
+  // Look every function up in the function cache. The keys are computed in
+  // parallel, but the cache is read from this thread only.
+  if (cache != NULL) {
+    gkcc_ir_full_parallel_for(definition_count, gkcc_ir_full_key_function,
+                              &lowering);
+    for (size_t i = 0; i < definition_count; i++) {
+      if (lowering.keys[i] == NULL) continue;
+      lowering.gen_states[i] = gkcc_function_cache_fetch(
+          cache, lowering.keys[i], lowering.definitions[i]);
+    }
+  }
 
-  // Go through and process all function definitions
+  // Functions are independent of each other, so they are lowered in parallel
+  gkcc_ir_full_parallel_for(definition_count, gkcc_ir_full_lower_function,
+                            &lowering);
+
+  // Number everything and build the lists in source order
+  definition_index = 0;
   for (struct ast_node *lnode = node->top_level.list; lnode != NULL;
        lnode = lnode->list.next) {
     struct ast_node *tnode = lnode->list.node;
@@ -45,14 +257,20 @@ struct gkcc_ir_full *gkcc_ir_build_full(struct ast_node *node) {
     if (tnode->declaration.type->gkcc_type.gkcc_type->type ==
         GKCC_TYPE_FUNCTION) {
       // Skip functions without a definition
-      if (tnode->declaration.type->gkcc_type.gkcc_type->function_declaration
-              .statements == NULL) {
+      if (!gkcc_ir_full_is_function_definition(tnode)) {
         continue;
       }
-      struct gkcc_ir_function *fn =
-          gkcc_internal_build_basic_blocks_for_function(gen_state, tnode);
-      ir_full->function_list =
-          gkcc_ir_function_list_append(ir_full->function_list, fn);
+      struct gkcc_ir_generation_state *fn_state =
+          lowering.gen_states[definition_index++];
+      gkcc_ir_full_number_function(ir_full, fn_state);
+      ir_full->function_list = gkcc_ir_function_list_append(
+          ir_full->function_list, fn_state->current_function);
+      for (struct gkcc_ir_symbol_list *slist = fn_state->string_constants;
+           slist != NULL; slist = slist->next) {
+        ir_full->global_symbols =
+            gkcc_ir_symbol_list_append(ir_full->global_symbols, slist->symbol);
+      }
+      gkcc_ir_generation_state_free(fn_state);
       continue;
     }
 
@@ -64,6 +282,9 @@ struct gkcc_ir_full *gkcc_ir_build_full(struct ast_node *node) {
             tnode->declaration.identifier->ident.symbol_table_entry, false));
   }
 
+  free(lowering.definitions);
+  free(lowering.keys);
+  free(lowering.gen_states);
   return ir_full;
 }
 
@@ -71,17 +292,20 @@ struct gkcc_ir_full *gkcc_ir_full_new(void) {
   struct gkcc_ir_full *ir_full = malloc(sizeof(struct gkcc_ir_full));
   memset(ir_full, 0, sizeof(struct gkcc_ir_full));
 
+  ir_full->gen_state = gkcc_ir_generation_state_new();
+  ir_full->gen_state->ir_full = ir_full;
+
   return ir_full;
 }
 struct gkcc_ir_function_list *gkcc_ir_function_list_append(
     struct gkcc_ir_function_list *fn_list, struct gkcc_ir_function *fn) {
+  struct gkcc_ir_function_list *node = gkcc_ir_function_list_new(fn);
   if (fn_list == NULL) {
-    return gkcc_ir_function_list_new(fn);
+    return node;
   }
 
-  struct gkcc_ir_function_list *end;
-  for (end = fn_list; end->next != NULL; end = end->next);
-  end->next = gkcc_ir_function_list_new(fn);
+  fn_list->end->next = node;
+  fn_list->end = node;
 
   return fn_list;
 }
@@ -89,42 +313,42 @@ struct gkcc_ir_function_list *gkcc_ir_function_list_append(
 struct gkcc_ir_function_list *gkcc_ir_function_list_new(
     struct gkcc_ir_function *fn) {
   struct gkcc_ir_function_list *fn_list =
-      malloc(sizeof(struct gkcc_ir_function_list));
-  memset(fn_list, 0, sizeof(struct gkcc_ir_function_list));
+      gkcc_arena_alloc(gkcc_arena_tu(), sizeof(struct gkcc_ir_function_list));
 
   fn_list->fn = fn;
+  fn_list->end = fn_list;
 
   return fn_list;
 }
 
 struct gkcc_ir_symbol_list *gkcc_ir_symbol_list_append(
     struct gkcc_ir_symbol_list *list, struct gkcc_ir_symbol *symbol) {
+  struct gkcc_ir_symbol_list *node = gkcc_ir_symbol_list_new(symbol);
   if (list == NULL) {
-    return gkcc_ir_symbol_list_new(symbol);
+    return node;
   }
 
-  struct gkcc_ir_symbol_list *end;
-  for (end = list; end->next != NULL; end = end->next);
-
-  end->next = gkcc_ir_symbol_list_new(symbol);
+  list->end->next = node;
+  list->end = node;
 
   return list;
 }
 
 struct gkcc_ir_symbol_list *gkcc_ir_symbol_list_new(
     struct gkcc_ir_symbol *symbol) {
-  struct gkcc_ir_symbol_list *list = malloc(sizeof(struct gkcc_ir_symbol_list));
-  memset(list, 0, sizeof(struct gkcc_ir_symbol_list));
+  struct gkcc_ir_symbol_list *list =
+      gkcc_arena_alloc(gkcc_arena_tu(), sizeof(struct gkcc_ir_symbol_list));
 
   list->symbol = symbol;
+  list->end = list;
 
   return list;
 }
 
 struct gkcc_ir_symbol *gkcc_ir_symbol_new(struct gkcc_symbol *gs,
                                           bool is_global) {
-  struct gkcc_ir_symbol *is = malloc(sizeof(struct gkcc_ir_symbol));
-  memset(is, 0, sizeof(struct gkcc_ir_symbol));
+  struct gkcc_ir_symbol *is =
+      gkcc_arena_alloc(gkcc_arena_tu(), sizeof(struct gkcc_ir_symbol));
 
   is->symbol = gs;
   is->is_global = is_global;
@@ -132,36 +356,46 @@ struct gkcc_ir_symbol *gkcc_ir_symbol_new(struct gkcc_symbol *gs,
   return is;
 }
 
-void gkcc_ir_full_print(struct gkcc_ir_full *ir_full) {
-  // List of printed basic blocks
-  bool printed_bbs[ir_full->gen_state->current_basic_block_number];
-  memset(printed_bbs, 0, sizeof(printed_bbs));
-
+void gkcc_ir_full_print(struct gkcc_writer *writer,
+                        struct gkcc_ir_full *ir_full) {
   // Print all global declarations
   for (struct gkcc_ir_symbol_list *slist = ir_full->global_symbols;
        slist != NULL; slist = slist->next) {
+    const char *symbol_name = slist->symbol->symbol->symbol_name;
     if (slist->symbol->ystring != NULL) {
       // This is a string
-      char buf[(1 << 12) + 1];
-      sprint_escaped_string(buf, slist->symbol->ystring->raw,
-                            slist->symbol->ystring->length);
-      printf("%s:\n", slist->symbol->symbol->symbol_name);
-      printf("\t.string \"%s\"\n", buf);
+      gkcc_writer_str(writer, symbol_name);
+      gkcc_writer_str(writer, ":\n\t.string \"");
+      gkcc_writer_escaped(writer, slist->symbol->ystring->raw,
+                          slist->symbol->ystring->length);
+      gkcc_writer_str(writer, "\"\n");
       continue;
     }
-    printf(".comm global:%s, %d, 4\n", slist->symbol->symbol->symbol_name,
-           gkcc_type_sizeof(slist->symbol->symbol->symbol_type));
+    struct gkcc_type_layout layout =
+        gkcc_ir_quad_storage_layout(slist->symbol->symbol->symbol_type);
+    gkcc_writer_str(writer, ".comm global:");
+    gkcc_writer_str(writer, symbol_name);
+    gkcc_writer_str(writer, ", ");
+    gkcc_writer_int(writer, layout.size);
+    gkcc_writer_str(writer, ", ");
+    gkcc_writer_int(writer, layout.align);
+    gkcc_writer_char(writer, '\n');
   }
 
-  printf("\n");
+  gkcc_writer_char(writer, '\n');
 
   // Print all functions
   for (struct gkcc_ir_function_list *fn_list = ir_full->function_list;
        fn_list != NULL; fn_list = fn_list->next) {
     struct gkcc_ir_function *fn = fn_list->fn;
-    printf("FN_%s:\n", fn->function_name);
+    gkcc_writer_str(writer, "FN_");
+    gkcc_writer_str(writer, fn->function_name);
+    gkcc_writer_str(writer, ":\n");
 
     // Print all BBs
-    gkcc_basic_block_print(printed_bbs, fn->entrance_basic_block);
+    for (int i = 0; i < fn->block_order_count; i++) {
+      gkcc_basic_block_print(writer, fn,
+                             fn->basic_blocks[fn->block_order[i]]);
+    }
   }
 }
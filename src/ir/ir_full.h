@@ -18,14 +18,18 @@
 
 #include "ir/ir_base.h"
 #include "ir/quads.h"
+#include "misc/cache.h"
 
 // ====================================
 // === struct gkcc_ir_function_list ===
 // ====================================
 
+// The first node of a function list doubles as its handle. Its end points to
+// the last node so that appending takes constant time.
 struct gkcc_ir_function_list {
   struct gkcc_ir_function *fn;
   struct gkcc_ir_function_list *next;
+  struct gkcc_ir_function_list *end;
 };
 
 // ===========================
@@ -36,6 +40,8 @@ struct gkcc_ir_full {
   struct gkcc_ir_function_list *function_list;
   struct gkcc_ir_symbol_list *global_symbols;
   struct gkcc_ir_generation_state *gen_state;
+  // cache, if set, is used as the function cache. See ir/function_cache.h.
+  struct gkcc_cache *cache;
 };
 
 // =============================
@@ -44,7 +50,15 @@ struct gkcc_ir_full {
 
 struct gkcc_ir_full *gkcc_ir_full_new(void);
 
-struct gkcc_ir_full *gkcc_ir_build_full(struct ast_node *node);
+struct gkcc_ir_full *gkcc_ir_build_full(struct ast_node *node,
+                                        struct gkcc_cache *cache);
+
+struct gkcc_ir_generation_state *gkcc_ir_full_lower_definition(
+    struct gkcc_ir_full *ir_full, struct ast_node *definition);
+
+void gkcc_ir_full_parallel_for(size_t count,
+                               void (*fn)(void *context, size_t index),
+                               void *context);
 
 struct gkcc_ir_function_list *gkcc_ir_function_list_append(
     struct gkcc_ir_function_list *fn_list, struct gkcc_ir_function *fn);
@@ -52,7 +66,8 @@ struct gkcc_ir_function_list *gkcc_ir_function_list_append(
 struct gkcc_ir_function_list *gkcc_ir_function_list_new(
     struct gkcc_ir_function *fn);
 
-void gkcc_ir_full_print(struct gkcc_ir_full *ir_full);
+void gkcc_ir_full_print(struct gkcc_writer *writer,
+                        struct gkcc_ir_full *ir_full);
 
 struct gkcc_ir_symbol_list *gkcc_ir_symbol_list_new(
     struct gkcc_ir_symbol *symbol);
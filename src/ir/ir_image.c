@@ -0,0 +1,755 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "ir/ir_image.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ast/types.h"
+#include "ir/basic_block.h"
+#include "misc/arena.h"
+#include "misc/cache.h"
+#include "misc/misc.h"
+#include "misc/writer.h"
+#include "scope/scope.h"
+
+// ==================================
+// === struct gkcc_ir_image_table ===
+// ==================================
+
+struct gkcc_ir_image_slot {
+  const void *pointer;
+  int index;
+};
+
+// gkcc_ir_image_table collects the records of the types, symbols or constants
+// that the operands being written out refer to. slots is an open addressing
+// hash table (linear probing) from the pointer a record was made from to its
+// index, which is kept at most half full.
+struct gkcc_ir_image_table {
+  char *records;
+  size_t record_size;
+  int count;
+  int capacity;
+
+  struct gkcc_ir_image_slot *slots;
+  size_t slot_capacity;
+};
+
+// gkcc_ir_image_builder is the state of writing out an image. The image is
+// collected in memory since the header, which comes first, is only known at
+// the end.
+struct gkcc_ir_image_builder {
+  struct gkcc_writer *image;
+  struct gkcc_writer *strings;
+  struct gkcc_ir_image_table types;
+  struct gkcc_ir_image_table symbols;
+  struct gkcc_ir_image_table constants;
+};
+
+static size_t gkcc_ir_image_slot(const void *pointer, size_t capacity) {
+  return (size_t)(((uintptr_t)pointer * 0x9e3779b97f4a7c15ULL) >> 32) &
+         (capacity - 1);
+}
+
+static void gkcc_ir_image_table_grow_slots(struct gkcc_ir_image_table *table) {
+  size_t new_capacity =
+      table->slot_capacity == 0 ? 256 : table->slot_capacity * 2;
+  struct gkcc_ir_image_slot *new_slots =
+      calloc(new_capacity, sizeof(struct gkcc_ir_image_slot));
+  gkcc_assert(new_slots != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to grow an IR image table");
+
+  for (size_t i = 0; i < table->slot_capacity; i++) {
+    if (table->slots[i].pointer == NULL) continue;
+
+    size_t slot = gkcc_ir_image_slot(table->slots[i].pointer, new_capacity);
+    while (new_slots[slot].pointer != NULL) {
+      slot = (slot + 1) & (new_capacity - 1);
+    }
+    new_slots[slot] = table->slots[i];
+  }
+  free(table->slots);
+  table->slots = new_slots;
+  table->slot_capacity = new_capacity;
+}
+
+// gkcc_ir_image_table_add returns the index of the record made from pointer.
+// If there is none yet, a zeroed record is added for the caller to fill in and
+// *is_new is set.
+static int gkcc_ir_image_table_add(struct gkcc_ir_image_table *table,
+                                   const void *pointer, bool *is_new) {
+  if ((size_t)(table->count + 1) * 2 > table->slot_capacity) {
+    gkcc_ir_image_table_grow_slots(table);
+  }
+
+  size_t slot = gkcc_ir_image_slot(pointer, table->slot_capacity);
+  for (; table->slots[slot].pointer != NULL;
+       slot = (slot + 1) & (table->slot_capacity - 1)) {
+    if (table->slots[slot].pointer == pointer) {
+      *is_new = false;
+      return table->slots[slot].index;
+    }
+  }
+
+  if (table->count == table->capacity) {
+    table->capacity = table->capacity == 0 ? 64 : table->capacity * 2;
+    table->records =
+        realloc(table->records, table->capacity * table->record_size);
+    gkcc_assert(table->records != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                "Failed to grow an IR image table");
+  }
+  memset(&table->records[table->count * table->record_size], 0,
+         table->record_size);
+  table->slots[slot] =
+      (struct gkcc_ir_image_slot){.pointer = pointer, .index = table->count};
+  *is_new = true;
+  return table->count++;
+}
+
+static void *gkcc_ir_image_table_record(struct gkcc_ir_image_table *table,
+                                        int index) {
+  return &table->records[index * table->record_size];
+}
+
+static void gkcc_ir_image_table_free(struct gkcc_ir_image_table *table) {
+  free(table->records);
+  free(table->slots);
+}
+
+// ===================
+// === WRITING OUT ===
+// ===================
+
+// gkcc_ir_image_append appends data to the image at the next multiple of
+// GKCC_IR_IMAGE_ALIGN and returns its offset
+static uint32_t gkcc_ir_image_append(struct gkcc_writer *image,
+                                     const void *data, size_t length) {
+  static const char padding[GKCC_IR_IMAGE_ALIGN];
+  gkcc_writer_bytes(image, padding, -image->used & (GKCC_IR_IMAGE_ALIGN - 1));
+  size_t offset = image->used;
+  gkcc_writer_bytes(image, data, length);
+  gkcc_assert(image->used <= UINT32_MAX, GKCC_ERROR_NOT_YET_IMPLEMENTED,
+              "IR images larger than 4 GiB are not supported");
+  return offset;
+}
+
+// gkcc_ir_image_string adds length bytes of data and a NUL byte to the string
+// table and returns their offset in it
+static uint32_t gkcc_ir_image_string(struct gkcc_ir_image_builder *builder,
+                                     const char *data, size_t length) {
+  size_t offset = builder->strings->used;
+  gkcc_writer_bytes(builder->strings, data, length);
+  gkcc_writer_char(builder->strings, '\0');
+  return offset;
+}
+
+static int gkcc_ir_image_add_type(struct gkcc_ir_image_builder *builder,
+                                  struct gkcc_type *type) {
+  if (type == NULL) return -1;
+
+  bool is_new = false;
+  int index = gkcc_ir_image_table_add(&builder->types, type, &is_new);
+  if (!is_new) return index;
+
+  int of = gkcc_ir_image_add_type(builder, type->of);
+  struct gkcc_ir_image_type *record =
+      gkcc_ir_image_table_record(&builder->types, index);
+  record->type = type->type;
+  record->of = of;
+  if (gkcc_type_layout_is_known(type)) {
+    struct gkcc_type_layout layout = gkcc_type_layout(type);
+    record->has_layout = true;
+    record->size = layout.size;
+    record->align = layout.align;
+  }
+  return index;
+}
+
+static int gkcc_ir_image_add_symbol(struct gkcc_ir_image_builder *builder,
+                                    struct gkcc_ir_symbol *ir_symbol) {
+  struct gkcc_symbol *symbol = ir_symbol->symbol;
+  bool is_new = false;
+  int index = gkcc_ir_image_table_add(&builder->symbols, symbol, &is_new);
+  if (!is_new) return index;
+
+  int type = gkcc_ir_image_add_type(builder, symbol->symbol_type);
+  uint32_t symbol_name = gkcc_ir_image_string(builder, symbol->symbol_name,
+                                              strlen(symbol->symbol_name));
+  struct gkcc_ir_image_symbol *record =
+      gkcc_ir_image_table_record(&builder->symbols, index);
+  record->symbol_name = symbol_name;
+  record->offset = symbol->offset;
+  record->type = type;
+  record->string_length = -1;
+  if (ir_symbol->ystring != NULL) {
+    uint32_t string = gkcc_ir_image_string(builder, ir_symbol->ystring->raw,
+                                           ir_symbol->ystring->length);
+    record = gkcc_ir_image_table_record(&builder->symbols, index);
+    record->string = string;
+    record->string_length = ir_symbol->ystring->length;
+  }
+  return index;
+}
+
+static int gkcc_ir_image_add_constant(struct gkcc_ir_image_builder *builder,
+                                      struct ast_constant *constant) {
+  bool is_new = false;
+  int index = gkcc_ir_image_table_add(&builder->constants, constant, &is_new);
+  if (!is_new) return index;
+
+  uint32_t string = 0;
+  if (constant->type == AST_CONSTANT_STRING) {
+    string = gkcc_ir_image_string(builder, constant->ystring.raw,
+                                  constant->ystring.length);
+  }
+  struct gkcc_ir_image_constant *record =
+      gkcc_ir_image_table_record(&builder->constants, index);
+  record->constant = *constant;
+  if (constant->type == AST_CONSTANT_STRING) {
+    record->constant.ystring.raw = NULL;
+    record->string = string;
+  }
+  return index;
+}
+
+static struct gkcc_ir_image_operand gkcc_ir_image_operand(
+    struct gkcc_ir_image_builder *builder, struct gkcc_ir_function *fn,
+    int operand) {
+  union gkcc_ir_operand_value *value = &fn->operands.values[operand];
+  struct gkcc_ir_image_operand record = {
+      .type = gkcc_ir_image_add_type(builder, fn->operands.types[operand])};
+  switch (fn->operands.kinds[operand]) {
+    case GKCC_IR_QUAD_REGISTER_PSEUDOREGISTER:
+      record.value = value->pseudoregister.register_num;
+      record.extra = value->pseudoregister.offset;
+      break;
+    case GKCC_IR_QUAD_REGISTER_SYMBOL:
+      record.value = gkcc_ir_image_add_symbol(builder, &value->symbol);
+      record.extra = value->symbol.is_global;
+      break;
+    case GKCC_IR_QUAD_REGISTER_CONSTANT:
+      record.value = gkcc_ir_image_add_constant(builder, value->constant);
+      break;
+    case GKCC_IR_QUAD_REGISTER_BASIC_BLOCK:
+      record.value = value->basic_block;
+      break;
+  }
+  return record;
+}
+
+static struct gkcc_ir_image_function gkcc_ir_image_write_function(
+    struct gkcc_ir_image_builder *builder, struct gkcc_ir_function *fn) {
+  gkcc_assert(fn->cached_assembly == NULL, GKCC_ERROR_INVALID_ARGUMENTS,
+              "Functions from the function cache have no IR to write out");
+
+  struct gkcc_ir_image_function record = {
+      .function_name = gkcc_ir_image_string(builder, fn->function_name,
+                                            strlen(fn->function_name)),
+      .required_space_for_locals = fn->required_space_for_locals,
+      .first_basic_block = fn->first_basic_block,
+      .first_pseudoregister = fn->first_pseudoregister,
+      .basic_block_count = fn->basic_block_count,
+      .block_order_count = fn->block_order_count,
+      .quad_count = fn->quad_count,
+      .operand_count = fn->operands.count,
+  };
+
+  struct gkcc_ir_image_basic_block *basic_blocks = malloc(
+      fn->basic_block_count * sizeof(struct gkcc_ir_image_basic_block));
+  for (int i = 0; i < fn->basic_block_count; i++) {
+    struct gkcc_basic_block *bb = fn->basic_blocks[i];
+    basic_blocks[i] = (struct gkcc_ir_image_basic_block){
+        .bb_name = gkcc_ir_image_string(builder, bb->bb_name,
+                                        strlen(bb->bb_name)),
+        .first_quad = bb->first_quad,
+        .quad_count = bb->quad_count,
+    };
+  }
+  record.basic_blocks = gkcc_ir_image_append(
+      builder->image, basic_blocks,
+      fn->basic_block_count * sizeof(struct gkcc_ir_image_basic_block));
+  free(basic_blocks);
+
+  record.block_order =
+      gkcc_ir_image_append(builder->image, fn->block_order,
+                           fn->block_order_count * sizeof(int));
+  record.quads = gkcc_ir_image_append(
+      builder->image, fn->quads,
+      fn->quad_count * sizeof(struct gkcc_ir_packed_quad));
+  record.operand_kinds = gkcc_ir_image_append(
+      builder->image, fn->operands.kinds,
+      fn->operands.count * sizeof(enum gkcc_ir_quad_register_type));
+
+  // Operand 0 is reserved and left zeroed
+  struct gkcc_ir_image_operand *operands =
+      calloc(fn->operands.count, sizeof(struct gkcc_ir_image_operand));
+  for (int i = 1; i < fn->operands.count; i++) {
+    operands[i] = gkcc_ir_image_operand(builder, fn, i);
+  }
+  record.operands = gkcc_ir_image_append(
+      builder->image, operands,
+      fn->operands.count * sizeof(struct gkcc_ir_image_operand));
+  free(operands);
+
+  return record;
+}
+
+static struct gkcc_ir_image_section gkcc_ir_image_write_table(
+    struct gkcc_writer *image, struct gkcc_ir_image_table *table) {
+  return (struct gkcc_ir_image_section){
+      .offset = gkcc_ir_image_append(image, table->records,
+                                     table->count * table->record_size),
+      .count = table->count,
+  };
+}
+
+// gkcc_ir_image_build_key makes the key that ties an image to the build of
+// the compiler
+static bool gkcc_ir_image_build_key(struct gkcc_cache_key *key) {
+  gkcc_cache_key_init(key);
+  return gkcc_cache_key_add_build_id(key);
+}
+
+// gkcc_ir_image_write writes the IR of a translation unit out to out as an
+// image that gkcc_ir_image_map() can read back in. Returns false if the build
+// of the compiler cannot be found out.
+bool gkcc_ir_image_write(FILE *out, struct gkcc_ir_full *ir_full) {
+  struct gkcc_ir_image_header header = {.magic = GKCC_IR_IMAGE_MAGIC};
+  if (!gkcc_ir_image_build_key(&header.build)) return false;
+
+  struct gkcc_ir_image_builder builder = {
+      .image = gkcc_writer_new(NULL),
+      .strings = gkcc_writer_new(NULL),
+      .types = {.record_size = sizeof(struct gkcc_ir_image_type)},
+      .symbols = {.record_size = sizeof(struct gkcc_ir_image_symbol)},
+      .constants = {.record_size = sizeof(struct gkcc_ir_image_constant)},
+  };
+  gkcc_ir_image_append(builder.image, &header, sizeof(header));
+
+  size_t function_count = 0;
+  for (struct gkcc_ir_function_list *fn_list = ir_full->function_list;
+       fn_list != NULL; fn_list = fn_list->next) {
+    function_count++;
+  }
+  struct gkcc_ir_image_function *functions =
+      malloc(function_count * sizeof(struct gkcc_ir_image_function));
+  size_t index = 0;
+  for (struct gkcc_ir_function_list *fn_list = ir_full->function_list;
+       fn_list != NULL; fn_list = fn_list->next) {
+    functions[index++] = gkcc_ir_image_write_function(&builder, fn_list->fn);
+  }
+  header.functions = (struct gkcc_ir_image_section){
+      .offset = gkcc_ir_image_append(
+          builder.image, functions,
+          function_count * sizeof(struct gkcc_ir_image_function)),
+      .count = function_count,
+  };
+  free(functions);
+
+  size_t global_count = 0;
+  for (struct gkcc_ir_symbol_list *slist = ir_full->global_symbols;
+       slist != NULL; slist = slist->next) {
+    global_count++;
+  }
+  struct gkcc_ir_image_global *globals =
+      malloc(global_count * sizeof(struct gkcc_ir_image_global));
+  index = 0;
+  for (struct gkcc_ir_symbol_list *slist = ir_full->global_symbols;
+       slist != NULL; slist = slist->next) {
+    globals[index++] = (struct gkcc_ir_image_global){
+        .symbol = gkcc_ir_image_add_symbol(&builder, slist->symbol),
+        .is_global = slist->symbol->is_global,
+    };
+  }
+  header.globals = (struct gkcc_ir_image_section){
+      .offset = gkcc_ir_image_append(
+          builder.image, globals,
+          global_count * sizeof(struct gkcc_ir_image_global)),
+      .count = global_count,
+  };
+  free(globals);
+
+  header.types = gkcc_ir_image_write_table(builder.image, &builder.types);
+  header.symbols = gkcc_ir_image_write_table(builder.image, &builder.symbols);
+  header.constants =
+      gkcc_ir_image_write_table(builder.image, &builder.constants);
+  header.strings = (struct gkcc_ir_image_section){
+      .offset = gkcc_ir_image_append(builder.image, builder.strings->buffer,
+                                     builder.strings->used),
+      .count = builder.strings->used,
+  };
+
+  memcpy(builder.image->buffer, &header, sizeof(header));
+  fwrite(builder.image->buffer, 1, builder.image->used, out);
+
+  gkcc_writer_free(builder.image);
+  gkcc_writer_free(builder.strings);
+  gkcc_ir_image_table_free(&builder.types);
+  gkcc_ir_image_table_free(&builder.symbols);
+  gkcc_ir_image_table_free(&builder.constants);
+  return true;
+}
+
+// ===============
+// === LOADING ===
+// ===============
+
+// gkcc_ir_image_loader holds the tables of an image that are rebuilt when it
+// is loaded. The quads and block orders are used where they are, but every
+// index in them is checked before the code generator gets to use it.
+struct gkcc_ir_image_loader {
+  struct gkcc_ir_image *image;
+  struct gkcc_ir_image_header *header;
+  const char *strings;
+
+  struct gkcc_type *types;
+  struct gkcc_symbol *symbols;
+  struct ystring *ystrings;
+  struct ast_constant *constants;
+};
+
+// gkcc_ir_image_at returns the array of count records of the given size at
+// offset, or NULL if it does not lie within the image
+static void *gkcc_ir_image_at(struct gkcc_ir_image *image, uint32_t offset,
+                              int64_t count, size_t size) {
+  if (count < 0 || offset % GKCC_IR_IMAGE_ALIGN != 0 || offset > image->size ||
+      (uint64_t)count * size > image->size - offset) {
+    return NULL;
+  }
+  return &image->base[offset];
+}
+
+static bool gkcc_ir_image_index_ok(int32_t index, uint32_t count) {
+  return index >= 0 && (uint32_t)index < count;
+}
+
+static bool gkcc_ir_image_string_ok(struct gkcc_ir_image_loader *loader,
+                                    uint32_t offset) {
+  return offset < loader->header->strings.count;
+}
+
+static bool gkcc_ir_image_load_tables(struct gkcc_ir_image_loader *loader) {
+  struct gkcc_ir_image_header *header = loader->header;
+  struct gkcc_arena *arena = gkcc_arena_tu();
+
+  struct gkcc_ir_image_type *types = gkcc_ir_image_at(
+      loader->image, header->types.offset, header->types.count,
+      sizeof(struct gkcc_ir_image_type));
+  struct gkcc_ir_image_symbol *symbols = gkcc_ir_image_at(
+      loader->image, header->symbols.offset, header->symbols.count,
+      sizeof(struct gkcc_ir_image_symbol));
+  struct gkcc_ir_image_constant *constants = gkcc_ir_image_at(
+      loader->image, header->constants.offset, header->constants.count,
+      sizeof(struct gkcc_ir_image_constant));
+  if (types == NULL || symbols == NULL || constants == NULL) return false;
+
+  // The types only keep their layout, so they are made canonical for
+  // gkcc_type_layout() to use it instead of computing it again
+  loader->types =
+      gkcc_arena_alloc(arena, header->types.count * sizeof(struct gkcc_type));
+  for (uint32_t i = 0; i < header->types.count; i++) {
+    struct gkcc_type *type = &loader->types[i];
+    if (types[i].of != -1 &&
+        !gkcc_ir_image_index_ok(types[i].of, header->types.count)) {
+      return false;
+    }
+    type->type = types[i].type;
+    type->of = types[i].of == -1 ? NULL : &loader->types[types[i].of];
+    type->canonical = true;
+    type->has_layout = types[i].has_layout;
+    type->layout.size = types[i].size;
+    type->layout.align = types[i].align;
+  }
+
+  loader->symbols = gkcc_arena_alloc(
+      arena, header->symbols.count * sizeof(struct gkcc_symbol));
+  loader->ystrings = gkcc_arena_alloc(
+      arena, header->symbols.count * sizeof(struct ystring));
+  for (uint32_t i = 0; i < header->symbols.count; i++) {
+    struct gkcc_symbol *symbol = &loader->symbols[i];
+    if (!gkcc_ir_image_string_ok(loader, symbols[i].symbol_name) ||
+        (symbols[i].type != -1 &&
+         !gkcc_ir_image_index_ok(symbols[i].type, header->types.count))) {
+      return false;
+    }
+    symbol->symbol_name = &loader->strings[symbols[i].symbol_name];
+    symbol->symbol_type =
+        symbols[i].type == -1 ? NULL : &loader->types[symbols[i].type];
+    symbol->offset = symbols[i].offset;
+    symbol->fully_defined = true;
+    if (symbols[i].string_length == -1) continue;
+
+    if ((uint64_t)symbols[i].string + symbols[i].string_length >=
+        header->strings.count) {
+      return false;
+    }
+    loader->ystrings[i] = (struct ystring){
+        .raw = &loader->strings[symbols[i].string],
+        .length = symbols[i].string_length,
+    };
+  }
+
+  loader->constants = gkcc_arena_alloc(
+      arena, header->constants.count * sizeof(struct ast_constant));
+  for (uint32_t i = 0; i < header->constants.count; i++) {
+    struct ast_constant *constant = &loader->constants[i];
+    *constant = constants[i].constant;
+    if (constant->type != AST_CONSTANT_STRING) continue;
+
+    if ((uint64_t)constants[i].string + constant->ystring.length >=
+        header->strings.count) {
+      return false;
+    }
+    constant->ystring.raw = &loader->strings[constants[i].string];
+  }
+  return true;
+}
+
+static bool gkcc_ir_image_load_operand(struct gkcc_ir_image_loader *loader,
+                                       struct gkcc_ir_function *fn,
+                                       struct gkcc_ir_image_operand *record,
+                                       int operand) {
+  struct gkcc_ir_image_header *header = loader->header;
+  union gkcc_ir_operand_value *value = &fn->operands.values[operand];
+
+  if (record->type != -1 &&
+      !gkcc_ir_image_index_ok(record->type, header->types.count)) {
+    return false;
+  }
+  fn->operands.types[operand] =
+      record->type == -1 ? NULL : &loader->types[record->type];
+
+  switch (fn->operands.kinds[operand]) {
+    case GKCC_IR_QUAD_REGISTER_PSEUDOREGISTER:
+      value->pseudoregister.register_num = record->value;
+      value->pseudoregister.offset = record->extra;
+      return true;
+    case GKCC_IR_QUAD_REGISTER_SYMBOL:
+      if (!gkcc_ir_image_index_ok(record->value, header->symbols.count)) {
+        return false;
+      }
+      value->symbol = (struct gkcc_ir_symbol){
+          .is_global = record->extra,
+          .ystring = loader->ystrings[record->value].raw != NULL
+                         ? &loader->ystrings[record->value]
+                         : NULL,
+          .symbol = &loader->symbols[record->value],
+      };
+      return true;
+    case GKCC_IR_QUAD_REGISTER_CONSTANT:
+      if (!gkcc_ir_image_index_ok(record->value, header->constants.count)) {
+        return false;
+      }
+      value->constant = &loader->constants[record->value];
+      return true;
+    case GKCC_IR_QUAD_REGISTER_BASIC_BLOCK:
+      value->basic_block = record->value;
+      return gkcc_ir_image_index_ok(record->value, fn->basic_block_count);
+  }
+  return false;
+}
+
+static struct gkcc_ir_function *gkcc_ir_image_load_function(
+    struct gkcc_ir_image_loader *loader,
+    struct gkcc_ir_image_function *record) {
+  struct gkcc_ir_image *image = loader->image;
+  struct gkcc_arena *arena = gkcc_arena_tu();
+
+  struct gkcc_ir_image_basic_block *basic_blocks = gkcc_ir_image_at(
+      image, record->basic_blocks, record->basic_block_count,
+      sizeof(struct gkcc_ir_image_basic_block));
+  int *block_order = gkcc_ir_image_at(image, record->block_order,
+                                      record->block_order_count, sizeof(int));
+  struct gkcc_ir_packed_quad *quads =
+      gkcc_ir_image_at(image, record->quads, record->quad_count,
+                       sizeof(struct gkcc_ir_packed_quad));
+  enum gkcc_ir_quad_register_type *operand_kinds = gkcc_ir_image_at(
+      image, record->operand_kinds, record->operand_count,
+      sizeof(enum gkcc_ir_quad_register_type));
+  struct gkcc_ir_image_operand *operands =
+      gkcc_ir_image_at(image, record->operands, record->operand_count,
+                       sizeof(struct gkcc_ir_image_operand));
+  if (basic_blocks == NULL || block_order == NULL || quads == NULL ||
+      operand_kinds == NULL || operands == NULL ||
+      !gkcc_ir_image_string_ok(loader, record->function_name)) {
+    return NULL;
+  }
+
+  struct gkcc_ir_function *fn =
+      gkcc_arena_alloc(arena, sizeof(struct gkcc_ir_function));
+  fn->function_name = &loader->strings[record->function_name];
+  fn->required_space_for_locals = record->required_space_for_locals;
+  fn->first_basic_block = record->first_basic_block;
+  fn->basic_block_count = record->basic_block_count;
+  fn->first_pseudoregister = record->first_pseudoregister;
+  fn->block_order = block_order;
+  fn->block_order_count = record->block_order_count;
+  fn->quads = quads;
+  fn->quad_count = record->quad_count;
+
+  struct gkcc_basic_block *bbs = gkcc_arena_alloc(
+      arena, record->basic_block_count * sizeof(struct gkcc_basic_block));
+  fn->basic_blocks = gkcc_arena_alloc(
+      arena, record->basic_block_count * sizeof(struct gkcc_basic_block *));
+  for (int i = 0; i < record->basic_block_count; i++) {
+    struct gkcc_ir_image_basic_block *bb_record = &basic_blocks[i];
+    if (!gkcc_ir_image_string_ok(loader, bb_record->bb_name) ||
+        bb_record->first_quad < 0 || bb_record->quad_count < 0 ||
+        bb_record->first_quad > record->quad_count - bb_record->quad_count) {
+      return NULL;
+    }
+    bbs[i].bb_name = (char *)&loader->strings[bb_record->bb_name];
+    bbs[i].bb_number = record->first_basic_block + i;
+    bbs[i].first_quad = bb_record->first_quad;
+    bbs[i].quad_count = bb_record->quad_count;
+    fn->basic_blocks[i] = &bbs[i];
+  }
+  for (int i = 0; i < record->block_order_count; i++) {
+    if (!gkcc_ir_image_index_ok(block_order[i], record->basic_block_count)) {
+      return NULL;
+    }
+  }
+  if (record->block_order_count > 0) {
+    fn->entrance_basic_block = fn->basic_blocks[block_order[0]];
+  }
+
+  // Operand 0 stands for no operand
+  for (int i = 0; i < record->quad_count; i++) {
+    struct gkcc_ir_packed_quad *quad = &quads[i];
+    if (!gkcc_ir_image_index_ok(quad->instruction,
+                                sizeof(GKCC_IR_QUAD_INSTRUCTION_STRING) /
+                                    sizeof(GKCC_IR_QUAD_INSTRUCTION_STRING[0])) ||
+        !gkcc_ir_image_index_ok(quad->dest, record->operand_count) ||
+        !gkcc_ir_image_index_ok(quad->source1, record->operand_count) ||
+        !gkcc_ir_image_index_ok(quad->source2, record->operand_count)) {
+      return NULL;
+    }
+  }
+
+  fn->operands.count = record->operand_count;
+  fn->operands.kinds = operand_kinds;
+  fn->operands.types = gkcc_arena_alloc(
+      arena, record->operand_count * sizeof(struct gkcc_type *));
+  fn->operands.values = gkcc_arena_alloc(
+      arena, record->operand_count * sizeof(union gkcc_ir_operand_value));
+  for (int i = 1; i < record->operand_count; i++) {
+    if (!gkcc_ir_image_load_operand(loader, fn, &operands[i], i)) return NULL;
+  }
+  return fn;
+}
+
+static struct gkcc_ir_full *gkcc_ir_image_load(
+    struct gkcc_ir_image_loader *loader) {
+  struct gkcc_ir_image_header *header = loader->header;
+  struct gkcc_cache_key build;
+  if (memcmp(header->magic, GKCC_IR_IMAGE_MAGIC, sizeof(header->magic)) != 0 ||
+      !gkcc_ir_image_build_key(&build) ||
+      memcmp(&build, &header->build, sizeof(build)) != 0) {
+    return NULL;
+  }
+
+  // Every string is followed by a NUL byte, so one at the end of the string
+  // table ends any string that starts within it
+  loader->strings = gkcc_ir_image_at(loader->image, header->strings.offset,
+                                     header->strings.count, 1);
+  if (loader->strings == NULL ||
+      (header->strings.count != 0 &&
+       loader->strings[header->strings.count - 1] != '\0')) {
+    return NULL;
+  }
+  if (!gkcc_ir_image_load_tables(loader)) return NULL;
+
+  struct gkcc_ir_image_global *globals = gkcc_ir_image_at(
+      loader->image, header->globals.offset, header->globals.count,
+      sizeof(struct gkcc_ir_image_global));
+  struct gkcc_ir_image_function *functions = gkcc_ir_image_at(
+      loader->image, header->functions.offset, header->functions.count,
+      sizeof(struct gkcc_ir_image_function));
+  if (globals == NULL || functions == NULL) return NULL;
+
+  struct gkcc_ir_full *ir_full = gkcc_ir_full_new();
+  for (uint32_t i = 0; i < header->globals.count; i++) {
+    int32_t symbol = globals[i].symbol;
+    if (!gkcc_ir_image_index_ok(symbol, header->symbols.count)) return NULL;
+
+    struct gkcc_ir_symbol *ir_symbol =
+        gkcc_ir_symbol_new(&loader->symbols[symbol], globals[i].is_global);
+    if (loader->ystrings[symbol].raw != NULL) {
+      ir_symbol->ystring = &loader->ystrings[symbol];
+    }
+    ir_full->global_symbols =
+        gkcc_ir_symbol_list_append(ir_full->global_symbols, ir_symbol);
+  }
+  for (uint32_t i = 0; i < header->functions.count; i++) {
+    struct gkcc_ir_function *fn =
+        gkcc_ir_image_load_function(loader, &functions[i]);
+    if (fn == NULL) return NULL;
+
+    ir_full->function_list =
+        gkcc_ir_function_list_append(ir_full->function_list, fn);
+  }
+  return ir_full;
+}
+
+// gkcc_ir_image_map maps the image at the given path into memory and loads
+// the IR in it. Returns NULL if the file cannot be mapped or is not an image.
+//
+// The mapping is private and writable because the code generator rewrites
+// some of the quads it is given. Only the pages it writes to are copied.
+struct gkcc_ir_image *gkcc_ir_image_map(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < sizeof(struct gkcc_ir_image_header)) {
+    close(fd);
+    return NULL;
+  }
+  char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return NULL;
+
+  struct gkcc_ir_image *image = malloc(sizeof(struct gkcc_ir_image));
+  gkcc_assert(image != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate an IR image");
+  *image = (struct gkcc_ir_image){.base = base, .size = st.st_size};
+
+  struct gkcc_ir_image_loader loader = {
+      .image = image,
+      .header = (struct gkcc_ir_image_header *)base,
+  };
+  image->ir_full = gkcc_ir_image_load(&loader);
+  if (image->ir_full == NULL) {
+    gkcc_ir_image_unmap(image);
+    return NULL;
+  }
+  return image;
+}
+
+void gkcc_ir_image_unmap(struct gkcc_ir_image *image) {
+  if (image == NULL) return;
+
+  munmap(image->base, image->size);
+  free(image);
+}
@@ -0,0 +1,200 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GKCC_IR_IMAGE_H
+#define GKCC_IR_IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ir/ir_full.h"
+#include "ir/quads.h"
+#include "misc/cache.h"
+
+// An IR image is the IR of a translation unit written out by gkcc_int
+// -emit-ir, so that code can be generated from it later with -from-ir. It is
+// laid out so that it can be mapped into memory and used where it is: every
+// pointer of the IR is stored as an index or as an offset from the start of
+// the image, and the quads, operand kinds, block orders and names of a
+// function are used straight from the mapping. Only the operand values, which
+// hold pointers, and the small tables of types, symbols and constants they
+// point to are rebuilt when the image is loaded.
+//
+// The records are stored the way the compiler that wrote them lays them out
+// in memory, so an image can only be read by the build of gkcc_int that wrote
+// it. The header holds a key made from the build of the compiler, and an
+// image whose key does not match is not loaded.
+//
+// An image is made up of a header followed by these sections, each of which
+// starts at an offset that is a multiple of GKCC_IR_IMAGE_ALIGN, so that the
+// records in it are aligned once the image is mapped:
+//   - the functions, as gkcc_ir_image_function
+//   - the global symbols, as gkcc_ir_image_global
+//   - the types, symbols and constants the operands refer to
+//   - the string table, which holds names and the bytes of string constants
+// The arrays of a function are stored ahead of the function table.
+
+#define GKCC_IR_IMAGE_MAGIC "GKCCIR02"
+#define GKCC_IR_IMAGE_ALIGN 16
+
+// ====================================
+// === struct gkcc_ir_image_section ===
+// ====================================
+
+struct gkcc_ir_image_section {
+  uint32_t offset;
+  uint32_t count;
+};
+
+// ===================================
+// === struct gkcc_ir_image_header ===
+// ===================================
+
+struct gkcc_ir_image_header {
+  char magic[8];
+  // build is a key made from nothing but the build of the compiler
+  struct gkcc_cache_key build;
+  struct gkcc_ir_image_section functions;
+  struct gkcc_ir_image_section globals;
+  struct gkcc_ir_image_section types;
+  struct gkcc_ir_image_section symbols;
+  struct gkcc_ir_image_section constants;
+  // The count of the string table is its size in bytes
+  struct gkcc_ir_image_section strings;
+};
+
+// =====================================
+// === struct gkcc_ir_image_function ===
+// =====================================
+
+// Names are offsets into the string table. The other offsets are from the
+// start of the image.
+struct gkcc_ir_image_function {
+  uint32_t function_name;
+  int32_t required_space_for_locals;
+  int32_t first_basic_block;
+  int32_t first_pseudoregister;
+  // basic_blocks holds basic_block_count gkcc_ir_image_basic_block
+  uint32_t basic_blocks;
+  int32_t basic_block_count;
+  // block_order holds block_order_count int indices into basic_blocks
+  uint32_t block_order;
+  int32_t block_order_count;
+  // quads holds quad_count gkcc_ir_packed_quad
+  uint32_t quads;
+  int32_t quad_count;
+  // operand_kinds holds operand_count enum gkcc_ir_quad_register_type and
+  // operands holds as many gkcc_ir_image_operand
+  uint32_t operand_kinds;
+  uint32_t operands;
+  int32_t operand_count;
+};
+
+// ========================================
+// === struct gkcc_ir_image_basic_block ===
+// ========================================
+
+struct gkcc_ir_image_basic_block {
+  uint32_t bb_name;
+  int32_t first_quad;
+  int32_t quad_count;
+};
+
+// ====================================
+// === struct gkcc_ir_image_operand ===
+// ====================================
+
+// type indexes the types of the image and is -1 if the operand has no type.
+// What value and extra are depends on the kind of the operand:
+//   - a pseudoregister has its number in value and its offset in extra
+//   - a symbol has its index in value and extra is 1 if it is global
+//   - a constant has its index in value
+//   - a basic block has its index in the function in value
+struct gkcc_ir_image_operand {
+  int32_t type;
+  int32_t value;
+  int32_t extra;
+};
+
+// =================================
+// === struct gkcc_ir_image_type ===
+// =================================
+
+// Only what the code generator looks at is kept of a type: its kind, the type
+// it is derived from and, where it can be computed, its layout
+struct gkcc_ir_image_type {
+  int32_t type;
+  int32_t of;
+  int32_t has_layout;
+  int32_t size;
+  int32_t align;
+};
+
+// ===================================
+// === struct gkcc_ir_image_symbol ===
+// ===================================
+
+// string is the offset of the bytes of a string constant in the string table
+// and string_length is -1 if the symbol is not a string constant
+struct gkcc_ir_image_symbol {
+  uint32_t symbol_name;
+  int32_t offset;
+  int32_t type;
+  uint32_t string;
+  int32_t string_length;
+};
+
+// ===================================
+// === struct gkcc_ir_image_global ===
+// ===================================
+
+struct gkcc_ir_image_global {
+  int32_t symbol;
+  int32_t is_global;
+};
+
+// =====================================
+// === struct gkcc_ir_image_constant ===
+// =====================================
+
+// The pointer of a string constant is not kept. Its bytes are at string in
+// the string table instead.
+struct gkcc_ir_image_constant {
+  struct ast_constant constant;
+  uint32_t string;
+};
+
+// ============================
+// === struct gkcc_ir_image ===
+// ============================
+
+// gkcc_ir_image is an image mapped into memory. ir_full points into base and
+// into the translation unit arena, so it must not be used after the image has
+// been unmapped or the arena has been released.
+struct gkcc_ir_image {
+  char *base;
+  size_t size;
+  struct gkcc_ir_full *ir_full;
+};
+
+// === FUNCTION DECLARATIONS ===
+
+bool gkcc_ir_image_write(FILE *out, struct gkcc_ir_full *ir_full);
+struct gkcc_ir_image *gkcc_ir_image_map(const char *path);
+void gkcc_ir_image_unmap(struct gkcc_ir_image *image);
+
+#endif  // GKCC_IR_IMAGE_H
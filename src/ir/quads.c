@@ -17,103 +17,124 @@
 
 #include <malloc.h>
 #include <memory.h>
+#include <stdint.h>
 
 #include "ast/ast.h"
 #include "ir/translators.h"
-
-char *gkcc_ir_quad_register_constant_string(char *buf,
-                                            struct gkcc_ir_quad_register *qr) {
-  gkcc_assert(qr->register_type == GKCC_IR_QUAD_REGISTER_CONSTANT,
-              GKCC_ERROR_INVALID_ARGUMENTS,
-              "gkcc_ir_quad_register_constant_string() got a qr that is not of "
-              "type GKCC_IR_QUAD_REGISTER_CONSTANT");
-
-  switch (qr->constant->type) {
+#include "misc/arena.h"
+#include "misc/intern.h"
+
+// gkcc_ir_constant_write writes a constant the way it appears in the IR dump.
+// String constants are quoted and escaped.
+void gkcc_ir_constant_write(struct gkcc_writer *writer,
+                            struct ast_constant *constant) {
+  switch (constant->type) {
     case AST_CONSTANT_LONGLONG:
-      sprintf(buf, "%lld", qr->constant->ylonglong);
-      return buf;
+      gkcc_writer_int(writer, constant->ylonglong);
+      return;
     case AST_CONSTANT_LONG_DOUBLE:
-      sprintf(buf, "%Lf", qr->constant->ylongdouble);
-      return buf;
+      gkcc_writer_printf(writer, "%Lf", constant->ylongdouble);
+      return;
     case AST_CONSTANT_DOUBLE:
-      sprintf(buf, "%lf", qr->constant->ydouble);
-      return buf;
+      gkcc_writer_printf(writer, "%lf", constant->ydouble);
+      return;
     case AST_CONSTANT_FLOAT:
-      sprintf(buf, "%f", qr->constant->yfloat);
-      return buf;
+      gkcc_writer_printf(writer, "%f", constant->yfloat);
+      return;
     case AST_CONSTANT_LONG:
-      sprintf(buf, "%ld", qr->constant->ylong);
-      return buf;
+      gkcc_writer_int(writer, constant->ylong);
+      return;
     case AST_CONSTANT_INT:
-      sprintf(buf, "%d", qr->constant->yint);
-      return buf;
+      gkcc_writer_int(writer, constant->yint);
+      return;
     case AST_CONSTANT_CHAR:
-      sprint_escaped_char(buf, qr->constant->ychar);
-      return buf;
+      gkcc_writer_escaped(writer, &constant->ychar, 1);
+      return;
     case AST_CONSTANT_STRING:
-      buf[0] = '"';
-      sprint_escaped_string(&buf[1], qr->constant->ystring.raw,
-                            qr->constant->ystring.length);
-      int len = strlen(buf);
-      buf[len] = '"';
-      buf[len + 1] = '\0';
-      return buf;
+      gkcc_writer_char(writer, '"');
+      gkcc_writer_escaped(writer, constant->ystring.raw,
+                          constant->ystring.length);
+      gkcc_writer_char(writer, '"');
+      return;
   }
-  return NULL;
 }
 
-char *gkcc_ir_quad_register_string(char *buf,
-                                   struct gkcc_ir_quad_register *qr) {
-  char buf1[(1 << 12) + 1];
-
-  if (qr == NULL) {
-    strcpy(buf, "NULL");
-    return buf;
+void gkcc_ir_operand_write(struct gkcc_writer *writer,
+                           struct gkcc_ir_function *fn, int operand) {
+  if (operand == 0) {
+    gkcc_writer_str(writer, "NULL");
+    return;
   }
 
-  switch (qr->register_type) {
+  union gkcc_ir_operand_value *value = &fn->operands.values[operand];
+  switch (fn->operands.kinds[operand]) {
     case GKCC_IR_QUAD_REGISTER_PSEUDOREGISTER:
-      sprintf(buf, "%%T%d", qr->pseudoregister.register_num);
+      gkcc_writer_str(writer, "%T");
+      gkcc_writer_int(writer, fn->first_pseudoregister +
+                                  value->pseudoregister.register_num);
       break;
     case GKCC_IR_QUAD_REGISTER_SYMBOL:
-      if (qr->symbol.is_global) {
-        sprintf(buf, "global:%s", qr->symbol.symbol->symbol_name);
-      } else {
-        sprintf(buf, "local:%s", qr->symbol.symbol->symbol_name);
-      }
+      gkcc_writer_str(writer, value->symbol.is_global ? "global:" : "local:");
+      gkcc_writer_str(writer, value->symbol.symbol->symbol_name);
       break;
     case GKCC_IR_QUAD_REGISTER_CONSTANT:
-      sprintf(buf, "$%s", gkcc_ir_quad_register_constant_string(buf1, qr));
+      gkcc_writer_char(writer, '$');
+      gkcc_ir_constant_write(writer, value->constant);
       break;
     case GKCC_IR_QUAD_REGISTER_BASIC_BLOCK:
-      sprintf(buf, "%s", qr->basic_block->bb_name);
+      gkcc_writer_str(writer, fn->basic_blocks[value->basic_block]->bb_name);
       break;
   }
-
-  return buf;
 }
 
-void gkcc_ir_quad_print(struct gkcc_ir_quad_list *ql) {
-  char buf1[(1 << 12) + 1];
-  char buf2[(1 << 12) + 1];
-  char buf3[(1 << 12) + 1];
-
-  for (struct gkcc_ir_quad_list *n = ql; n != NULL; n = n->next) {
-    struct gkcc_ir_quad *q = n->quad;
-    printf("\t%s = %s %s %s\n", gkcc_ir_quad_register_string(buf1, q->dest),
-           GKCC_IR_QUAD_INSTRUCTION_STRING[q->instruction],
-           gkcc_ir_quad_register_string(buf2, q->source1),
-           gkcc_ir_quad_register_string(buf3, q->source2));
+void gkcc_ir_quad_print(struct gkcc_writer *writer,
+                        struct gkcc_ir_function *fn,
+                        struct gkcc_basic_block *bb) {
+  struct gkcc_ir_packed_quad *end = &fn->quads[bb->first_quad + bb->quad_count];
+  for (struct gkcc_ir_packed_quad *q = &fn->quads[bb->first_quad]; q != end;
+       q++) {
+    gkcc_writer_char(writer, '\t');
+    gkcc_ir_operand_write(writer, fn, q->dest);
+    gkcc_writer_str(writer, " = ");
+    gkcc_writer_str(writer, GKCC_IR_QUAD_INSTRUCTION_STRING[q->instruction]);
+    gkcc_writer_char(writer, ' ');
+    gkcc_ir_operand_write(writer, fn, q->source1);
+    gkcc_writer_char(writer, ' ');
+    gkcc_ir_operand_write(writer, fn, q->source2);
+    gkcc_writer_char(writer, '\n');
   }
 }
 
+// gkcc_ir_quad_storage_layout returns the layout of the storage reserved for
+// an object of the given type. The x86 backend moves scalars as whole 32-bit
+// words, so storage is always word aligned and a whole number of words.
+struct gkcc_type_layout gkcc_ir_quad_storage_layout(struct gkcc_type *type) {
+  struct gkcc_type_layout layout = gkcc_type_layout(type);
+  if (layout.align < 4) layout.align = 4;
+  layout.size = (layout.size + 3) / 4 * 4;
+  return layout;
+}
+
+// gkcc_ir_quad_allocate_local reserves space in the stack frame of the current
+// function and returns the offset below the base pointer at which the object
+// starts.
+static int gkcc_ir_quad_allocate_local(
+    struct gkcc_ir_generation_state *gen_state,
+    struct gkcc_type_layout layout) {
+  struct gkcc_ir_function *fn = gen_state->current_function;
+  int end = fn->required_space_for_locals + layout.size;
+  fn->required_space_for_locals = (end + layout.align - 1) / layout.align *
+                                  layout.align;
+  return fn->required_space_for_locals;
+}
+
 struct gkcc_ir_translation_result gkcc_ir_quad_generate_declaration(
     struct gkcc_ir_generation_state *gen_state, struct ast_node *node) {
   struct gkcc_ir_translation_result translation_result = {};
-  int size = gkcc_type_sizeof(node->declaration.type->gkcc_type.gkcc_type);
   node->declaration.identifier->ident.symbol_table_entry->offset =
-      gen_state->current_function->required_space_for_locals;
-  gen_state->current_function->required_space_for_locals += size;
+      gkcc_ir_quad_allocate_local(
+          gen_state, gkcc_ir_quad_storage_layout(
+                         node->declaration.type->gkcc_type.gkcc_type));
 
   return translation_result;
 }
@@ -157,38 +178,220 @@ struct gkcc_ir_quad_register *gkcc_ir_quad_register_new_pseudoregister(
       gkcc_ir_quad_register_new(GKCC_IR_QUAD_REGISTER_PSEUDOREGISTER);
   gkcc_ir_quad_register->pseudoregister.register_num =
       gen_state->current_pseudoregister_number++;
-  gkcc_ir_quad_register->pseudoregister.offset =
-      gen_state->current_function->required_space_for_locals;
-  gen_state->current_function->required_space_for_locals += 4;
+  gkcc_ir_quad_register->pseudoregister.offset = gkcc_ir_quad_allocate_local(
+      gen_state, (struct gkcc_type_layout){.size = 4, .align = 4});
 
   return gkcc_ir_quad_register;
 }
 
-struct gkcc_ir_quad_register *gkcc_ir_quad_register_new_basic_block(
-    struct gkcc_basic_block *bb) {
+// The operand pool of a generation state interns the constant, symbol and
+// basic block registers of the function being lowered, so that every distinct
+// operand is a single register and ends up as a single operand once packed.
+#define GKCC_IR_OPERAND_POOL_INITIAL_CAPACITY 64
+
+static bool gkcc_ir_constant_equal(struct ast_constant *a,
+                                   struct ast_constant *b) {
+  if (a->type != b->type || a->is_unsigned != b->is_unsigned) return false;
+
+  switch (a->type) {
+    case AST_CONSTANT_LONGLONG:
+      return a->ylonglong == b->ylonglong;
+    case AST_CONSTANT_LONG_DOUBLE:
+      return a->ylongdouble == b->ylongdouble;
+    case AST_CONSTANT_DOUBLE:
+      return a->ydouble == b->ydouble;
+    case AST_CONSTANT_FLOAT:
+      return a->yfloat == b->yfloat;
+    case AST_CONSTANT_LONG:
+      return a->ylong == b->ylong;
+    case AST_CONSTANT_INT:
+      return a->yint == b->yint;
+    case AST_CONSTANT_CHAR:
+      return a->ychar == b->ychar;
+    case AST_CONSTANT_STRING:
+      return a == b;
+  }
+  return false;
+}
+
+// gkcc_ir_constant_hash_value returns the part of a constant that goes into
+// its hash. Floating point constants are only told apart by
+// gkcc_ir_constant_equal.
+static long long gkcc_ir_constant_hash_value(struct ast_constant *constant) {
+  switch (constant->type) {
+    case AST_CONSTANT_LONGLONG:
+      return constant->ylonglong;
+    case AST_CONSTANT_LONG:
+      return constant->ylong;
+    case AST_CONSTANT_INT:
+      return constant->yint;
+    case AST_CONSTANT_CHAR:
+      return constant->ychar;
+    case AST_CONSTANT_STRING:
+      return (long long)(uintptr_t)constant;
+    default:
+      return 0;
+  }
+}
+
+static unsigned int gkcc_ir_operand_pool_hash(
+    struct gkcc_ir_quad_register *qr) {
+  uintptr_t fields[3] = {qr->register_type, 0, 0};
+  switch (qr->register_type) {
+    case GKCC_IR_QUAD_REGISTER_SYMBOL:
+      fields[1] = (uintptr_t)qr->symbol.symbol;
+      break;
+    case GKCC_IR_QUAD_REGISTER_CONSTANT:
+      fields[1] = qr->constant->type;
+      fields[2] = (uintptr_t)gkcc_ir_constant_hash_value(qr->constant);
+      break;
+    case GKCC_IR_QUAD_REGISTER_BASIC_BLOCK:
+      fields[1] = (uintptr_t)qr->basic_block;
+      break;
+    case GKCC_IR_QUAD_REGISTER_PSEUDOREGISTER:
+      break;
+  }
+  return gkcc_intern_hash_bytes((const char *)fields, sizeof(fields));
+}
+
+static bool gkcc_ir_operand_pool_equal(struct gkcc_ir_quad_register *a,
+                                       struct gkcc_ir_quad_register *b) {
+  if (a->register_type != b->register_type) return false;
+
+  switch (a->register_type) {
+    case GKCC_IR_QUAD_REGISTER_SYMBOL:
+      return a->symbol.symbol == b->symbol.symbol;
+    case GKCC_IR_QUAD_REGISTER_CONSTANT:
+      return gkcc_ir_constant_equal(a->constant, b->constant);
+    case GKCC_IR_QUAD_REGISTER_BASIC_BLOCK:
+      return a->basic_block == b->basic_block;
+    case GKCC_IR_QUAD_REGISTER_PSEUDOREGISTER:
+      return false;
+  }
+  return false;
+}
+
+static void gkcc_ir_operand_pool_grow(
+    struct gkcc_ir_generation_state *gen_state) {
+  size_t new_capacity = gen_state->operand_pool_capacity == 0
+                            ? GKCC_IR_OPERAND_POOL_INITIAL_CAPACITY
+                            : gen_state->operand_pool_capacity * 2;
+  struct gkcc_ir_quad_register **new_slots =
+      calloc(new_capacity, sizeof(struct gkcc_ir_quad_register *));
+  gkcc_assert(new_slots != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate the operand pool of a function");
+
+  for (size_t i = 0; i < gen_state->operand_pool_capacity; i++) {
+    struct gkcc_ir_quad_register *qr = gen_state->operand_pool[i];
+    if (qr == NULL) continue;
+
+    size_t slot = gkcc_ir_operand_pool_hash(qr) & (new_capacity - 1);
+    while (new_slots[slot] != NULL) slot = (slot + 1) & (new_capacity - 1);
+    new_slots[slot] = qr;
+  }
+
+  free(gen_state->operand_pool);
+  gen_state->operand_pool = new_slots;
+  gen_state->operand_pool_capacity = new_capacity;
+}
+
+// gkcc_ir_operand_pool_intern returns the register of the function being
+// lowered that is equal to key, creating it from a copy of key if there is
+// none yet.
+static struct gkcc_ir_quad_register *gkcc_ir_operand_pool_intern(
+    struct gkcc_ir_generation_state *gen_state,
+    struct gkcc_ir_quad_register *key) {
+  if (2 * (gen_state->operand_pool_count + 1) >
+      gen_state->operand_pool_capacity) {
+    gkcc_ir_operand_pool_grow(gen_state);
+  }
+
+  size_t mask = gen_state->operand_pool_capacity - 1;
+  size_t slot = gkcc_ir_operand_pool_hash(key) & mask;
+  for (; gen_state->operand_pool[slot] != NULL; slot = (slot + 1) & mask) {
+    if (gkcc_ir_operand_pool_equal(gen_state->operand_pool[slot], key)) {
+      return gen_state->operand_pool[slot];
+    }
+  }
+
   struct gkcc_ir_quad_register *qr =
-      gkcc_ir_quad_register_new(GKCC_IR_QUAD_REGISTER_BASIC_BLOCK);
-  qr->basic_block = bb;
+      gkcc_ir_quad_register_new(key->register_type);
+  *qr = *key;
 
+  gen_state->operand_pool[slot] = qr;
+  gen_state->operand_pool_count++;
   return qr;
 }
 
+// gkcc_ir_operand_pool_release empties the operand pool once the registers in
+// it are no longer valid
+static void gkcc_ir_operand_pool_release(
+    struct gkcc_ir_generation_state *gen_state) {
+  free(gen_state->operand_pool);
+  gen_state->operand_pool = NULL;
+  gen_state->operand_pool_count = 0;
+  gen_state->operand_pool_capacity = 0;
+}
+
+struct gkcc_ir_quad_register *gkcc_ir_quad_register_new_basic_block(
+    struct gkcc_ir_generation_state *gen_state, struct gkcc_basic_block *bb) {
+  struct gkcc_ir_quad_register key = {
+      .register_type = GKCC_IR_QUAD_REGISTER_BASIC_BLOCK,
+      .type = gkcc_type_signed_int(),
+      .basic_block = bb,
+  };
+  return gkcc_ir_operand_pool_intern(gen_state, &key);
+}
+
+// gkcc_ir_quad_register_new_symbol returns the register for a reference to a
+// named variable or function
+struct gkcc_ir_quad_register *gkcc_ir_quad_register_new_symbol(
+    struct gkcc_ir_generation_state *gen_state, struct gkcc_symbol *symbol) {
+  struct gkcc_ir_quad_register key = {
+      .register_type = GKCC_IR_QUAD_REGISTER_SYMBOL,
+      .type = symbol->symbol_type,
+      .symbol =
+          {
+              .is_global =
+                  symbol->symbol_table_set->scope == GKCC_SCOPE_GLOBAL,
+              .symbol = symbol,
+          },
+  };
+  return gkcc_ir_operand_pool_intern(gen_state, &key);
+}
+
+struct gkcc_ir_quad_register *gkcc_ir_quad_register_new_constant(
+    struct gkcc_ir_generation_state *gen_state,
+    struct ast_constant *constant) {
+  struct gkcc_ir_quad_register key = {
+      .register_type = GKCC_IR_QUAD_REGISTER_CONSTANT,
+      .type = gkcc_type_signed_int(),
+      .constant = constant,
+  };
+  return gkcc_ir_operand_pool_intern(gen_state, &key);
+}
+
 struct gkcc_ir_quad_register *gkcc_ir_quad_register_new(
     enum gkcc_ir_quad_register_type register_type) {
-  struct gkcc_ir_quad_register *gkcc_register =
-      malloc(sizeof(struct gkcc_ir_quad_register));
-  memset(gkcc_register, 0, sizeof(struct gkcc_ir_quad_register));
+  struct gkcc_ir_quad_register *gkcc_register = gkcc_arena_alloc(
+      gkcc_basic_block_scratch_arena(), sizeof(struct gkcc_ir_quad_register));
 
   gkcc_register->register_type = register_type;
-  gkcc_register->type = gkcc_type_new_signed_int_type();
+  gkcc_register->type = gkcc_type_signed_int();
   return gkcc_register;
 }
 
 struct gkcc_ir_quad_register *gkcc_ir_quad_register_new_int_constant(
-    int constant) {
+    struct gkcc_ir_generation_state *gen_state, int constant) {
+  struct ast_constant key = {.type = AST_CONSTANT_INT, .yint = constant};
   struct gkcc_ir_quad_register *qr =
-      gkcc_ir_quad_register_new(GKCC_IR_QUAD_REGISTER_CONSTANT);
-  qr->constant = &ast_node_new_constant_int_node(constant)->constant;
+      gkcc_ir_quad_register_new_constant(gen_state, &key);
+  if (qr->constant == &key) {
+    // This is the first use of the value in the function
+    qr->constant =
+        gkcc_arena_alloc(gkcc_arena_tu(), sizeof(struct ast_constant));
+    *qr->constant = key;
+  }
   return qr;
 }
 
@@ -205,26 +408,23 @@ struct gkcc_ir_quad *gkcc_ir_quad_new_with_args(
 }
 
 struct gkcc_ir_quad *gkcc_ir_quad_new(void) {
-  struct gkcc_ir_quad *tr = malloc(sizeof(struct gkcc_ir_quad));
-  memset(tr, 0, sizeof(struct gkcc_ir_quad));
-
-  return tr;
+  return gkcc_arena_alloc(gkcc_basic_block_scratch_arena(),
+                          sizeof(struct gkcc_ir_quad));
 }
 
 struct gkcc_ir_quad_list *gkcc_ir_quad_list_append(
     struct gkcc_ir_quad_list *ql1, struct gkcc_ir_quad *ta) {
-  struct gkcc_ir_quad_list *ql;
   if (ta == NULL) {
     return ql1;
   }
+  struct gkcc_ir_quad_list *ql = gkcc_ir_quad_list_new();
+  ql->quad = ta;
+  ql->end = ql;
   if (ql1 == NULL) {
-    ql = gkcc_ir_quad_list_new();
-    ql->quad = ta;
     return ql;
   }
-  for (ql = ql1; ql->next != NULL; ql = ql->next);
-  ql->next = gkcc_ir_quad_list_new();
-  ql->next->quad = ta;
+  ql1->end->next = ql;
+  ql1->end = ql;
 
   return ql1;
 }
@@ -238,18 +438,15 @@ struct gkcc_ir_quad_list *gkcc_ir_quad_list_append_list(
     return ql1;
   }
 
-  struct gkcc_ir_quad_list *ql;
-  for (ql = ql1; ql->next != NULL; ql = ql->next);
-  ql->next = ql2;
+  ql1->end->next = ql2;
+  ql1->end = ql2->end;
 
   return ql1;
 }
 
 struct gkcc_ir_quad_list *gkcc_ir_quad_list_new(void) {
-  struct gkcc_ir_quad_list *ql = malloc(sizeof(struct gkcc_ir_quad_list));
-  memset(ql, 0, sizeof(struct gkcc_ir_quad_list));
-
-  return ql;
+  return gkcc_arena_alloc(gkcc_basic_block_scratch_arena(),
+                          sizeof(struct gkcc_ir_quad_list));
 }
 
 struct gkcc_ir_generation_state *gkcc_ir_generation_state_new(void) {
@@ -260,15 +457,110 @@ struct gkcc_ir_generation_state *gkcc_ir_generation_state_new(void) {
   return gen_state;
 }
 
-struct gkcc_ir_function *gkcc_ir_function_new(char *function_name) {
-  struct gkcc_ir_function *ir_function =
-      malloc(sizeof(struct gkcc_ir_function));
-  memset(ir_function, 0, sizeof(struct gkcc_ir_function));
+// gkcc_ir_generation_state_free frees a generation state. The IR it generated
+// lives in the translation unit arena and is not affected.
+void gkcc_ir_generation_state_free(struct gkcc_ir_generation_state *gen_state) {
+  if (gen_state == NULL) return;
+
+  free(gen_state->basic_blocks);
+  free(gen_state->operand_pool);
+  free(gen_state);
+}
 
-  ir_function->function_name = malloc(strlen(function_name) + 1);
-  strcpy(ir_function->function_name, function_name);
+struct gkcc_ir_function *gkcc_ir_function_new(const char *function_name) {
+  struct gkcc_ir_function *ir_function =
+      gkcc_arena_alloc(gkcc_arena_tu(), sizeof(struct gkcc_ir_function));
 
-  ir_function->required_space_for_locals = 4;
+  ir_function->function_name = function_name;
 
   return ir_function;
 }
+
+// gkcc_ir_function_pack_operand fills in the operand table entry of qr and
+// returns its index
+static int gkcc_ir_function_pack_operand(struct gkcc_ir_function *fn,
+                                         struct gkcc_ir_quad_register *qr) {
+  if (qr == NULL) return 0;
+
+  struct gkcc_ir_operand_table *operands = &fn->operands;
+  operands->kinds[qr->operand] = qr->register_type;
+  operands->types[qr->operand] = qr->type;
+  union gkcc_ir_operand_value *value = &operands->values[qr->operand];
+  switch (qr->register_type) {
+    case GKCC_IR_QUAD_REGISTER_PSEUDOREGISTER:
+      value->pseudoregister = qr->pseudoregister;
+      break;
+    case GKCC_IR_QUAD_REGISTER_SYMBOL:
+      value->symbol = qr->symbol;
+      break;
+    case GKCC_IR_QUAD_REGISTER_CONSTANT:
+      value->constant = qr->constant;
+      break;
+    case GKCC_IR_QUAD_REGISTER_BASIC_BLOCK:
+      value->basic_block = qr->basic_block->bb_number;
+      break;
+  }
+  return qr->operand;
+}
+
+static void gkcc_ir_function_number_operand(struct gkcc_ir_function *fn,
+                                            struct gkcc_ir_quad_register *qr) {
+  if (qr != NULL && qr->operand == 0) qr->operand = fn->operands.count++;
+}
+
+// gkcc_ir_function_pack copies the quads of the function being lowered out of
+// the lists of its basic blocks into one array, with the quads of every basic
+// block next to each other, and its registers into an operand table. This has
+// to happen before the basic blocks are given their final numbers. The lists
+// and the operand pool are cleared since the scratch arena they live in is
+// reused for the next function.
+void gkcc_ir_function_pack(struct gkcc_ir_generation_state *gen_state) {
+  struct gkcc_ir_function *fn = gen_state->current_function;
+  int basic_block_count = gen_state->current_basic_block_number;
+
+  fn->basic_block_count = basic_block_count;
+  fn->quad_count = 0;
+  fn->operands.count = 1;
+  for (int i = 0; i < basic_block_count; i++) {
+    for (struct gkcc_ir_quad_list *ql = gen_state->basic_blocks[i]->quads_in_bb;
+         ql != NULL; ql = ql->next) {
+      fn->quad_count++;
+      gkcc_ir_function_number_operand(fn, ql->quad->dest);
+      gkcc_ir_function_number_operand(fn, ql->quad->source1);
+      gkcc_ir_function_number_operand(fn, ql->quad->source2);
+    }
+  }
+
+  struct gkcc_arena *arena = gkcc_arena_tu();
+  fn->basic_blocks = gkcc_arena_alloc(
+      arena, basic_block_count * sizeof(struct gkcc_basic_block *));
+  memcpy(fn->basic_blocks, gen_state->basic_blocks,
+         basic_block_count * sizeof(struct gkcc_basic_block *));
+  fn->quads = gkcc_arena_alloc(
+      arena, fn->quad_count * sizeof(struct gkcc_ir_packed_quad));
+  fn->operands.kinds =
+      gkcc_arena_alloc(arena, fn->operands.count *
+                                  sizeof(enum gkcc_ir_quad_register_type));
+  fn->operands.types =
+      gkcc_arena_alloc(arena, fn->operands.count * sizeof(struct gkcc_type *));
+  fn->operands.values = gkcc_arena_alloc(
+      arena, fn->operands.count * sizeof(union gkcc_ir_operand_value));
+
+  int quad_index = 0;
+  for (int i = 0; i < basic_block_count; i++) {
+    struct gkcc_basic_block *bb = gen_state->basic_blocks[i];
+    bb->first_quad = quad_index;
+    for (struct gkcc_ir_quad_list *ql = bb->quads_in_bb; ql != NULL;
+         ql = ql->next) {
+      fn->quads[quad_index++] = (struct gkcc_ir_packed_quad){
+          .instruction = ql->quad->instruction,
+          .dest = gkcc_ir_function_pack_operand(fn, ql->quad->dest),
+          .source1 = gkcc_ir_function_pack_operand(fn, ql->quad->source1),
+          .source2 = gkcc_ir_function_pack_operand(fn, ql->quad->source2),
+      };
+    }
+    bb->quad_count = quad_index - bb->first_quad;
+    bb->quads_in_bb = NULL;
+  }
+  gkcc_ir_operand_pool_release(gen_state);
+}
@@ -21,7 +21,9 @@
 #include "ast/ast.h"
 #include "ir/basic_block.h"
 #include "ir/ir_full.h"
+#include "misc/cache.h"
 #include "misc/misc.h"
+#include "misc/writer.h"
 
 // =====================================
 // === struct gkcc_ir_pseudoregister ===
@@ -36,9 +38,13 @@ struct gkcc_ir_pseudoregister {
 // === struct gkcc_ir_symbol_list ===
 // ==================================
 
+// Like the other IR lists, the first node of a symbol list doubles as its
+// handle. Its end points to the last node so that appending takes constant
+// time. end is not kept up to date on the other nodes.
 struct gkcc_ir_symbol_list {
   struct gkcc_ir_symbol *symbol;
   struct gkcc_ir_symbol_list *next;
+  struct gkcc_ir_symbol_list *end;
 };
 
 // ====================================
@@ -60,9 +66,16 @@ static const char *const GKCC_IR_QUAD_REGISTER_TYPE_STRING[] = {
 
 #undef ENUM_IR_QUAD_REGISTER_TYPE
 
+// Registers, quads and quad lists are what the translators build the quads of
+// a function with. They live in the scratch arena of the thread lowering the
+// function and are only valid until gkcc_ir_function_pack() has copied the
+// function into the dense form below.
 struct gkcc_ir_quad_register {
   enum gkcc_ir_quad_register_type register_type;
   struct gkcc_type *type;
+  // operand is the index of the register in the operand table of its function
+  // once packed. 0 until then.
+  int operand;
   union {
     struct gkcc_ir_symbol symbol;
     struct ast_constant *constant;
@@ -120,9 +133,55 @@ struct gkcc_ir_quad {
 // === struct gkcc_ir_quad_list ===
 // ================================
 
+// The first node of a quad list doubles as its handle. Its end points to the
+// last node so that appending a quad or splicing in another list takes
+// constant time. end is not kept up to date on the other nodes, so a list
+// that has been spliced into another one must not be appended to on its own.
 struct gkcc_ir_quad_list {
   struct gkcc_ir_quad *quad;
   struct gkcc_ir_quad_list *next;
+  struct gkcc_ir_quad_list *end;
+};
+
+// ===================================
+// === union gkcc_ir_operand_value ===
+// ===================================
+
+// The pseudoregister number of an operand is relative to the
+// first_pseudoregister of its function and basic_block indexes the
+// basic_blocks of its function.
+union gkcc_ir_operand_value {
+  struct gkcc_ir_symbol symbol;
+  struct ast_constant *constant;
+  struct gkcc_ir_pseudoregister pseudoregister;
+  int basic_block;
+};
+
+// ====================================
+// === struct gkcc_ir_operand_table ===
+// ====================================
+
+// gkcc_ir_operand_table holds the operands of the quads of a function as a
+// struct of arrays indexed by operand. Operand 0 is reserved for a missing
+// operand.
+struct gkcc_ir_operand_table {
+  int count;
+  enum gkcc_ir_quad_register_type *kinds;
+  struct gkcc_type **types;
+  union gkcc_ir_operand_value *values;
+};
+
+// ==================================
+// === struct gkcc_ir_packed_quad ===
+// ==================================
+
+// gkcc_ir_packed_quad is a quad as it is stored in its function. dest,
+// source1 and source2 index the operand table of the function.
+struct gkcc_ir_packed_quad {
+  enum gkcc_ir_quad_instruction instruction;
+  int dest;
+  int source1;
+  int source2;
 };
 
 // ===============================
@@ -130,9 +189,42 @@ struct gkcc_ir_quad_list {
 // ===============================
 
 struct gkcc_ir_function {
-  char *function_name;
+  // function_name is an interned handle
+  const char *function_name;
   struct gkcc_basic_block *entrance_basic_block;
   int required_space_for_locals;
+  // The basic blocks of the function are numbered from first_basic_block to
+  // first_basic_block + basic_block_count - 1
+  int first_basic_block;
+  int basic_block_count;
+  // basic_blocks holds the basic blocks in the order they were created in
+  struct gkcc_basic_block **basic_blocks;
+  // block_order holds the indices into basic_blocks of the basic blocks that
+  // can be reached from entrance_basic_block, in reverse postorder. The IR
+  // printer and the code generator lay the function out in this order.
+  int *block_order;
+  int block_order_count;
+  // The pseudoregisters of the function are numbered from
+  // first_pseudoregister on
+  int first_pseudoregister;
+  // The string constants of the function are named from
+  // .STR<first_string_constant> on
+  int first_string_constant;
+  struct gkcc_ir_symbol_list *string_constants;
+
+  // cache_key is the key the assembly of the function is stored under in the
+  // function cache, or NULL if the function cache is not used. A function
+  // found there has cached_assembly instead of quads. See
+  // ir/function_cache.h.
+  struct gkcc_cache_key *cache_key;
+  const char *cached_assembly;
+  size_t cached_assembly_length;
+
+  // The quads of all basic blocks stored back to back. See
+  // gkcc_ir_function_pack().
+  struct gkcc_ir_packed_quad *quads;
+  int quad_count;
+  struct gkcc_ir_operand_table operands;
 };
 
 // =============================
@@ -160,7 +252,11 @@ struct gkcc_ir_quad_list *gkcc_ir_quad_list_append(
 
 struct gkcc_ir_generation_state *gkcc_ir_generation_state_new(void);
 
-void gkcc_ir_quad_print(struct gkcc_ir_quad_list *ql);
+void gkcc_ir_generation_state_free(struct gkcc_ir_generation_state *gen_state);
+
+void gkcc_ir_quad_print(struct gkcc_writer *writer,
+                        struct gkcc_ir_function *fn,
+                        struct gkcc_basic_block *bb);
 
 struct gkcc_ir_quad *gkcc_ir_quad_new_with_args(
     enum gkcc_ir_quad_instruction instruction,
@@ -168,17 +264,30 @@ struct gkcc_ir_quad *gkcc_ir_quad_new_with_args(
     struct gkcc_ir_quad_register *source2);
 
 struct gkcc_ir_quad_register *gkcc_ir_quad_register_new_basic_block(
-    struct gkcc_basic_block *bb);
+    struct gkcc_ir_generation_state *gen_state, struct gkcc_basic_block *bb);
+
+struct gkcc_ir_quad_register *gkcc_ir_quad_register_new_symbol(
+    struct gkcc_ir_generation_state *gen_state, struct gkcc_symbol *symbol);
 
-struct gkcc_ir_function *gkcc_ir_function_new(char *function_name);
+struct gkcc_ir_quad_register *gkcc_ir_quad_register_new_constant(
+    struct gkcc_ir_generation_state *gen_state, struct ast_constant *constant);
+
+struct gkcc_ir_function *gkcc_ir_function_new(const char *function_name);
+
+void gkcc_ir_function_pack(struct gkcc_ir_generation_state *gen_state);
 
 struct gkcc_ir_quad_register *gkcc_ir_quad_register_new_int_constant(
-    int constant);
+    struct gkcc_ir_generation_state *gen_state, int constant);
+
+struct gkcc_type_layout gkcc_ir_quad_storage_layout(struct gkcc_type *type);
 
 struct gkcc_ir_translation_result gkcc_ir_quad_generate_declaration(
     struct gkcc_ir_generation_state *gen_state, struct ast_node *node);
 
-char *gkcc_ir_quad_register_constant_string(char *buf,
-                                            struct gkcc_ir_quad_register *qr);
+void gkcc_ir_constant_write(struct gkcc_writer *writer,
+                            struct ast_constant *constant);
+
+void gkcc_ir_operand_write(struct gkcc_writer *writer,
+                           struct gkcc_ir_function *fn, int operand);
 
 #endif  // GKCC_QUADS_H
@@ -25,11 +25,7 @@
 struct gkcc_ir_translation_result gkcc_ir_translate_ast_ident(
     struct gkcc_ir_generation_state* gen_state, struct ast_ident* ident) {
   struct gkcc_ir_quad_register* ir_register =
-      gkcc_ir_quad_register_new(GKCC_IR_QUAD_REGISTER_SYMBOL);
-  ir_register->symbol.symbol = ident->symbol_table_entry;
-  ir_register->symbol.is_global =
-      ident->symbol_table_entry->symbol_table_set->scope == GKCC_SCOPE_GLOBAL;
-  ir_register->type = ident->symbol_table_entry->symbol_type;
+      gkcc_ir_quad_register_new_symbol(gen_state, ident->symbol_table_entry);
   struct gkcc_ir_translation_result translation_result = {
       .result = ir_register,
       .ir_quad_list = NULL,
@@ -53,21 +49,22 @@ struct gkcc_ir_translation_result gkcc_ir_translate_ast_constant(
     struct gkcc_ir_generation_state* gen_state, struct ast_constant* constant) {
   // Strings go separately
   if (constant->type == AST_CONSTANT_STRING) {
-    char buf[(1 << 12) + 1];
-    sprintf(buf, ".STR%d", gen_state->current_string_constant_number++);
+    // The symbol is named .STR<n> once the string constants of every function
+    // are numbered in source order
+    gen_state->current_string_constant_number++;
     struct gkcc_ir_quad_register* ir_register =
         gkcc_ir_quad_register_new(GKCC_IR_QUAD_REGISTER_SYMBOL);
     ir_register->symbol.is_global = true;
     ir_register->symbol.symbol =
-        gkcc_symbol_new(buf, GKCC_STORAGE_CLASS_INVALID, NULL, 0, "");
+        gkcc_symbol_new(NULL, GKCC_STORAGE_CLASS_INVALID, NULL, 0, "");
 
     struct gkcc_ir_symbol* is =
         gkcc_ir_symbol_new(ir_register->symbol.symbol, true);
     is->ystring = &constant->ystring;
     ir_register->symbol.ystring = &constant->ystring;
 
-    gen_state->ir_full->global_symbols =
-        gkcc_ir_symbol_list_append(gen_state->ir_full->global_symbols, is);
+    gen_state->string_constants =
+        gkcc_ir_symbol_list_append(gen_state->string_constants, is);
 
     struct gkcc_ir_translation_result translation_result = {
         .result = ir_register,
@@ -76,11 +73,8 @@ struct gkcc_ir_translation_result gkcc_ir_translate_ast_constant(
 
     return translation_result;
   }
-  struct gkcc_ir_quad_register* ir_register =
-      gkcc_ir_quad_register_new(GKCC_IR_QUAD_REGISTER_CONSTANT);
-  ir_register->constant = constant;
   struct gkcc_ir_translation_result translation_result = {
-      .result = ir_register,
+      .result = gkcc_ir_quad_register_new_constant(gen_state, constant),
       .ir_quad_list = NULL,
   };
   return translation_result;
@@ -111,7 +105,7 @@ struct gkcc_ir_translation_result gkcc_ir_translate_ast_node_binop_add(
     rresult = intermediate.result;
     struct gkcc_ir_quad_register* size_register =
         gkcc_ir_quad_register_new_int_constant(
-            gkcc_type_sizeof(intermediate.result->type));
+            gen_state, gkcc_type_sizeof(intermediate.result->type));
     ADD_INST(gkcc_ir_quad_new_with_args(
         GKCC_IR_QUAD_INSTRUCTION_MULTIPLY, intermediate.result,
         translation_result_right.result, size_register));
@@ -126,7 +120,7 @@ struct gkcc_ir_translation_result gkcc_ir_translate_ast_node_binop_add(
     lresult = intermediate.result;
     struct gkcc_ir_quad_register* size_register =
         gkcc_ir_quad_register_new_int_constant(
-            gkcc_type_sizeof(intermediate.result->type));
+            gen_state, gkcc_type_sizeof(intermediate.result->type));
     ADD_INST(gkcc_ir_quad_new_with_args(
         GKCC_IR_QUAD_INSTRUCTION_MULTIPLY, intermediate.result,
         translation_result_left.result, size_register));
@@ -158,7 +152,7 @@ struct gkcc_ir_translation_result gkcc_ir_translate_ast_node_binop_subtract(
     rresult = intermediate.result;
     struct gkcc_ir_quad_register* size_register =
         gkcc_ir_quad_register_new_int_constant(
-            gkcc_type_sizeof(intermediate.result->type));
+            gen_state, gkcc_type_sizeof(intermediate.result->type));
     ADD_INST(gkcc_ir_quad_new_with_args(
         GKCC_IR_QUAD_INSTRUCTION_MULTIPLY, intermediate.result,
         translation_result_right.result, size_register));
@@ -172,7 +166,7 @@ struct gkcc_ir_translation_result gkcc_ir_translate_ast_node_binop_subtract(
     lresult = intermediate.result;
     struct gkcc_ir_quad_register* size_register =
         gkcc_ir_quad_register_new_int_constant(
-            gkcc_type_sizeof(intermediate.result->type));
+            gen_state, gkcc_type_sizeof(intermediate.result->type));
     ADD_INST(gkcc_ir_quad_new_with_args(
         GKCC_IR_QUAD_INSTRUCTION_MULTIPLY, intermediate.result,
         translation_result_left.result, size_register));
@@ -187,6 +181,7 @@ struct gkcc_ir_translation_result gkcc_ir_translate_ast_node_binop_subtract(
     tr.result = gkcc_ir_quad_register_new_pseudoregister(gen_state);
     struct gkcc_ir_quad_register* size_register =
         gkcc_ir_quad_register_new_int_constant(
+            gen_state,
             gkcc_type_sizeof(translation_result_left.result->type->of));
     ADD_INST(gkcc_ir_quad_new_with_args(GKCC_IR_QUAD_INSTRUCTION_DIVIDE,
                                         tr.result, old_result, size_register));
@@ -307,6 +302,13 @@ struct gkcc_ir_translation_result gkcc_ir_translate_ast_node_binop_assign(
     struct gkcc_ir_translation_result translation_result_right) {
   struct gkcc_ir_quad_register* address_of =
       gkcc_ir_quad_register_new_pseudoregister(gen_state);
+  // Named variables always occupy whole words. See
+  // gkcc_ir_quad_storage_layout()
+  if (translation_result_left.result->register_type !=
+      GKCC_IR_QUAD_REGISTER_SYMBOL) {
+    address_of->type =
+        gkcc_type_pointer_to(translation_result_left.result->type);
+  }
   ADD_INST(gkcc_ir_quad_new_with_args(GKCC_IR_QUAD_INSTRUCTION_LEA, address_of,
                                       translation_result_left.result, NULL));
   tr.result = translation_result_left.result;
@@ -575,12 +577,12 @@ struct gkcc_ir_translation_result gkcc_ir_translate_ast_function_call(
 }
 
 struct gkcc_ir_translation_result gkcc_ir_translate_ast_unary_sizeof(
-    struct gkcc_ir_generation_state* gen_state __attribute__((unused)),
+    struct gkcc_ir_generation_state* gen_state,
     struct gkcc_ir_translation_result prev_result,
     struct gkcc_ir_translation_result tr,
     struct ast_unary* unary __attribute__((unused))) {
   tr.result = gkcc_ir_quad_register_new_int_constant(
-      gkcc_type_sizeof(prev_result.result->type));
+      gen_state, gkcc_type_sizeof(prev_result.result->type));
   return tr;
 }
 
@@ -591,8 +593,7 @@ struct gkcc_ir_translation_result gkcc_ir_translate_ast_unary_addressof(
     struct ast_unary* unary __attribute((unused))) {
   ADD_INST(gkcc_ir_quad_new_with_args(GKCC_IR_QUAD_INSTRUCTION_LEA, tr.result,
                                       prev_result.result, NULL));
-  tr.result->type = gkcc_type_new(GKCC_TYPE_PTR);
-  tr.result->type->of = prev_result.result->type->of;
+  tr.result->type = gkcc_type_pointer_to(prev_result.result->type->of);
   return tr;
 }
 
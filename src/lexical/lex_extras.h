@@ -17,10 +17,12 @@
 #define LEX_EXTRAS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
-#define MAX_STR_LENGTH 2048
-
-extern char YY_FILENAME[MAX_STR_LENGTH];
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
 
 union _yynums {
   long long ylonglong;
@@ -50,18 +52,57 @@ enum _yylval_type {
   YYLVAL_TYPE_NUMBER = 0,
   YYLVAL_TYPE_STRING,
   YYLVAL_TYPE_CHAR,
+  YYLVAL_TYPE_IDENT,
 };
 
+// _yylval is the semantic value of every token and gets copied on each shift,
+// so it must stay small. Contents of string literals live in the translation
+// unit arena and are only referenced from here.
 struct _yylval {
   union _data {
     struct _yynum number;
     struct _yystring {
-      char string[MAX_STR_LENGTH];
+      const char *string;
       unsigned int length;
     } string;
     char character;
+    // ident is an interned handle from gkcc_intern
+    const char *ident;
   } data;
   enum _yylval_type type;
 };
 
+// gkcc_lex_context holds all state of one scanner besides flex's own. It is
+// the scanner's yyextra.
+struct gkcc_lex_context {
+  // filename is an interned handle of the file currently being lexed
+  const char *filename;
+
+  // literal collects the contents of the string or character literal that is
+  // currently being lexed. It grows as needed so literals have no length
+  // limit.
+  char *literal;
+  size_t literal_length;
+  size_t literal_capacity;
+
+  // input is the input set up by gkcc_lex_map_file() or
+  // gkcc_lex_scan_preprocessed(), if any. Tokens may refer to it directly, so
+  // it stays alive until gkcc_lex_release_input() is called. input_length is
+  // only set for memory mapped input.
+  char *input;
+  size_t input_length;
+  bool input_is_mapped;
+};
+
+// === FUNCTION DECLARATIONS ===
+
+yyscan_t gkcc_lex_new(void);
+void gkcc_lex_free(yyscan_t scanner);
+const char *gkcc_lex_filename(yyscan_t scanner);
+bool gkcc_lex_map_file(yyscan_t scanner, const char *path);
+void gkcc_lex_scan_preprocessed(yyscan_t scanner, char *buffer, size_t length);
+void gkcc_lex_skip(yyscan_t scanner, size_t length, int line_number,
+                   const char *filename);
+void gkcc_lex_release_input(yyscan_t scanner);
+
 #endif
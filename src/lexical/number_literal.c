@@ -0,0 +1,203 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "number_literal.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Ranges of the target's (i386) integer types
+#define GKCC_TARGET_INT_MAX 0x7FFFFFFFull
+#define GKCC_TARGET_UINT_MAX 0xFFFFFFFFull
+#define GKCC_TARGET_LONG_MAX GKCC_TARGET_INT_MAX
+#define GKCC_TARGET_ULONG_MAX GKCC_TARGET_UINT_MAX
+#define GKCC_TARGET_LONGLONG_MAX 0x7FFFFFFFFFFFFFFFull
+
+static int gkcc_digit_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static void gkcc_set_integer(struct _yynum *number, enum _yynum_type type,
+                             bool is_unsigned, unsigned long long value) {
+  number->type = type;
+  number->is_unsigned = is_unsigned;
+  switch (type) {
+    case YYNUM_TYPE_INT:
+      number->num.yint = (int)(unsigned int)value;
+      break;
+    case YYNUM_TYPE_LONG:
+      number->num.ylong = is_unsigned ? (long)(unsigned int)value
+                                      : (long)(int)(unsigned int)value;
+      break;
+    default:
+      number->num.ylonglong = (long long)value;
+      break;
+  }
+}
+
+// gkcc_decode_integer_literal decodes a decimal, hexadecimal or octal integer
+// constant including its suffix. The type is picked following C17 6.4.4.1: the
+// first type allowed by the suffix and base that can represent the value.
+// Returns false if the value does not fit in any integer type, in which case it
+// is truncated to an unsigned long long.
+bool gkcc_decode_integer_literal(const char *text, size_t length,
+                                 struct _yynum *number) {
+  size_t pos = 0;
+  unsigned int base = 10;
+  if (length > 1 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+    base = 16;
+    pos = 2;
+  } else if (text[0] == '0') {
+    base = 8;
+  }
+
+  unsigned long long value = 0;
+  bool overflow = false;
+  for (; pos < length; pos++) {
+    int digit = gkcc_digit_value(text[pos]);
+    if (digit < 0 || (unsigned int)digit >= base) break;
+    if (value > (ULLONG_MAX - digit) / base) overflow = true;
+    value = value * base + digit;
+  }
+
+  int longs = 0;
+  bool is_unsigned = false;
+  for (; pos < length; pos++) {
+    if (text[pos] == 'u' || text[pos] == 'U') is_unsigned = true;
+    if (text[pos] == 'l' || text[pos] == 'L') longs++;
+  }
+
+  if (overflow) {
+    gkcc_set_integer(number, YYNUM_TYPE_LONGLONG, true, value);
+    return false;
+  }
+
+  // Octal and hexadecimal constants may become unsigned without a suffix
+  bool may_be_unsigned = is_unsigned || base != 10;
+
+  if (longs == 0) {
+    if (!is_unsigned && value <= GKCC_TARGET_INT_MAX) {
+      gkcc_set_integer(number, YYNUM_TYPE_INT, false, value);
+      return true;
+    }
+    if (may_be_unsigned && value <= GKCC_TARGET_UINT_MAX) {
+      gkcc_set_integer(number, YYNUM_TYPE_INT, true, value);
+      return true;
+    }
+  }
+  if (longs <= 1) {
+    if (!is_unsigned && value <= GKCC_TARGET_LONG_MAX) {
+      gkcc_set_integer(number, YYNUM_TYPE_LONG, false, value);
+      return true;
+    }
+    if (may_be_unsigned && value <= GKCC_TARGET_ULONG_MAX) {
+      gkcc_set_integer(number, YYNUM_TYPE_LONG, true, value);
+      return true;
+    }
+  }
+  if (!is_unsigned && value <= GKCC_TARGET_LONGLONG_MAX) {
+    gkcc_set_integer(number, YYNUM_TYPE_LONGLONG, false, value);
+    return true;
+  }
+
+  // Like gcc, decimal constants that are too large for long long are made
+  // unsigned
+  gkcc_set_integer(number, YYNUM_TYPE_LONGLONG, true, value);
+  return true;
+}
+
+// Powers of ten that are exactly representable as a double
+static const double gkcc_exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// gkcc_decode_double_fast handles the common case of a decimal literal with a
+// short mantissa and a small exponent. The mantissa and the power of ten are
+// then both exact, so a single multiplication or division is correctly
+// rounded. Returns false if the literal needs the general algorithm.
+static bool gkcc_decode_double_fast(const char *text, size_t length,
+                                    double *result) {
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  size_t pos = 0;
+
+  for (; pos < length && text[pos] >= '0' && text[pos] <= '9'; pos++) {
+    if (mantissa == 0 && text[pos] == '0') continue;
+    if (++digits > 19) return false;
+    mantissa = mantissa * 10 + (text[pos] - '0');
+  }
+  if (pos < length && text[pos] == '.') {
+    for (pos++; pos < length && text[pos] >= '0' && text[pos] <= '9'; pos++) {
+      exponent--;
+      if (mantissa == 0 && text[pos] == '0') continue;
+      if (++digits > 19) return false;
+      mantissa = mantissa * 10 + (text[pos] - '0');
+    }
+  }
+  if (pos < length && (text[pos] == 'e' || text[pos] == 'E')) {
+    pos++;
+    bool negative = false;
+    if (text[pos] == '+' || text[pos] == '-') negative = text[pos++] == '-';
+    int written = 0;
+    for (; pos < length && text[pos] >= '0' && text[pos] <= '9'; pos++) {
+      written = written * 10 + (text[pos] - '0');
+      if (written > 1000) return false;
+    }
+    exponent += negative ? -written : written;
+  }
+
+  if (mantissa > (1ull << 53) || exponent < -22 || exponent > 22) {
+    return false;
+  }
+
+  *result = exponent < 0
+                ? (double)mantissa / gkcc_exact_powers_of_ten[-exponent]
+                : (double)mantissa * gkcc_exact_powers_of_ten[exponent];
+  return true;
+}
+
+// gkcc_decode_float_literal decodes a decimal or hexadecimal floating constant
+// including its suffix. text must be followed by a character that cannot be
+// part of the literal, as yytext is.
+void gkcc_decode_float_literal(const char *text, size_t length,
+                               struct _yynum *number) {
+  number->is_unsigned = false;
+  char suffix = text[length - 1];
+
+  if (suffix == 'f' || suffix == 'F') {
+    number->type = YYNUM_TYPE_FLOAT;
+    number->num.yfloat = strtof(text, NULL);
+    return;
+  }
+
+  if (suffix == 'l' || suffix == 'L') {
+    number->type = YYNUM_TYPE_LONG_DOUBLE;
+    number->num.ylongdouble = strtold(text, NULL);
+    return;
+  }
+
+  number->type = YYNUM_TYPE_DOUBLE;
+  bool is_hex =
+      length > 1 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X');
+  if (is_hex || !gkcc_decode_double_fast(text, length, &number->num.ydouble)) {
+    number->num.ydouble = strtod(text, NULL);
+  }
+}
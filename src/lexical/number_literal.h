@@ -0,0 +1,31 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GKCC_NUMBER_LITERAL_H
+#define GKCC_NUMBER_LITERAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lex_extras.h"
+
+// === FUNCTION DECLARATIONS ===
+
+bool gkcc_decode_integer_literal(const char *text, size_t length,
+                                 struct _yynum *number);
+void gkcc_decode_float_literal(const char *text, size_t length,
+                               struct _yynum *number);
+
+#endif  // GKCC_NUMBER_LITERAL_H
@@ -20,10 +20,10 @@
 #include "lex_extras.h"
 #include "misc.h"
 
-YYSTYPE yylval;
+YYSTYPE token_value;
 
 // Stopgap until proper replacement
-#define yylval yylval.yylval
+#define yylval token_value.yylval
 
 char buf[10];
 char *TP_YYEOF = "YYEOF";
@@ -270,13 +270,15 @@ void print_num() {
 }
 
 int main(int argc, char **argv) {
+  yyscan_t scanner = gkcc_lex_new();
   while (true) {
-    int val = yylex();
+    int val = yylex(&token_value, scanner);
     if (val == 0) break;
 
-    printf("%s\t%d\t%s\t", YY_FILENAME, yylineno, nameof(val));
+    printf("%s\t%d\t%s\t", gkcc_lex_filename(scanner),
+           yyget_lineno(scanner), nameof(val));
 
-    if (val == IDENT) printf("%s", yytext);
+    if (val == IDENT) printf("%s", yyget_text(scanner));
 
     if (val == NUMBER) print_num();
 
@@ -288,4 +290,5 @@ int main(int argc, char **argv) {
 
     printf("\n");
   }
+  gkcc_lex_free(scanner);
 }
@@ -0,0 +1,218 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+
+// The arena used by the constructors of AST nodes, types and symbols for the
+// translation unit currently being compiled. Each thread compiles its own
+// translation unit, so every thread has its own arena.
+static _Thread_local struct gkcc_arena *tu_arena = NULL;
+// joined_arena is the arena of another thread whose translation unit this
+// thread is helping with. See gkcc_arena_tu_join().
+static _Thread_local struct gkcc_arena *joined_arena = NULL;
+// function_arena holds the body of the function definition being compiled in
+// streaming mode. See gkcc_arena_function_begin().
+static _Thread_local struct gkcc_arena *function_arena = NULL;
+// largest_function_arena keeps the statistics of the biggest function arena
+// released so far. It owns no chunks.
+static _Thread_local struct gkcc_arena largest_function_arena;
+
+static size_t gkcc_arena_align(size_t size) {
+  return (size + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1);
+}
+
+static struct gkcc_arena_chunk *gkcc_arena_chunk_new(struct gkcc_arena *arena,
+                                                     size_t min_size) {
+  size_t size = GKCC_ARENA_DEFAULT_CHUNK_SIZE;
+  if (min_size > size) size = min_size;
+
+  // calloc hands us zeroed memory so individual allocations never need to be
+  // cleared.
+  struct gkcc_arena_chunk *chunk =
+      calloc(1, sizeof(struct gkcc_arena_chunk) + size);
+  gkcc_assert(chunk != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate arena chunk");
+  chunk->size = size;
+
+  arena->bytes_reserved += size;
+  arena->chunk_count++;
+  return chunk;
+}
+
+struct gkcc_arena *gkcc_arena_new(void) {
+  struct gkcc_arena *arena = malloc(sizeof(struct gkcc_arena));
+  memset(arena, 0, sizeof(struct gkcc_arena));
+  return arena;
+}
+
+// gkcc_arena_alloc returns size bytes of zeroed memory aligned for any type.
+void *gkcc_arena_alloc(struct gkcc_arena *arena, size_t size) {
+  size = gkcc_arena_align(size);
+
+  struct gkcc_arena_chunk *chunk = arena->chunks;
+  if (chunk == NULL || chunk->size - chunk->used < size) {
+    struct gkcc_arena_chunk *new_chunk = gkcc_arena_chunk_new(arena, size);
+    if (chunk != NULL && size > GKCC_ARENA_DEFAULT_CHUNK_SIZE) {
+      // Oversized allocations get a chunk of their own. Keep bumping out of
+      // the current chunk afterwards.
+      new_chunk->next = chunk->next;
+      chunk->next = new_chunk;
+      chunk = new_chunk;
+    } else {
+      new_chunk->next = chunk;
+      arena->chunks = new_chunk;
+      chunk = new_chunk;
+    }
+  }
+
+  void *ptr = (char *)chunk->data + chunk->used;
+  chunk->used += size;
+
+  arena->bytes_allocated += size;
+  arena->allocation_count++;
+  return ptr;
+}
+
+char *gkcc_arena_strdup(struct gkcc_arena *arena, const char *str) {
+  size_t length = strlen(str);
+  char *copy = gkcc_arena_alloc(arena, length + 1);
+  memcpy(copy, str, length);
+  return copy;
+}
+
+// gkcc_arena_merge hands every chunk of from over to into and frees from. The
+// allocations of from live as long as into afterwards.
+void gkcc_arena_merge(struct gkcc_arena *into, struct gkcc_arena *from) {
+  if (from->chunks != NULL) {
+    struct gkcc_arena_chunk *last = from->chunks;
+    while (last->next != NULL) last = last->next;
+
+    // The chunks go behind the current chunk of into, which allocations keep
+    // bumping out of
+    if (into->chunks == NULL) {
+      into->chunks = from->chunks;
+    } else {
+      last->next = into->chunks->next;
+      into->chunks->next = from->chunks;
+    }
+  }
+
+  into->bytes_allocated += from->bytes_allocated;
+  into->bytes_reserved += from->bytes_reserved;
+  into->chunk_count += from->chunk_count;
+  into->allocation_count += from->allocation_count;
+  free(from);
+}
+
+// gkcc_arena_free releases every chunk of the arena and the arena itself.
+void gkcc_arena_free(struct gkcc_arena *arena) {
+  if (arena == NULL) return;
+
+  struct gkcc_arena_chunk *next = NULL;
+  for (struct gkcc_arena_chunk *chunk = arena->chunks; chunk != NULL;
+       chunk = next) {
+    next = chunk->next;
+    free(chunk);
+  }
+  free(arena);
+}
+
+// gkcc_arena_reset releases every allocation of the arena but keeps its
+// current chunk, cleared, for the allocations that follow.
+void gkcc_arena_reset(struct gkcc_arena *arena) {
+  struct gkcc_arena_chunk *chunk = arena->chunks;
+  if (chunk == NULL) return;
+
+  struct gkcc_arena_chunk *next = NULL;
+  for (struct gkcc_arena_chunk *old = chunk->next; old != NULL; old = next) {
+    next = old->next;
+    free(old);
+  }
+  memset(chunk->data, 0, chunk->used);
+  chunk->used = 0;
+  chunk->next = NULL;
+
+  arena->bytes_allocated = 0;
+  arena->bytes_reserved = chunk->size;
+  arena->chunk_count = 1;
+  arena->allocation_count = 0;
+}
+
+void gkcc_arena_print_stats(FILE *out, struct gkcc_arena *arena,
+                            const char *name) {
+  if (arena == NULL) return;
+
+  fprintf(out,
+          "arena %s: %zu allocations, %zu bytes allocated, %zu bytes reserved "
+          "in %zu chunks\n",
+          name, arena->allocation_count, arena->bytes_allocated,
+          arena->bytes_reserved, arena->chunk_count);
+}
+
+// gkcc_arena_tu returns the arena for the current translation unit, creating
+// it if this is the first allocation.
+struct gkcc_arena *gkcc_arena_tu(void) {
+  if (joined_arena != NULL) return joined_arena;
+  if (function_arena != NULL) return function_arena;
+  if (tu_arena == NULL) {
+    tu_arena = gkcc_arena_new();
+  }
+  return tu_arena;
+}
+
+// gkcc_arena_tu_release frees everything allocated for the current
+// translation unit. All AST nodes, types and symbols are invalid afterwards.
+void gkcc_arena_tu_release(void) {
+  gkcc_arena_free(tu_arena);
+  tu_arena = NULL;
+}
+
+// gkcc_arena_tu_join makes the calling thread allocate from the translation
+// unit arena of another thread, or from its own again if arena is NULL.
+void gkcc_arena_tu_join(struct gkcc_arena *arena) { joined_arena = arena; }
+
+// gkcc_arena_function_begin makes gkcc_arena_tu return a fresh arena until
+// gkcc_arena_function_release. Everything allocated for the body of a function
+// definition then goes away once the function has been compiled, while
+// declarations outside of it stay in the translation unit arena.
+void gkcc_arena_function_begin(void) {
+  gkcc_assert(function_arena == NULL, GKCC_ERROR_INVALID_ARGUMENTS,
+              "gkcc_arena_function_begin() called inside a function");
+  function_arena = gkcc_arena_new();
+}
+
+// gkcc_arena_function_release frees the arena of the current function
+// definition and goes back to allocating from the translation unit arena.
+void gkcc_arena_function_release(void) {
+  if (function_arena == NULL) return;
+
+  if (function_arena->bytes_reserved > largest_function_arena.bytes_reserved) {
+    largest_function_arena = *function_arena;
+    largest_function_arena.chunks = NULL;
+  }
+  gkcc_arena_free(function_arena);
+  function_arena = NULL;
+}
+
+// gkcc_arena_function_largest returns the statistics of the largest function
+// arena released so far.
+struct gkcc_arena *gkcc_arena_function_largest(void) {
+  return &largest_function_arena;
+}
@@ -0,0 +1,67 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GKCC_ARENA_H
+#define GKCC_ARENA_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// =========================
+// === struct gkcc_arena ===
+// =========================
+
+// gkcc_arena is a bump pointer region allocator. Memory handed out by an
+// arena is zeroed and lives until the whole arena is released with
+// gkcc_arena_free. There is no way to free a single allocation.
+
+#define GKCC_ARENA_DEFAULT_CHUNK_SIZE (1 << 16)
+
+struct gkcc_arena_chunk {
+  struct gkcc_arena_chunk *next;
+  size_t size;
+  size_t used;
+  max_align_t data[];
+};
+
+struct gkcc_arena {
+  struct gkcc_arena_chunk *chunks;
+
+  // Statistics
+  size_t bytes_allocated;
+  size_t bytes_reserved;
+  size_t chunk_count;
+  size_t allocation_count;
+};
+
+// === FUNCTION DECLARATIONS ===
+
+struct gkcc_arena *gkcc_arena_new(void);
+void *gkcc_arena_alloc(struct gkcc_arena *arena, size_t size);
+char *gkcc_arena_strdup(struct gkcc_arena *arena, const char *str);
+void gkcc_arena_merge(struct gkcc_arena *into, struct gkcc_arena *from);
+void gkcc_arena_free(struct gkcc_arena *arena);
+void gkcc_arena_reset(struct gkcc_arena *arena);
+void gkcc_arena_print_stats(FILE *out, struct gkcc_arena *arena,
+                            const char *name);
+
+struct gkcc_arena *gkcc_arena_tu(void);
+void gkcc_arena_tu_release(void);
+void gkcc_arena_tu_join(struct gkcc_arena *arena);
+void gkcc_arena_function_begin(void);
+void gkcc_arena_function_release(void);
+struct gkcc_arena *gkcc_arena_function_largest(void);
+
+#endif  // GKCC_ARENA_H
@@ -0,0 +1,514 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "cache.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "misc.h"
+#include "writer.h"
+
+// Every entry starts with GKCC_CACHE_MAGIC and its key, followed by the
+// assembly
+#define GKCC_CACHE_MAGIC "GKCCACH1"
+#define GKCC_CACHE_ENTRY_SUFFIX ".gkcc"
+#define GKCC_CACHE_TEMPORARY_PREFIX "tmp."
+// Temporary files left behind by a compiler that failed are removed once
+// they are this old
+#define GKCC_CACHE_TEMPORARY_MAX_AGE (60 * 60)
+
+struct gkcc_cache_entry_header {
+  char magic[8];
+  uint64_t hash[2];
+};
+
+// ============
+// === KEYS ===
+// ============
+
+void gkcc_cache_key_init(struct gkcc_cache_key *key) {
+  key->hash[0] = 0x6a09e667f3bcc908ULL;
+  key->hash[1] = 0xbb67ae8584caa73bULL;
+}
+
+// gkcc_cache_key_add_word mixes 8 bytes into both halves of the key. The
+// halves are mixed differently so that together they make a 128 bit hash.
+static void gkcc_cache_key_add_word(struct gkcc_cache_key *key,
+                                    uint64_t word) {
+  key->hash[0] = (key->hash[0] ^ word) * 0x9e3779b97f4a7c15ULL;
+  key->hash[0] ^= key->hash[0] >> 32;
+  uint64_t h1 = key->hash[1] + word;
+  key->hash[1] = ((h1 << 27) | (h1 >> 37)) * 0xc2b2ae3d27d4eb4fULL;
+}
+
+// gkcc_cache_key_add adds data to the key. The length of data is added as
+// well, so adding "ab" and "c" is different from adding "a" and "bc".
+void gkcc_cache_key_add(struct gkcc_cache_key *key, const void *data,
+                        size_t length) {
+  const unsigned char *bytes = data;
+  size_t remaining = length;
+  uint64_t word;
+  for (; remaining >= sizeof(word); remaining -= sizeof(word)) {
+    memcpy(&word, bytes, sizeof(word));
+    gkcc_cache_key_add_word(key, word);
+    bytes += sizeof(word);
+  }
+  word = 0;
+  memcpy(&word, bytes, remaining);
+  gkcc_cache_key_add_word(key, word);
+  gkcc_cache_key_add_word(key, length);
+}
+
+// The build id is looked up once, as every function gets a key of its own
+static uint64_t build_id[5];
+static bool has_build_id;
+static pthread_once_t build_id_once = PTHREAD_ONCE_INIT;
+
+static void gkcc_cache_build_id_init(void) {
+  struct stat st;
+  if (stat("/proc/self/exe", &st) != 0) return;
+
+  build_id[0] = st.st_dev;
+  build_id[1] = st.st_ino;
+  build_id[2] = st.st_size;
+  build_id[3] = st.st_mtim.tv_sec;
+  build_id[4] = st.st_mtim.tv_nsec;
+  has_build_id = true;
+}
+
+// gkcc_cache_key_add_build_id adds something that changes whenever the
+// compiler is rebuilt: the identity and modification time of its executable.
+// Returns false if that cannot be found out.
+bool gkcc_cache_key_add_build_id(struct gkcc_cache_key *key) {
+  pthread_once(&build_id_once, gkcc_cache_build_id_init);
+  if (!has_build_id) return false;
+
+  gkcc_cache_key_add(key, build_id, sizeof(build_id));
+  return true;
+}
+
+// gkcc_cache_key_finish returns the final value of one half of the key, with
+// every bit of the input affecting every bit of the result
+static uint64_t gkcc_cache_key_finish(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static struct gkcc_cache_entry_header gkcc_cache_entry_header(
+    struct gkcc_cache_key *key) {
+  struct gkcc_cache_entry_header header = {
+      .hash = {gkcc_cache_key_finish(key->hash[0]),
+               gkcc_cache_key_finish(key->hash[1])},
+  };
+  memcpy(header.magic, GKCC_CACHE_MAGIC, sizeof(header.magic));
+  return header;
+}
+
+// gkcc_cache_path returns the malloc'd path of name in the cache directory
+static char *gkcc_cache_path(struct gkcc_cache *cache, const char *name) {
+  size_t dir_length = strlen(cache->dir);
+  char *path = malloc(dir_length + strlen(name) + 2);
+  gkcc_assert(path != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate cache path");
+  memcpy(path, cache->dir, dir_length);
+  path[dir_length] = '/';
+  strcpy(path + dir_length + 1, name);
+  return path;
+}
+
+static char *gkcc_cache_entry_path(struct gkcc_cache *cache,
+                                   struct gkcc_cache_key *key) {
+  struct gkcc_cache_entry_header header = gkcc_cache_entry_header(key);
+  char name[64];
+  sprintf(name, "%016llx%016llx" GKCC_CACHE_ENTRY_SUFFIX,
+          (unsigned long long)header.hash[0],
+          (unsigned long long)header.hash[1]);
+  return gkcc_cache_path(cache, name);
+}
+
+// =============
+// === STATS ===
+// =============
+
+// gkcc_cache_lock locks the stats of the cache and reads them. They are
+// written back and unlocked by gkcc_cache_unlock().
+static struct gkcc_cache_stats gkcc_cache_lock(struct gkcc_cache *cache,
+                                               int operation) {
+  struct gkcc_cache_stats stats = {0};
+  flock(cache->stats_fd, operation);
+  if (pread(cache->stats_fd, &stats, sizeof(stats), 0) != sizeof(stats)) {
+    memset(&stats, 0, sizeof(stats));
+  }
+  return stats;
+}
+
+// gkcc_cache_unlock adds the lookups counted since the stats were last written
+// to stats, writes them back and unlocks them. stats is NULL if they were
+// only read.
+static void gkcc_cache_unlock(struct gkcc_cache *cache,
+                              struct gkcc_cache_stats *stats) {
+  if (stats != NULL) {
+    stats->hits += cache->hits;
+    stats->misses += cache->misses;
+    cache->hits = 0;
+    cache->misses = 0;
+    pwrite(cache->stats_fd, stats, sizeof(*stats), 0);
+  }
+  flock(cache->stats_fd, LOCK_UN);
+}
+
+// ================
+// === EVICTION ===
+// ================
+
+struct gkcc_cache_file {
+  struct timespec last_used;
+  uint64_t size;
+  char *name;
+};
+
+static int gkcc_cache_file_compare(const void *a, const void *b) {
+  const struct gkcc_cache_file *file_a = a;
+  const struct gkcc_cache_file *file_b = b;
+  if (file_a->last_used.tv_sec != file_b->last_used.tv_sec) {
+    return file_a->last_used.tv_sec < file_b->last_used.tv_sec ? -1 : 1;
+  }
+  if (file_a->last_used.tv_nsec != file_b->last_used.tv_nsec) {
+    return file_a->last_used.tv_nsec < file_b->last_used.tv_nsec ? -1 : 1;
+  }
+  return 0;
+}
+
+static bool gkcc_cache_has_suffix(const char *name, const char *suffix) {
+  size_t length = strlen(name);
+  size_t suffix_length = strlen(suffix);
+  return length >= suffix_length &&
+         strcmp(name + length - suffix_length, suffix) == 0;
+}
+
+// gkcc_cache_evict removes the least recently used entries until they take up
+// no more than three quarters of the size limit, so that it does not have to
+// run again for every new entry. It also counts the size of the entries again
+// and removes abandoned temporary files. The stats must be locked.
+static void gkcc_cache_evict(struct gkcc_cache *cache,
+                             struct gkcc_cache_stats *stats) {
+  DIR *dir = opendir(cache->dir);
+  if (dir == NULL) return;
+
+  struct gkcc_cache_file *files = NULL;
+  size_t file_count = 0;
+  size_t file_capacity = 0;
+  uint64_t size = 0;
+  time_t now = time(NULL);
+  for (struct dirent *dirent = readdir(dir); dirent != NULL;
+       dirent = readdir(dir)) {
+    struct stat st;
+    char *path = gkcc_cache_path(cache, dirent->d_name);
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+      free(path);
+      continue;
+    }
+
+    if (strncmp(dirent->d_name, GKCC_CACHE_TEMPORARY_PREFIX,
+                strlen(GKCC_CACHE_TEMPORARY_PREFIX)) == 0) {
+      if (now - st.st_mtim.tv_sec > GKCC_CACHE_TEMPORARY_MAX_AGE) {
+        unlink(path);
+      }
+      free(path);
+      continue;
+    }
+    if (!gkcc_cache_has_suffix(dirent->d_name, GKCC_CACHE_ENTRY_SUFFIX)) {
+      free(path);
+      continue;
+    }
+
+    if (file_count == file_capacity) {
+      file_capacity = file_capacity == 0 ? 64 : file_capacity * 2;
+      files = realloc(files, file_capacity * sizeof(struct gkcc_cache_file));
+      gkcc_assert(files != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                  "Failed to grow the list of cache entries");
+    }
+    files[file_count++] = (struct gkcc_cache_file){
+        .last_used = st.st_mtim, .size = st.st_size, .name = path};
+    size += st.st_size;
+  }
+  closedir(dir);
+
+  // Oldest first
+  qsort(files, file_count, sizeof(struct gkcc_cache_file),
+        gkcc_cache_file_compare);
+  uint64_t target = cache->max_size / 4 * 3;
+  for (size_t i = 0; i < file_count; i++) {
+    if (size > target && unlink(files[i].name) == 0) {
+      size -= files[i].size;
+      stats->evictions++;
+    }
+    free(files[i].name);
+  }
+  free(files);
+  stats->size = size;
+}
+
+// =============
+// === CACHE ===
+// =============
+
+// gkcc_cache_open opens the cache in dir, creating the directory if needed.
+// Returns NULL if it cannot be used.
+struct gkcc_cache *gkcc_cache_open(const char *dir, uint64_t max_size) {
+  if (mkdir(dir, 0777) != 0) {
+    struct stat st;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) return NULL;
+  }
+
+  struct gkcc_cache *cache = calloc(1, sizeof(struct gkcc_cache));
+  gkcc_assert(cache != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate cache");
+  cache->dir = strdup(dir);
+  cache->max_size = max_size;
+
+  char *stats_path = gkcc_cache_path(cache, "stats");
+  cache->stats_fd = open(stats_path, O_RDWR | O_CREAT, 0666);
+  free(stats_path);
+  if (cache->stats_fd < 0) {
+    free(cache->dir);
+    free(cache);
+    return NULL;
+  }
+  return cache;
+}
+
+// gkcc_cache_open_entry opens the entry for key and reads past its header.
+// Returns -1 if there is no entry for key. Opening an entry makes it the most
+// recently used.
+static int gkcc_cache_open_entry(struct gkcc_cache *cache,
+                                 struct gkcc_cache_key *key) {
+  char *path = gkcc_cache_entry_path(cache, key);
+  int fd = open(path, O_RDONLY);
+  free(path);
+  if (fd < 0) return -1;
+
+  struct gkcc_cache_entry_header expected = gkcc_cache_entry_header(key);
+  struct gkcc_cache_entry_header header;
+  if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+      memcmp(&header, &expected, sizeof(header)) != 0) {
+    close(fd);
+    return -1;
+  }
+  futimens(fd, NULL);
+  return fd;
+}
+
+// gkcc_cache_count_lookup counts a lookup. Lookups are only added to the
+// stats in the cache directory the next time they are written, so that
+// looking up every function of a translation unit does not lock them each
+// time.
+static void gkcc_cache_count_lookup(struct gkcc_cache *cache, bool hit) {
+  if (hit) {
+    cache->hits++;
+  } else {
+    cache->misses++;
+  }
+}
+
+// gkcc_cache_fetch writes the assembly stored for key to out and returns true
+// if there is an entry for it
+bool gkcc_cache_fetch(struct gkcc_cache *cache, struct gkcc_cache_key *key,
+                      FILE *out) {
+  int fd = gkcc_cache_open_entry(cache, key);
+  if (fd >= 0) {
+    char *buffer = malloc(GKCC_WRITER_BLOCK_SIZE);
+    gkcc_assert(buffer != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                "Failed to allocate cache read buffer");
+    for (ssize_t length = read(fd, buffer, GKCC_WRITER_BLOCK_SIZE);
+         length > 0; length = read(fd, buffer, GKCC_WRITER_BLOCK_SIZE)) {
+      fwrite(buffer, 1, length, out);
+    }
+    free(buffer);
+    close(fd);
+  }
+
+  gkcc_cache_count_lookup(cache, fd >= 0);
+  return fd >= 0;
+}
+
+// gkcc_cache_read returns a malloc'd copy of what is stored for key and sets
+// *length to its size, or returns NULL if there is no entry for it
+char *gkcc_cache_read(struct gkcc_cache *cache, struct gkcc_cache_key *key,
+                      size_t *length) {
+  char *data = NULL;
+  int fd = gkcc_cache_open_entry(cache, key);
+  struct stat st;
+  if (fd >= 0 && fstat(fd, &st) == 0 &&
+      st.st_size >= (off_t)sizeof(struct gkcc_cache_entry_header)) {
+    *length = st.st_size - sizeof(struct gkcc_cache_entry_header);
+    data = malloc(*length + 1);
+    gkcc_assert(data != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                "Failed to allocate cache entry");
+    size_t used = 0;
+    while (used < *length) {
+      ssize_t read_length = read(fd, &data[used], *length - used);
+      if (read_length <= 0) break;
+      used += read_length;
+    }
+    if (used != *length) {
+      free(data);
+      data = NULL;
+    }
+  }
+  if (fd >= 0) close(fd);
+
+  gkcc_cache_count_lookup(cache, data != NULL);
+  return data;
+}
+
+// gkcc_cache_entry_begin creates the temporary file a new entry for key is
+// written to before it is renamed to *path by gkcc_cache_entry_commit().
+// Returns NULL if it cannot be created.
+static FILE *gkcc_cache_entry_begin(struct gkcc_cache *cache,
+                                    struct gkcc_cache_key *key, char **path,
+                                    char **temporary_path) {
+  *path = gkcc_cache_entry_path(cache, key);
+  char name[64];
+  sprintf(name, GKCC_CACHE_TEMPORARY_PREFIX "%ld.XXXXXX", (long)getpid());
+  *temporary_path = gkcc_cache_path(cache, name);
+  int fd = mkstemp(*temporary_path);
+  FILE *entry = NULL;
+  // mkstemp only lets the owner read the file, but the cache may be shared
+  if (fd >= 0 && fchmod(fd, 0644) == 0) entry = fdopen(fd, "w");
+  if (entry == NULL) {
+    if (fd >= 0) {
+      close(fd);
+      unlink(*temporary_path);
+    }
+    free(*path);
+    free(*temporary_path);
+    return NULL;
+  }
+
+  struct gkcc_cache_entry_header header = gkcc_cache_entry_header(key);
+  fwrite(&header, sizeof(header), 1, entry);
+  return entry;
+}
+
+// gkcc_cache_entry_commit closes entry, renames it into place and evicts old
+// entries if the cache has grown too large
+static void gkcc_cache_entry_commit(struct gkcc_cache *cache, FILE *entry,
+                                    char *path, char *temporary_path) {
+  bool written = fflush(entry) == 0 && !ferror(entry);
+  struct stat st;
+  written = fstat(fileno(entry), &st) == 0 && written;
+  written = fclose(entry) == 0 && written;
+
+  // The rename happens with the stats locked so that an entry stored by two
+  // compilers at the same time is only counted once
+  struct gkcc_cache_stats stats = gkcc_cache_lock(cache, LOCK_EX);
+  struct stat replaced;
+  uint64_t replaced_size = stat(path, &replaced) == 0 ? replaced.st_size : 0;
+  written = written && rename(temporary_path, path) == 0;
+  if (written) {
+    stats.stores++;
+    stats.size += st.st_size;
+    stats.size = stats.size > replaced_size ? stats.size - replaced_size : 0;
+    if (stats.size > cache->max_size) gkcc_cache_evict(cache, &stats);
+  } else {
+    unlink(temporary_path);
+  }
+  gkcc_cache_unlock(cache, &stats);
+
+  free(path);
+  free(temporary_path);
+}
+
+// gkcc_cache_store_begin starts a new entry for key and returns the file the
+// assembly has to be written to. The entry is only added to the cache by
+// gkcc_cache_store_commit(). Returns NULL if the entry cannot be created.
+FILE *gkcc_cache_store_begin(struct gkcc_cache *cache,
+                             struct gkcc_cache_key *key) {
+  gkcc_assert(cache->entry == NULL, GKCC_ERROR_INVALID_ARGUMENTS,
+              "gkcc_cache_store_begin() called with an entry already begun");
+
+  cache->entry = gkcc_cache_entry_begin(cache, key, &cache->entry_path,
+                                        &cache->entry_temporary_path);
+  return cache->entry;
+}
+
+// gkcc_cache_store_commit adds the entry begun by gkcc_cache_store_begin() to
+// the cache
+void gkcc_cache_store_commit(struct gkcc_cache *cache) {
+  if (cache->entry == NULL) return;
+
+  gkcc_cache_entry_commit(cache, cache->entry, cache->entry_path,
+                          cache->entry_temporary_path);
+  cache->entry = NULL;
+}
+
+// gkcc_cache_store adds an entry with the given data for key to the cache. It
+// can be used while an entry begun by gkcc_cache_store_begin() is open.
+void gkcc_cache_store(struct gkcc_cache *cache, struct gkcc_cache_key *key,
+                      const void *data, size_t length) {
+  char *path;
+  char *temporary_path;
+  FILE *entry = gkcc_cache_entry_begin(cache, key, &path, &temporary_path);
+  if (entry == NULL) return;
+
+  fwrite(data, 1, length, entry);
+  gkcc_cache_entry_commit(cache, entry, path, temporary_path);
+}
+
+void gkcc_cache_print_stats(FILE *out, struct gkcc_cache *cache) {
+  struct gkcc_cache_stats stats = gkcc_cache_lock(cache, LOCK_EX);
+  gkcc_cache_unlock(cache, &stats);
+
+  fprintf(out,
+          "cache %s: %llu hits, %llu misses, %llu stores, %llu evictions, "
+          "%llu of %llu bytes used\n",
+          cache->dir, (unsigned long long)stats.hits,
+          (unsigned long long)stats.misses, (unsigned long long)stats.stores,
+          (unsigned long long)stats.evictions, (unsigned long long)stats.size,
+          (unsigned long long)cache->max_size);
+}
+
+// gkcc_cache_close writes out the lookups that have not been counted yet and
+// closes the cache. An entry that was begun but not committed is thrown away.
+void gkcc_cache_close(struct gkcc_cache *cache) {
+  if (cache == NULL) return;
+
+  if (cache->entry != NULL) {
+    fclose(cache->entry);
+    unlink(cache->entry_temporary_path);
+    free(cache->entry_path);
+    free(cache->entry_temporary_path);
+  }
+  if (cache->hits != 0 || cache->misses != 0) {
+    struct gkcc_cache_stats stats = gkcc_cache_lock(cache, LOCK_EX);
+    gkcc_cache_unlock(cache, &stats);
+  }
+  close(cache->stats_fd);
+  free(cache->dir);
+  free(cache);
+}
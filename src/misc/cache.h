@@ -0,0 +1,100 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GKCC_CACHE_H
+#define GKCC_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// The compile cache keeps the assembly of translation units that have been
+// compiled before in a directory. Entries are named by a hash of everything
+// the assembly depends on: the preprocessed input, the flags that change the
+// output and the build of the compiler. Entries are written to a temporary
+// file and renamed into place, so compilers running at the same time never
+// see a partial entry. Once the entries take up more than the size limit, the
+// least recently used ones are removed.
+//
+// The assembly of single functions is kept in the same directory under keys
+// of their own. See ir/function_cache.h.
+
+#define GKCC_CACHE_DEFAULT_MAX_SIZE ((uint64_t)256 << 20)
+
+// =============================
+// === struct gkcc_cache_key ===
+// =============================
+
+struct gkcc_cache_key {
+  uint64_t hash[2];
+};
+
+// ===============================
+// === struct gkcc_cache_stats ===
+// ===============================
+
+// gkcc_cache_stats are kept in the cache directory and shared by every
+// compiler using it
+struct gkcc_cache_stats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t stores;
+  uint64_t evictions;
+  // size is the total size of the entries in bytes
+  uint64_t size;
+};
+
+// =========================
+// === struct gkcc_cache ===
+// =========================
+
+struct gkcc_cache {
+  char *dir;
+  uint64_t max_size;
+  // stats_fd is the stats file, which is also locked while the stats are
+  // updated or entries are evicted
+  int stats_fd;
+  // The lookups that have not been added to the stats file yet
+  uint64_t hits;
+  uint64_t misses;
+
+  // The entry being stored, if any
+  FILE *entry;
+  char *entry_path;
+  char *entry_temporary_path;
+};
+
+// === FUNCTION DECLARATIONS ===
+
+void gkcc_cache_key_init(struct gkcc_cache_key *key);
+void gkcc_cache_key_add(struct gkcc_cache_key *key, const void *data,
+                        size_t length);
+bool gkcc_cache_key_add_build_id(struct gkcc_cache_key *key);
+
+struct gkcc_cache *gkcc_cache_open(const char *dir, uint64_t max_size);
+bool gkcc_cache_fetch(struct gkcc_cache *cache, struct gkcc_cache_key *key,
+                      FILE *out);
+char *gkcc_cache_read(struct gkcc_cache *cache, struct gkcc_cache_key *key,
+                      size_t *length);
+FILE *gkcc_cache_store_begin(struct gkcc_cache *cache,
+                             struct gkcc_cache_key *key);
+void gkcc_cache_store_commit(struct gkcc_cache *cache);
+void gkcc_cache_store(struct gkcc_cache *cache, struct gkcc_cache_key *key,
+                      const void *data, size_t length);
+void gkcc_cache_print_stats(FILE *out, struct gkcc_cache *cache);
+void gkcc_cache_close(struct gkcc_cache *cache);
+
+#endif  // GKCC_CACHE_H
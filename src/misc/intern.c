@@ -0,0 +1,214 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "intern.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "misc.h"
+
+#define GKCC_INTERN_INITIAL_CAPACITY 1024
+
+// gkcc_intern_slots is the slot array of the intern table. A grown table gets
+// a new one, which is published as a whole so that its capacity always goes
+// with its entries.
+struct gkcc_intern_slots {
+  size_t capacity;
+  // previous is the slot array this one replaced. It is kept, since a lookup
+  // without the lock may still be probing it.
+  struct gkcc_intern_slots *previous;
+  struct gkcc_interned_string *entries[];
+};
+
+// gkcc_intern_table is an open addressing hash table with linear probing. The
+// table is kept at most half full. Handles are shared by every thread.
+// Insertions hold intern_lock, but strings that are already interned are
+// found without it: entries are filled in before they are published with a
+// release store, and are never removed or moved. Reading through a handle
+// needs no lock either.
+struct gkcc_intern_table {
+  struct gkcc_intern_slots *slots;
+  size_t count;
+  struct gkcc_arena *arena;
+};
+
+static struct gkcc_intern_table intern_table;
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct gkcc_interned_string *gkcc_intern_entry(const char *handle) {
+  return (struct gkcc_interned_string *)(handle -
+                                         offsetof(struct gkcc_interned_string,
+                                                  string));
+}
+
+// FNV-1a
+unsigned int gkcc_intern_hash_bytes(const char *str, size_t length) {
+  unsigned int hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)str[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static void gkcc_intern_grow(void) {
+  struct gkcc_intern_slots *slots = intern_table.slots;
+  size_t capacity = slots == NULL ? 0 : slots->capacity;
+  size_t new_capacity =
+      capacity == 0 ? GKCC_INTERN_INITIAL_CAPACITY : capacity * 2;
+  struct gkcc_intern_slots *new_slots =
+      calloc(1, sizeof(struct gkcc_intern_slots) +
+                    new_capacity * sizeof(struct gkcc_interned_string *));
+  gkcc_assert(new_slots != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate intern table");
+  new_slots->capacity = new_capacity;
+  new_slots->previous = slots;
+
+  for (size_t i = 0; i < capacity; i++) {
+    struct gkcc_interned_string *entry = slots->entries[i];
+    if (entry == NULL) continue;
+
+    size_t slot = entry->hash & (new_capacity - 1);
+    while (new_slots->entries[slot] != NULL) {
+      slot = (slot + 1) & (new_capacity - 1);
+    }
+    new_slots->entries[slot] = entry;
+  }
+
+  __atomic_store_n(&intern_table.slots, new_slots, __ATOMIC_RELEASE);
+}
+
+// gkcc_intern_find returns the entry for the given string in slots, or NULL
+// after setting *slot to the empty slot it would go in. It may be called
+// without intern_lock.
+static struct gkcc_interned_string *gkcc_intern_find(
+    struct gkcc_intern_slots *slots, const char *str, size_t length,
+    unsigned int hash, size_t *slot) {
+  size_t mask = slots->capacity - 1;
+  struct gkcc_interned_string *entry;
+  for (*slot = hash & mask;
+       (entry = __atomic_load_n(&slots->entries[*slot], __ATOMIC_ACQUIRE)) !=
+       NULL;
+       *slot = (*slot + 1) & mask) {
+    if (entry->hash == hash && entry->length == length &&
+        memcmp(entry->string, str, length) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+// gkcc_intern_find_locked makes room for one more entry and then looks the
+// string up like gkcc_intern_find. intern_lock must be held.
+static struct gkcc_interned_string *gkcc_intern_find_locked(const char *str,
+                                                            size_t length,
+                                                            unsigned int hash,
+                                                            size_t *slot) {
+  if (intern_table.slots == NULL ||
+      2 * (intern_table.count + 1) > intern_table.slots->capacity) {
+    gkcc_intern_grow();
+  }
+  return gkcc_intern_find(intern_table.slots, str, length, hash, slot);
+}
+
+// gkcc_intern_add puts entry into the empty slot and gives it the next id.
+// intern_lock must be held.
+static void gkcc_intern_add(struct gkcc_interned_string *entry, size_t slot) {
+  entry->id = intern_table.count;
+  __atomic_store_n(&intern_table.slots->entries[slot], entry,
+                   __ATOMIC_RELEASE);
+  intern_table.count++;
+}
+
+// gkcc_intern returns the unique handle for the given string. str need not be
+// null terminated and need not outlive the call.
+const char *gkcc_intern(const char *str, size_t length) {
+  unsigned int hash = gkcc_intern_hash_bytes(str, length);
+
+  // Most strings are interned already and are found without the lock
+  size_t slot = 0;
+  struct gkcc_intern_slots *slots =
+      __atomic_load_n(&intern_table.slots, __ATOMIC_ACQUIRE);
+  struct gkcc_interned_string *entry =
+      slots == NULL ? NULL : gkcc_intern_find(slots, str, length, hash, &slot);
+  if (entry != NULL) return entry->string;
+
+  pthread_mutex_lock(&intern_lock);
+  entry = gkcc_intern_find_locked(str, length, hash, &slot);
+  if (entry != NULL) {
+    pthread_mutex_unlock(&intern_lock);
+    return entry->string;
+  }
+
+  if (intern_table.arena == NULL) {
+    intern_table.arena = gkcc_arena_new();
+  }
+  entry = gkcc_arena_alloc(intern_table.arena,
+                           sizeof(struct gkcc_interned_string) + length + 1);
+  entry->hash = hash;
+  entry->length = length;
+  memcpy(entry->string, str, length);
+  gkcc_intern_add(entry, slot);
+  pthread_mutex_unlock(&intern_lock);
+  return entry->string;
+}
+
+// gkcc_intern_adopt interns the string of an entry that was made elsewhere,
+// such as one mapped in from a precompiled header, without copying it. The
+// entry must have its hash and length set, its string must be null terminated
+// and it must stay valid for the lifetime of the process. Returns the handle
+// of the string, which is only the string of entry if the string had not been
+// interned yet.
+const char *gkcc_intern_adopt(struct gkcc_interned_string *entry) {
+  pthread_mutex_lock(&intern_lock);
+  size_t slot = 0;
+  struct gkcc_interned_string *existing = gkcc_intern_find_locked(
+      entry->string, entry->length, entry->hash, &slot);
+  if (existing == NULL) {
+    gkcc_intern_add(entry, slot);
+    existing = entry;
+  }
+  pthread_mutex_unlock(&intern_lock);
+  return existing->string;
+}
+
+const char *gkcc_intern_cstr(const char *str) {
+  return gkcc_intern(str, strlen(str));
+}
+
+// gkcc_intern_hash returns the precomputed hash of an interned handle.
+unsigned int gkcc_intern_hash(const char *handle) {
+  return gkcc_intern_entry(handle)->hash;
+}
+
+unsigned int gkcc_intern_length(const char *handle) {
+  return gkcc_intern_entry(handle)->length;
+}
+
+unsigned int gkcc_intern_id(const char *handle) {
+  return gkcc_intern_entry(handle)->id;
+}
+
+// gkcc_intern_count returns the number of distinct strings interned so far.
+// Every id is less than this.
+unsigned int gkcc_intern_count(void) {
+  pthread_mutex_lock(&intern_lock);
+  unsigned int count = intern_table.count;
+  pthread_mutex_unlock(&intern_lock);
+  return count;
+}
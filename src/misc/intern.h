@@ -0,0 +1,49 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GKCC_INTERN_H
+#define GKCC_INTERN_H
+
+#include <stddef.h>
+
+// ===================================
+// === struct gkcc_interned_string ===
+// ===================================
+
+// Every distinct string passed to gkcc_intern is stored exactly once. The
+// returned handle points at the string member below, so two handles are equal
+// if and only if the pointers are equal. Handles stay valid for the lifetime
+// of the process.
+
+struct gkcc_interned_string {
+  unsigned int hash;
+  unsigned int length;
+  // id is a dense index handed out in interning order starting from 0
+  unsigned int id;
+  char string[];
+};
+
+// === FUNCTION DECLARATIONS ===
+
+const char *gkcc_intern(const char *str, size_t length);
+const char *gkcc_intern_cstr(const char *str);
+const char *gkcc_intern_adopt(struct gkcc_interned_string *entry);
+unsigned int gkcc_intern_hash(const char *handle);
+unsigned int gkcc_intern_length(const char *handle);
+unsigned int gkcc_intern_id(const char *handle);
+unsigned int gkcc_intern_count(void);
+unsigned int gkcc_intern_hash_bytes(const char *str, size_t length);
+
+#endif  // GKCC_INTERN_H
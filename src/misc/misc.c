@@ -70,18 +70,14 @@ void print_escaped_char(char toprint) {
   printf("'%s'", buf);
 }
 
-void print_escaped_string(char* str, size_t len) {
-  char buf[8193];
-  sprint_escaped_string(buf, str, len);
-  printf("\"%s\"", buf);
-}
-
-void sprint_escaped_string(char* buf, char* str, size_t len) {
-  size_t pos = 0;
-  for (int i = 0; i < len; i++) {
-    pos += sprint_escaped_char(&buf[pos], str[i]) - 1;
+void print_escaped_string(const char* str, size_t len) {
+  char buf[16];
+  putchar('"');
+  for (size_t i = 0; i < len; i++) {
+    sprint_escaped_char(buf, str[i]);
+    fputs(buf, stdout);
   }
-  buf[pos] = '\0';
+  putchar('"');
 }
 
 // Returns used up length
@@ -100,6 +96,7 @@ int sprint_escaped_char(char* buf, char toprint) {
 
   if (isprint(toprint)) {
     buf[0] = toprint;
+    buf[1] = '\0';
     return 2;
   }
 
@@ -129,6 +126,6 @@ int sprint_escaped_char(char* buf, char toprint) {
       strcpy(buf, "\\v");
       return sizeof("\\v");
     default:
-      return sprintf(buf, "\\%03o", (unsigned char)toprint);
+      return sprintf(buf, "\\%03o", (unsigned char)toprint) + 1;
   }
 }
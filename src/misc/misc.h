@@ -49,9 +49,8 @@ void gkcc_assert(int to_assert, enum gkcc_error err, char* message);
 void setup_segfault_stack_trace();
 void gkcc_error_fatal(enum gkcc_error err, char* message);
 void print_escaped_char(char toprint);
-void print_escaped_string(char* str, size_t len);
+void print_escaped_string(const char* str, size_t len);
 int sprint_escaped_char(char* buf, char toprint);
-void sprint_escaped_string(char* buf, char* str, size_t len);
 void gkcc_assert_success(enum gkcc_error err, char* message);
 
 #endif  // GKCC_MISC_H
@@ -0,0 +1,108 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "misc.h"
+
+static int thread_count = 1;
+
+// gkcc_parallel_loop is shared by the threads running one gkcc_parallel_for.
+// Indices are handed out in increasing order.
+struct gkcc_parallel_loop {
+  pthread_mutex_t lock;
+  size_t next;
+  size_t count;
+  void (*fn)(void *context, size_t worker, size_t index);
+  void *context;
+};
+
+// gkcc_parallel_worker is one of the threads started by gkcc_parallel_for
+struct gkcc_parallel_worker {
+  pthread_t thread;
+  struct gkcc_parallel_loop *loop;
+  size_t worker;
+};
+
+void gkcc_parallel_set_thread_count(int count) {
+  thread_count = count < 1 ? 1 : count;
+}
+
+int gkcc_parallel_thread_count(void) { return thread_count; }
+
+// gkcc_parallel_worker_count returns the number of threads gkcc_parallel_for
+// runs count calls on, including the calling thread
+size_t gkcc_parallel_worker_count(size_t count) {
+  size_t workers = (size_t)thread_count < count ? (size_t)thread_count : count;
+  return workers < 1 ? 1 : workers;
+}
+
+static void gkcc_parallel_run(struct gkcc_parallel_loop *loop, size_t worker) {
+  for (;;) {
+    pthread_mutex_lock(&loop->lock);
+    size_t index = loop->next++;
+    pthread_mutex_unlock(&loop->lock);
+    if (index >= loop->count) return;
+
+    loop->fn(loop->context, worker, index);
+  }
+}
+
+static void *gkcc_parallel_thread(void *arg) {
+  struct gkcc_parallel_worker *worker = arg;
+  gkcc_parallel_run(worker->loop, worker->worker);
+  return NULL;
+}
+
+// gkcc_parallel_for calls fn(context, worker, index) for every index below
+// count and returns once all calls have returned. The calls may run
+// concurrently and in any order. worker is below
+// gkcc_parallel_worker_count(count) and is the same for every call made on one
+// thread, so fn can keep state per worker. The calling thread takes part in
+// the work as worker 0.
+void gkcc_parallel_for(size_t count,
+                       void (*fn)(void *context, size_t worker, size_t index),
+                       void *context) {
+  size_t workers = gkcc_parallel_worker_count(count);
+  if (workers <= 1) {
+    for (size_t i = 0; i < count; i++) fn(context, 0, i);
+    return;
+  }
+
+  struct gkcc_parallel_loop loop = {
+      .next = 0, .count = count, .fn = fn, .context = context};
+  pthread_mutex_init(&loop.lock, NULL);
+
+  struct gkcc_parallel_worker *threads =
+      malloc((workers - 1) * sizeof(struct gkcc_parallel_worker));
+  gkcc_assert(threads != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate worker threads");
+  for (size_t i = 0; i < workers - 1; i++) {
+    threads[i] = (struct gkcc_parallel_worker){.loop = &loop, .worker = i + 1};
+    gkcc_assert(pthread_create(&threads[i].thread, NULL, gkcc_parallel_thread,
+                               &threads[i]) == 0,
+                GKCC_ERROR_UNKNOWN, "Failed to start a worker thread");
+  }
+  gkcc_parallel_run(&loop, 0);
+  for (size_t i = 0; i < workers - 1; i++) {
+    pthread_join(threads[i].thread, NULL);
+  }
+  free(threads);
+
+  pthread_mutex_destroy(&loop.lock);
+}
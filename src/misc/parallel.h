@@ -0,0 +1,35 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GKCC_PARALLEL_H
+#define GKCC_PARALLEL_H
+
+#include <stddef.h>
+
+// gkcc_parallel_for runs independent pieces of work, such as the functions of
+// a translation unit, on a pool of threads. The number of threads is a
+// process wide setting that defaults to 1, in which case everything runs on
+// the calling thread.
+
+// === FUNCTION DECLARATIONS ===
+
+void gkcc_parallel_set_thread_count(int thread_count);
+int gkcc_parallel_thread_count(void);
+size_t gkcc_parallel_worker_count(size_t count);
+void gkcc_parallel_for(size_t count,
+                       void (*fn)(void *context, size_t worker, size_t index),
+                       void *context);
+
+#endif  // GKCC_PARALLEL_H
@@ -0,0 +1,165 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "writer.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+
+// gkcc_writer_new returns a writer that writes to out, or one that collects
+// everything it is given if out is NULL
+struct gkcc_writer *gkcc_writer_new(FILE *out) {
+  struct gkcc_writer *writer = malloc(sizeof(struct gkcc_writer));
+  gkcc_assert(writer != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate writer");
+  writer->out = out;
+  writer->copy = NULL;
+  writer->buffer = malloc(GKCC_WRITER_BLOCK_SIZE);
+  gkcc_assert(writer->buffer != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate writer buffer");
+  writer->used = 0;
+  writer->capacity = GKCC_WRITER_BLOCK_SIZE;
+  return writer;
+}
+
+// gkcc_writer_reserve makes room for length more bytes in the buffer. A writer
+// with a file is never asked for more than a block.
+static void gkcc_writer_reserve(struct gkcc_writer *writer, size_t length) {
+  if (writer->out != NULL) {
+    gkcc_writer_flush(writer);
+    return;
+  }
+
+  size_t capacity = writer->capacity;
+  while (capacity - writer->used < length) capacity *= 2;
+  writer->buffer = realloc(writer->buffer, capacity);
+  gkcc_assert(writer->buffer != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to grow writer buffer");
+  writer->capacity = capacity;
+}
+
+void gkcc_writer_bytes(struct gkcc_writer *writer, const char *data,
+                       size_t length) {
+  if (writer->capacity - writer->used < length) {
+    // Anything that does not fit into an empty block goes straight to the
+    // file
+    if (writer->out != NULL && length >= writer->capacity) {
+      gkcc_writer_flush(writer);
+      fwrite(data, 1, length, writer->out);
+      if (writer->copy != NULL) fwrite(data, 1, length, writer->copy);
+      return;
+    }
+    gkcc_writer_reserve(writer, length);
+  }
+  memcpy(&writer->buffer[writer->used], data, length);
+  writer->used += length;
+}
+
+void gkcc_writer_str(struct gkcc_writer *writer, const char *str) {
+  gkcc_writer_bytes(writer, str, strlen(str));
+}
+
+void gkcc_writer_char(struct gkcc_writer *writer, char c) {
+  if (writer->used == writer->capacity) gkcc_writer_reserve(writer, 1);
+  writer->buffer[writer->used++] = c;
+}
+
+// gkcc_writer_int writes value in decimal
+void gkcc_writer_int(struct gkcc_writer *writer, long long value) {
+  // Enough for the digits of any long long and a sign
+  char digits[24];
+  char *start = &digits[sizeof(digits)];
+  unsigned long long magnitude =
+      value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+  do {
+    *--start = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0) *--start = '-';
+
+  gkcc_writer_bytes(writer, start, &digits[sizeof(digits)] - start);
+}
+
+// gkcc_writer_printf writes the result of formatting with printf. Output that
+// does not fit into the buffer on the stack, like a long double printed with
+// %Lf, is formatted again into one that is large enough.
+void gkcc_writer_printf(struct gkcc_writer *writer, const char *format, ...) {
+  char small[256];
+  va_list args;
+
+  va_start(args, format);
+  int length = vsnprintf(small, sizeof(small), format, args);
+  va_end(args);
+  gkcc_assert(length >= 0, GKCC_ERROR_INVALID_ARGUMENTS,
+              "gkcc_writer_printf() failed to format its arguments");
+  if ((size_t)length < sizeof(small)) {
+    gkcc_writer_bytes(writer, small, length);
+    return;
+  }
+
+  char *large = malloc(length + 1);
+  gkcc_assert(large != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate gkcc_writer_printf() buffer");
+  va_start(args, format);
+  vsnprintf(large, length + 1, format, args);
+  va_end(args);
+  gkcc_writer_bytes(writer, large, length);
+  free(large);
+}
+
+// gkcc_writer_escaped writes the length bytes of str with the escapes of a C
+// string literal, without the surrounding quotes
+void gkcc_writer_escaped(struct gkcc_writer *writer, const char *str,
+                         size_t length) {
+  // Enough for the longest escape sprint_escaped_char produces
+  char escaped[16];
+  for (size_t i = 0; i < length; i++) {
+    int used = sprint_escaped_char(escaped, str[i]);
+    gkcc_writer_bytes(writer, escaped, used - 1);
+  }
+}
+
+// gkcc_writer_set_copy makes a writer with a file also write everything from
+// now on to copy
+void gkcc_writer_set_copy(struct gkcc_writer *writer, FILE *copy) {
+  gkcc_assert(writer->out != NULL, GKCC_ERROR_INVALID_ARGUMENTS,
+              "gkcc_writer_set_copy() got a writer without a file");
+  gkcc_writer_flush(writer);
+  writer->copy = copy;
+}
+
+// gkcc_writer_flush hands everything buffered so far to the file of the
+// writer. It does nothing for a writer without a file.
+void gkcc_writer_flush(struct gkcc_writer *writer) {
+  if (writer->out == NULL || writer->used == 0) return;
+
+  fwrite(writer->buffer, 1, writer->used, writer->out);
+  if (writer->copy != NULL) {
+    fwrite(writer->buffer, 1, writer->used, writer->copy);
+  }
+  writer->used = 0;
+}
+
+// gkcc_writer_free flushes the writer and frees it. The file is left open.
+void gkcc_writer_free(struct gkcc_writer *writer) {
+  if (writer == NULL) return;
+
+  gkcc_writer_flush(writer);
+  free(writer->buffer);
+  free(writer);
+}
@@ -0,0 +1,58 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GKCC_WRITER_H
+#define GKCC_WRITER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// ==========================
+// === struct gkcc_writer ===
+// ==========================
+
+// gkcc_writer buffers output so that it can be handed to stdio in large
+// blocks. A writer without a file keeps everything it is given in its buffer,
+// which is how output produced in parallel is collected before it is written
+// out in order.
+
+#define GKCC_WRITER_BLOCK_SIZE (1 << 16)
+
+struct gkcc_writer {
+  // out is NULL if the writer only collects output in buffer
+  FILE *out;
+  // copy, if set, gets everything that is written to out
+  FILE *copy;
+  char *buffer;
+  size_t used;
+  size_t capacity;
+};
+
+// === FUNCTION DECLARATIONS ===
+
+struct gkcc_writer *gkcc_writer_new(FILE *out);
+void gkcc_writer_bytes(struct gkcc_writer *writer, const char *data,
+                       size_t length);
+void gkcc_writer_str(struct gkcc_writer *writer, const char *str);
+void gkcc_writer_char(struct gkcc_writer *writer, char c);
+void gkcc_writer_int(struct gkcc_writer *writer, long long value);
+void gkcc_writer_printf(struct gkcc_writer *writer, const char *format, ...);
+void gkcc_writer_escaped(struct gkcc_writer *writer, const char *str,
+                         size_t length);
+void gkcc_writer_set_copy(struct gkcc_writer *writer, FILE *copy);
+void gkcc_writer_flush(struct gkcc_writer *writer);
+void gkcc_writer_free(struct gkcc_writer *writer);
+
+#endif  // GKCC_WRITER_H
@@ -24,21 +24,53 @@
 %code {
 #include <stdio.h>
 #include "lex.yy.h"
-
-static void yyerror() {
-  gkcc_error_fatal(GKCC_ERROR_YYERROR, "Got yyerror");
+#include "arena.h"
+
+static void yyerror(struct ast_node *top_ast_node,
+                    struct gkcc_symbol_table_set *current_symbol_table,
+                    struct ast_definition_handler *definition_handler,
+                    yyscan_t scanner, const char *message) {
+  (void)top_ast_node;
+  (void)current_symbol_table;
+  (void)definition_handler;
+  char buf[(1 << 12) + 1];
+  snprintf(buf, sizeof(buf), "%s:%d: %s", gkcc_lex_filename(scanner),
+           yyget_lineno(scanner), message);
+  gkcc_error_fatal(GKCC_ERROR_YYERROR, buf);
 }
 
 #define ENTER_SCOPE(TYPE) \
   current_symbol_table = gkcc_symbol_table_set_new(current_symbol_table, TYPE)
 
 #define EXIT_SCOPE() \
-  current_symbol_table = gkcc_symbol_table_set_get_parent_symbol_table_set(current_symbol_table)
+  current_symbol_table = gkcc_symbol_table_set_exit(current_symbol_table)
+
+// With a definition handler, the body of each function definition gets an
+// arena and canonical types of its own, which are released as soon as the
+// handler has compiled the function.
+static void function_body_begin(struct ast_definition_handler *handler) {
+  if (handler == NULL) return;
+  gkcc_arena_function_begin();
+  gkcc_type_canonical_function_begin();
+}
+
+static void function_body_end(struct ast_definition_handler *handler,
+                              struct ast_node *definition) {
+  if (handler == NULL) return;
+  handler->fn(handler->context, definition);
+  ast_node_function_definition_set_statements(definition, NULL);
+  gkcc_type_canonical_function_release();
+  gkcc_arena_function_release();
+}
 
 }
 
+%define api.pure full
+
 %parse-param { struct ast_node* top_ast_node }
 %parse-param { struct gkcc_symbol_table_set *current_symbol_table }
+%parse-param { struct ast_definition_handler *definition_handler }
+%param { yyscan_t scanner }
 
 %union {
   struct _yylval yylval;
@@ -213,7 +245,7 @@ identifier: IDENT {
 
 primary_expression: identifier {
                       $$ = ast_node_identifier_set_symbol_if_exists(current_symbol_table, $identifier, GKCC_NAMESPACE_GENERAL);
-                      ast_node_identifier_verify_symbol_exists($$, YY_FILENAME, yylineno);
+                      ast_node_identifier_verify_symbol_exists($$, gkcc_lex_filename(scanner), yyget_lineno(scanner));
                    }
                  | constant
                  | STRING {
@@ -465,7 +497,7 @@ declaration: declaration_specifiers ';' {
              }
            | declaration_specifiers init_declarator_list ';' {
                $$ = ast_node_new_declaration_node($1, $2);
-               gkcc_scope_add_variable_to_scope(current_symbol_table, $$, yylineno, YY_FILENAME);
+               gkcc_scope_add_variable_to_scope(current_symbol_table, $$, yyget_lineno(scanner), gkcc_lex_filename(scanner));
            }
            //| static_assert_declaration // NOT IMPLEMENTED
            ;
@@ -573,20 +605,20 @@ type_specifier: VOID {
               //;
 
 struct_or_union_specifier: struct_or_union identifier {
-                             ast_node_update_struct_or_union_specifier_node($struct_or_union, $identifier, NULL, current_symbol_table, YY_FILENAME, yylineno);
+                             ast_node_update_struct_or_union_specifier_node($struct_or_union, $identifier, NULL, current_symbol_table, gkcc_lex_filename(scanner), yyget_lineno(scanner));
                              current_symbol_table = gkcc_symbol_table_set_get_symbol_table_set_of_struct_or_union_node($struct_or_union);
                            } '{' struct_declaration_list '}' {
                              EXIT_SCOPE();
-                             $$ = ast_node_update_struct_or_union_specifier_node($struct_or_union, NULL, $struct_declaration_list, current_symbol_table, YY_FILENAME, yylineno);
+                             $$ = ast_node_update_struct_or_union_specifier_node($struct_or_union, NULL, $struct_declaration_list, current_symbol_table, gkcc_lex_filename(scanner), yyget_lineno(scanner));
                            }
                          | struct_or_union {
                              current_symbol_table = gkcc_symbol_table_set_get_symbol_table_set_of_struct_or_union_node($struct_or_union);
                            } '{' struct_declaration_list '}' {
                              EXIT_SCOPE();
-                             $$ = ast_node_update_struct_or_union_specifier_node($struct_or_union, NULL, $struct_declaration_list, current_symbol_table, YY_FILENAME, yylineno);
+                             $$ = ast_node_update_struct_or_union_specifier_node($struct_or_union, NULL, $struct_declaration_list, current_symbol_table, gkcc_lex_filename(scanner), yyget_lineno(scanner));
                            }
                          | struct_or_union identifier {
-                             $$ = ast_node_update_struct_or_union_specifier_node($struct_or_union, $identifier, NULL, current_symbol_table, YY_FILENAME, yylineno);
+                             $$ = ast_node_update_struct_or_union_specifier_node($struct_or_union, $identifier, NULL, current_symbol_table, gkcc_lex_filename(scanner), yyget_lineno(scanner));
                            }
                          ;
 
@@ -897,7 +929,7 @@ statement: labeled_statement {
 labeled_statement: IDENT ':' statement {
                      struct ast_node *ident_node = yylval2ast_node_ident(&$IDENT);
                      $$ = ast_node_new_goto_node(ident_node);
-                     gkcc_scope_add_label_to_scope(current_symbol_table, $$, $statement, YY_FILENAME, yylineno);
+                     gkcc_scope_add_label_to_scope(current_symbol_table, $$, $statement, gkcc_lex_filename(scanner), yyget_lineno(scanner));
                    }
                  | CASE constant_expression ':' statement {
                      $$ = ast_node_new_switch_case_case_node($constant_expression, $statement);
@@ -949,6 +981,7 @@ selection_statement: IF '(' expression ')' enter_block_symbol_table_set statemen
 
 iteration_statement: WHILE '(' expression ')' enter_block_symbol_table_set statement {
                        $$ = ast_node_new_for_loop(NULL, $expression, NULL, $statement);
+                       EXIT_SCOPE();
                      }
                    | DO statement WHILE '(' expression ')' ';' {
                        $$ = ast_node_new_do_while_loop($expression, $statement);
@@ -979,7 +1012,7 @@ iteration_statement: WHILE '(' expression ')' enter_block_symbol_table_set state
 jump_statement: GOTO IDENT ';' {
                   struct ast_node *ident_node = yylval2ast_node_ident(&$IDENT);
                   $$ = ast_node_new_goto_node(ident_node);
-                  gkcc_scope_add_label_to_scope(current_symbol_table, $$, NULL, YY_FILENAME, yylineno);
+                  gkcc_scope_add_label_to_scope(current_symbol_table, $$, NULL, gkcc_lex_filename(scanner), yyget_lineno(scanner));
                 }
               | CONTINUE ';' {
                   $$ = ast_node_new(AST_NODE_JUMP_CONTINUE);
@@ -1000,11 +1033,15 @@ jump_statement: GOTO IDENT ';' {
 // ==================================
 
 function_definition: declaration_specifiers declarator {
-                       gkcc_scope_add_variable_to_scope(current_symbol_table, ast_node_new_list_node($declarator), yylineno, YY_FILENAME);
+                       gkcc_scope_add_variable_to_scope(current_symbol_table, ast_node_new_list_node($declarator), yyget_lineno(scanner), gkcc_lex_filename(scanner));
+                       // The return type outlives the body, so it is made before the body gets its own arena
+                       ast_node_function_definition_set_return_type($declarator, $declaration_specifiers);
+                       function_body_begin(definition_handler);
                        current_symbol_table = gkcc_symbol_table_set_new(current_symbol_table, GKCC_SCOPE_FUNCTION);
                      } compound_statement {
-                       $$ = ast_node_new_function_definition_node($declaration_specifiers, $declarator, NULL, $compound_statement);
+                       $$ = ast_node_function_definition_set_statements($declarator, $compound_statement);
                        EXIT_SCOPE();
+                       function_body_end(definition_handler, $$);
                      }
                    //| declaration_specifiers declarator declaration_list compound_statement
                    // NO, I am not supporting this old syntax (actually, on second thought, maybe later)
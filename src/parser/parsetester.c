@@ -15,13 +15,16 @@
 
 #include "parsetester.h"
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "ast.h"
+#include "arena.h"
 #include "ast_constructors.h"
 #include "c.tab.h"
 #include "scope.h"
+#include "writer.h"
 
 int main(int argc, char** argv) {
   setup_segfault_stack_trace();
@@ -33,18 +36,36 @@ int main(int argc, char** argv) {
 
   if (strcmp(argv[1], "debug") == 0) yydebug = 1;
 
+  // Like gkcc_int, -m prints the memory stats of the translation unit
+  bool should_print_memory_stats = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-m") == 0) should_print_memory_stats = true;
+  }
+
   struct ast_node ast_node;
   struct gkcc_symbol_table_set* global_symbol_table =
       gkcc_symbol_table_set_new(NULL, GKCC_SCOPE_GLOBAL);
 
-  yyparse(&ast_node, global_symbol_table);
+  yyscan_t scanner = gkcc_lex_new();
+  yyparse(&ast_node, global_symbol_table, NULL, scanner);
 
   struct ast_node* top_level = ast_node_new(AST_NODE_TOP_LEVEL);
   top_level->top_level.list = &ast_node;
 
-  ast_print(top_level, 0, "");
+  struct gkcc_writer* dump_writer = gkcc_writer_new(stdout);
+  ast_print(dump_writer, top_level, 0, "");
+  gkcc_writer_free(dump_writer);
 
   if (argc > 2 && strcmp(argv[2], "ir") == 0) {
     // TODO: Do IR gen here
   }
+
+  gkcc_symbol_table_set_pop_bindings(global_symbol_table);
+  if (should_print_memory_stats) {
+    gkcc_arena_print_stats(stderr, gkcc_arena_tu(), "translation unit");
+    gkcc_type_canonical_print_stats(stderr);
+  }
+  gkcc_type_canonical_release();
+  gkcc_arena_tu_release();
+  gkcc_lex_free(scanner);
 }
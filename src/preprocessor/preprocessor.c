@@ -0,0 +1,1400 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "preprocessor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "misc/arena.h"
+#include "misc/intern.h"
+#include "misc/misc.h"
+
+// Limit on the number of #include directives processed for one translation
+// unit. It turns a header that includes itself without a guard into an error
+// instead of an endless loop.
+#define GKCC_PP_MAX_INCLUDES (1 << 16)
+#define GKCC_PP_MAX_PARAMETERS 256
+#define GKCC_PP_MAX_PATH 4096
+// Tokens this many lines ahead of the output are reached with newlines
+// rather than with a line marker
+#define GKCC_PP_MAX_NEWLINES 8
+
+// GKCC_COMPILER_INCLUDE_DIR is the include directory of the compiler gkcc was
+// built with, set by the build. It has the freestanding headers, like stddef.h
+// and stdarg.h, that the C library headers rely on.
+static const char *const GKCC_PP_SYSTEM_INCLUDE_DIRS[] = {
+#ifdef GKCC_COMPILER_INCLUDE_DIR
+    GKCC_COMPILER_INCLUDE_DIR,
+#endif
+    "/usr/local/include",
+    "/usr/include/i386-linux-gnu",
+    "/usr/include",
+};
+
+static const char *const GKCC_PP_PREDEFINED_MACROS[] = {
+    "__STDC__ 1",
+    "__STDC_VERSION__ 201710L",
+    "__STDC_HOSTED__ 1",
+    "__gkcc__ 1",
+    "__i386__ 1",
+    "__i386 1",
+    "__linux__ 1",
+    "__linux 1",
+    "__unix__ 1",
+    "__unix 1",
+    "__ELF__ 1",
+    "__ILP32__ 1",
+    "__CHAR_BIT__ 8",
+    "__SIZEOF_SHORT__ 2",
+    "__SIZEOF_INT__ 4",
+    "__SIZEOF_LONG__ 4",
+    "__SIZEOF_LONG_LONG__ 8",
+    "__SIZEOF_POINTER__ 4",
+    "__SIZEOF_FLOAT__ 4",
+    "__SIZEOF_DOUBLE__ 8",
+    "__SIZEOF_LONG_DOUBLE__ 12",
+    "__SIZE_TYPE__ unsigned int",
+    "__PTRDIFF_TYPE__ int",
+    "__WCHAR_TYPE__ long int",
+    "__SCHAR_MAX__ 127",
+    "__SHRT_MAX__ 32767",
+    "__INT_MAX__ 2147483647",
+    "__LONG_MAX__ 2147483647L",
+    "__LONG_LONG_MAX__ 9223372036854775807LL",
+    "__ORDER_LITTLE_ENDIAN__ 1234",
+    "__ORDER_BIG_ENDIAN__ 4321",
+    "__BYTE_ORDER__ __ORDER_LITTLE_ENDIAN__",
+};
+
+enum gkcc_pp_conditional_context {
+  GKCC_PP_IN_THEN,
+  GKCC_PP_IN_ELIF,
+  GKCC_PP_IN_ELSE,
+};
+
+struct gkcc_pp_conditional {
+  enum gkcc_pp_conditional_context context;
+  struct gkcc_pp_token *directive;
+  // included is set once one of the groups has been taken
+  bool included;
+  struct gkcc_pp_conditional *next;
+};
+
+struct gkcc_pp_macro_argument {
+  struct gkcc_pp_token *tokens;
+  // expanded is the fully macro expanded argument, computed when first needed
+  struct gkcc_pp_token *expanded;
+};
+
+struct gkcc_pp_once_file {
+  struct gkcc_pp_file *file;
+  struct gkcc_pp_once_file *next;
+};
+
+struct gkcc_pp_output {
+  char *buffer;
+  size_t length;
+  size_t capacity;
+  struct gkcc_pp_file *file;
+  unsigned int line;
+  struct gkcc_pp_token *previous;
+};
+
+// Options shared by every translation unit
+static const char **include_dirs = NULL;
+static size_t include_dir_count = 0;
+static const char **definitions = NULL;
+static size_t definition_count = 0;
+
+// State of the translation unit being preprocessed. Everything it points to
+// lives in run_arena, which is released at the end of each run. Threads
+// preprocess translation units independently, so the state is per thread.
+static _Thread_local struct gkcc_arena *run_arena = NULL;
+static _Thread_local struct gkcc_pp_macro **macros = NULL;
+static _Thread_local unsigned int macros_capacity = 0;
+static _Thread_local struct gkcc_pp_conditional *conditionals = NULL;
+static _Thread_local struct gkcc_pp_once_file *once_files = NULL;
+static _Thread_local size_t include_count = 0;
+static _Thread_local int counter = 0;
+
+// Statistics of the calling thread
+static _Thread_local size_t stats_includes = 0;
+static _Thread_local size_t stats_includes_skipped = 0;
+static _Thread_local size_t stats_expansions = 0;
+
+static struct gkcc_pp_token *gkcc_pp_process(struct gkcc_pp_token *token);
+
+// ===============
+// === OPTIONS ===
+// ===============
+
+static void gkcc_pp_append_option(const char ***list, size_t *count,
+                                  const char *value) {
+  *list = realloc(*list, (*count + 1) * sizeof(const char *));
+  gkcc_assert(*list != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to grow preprocessor options");
+  (*list)[(*count)++] = value;
+}
+
+// gkcc_pp_add_include_dir adds a directory to search for included files. The
+// directories are searched in the order they were added, before the system
+// include directories.
+void gkcc_pp_add_include_dir(const char *dir) {
+  gkcc_pp_append_option(&include_dirs, &include_dir_count, dir);
+}
+
+// gkcc_pp_add_definition predefines a macro for every following run, given as
+// NAME or NAME=VALUE like the -D option of other compilers
+void gkcc_pp_add_definition(const char *definition) {
+  gkcc_pp_append_option(&definitions, &definition_count, definition);
+}
+
+static size_t gkcc_pp_search_dir_count(void) {
+  return include_dir_count + sizeof(GKCC_PP_SYSTEM_INCLUDE_DIRS) /
+                                 sizeof(GKCC_PP_SYSTEM_INCLUDE_DIRS[0]);
+}
+
+static const char *gkcc_pp_search_dir(size_t index) {
+  if (index < include_dir_count) return include_dirs[index];
+  return GKCC_PP_SYSTEM_INCLUDE_DIRS[index - include_dir_count];
+}
+
+// ==============
+// === TOKENS ===
+// ==============
+
+static bool gkcc_pp_is_directive(struct gkcc_pp_token *token) {
+  return token->at_bol && gkcc_pp_token_equal(token, "#");
+}
+
+static struct gkcc_pp_token *gkcc_pp_token_copy(struct gkcc_pp_token *token) {
+  struct gkcc_pp_token *copy = gkcc_arena_alloc(run_arena, sizeof(*copy));
+  *copy = *token;
+  copy->next = NULL;
+  return copy;
+}
+
+static struct gkcc_pp_token *gkcc_pp_token_new_eof(
+    struct gkcc_pp_token *token) {
+  struct gkcc_pp_token *eof = gkcc_pp_token_copy(token);
+  eof->type = GKCC_PP_TOKEN_EOF;
+  eof->text = "";
+  eof->length = 0;
+  eof->at_bol = true;
+  return eof;
+}
+
+// gkcc_pp_token_new_text makes a token spelled text at the position of
+// the given token
+static struct gkcc_pp_token *gkcc_pp_token_new_text(
+    struct gkcc_pp_token *position, enum gkcc_pp_token_type type,
+    const char *text, size_t length) {
+  struct gkcc_pp_token *token = gkcc_pp_token_copy(position);
+  token->type = type;
+  token->text = text;
+  token->length = length;
+  token->hideset = NULL;
+  return token;
+}
+
+// gkcc_pp_append copies the tokens of first up to its EOF and links the copy in
+// front of second. Token lists of cached files are never modified, since a
+// run only ever modifies its own copies.
+static struct gkcc_pp_token *gkcc_pp_append(struct gkcc_pp_token *first,
+                                            struct gkcc_pp_token *second) {
+  struct gkcc_pp_token head = {0};
+  struct gkcc_pp_token *current = &head;
+  for (; first->type != GKCC_PP_TOKEN_EOF; first = first->next) {
+    current = current->next = gkcc_pp_token_copy(first);
+  }
+  current->next = second;
+  return head.next;
+}
+
+static struct gkcc_pp_token *gkcc_pp_skip_line(struct gkcc_pp_token *token) {
+  while (!token->at_bol) token = token->next;
+  return token;
+}
+
+// gkcc_pp_copy_line copies the rest of the line starting at token into a new
+// EOF terminated list and points rest at the start of the next line
+static struct gkcc_pp_token *gkcc_pp_copy_line(struct gkcc_pp_token **rest,
+                                               struct gkcc_pp_token *token) {
+  struct gkcc_pp_token head = {0};
+  struct gkcc_pp_token *current = &head;
+  for (; !token->at_bol; token = token->next) {
+    current = current->next = gkcc_pp_token_copy(token);
+  }
+  current->next = gkcc_pp_token_new_eof(token);
+  *rest = token;
+  return head.next;
+}
+
+static char *gkcc_pp_token_cstr(struct gkcc_pp_token *token) {
+  char *str = gkcc_arena_alloc(run_arena, token->length + 1);
+  memcpy(str, token->text, token->length);
+  return str;
+}
+
+static void gkcc_pp_warning(struct gkcc_pp_token *token, const char *message) {
+  fprintf(stderr, "%s:%u:Warning:%s\n", token->file->path, token->line,
+          message);
+}
+
+// ================
+// === HIDESETS ===
+// ================
+
+static struct gkcc_pp_hideset *gkcc_pp_hideset_new(const char *name) {
+  struct gkcc_pp_hideset *hideset =
+      gkcc_arena_alloc(run_arena, sizeof(*hideset));
+  hideset->name = name;
+  return hideset;
+}
+
+static bool gkcc_pp_hideset_contains(struct gkcc_pp_hideset *hideset,
+                                     const char *name) {
+  for (; hideset != NULL; hideset = hideset->next) {
+    if (hideset->name == name) return true;
+  }
+  return false;
+}
+
+static struct gkcc_pp_hideset *gkcc_pp_hideset_union(
+    struct gkcc_pp_hideset *a, struct gkcc_pp_hideset *b) {
+  struct gkcc_pp_hideset head = {0};
+  struct gkcc_pp_hideset *current = &head;
+  for (; a != NULL; a = a->next) {
+    if (gkcc_pp_hideset_contains(b, a->name)) continue;
+    current = current->next = gkcc_pp_hideset_new(a->name);
+  }
+  current->next = b;
+  return head.next;
+}
+
+static struct gkcc_pp_hideset *gkcc_pp_hideset_intersection(
+    struct gkcc_pp_hideset *a, struct gkcc_pp_hideset *b) {
+  struct gkcc_pp_hideset head = {0};
+  struct gkcc_pp_hideset *current = &head;
+  for (; a != NULL; a = a->next) {
+    if (!gkcc_pp_hideset_contains(b, a->name)) continue;
+    current = current->next = gkcc_pp_hideset_new(a->name);
+  }
+  return head.next;
+}
+
+// ==============
+// === MACROS ===
+// ==============
+
+// Macros are looked up by the intern id of their name, the same way scope
+// bindings are
+static struct gkcc_pp_macro **gkcc_pp_macro_slot(const char *name) {
+  unsigned int id = gkcc_intern_id(name);
+  if (id < macros_capacity) return &macros[id];
+
+  unsigned int new_capacity = macros_capacity == 0 ? 1024 : macros_capacity;
+  while (new_capacity <= id) new_capacity *= 2;
+
+  macros = realloc(macros, new_capacity * sizeof(struct gkcc_pp_macro *));
+  gkcc_assert(macros != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to grow the macro table");
+  memset(&macros[macros_capacity], 0,
+         (new_capacity - macros_capacity) * sizeof(struct gkcc_pp_macro *));
+  macros_capacity = new_capacity;
+  return &macros[id];
+}
+
+static struct gkcc_pp_macro *gkcc_pp_macro_find(const char *name) {
+  unsigned int id = gkcc_intern_id(name);
+  return id < macros_capacity ? macros[id] : NULL;
+}
+
+// gkcc_pp_is_defined returns what defined and #ifdef report for name.
+// __has_include counts as defined, so headers can check for it before using
+// it.
+static bool gkcc_pp_is_defined(const char *name) {
+  return gkcc_pp_macro_find(name) != NULL ||
+         strcmp(name, "__has_include") == 0 ||
+         strcmp(name, "__has_include_next") == 0;
+}
+
+static struct gkcc_pp_macro *gkcc_pp_macro_define(const char *name) {
+  struct gkcc_pp_macro *macro = gkcc_arena_alloc(run_arena, sizeof(*macro));
+  macro->name = name;
+  *gkcc_pp_macro_slot(name) = macro;
+  return macro;
+}
+
+static struct gkcc_pp_token *gkcc_pp_builtin_file(
+    struct gkcc_pp_token *macro_token) {
+  const char *path = macro_token->file->path;
+  size_t length = strlen(path);
+  char *text = gkcc_arena_alloc(run_arena, length * 2 + 3);
+  char *p = text;
+  *p++ = '"';
+  for (size_t i = 0; i < length; i++) {
+    if (path[i] == '"' || path[i] == '\\') *p++ = '\\';
+    *p++ = path[i];
+  }
+  *p++ = '"';
+  return gkcc_pp_token_new_text(macro_token, GKCC_PP_TOKEN_STRING, text,
+                                p - text);
+}
+
+static struct gkcc_pp_token *gkcc_pp_number_token(
+    struct gkcc_pp_token *position, long long value) {
+  char *text = gkcc_arena_alloc(run_arena, 24);
+  int length = snprintf(text, 24, "%lld", value);
+  return gkcc_pp_token_new_text(position, GKCC_PP_TOKEN_NUMBER, text, length);
+}
+
+static struct gkcc_pp_token *gkcc_pp_builtin_line(
+    struct gkcc_pp_token *macro_token) {
+  return gkcc_pp_number_token(macro_token, macro_token->line);
+}
+
+static struct gkcc_pp_token *gkcc_pp_builtin_counter(
+    struct gkcc_pp_token *macro_token) {
+  return gkcc_pp_number_token(macro_token, counter++);
+}
+
+// gkcc_pp_read_define reads a #define directive starting at the macro name
+static struct gkcc_pp_token *gkcc_pp_read_define(struct gkcc_pp_token *token) {
+  if (token->at_bol || token->type != GKCC_PP_TOKEN_IDENTIFIER) {
+    gkcc_pp_token_error(token, "Macro name must be an identifier");
+  }
+  const char *name = token->text;
+  token = token->next;
+
+  const char *parameters[GKCC_PP_MAX_PARAMETERS];
+  int parameter_count = 0;
+  bool is_function_like = !token->has_space && !token->at_bol &&
+                          gkcc_pp_token_equal(token, "(");
+  bool is_variadic = false;
+  if (is_function_like) {
+    token = token->next;
+    while (!token->at_bol && !gkcc_pp_token_equal(token, ")")) {
+      if (parameter_count != 0) {
+        if (!gkcc_pp_token_equal(token, ",")) {
+          gkcc_pp_token_error(token, "Expected ',' in macro parameter list");
+        }
+        token = token->next;
+      }
+      if (parameter_count == GKCC_PP_MAX_PARAMETERS) {
+        gkcc_pp_token_error(token, "Too many macro parameters");
+      }
+      if (gkcc_pp_token_equal(token, "...")) {
+        is_variadic = true;
+        parameters[parameter_count++] = gkcc_intern_cstr("__VA_ARGS__");
+        token = token->next;
+        break;
+      }
+      if (token->at_bol || token->type != GKCC_PP_TOKEN_IDENTIFIER) {
+        gkcc_pp_token_error(token, "Expected a macro parameter name");
+      }
+      parameters[parameter_count++] = token->text;
+      token = token->next;
+      // GNU style named variadic parameter
+      if (gkcc_pp_token_equal(token, "...")) {
+        is_variadic = true;
+        token = token->next;
+        break;
+      }
+    }
+    if (token->at_bol || !gkcc_pp_token_equal(token, ")")) {
+      gkcc_pp_token_error(token, "Unterminated macro parameter list");
+    }
+    token = token->next;
+  }
+
+  struct gkcc_pp_macro *macro = gkcc_pp_macro_define(name);
+  macro->is_function_like = is_function_like;
+  macro->is_variadic = is_variadic;
+  macro->parameter_count = parameter_count;
+  if (parameter_count != 0) {
+    macro->parameters =
+        gkcc_arena_alloc(run_arena, parameter_count * sizeof(const char *));
+    memcpy(macro->parameters, parameters,
+           parameter_count * sizeof(const char *));
+  }
+  macro->body = gkcc_pp_copy_line(&token, token);
+  return token;
+}
+
+// gkcc_pp_read_argument reads one macro argument up to the next top level
+// comma, or up to the closing parenthesis if read_rest is set
+static struct gkcc_pp_token *gkcc_pp_read_argument(
+    struct gkcc_pp_token **rest, struct gkcc_pp_token *token, bool read_rest) {
+  struct gkcc_pp_token head = {0};
+  struct gkcc_pp_token *current = &head;
+  int depth = 0;
+  for (;; token = token->next) {
+    if (depth == 0 && gkcc_pp_token_equal(token, ")")) break;
+    if (depth == 0 && !read_rest && gkcc_pp_token_equal(token, ",")) break;
+    if (token->type == GKCC_PP_TOKEN_EOF) {
+      gkcc_pp_token_error(token, "Unterminated macro argument list");
+    }
+    if (gkcc_pp_token_equal(token, "(")) depth++;
+    if (gkcc_pp_token_equal(token, ")")) depth--;
+    current = current->next = gkcc_pp_token_copy(token);
+  }
+  current->next = gkcc_pp_token_new_eof(token);
+  *rest = token;
+  return head.next;
+}
+
+// gkcc_pp_read_arguments reads the arguments of a function-like macro. token
+// is the opening parenthesis, rest is pointed at the closing one.
+static struct gkcc_pp_macro_argument *gkcc_pp_read_arguments(
+    struct gkcc_pp_token **rest, struct gkcc_pp_token *token,
+    struct gkcc_pp_macro *macro) {
+  struct gkcc_pp_macro_argument *arguments = gkcc_arena_alloc(
+      run_arena,
+      (macro->parameter_count + 1) * sizeof(struct gkcc_pp_macro_argument));
+  int named_count = macro->parameter_count - (macro->is_variadic ? 1 : 0);
+  token = token->next;
+
+  for (int i = 0; i < named_count; i++) {
+    if (i != 0) {
+      if (!gkcc_pp_token_equal(token, ",")) {
+        gkcc_pp_token_error(token, "Too few arguments to function-like macro");
+      }
+      token = token->next;
+    }
+    arguments[i].tokens = gkcc_pp_read_argument(&token, token, false);
+  }
+
+  if (macro->is_variadic) {
+    if (gkcc_pp_token_equal(token, ")")) {
+      arguments[named_count].tokens = gkcc_pp_token_new_eof(token);
+    } else {
+      if (named_count != 0) {
+        if (!gkcc_pp_token_equal(token, ",")) {
+          gkcc_pp_token_error(token,
+                              "Too few arguments to function-like macro");
+        }
+        token = token->next;
+      }
+      arguments[named_count].tokens = gkcc_pp_read_argument(&token, token, true);
+    }
+  } else if (named_count == 0) {
+    // A macro without parameters may still be called as F()
+    gkcc_pp_read_argument(&token, token, false);
+  }
+
+  if (!gkcc_pp_token_equal(token, ")")) {
+    gkcc_pp_token_error(token, "Too many arguments to function-like macro");
+  }
+  *rest = token;
+  return arguments;
+}
+
+static struct gkcc_pp_macro_argument *gkcc_pp_find_argument(
+    struct gkcc_pp_macro *macro, struct gkcc_pp_macro_argument *arguments,
+    struct gkcc_pp_token *token) {
+  if (token->type != GKCC_PP_TOKEN_IDENTIFIER) return NULL;
+  for (int i = 0; i < macro->parameter_count; i++) {
+    if (macro->parameters[i] == token->text) return &arguments[i];
+  }
+  return NULL;
+}
+
+static struct gkcc_pp_token *gkcc_pp_expand_argument(
+    struct gkcc_pp_macro_argument *argument) {
+  if (argument->expanded == NULL) {
+    argument->expanded =
+        gkcc_pp_process(gkcc_pp_append(argument->tokens,
+                                       gkcc_pp_token_new_eof(argument->tokens)));
+  }
+  return argument->expanded;
+}
+
+// gkcc_pp_stringize implements the # operator
+static struct gkcc_pp_token *gkcc_pp_stringize(struct gkcc_pp_token *position,
+                                               struct gkcc_pp_token *tokens) {
+  size_t length = 2;
+  for (struct gkcc_pp_token *token = tokens;
+       token->type != GKCC_PP_TOKEN_EOF; token = token->next) {
+    length += token->length * 2 + 1;
+  }
+
+  char *text = gkcc_arena_alloc(run_arena, length + 1);
+  char *p = text;
+  *p++ = '"';
+  for (struct gkcc_pp_token *token = tokens;
+       token->type != GKCC_PP_TOKEN_EOF; token = token->next) {
+    if (token != tokens && token->has_space) *p++ = ' ';
+    bool escape = token->type == GKCC_PP_TOKEN_STRING ||
+                  token->type == GKCC_PP_TOKEN_CHARACTER;
+    for (unsigned int i = 0; i < token->length; i++) {
+      if (escape && (token->text[i] == '"' || token->text[i] == '\\')) {
+        *p++ = '\\';
+      }
+      *p++ = token->text[i];
+    }
+  }
+  *p++ = '"';
+  return gkcc_pp_token_new_text(position, GKCC_PP_TOKEN_STRING, text,
+                                p - text);
+}
+
+// gkcc_pp_paste implements the ## operator by replacing left with the token
+// spelled by left followed by right
+static void gkcc_pp_paste(struct gkcc_pp_token *left,
+                          struct gkcc_pp_token *right) {
+  size_t length = left->length + right->length;
+  char *text = gkcc_arena_alloc(run_arena, length + 1);
+  memcpy(text, left->text, left->length);
+  memcpy(text + left->length, right->text, right->length);
+
+  struct gkcc_pp_token *pasted =
+      gkcc_pp_tokenize(run_arena, left->file, text, length);
+  if (pasted->type == GKCC_PP_TOKEN_EOF ||
+      pasted->next->type != GKCC_PP_TOKEN_EOF) {
+    char buf[(1 << 12) + 1];
+    snprintf(buf, sizeof(buf),
+             "Pasting \"%.*s\" and \"%.*s\" does not give a valid token",
+             (int)left->length, left->text, (int)right->length, right->text);
+    gkcc_pp_token_error(left, buf);
+  }
+  left->type = pasted->type;
+  left->text = pasted->text;
+  left->length = pasted->length;
+}
+
+static struct gkcc_pp_token *gkcc_pp_append_to(struct gkcc_pp_token *current,
+                                               struct gkcc_pp_token *tokens) {
+  for (; tokens->type != GKCC_PP_TOKEN_EOF; tokens = tokens->next) {
+    current = current->next = gkcc_pp_token_copy(tokens);
+  }
+  return current;
+}
+
+// gkcc_pp_substitute replaces the parameters in the body of a function-like
+// macro with its arguments
+static struct gkcc_pp_token *gkcc_pp_substitute(
+    struct gkcc_pp_macro *macro, struct gkcc_pp_macro_argument *arguments) {
+  struct gkcc_pp_token head = {0};
+  struct gkcc_pp_token *current = &head;
+  struct gkcc_pp_macro_argument *variadic =
+      macro->is_variadic ? &arguments[macro->parameter_count - 1] : NULL;
+  struct gkcc_pp_token *token = macro->body;
+
+  while (token->type != GKCC_PP_TOKEN_EOF) {
+    struct gkcc_pp_macro_argument *argument;
+
+    if (gkcc_pp_token_equal(token, "#")) {
+      argument = gkcc_pp_find_argument(macro, arguments, token->next);
+      if (argument == NULL) {
+        gkcc_pp_token_error(token, "'#' is not followed by a macro parameter");
+      }
+      current = current->next = gkcc_pp_stringize(token, argument->tokens);
+      token = token->next->next;
+      continue;
+    }
+
+    // GNU extension: the comma in ", ## __VA_ARGS__" is removed when the
+    // variable arguments are empty
+    if (variadic != NULL && gkcc_pp_token_equal(token, ",") &&
+        gkcc_pp_token_equal(token->next, "##") &&
+        gkcc_pp_find_argument(macro, arguments, token->next->next) ==
+            variadic) {
+      if (variadic->tokens->type != GKCC_PP_TOKEN_EOF) {
+        current = current->next = gkcc_pp_token_copy(token);
+        current = gkcc_pp_append_to(current, variadic->tokens);
+      }
+      token = token->next->next->next;
+      continue;
+    }
+
+    if (gkcc_pp_token_equal(token, "##")) {
+      if (current == &head || token->next->type == GKCC_PP_TOKEN_EOF) {
+        gkcc_pp_token_error(
+            token, "'##' cannot appear at either end of a macro expansion");
+      }
+      argument = gkcc_pp_find_argument(macro, arguments, token->next);
+      if (argument == NULL) {
+        gkcc_pp_paste(current, token->next);
+      } else if (argument->tokens->type != GKCC_PP_TOKEN_EOF) {
+        gkcc_pp_paste(current, argument->tokens);
+        current = gkcc_pp_append_to(current, argument->tokens->next);
+      }
+      token = token->next->next;
+      continue;
+    }
+
+    argument = gkcc_pp_find_argument(macro, arguments, token);
+    if (argument != NULL && gkcc_pp_token_equal(token->next, "##")) {
+      // Operands of ## are not macro expanded
+      struct gkcc_pp_token *right = token->next->next;
+      if (argument->tokens->type != GKCC_PP_TOKEN_EOF) {
+        current = gkcc_pp_append_to(current, argument->tokens);
+        token = token->next;
+        continue;
+      }
+      // An empty left operand leaves the right operand as it is
+      struct gkcc_pp_macro_argument *right_argument =
+          gkcc_pp_find_argument(macro, arguments, right);
+      if (right_argument != NULL) {
+        current = gkcc_pp_append_to(current, right_argument->tokens);
+        token = right->next;
+      } else {
+        token = right;
+      }
+      continue;
+    }
+
+    if (argument != NULL) {
+      struct gkcc_pp_token *expanded = gkcc_pp_expand_argument(argument);
+      struct gkcc_pp_token *first = current;
+      current = gkcc_pp_append_to(current, expanded);
+      if (current != first) first->next->has_space = token->has_space;
+      token = token->next;
+      continue;
+    }
+
+    current = current->next = gkcc_pp_token_copy(token);
+    token = token->next;
+  }
+
+  current->next = gkcc_pp_token_new_eof(token);
+  return head.next;
+}
+
+// gkcc_pp_splice_expansion links a copy of an expansion in front of rest. The
+// copies get the hideset and the position of the macro token, so the
+// expansion appears on the line the macro was used on. None of them is at the
+// beginning of a line, as the result of a replacement is never run as a
+// directive (C17 6.10.3.4p3).
+static struct gkcc_pp_token *gkcc_pp_splice_expansion(
+    struct gkcc_pp_token *body, struct gkcc_pp_hideset *hideset,
+    struct gkcc_pp_token *macro_token, struct gkcc_pp_token *rest) {
+  if (body->type == GKCC_PP_TOKEN_EOF) {
+    // The spacing may not be lost with the macro token
+    rest->has_space |= macro_token->has_space;
+    return rest;
+  }
+
+  struct gkcc_pp_token head = {0};
+  struct gkcc_pp_token *current = &head;
+  for (; body->type != GKCC_PP_TOKEN_EOF; body = body->next) {
+    current = current->next = gkcc_pp_token_copy(body);
+    current->hideset = gkcc_pp_hideset_union(current->hideset, hideset);
+    current->file = macro_token->file;
+    current->line = macro_token->line;
+    current->at_bol = false;
+  }
+  current->next = rest;
+  head.next->has_space = macro_token->has_space;
+  return head.next;
+}
+
+// gkcc_pp_expand_macro expands token if it names a macro. The expansion is
+// rescanned together with the rest of the input, which rest is pointed at.
+static bool gkcc_pp_expand_macro(struct gkcc_pp_token **rest,
+                                 struct gkcc_pp_token *token) {
+  if (token->type != GKCC_PP_TOKEN_IDENTIFIER) return false;
+  if (gkcc_pp_hideset_contains(token->hideset, token->text)) return false;
+  struct gkcc_pp_macro *macro = gkcc_pp_macro_find(token->text);
+  if (macro == NULL) return false;
+
+  if (macro->handler != NULL) {
+    struct gkcc_pp_token *result = macro->handler(token);
+    result->next = token->next;
+    *rest = result;
+    stats_expansions++;
+    return true;
+  }
+
+  if (!macro->is_function_like) {
+    struct gkcc_pp_hideset *hideset = gkcc_pp_hideset_union(
+        token->hideset, gkcc_pp_hideset_new(macro->name));
+    *rest = gkcc_pp_splice_expansion(macro->body, hideset, token, token->next);
+    stats_expansions++;
+    return true;
+  }
+
+  // A function-like macro name not followed by ( is not an invocation
+  if (!gkcc_pp_token_equal(token->next, "(")) return false;
+
+  struct gkcc_pp_token *close;
+  struct gkcc_pp_macro_argument *arguments =
+      gkcc_pp_read_arguments(&close, token->next, macro);
+  struct gkcc_pp_hideset *hideset =
+      gkcc_pp_hideset_intersection(token->hideset, close->hideset);
+  hideset = gkcc_pp_hideset_union(hideset, gkcc_pp_hideset_new(macro->name));
+  *rest = gkcc_pp_splice_expansion(gkcc_pp_substitute(macro, arguments),
+                                   hideset, token, close->next);
+  stats_expansions++;
+  return true;
+}
+
+// ================
+// === INCLUDES ===
+// ================
+
+static struct gkcc_pp_file *gkcc_pp_file_in_dir(const char *dir,
+                                                size_t dir_length,
+                                                const char *name,
+                                                int include_dir_index) {
+  char path[GKCC_PP_MAX_PATH];
+  int length;
+  if (dir_length == 0) {
+    length = snprintf(path, sizeof(path), "%s", name);
+  } else {
+    length =
+        snprintf(path, sizeof(path), "%.*s/%s", (int)dir_length, dir, name);
+  }
+  if (length < 0 || (size_t)length >= sizeof(path)) return NULL;
+  return gkcc_pp_file_get(path, include_dir_index);
+}
+
+// gkcc_pp_find_include resolves the name of an included file. Quoted names
+// are looked up next to the including file first. Since files are cached,
+// none of this touches the file system for a header seen before.
+static struct gkcc_pp_file *gkcc_pp_find_include(
+    struct gkcc_pp_token *directive, const char *name, bool is_quoted,
+    bool is_next) {
+  if (name[0] == '/') return gkcc_pp_file_get(name, -1);
+
+  size_t first_dir = 0;
+  if (is_next) {
+    first_dir = directive->file->include_dir_index + 1;
+  } else if (is_quoted) {
+    const char *including = directive->file->path;
+    const char *slash = strrchr(including, '/');
+    struct gkcc_pp_file *file = gkcc_pp_file_in_dir(
+        including, slash == NULL ? 0 : (size_t)(slash - including), name, -1);
+    if (file != NULL) return file;
+  }
+
+  for (size_t i = first_dir; i < gkcc_pp_search_dir_count(); i++) {
+    const char *dir = gkcc_pp_search_dir(i);
+    struct gkcc_pp_file *file =
+        gkcc_pp_file_in_dir(dir, strlen(dir), name, (int)i);
+    if (file != NULL) return file;
+  }
+  return NULL;
+}
+
+// gkcc_pp_read_include_name reads the header name of #include starting at
+// token. Returns NULL if the line does not start with a header name.
+static const char *gkcc_pp_read_include_name(struct gkcc_pp_token *token,
+                                             bool *is_quoted) {
+  if (token->type == GKCC_PP_TOKEN_STRING && token->text[0] == '"') {
+    *is_quoted = true;
+    char *name = gkcc_arena_alloc(run_arena, token->length - 1);
+    memcpy(name, token->text + 1, token->length - 2);
+    return name;
+  }
+
+  if (!gkcc_pp_token_equal(token, "<")) return NULL;
+  *is_quoted = false;
+  size_t length = 0;
+  struct gkcc_pp_token *end = token->next;
+  for (; !gkcc_pp_token_equal(end, ">"); end = end->next) {
+    if (end->at_bol) gkcc_pp_token_error(token, "Expected '>'");
+    length += end->length + 1;
+  }
+
+  char *name = gkcc_arena_alloc(run_arena, length + 1);
+  char *p = name;
+  for (struct gkcc_pp_token *part = token->next; part != end;
+       part = part->next) {
+    if (part != token->next && part->has_space) *p++ = ' ';
+    memcpy(p, part->text, part->length);
+    p += part->length;
+  }
+  return name;
+}
+
+// gkcc_pp_include_operand reads the operand of #include or __has_include,
+// macro expanding it first if it is not a header name
+static const char *gkcc_pp_include_operand(struct gkcc_pp_token *token,
+                                           bool *is_quoted) {
+  const char *name = gkcc_pp_read_include_name(token, is_quoted);
+  if (name != NULL) return name;
+
+  struct gkcc_pp_token *rest;
+  struct gkcc_pp_token *line = gkcc_pp_process(gkcc_pp_copy_line(&rest, token));
+  name = gkcc_pp_read_include_name(line, is_quoted);
+  if (name == NULL) gkcc_pp_token_error(token, "Expected a header name");
+  return name;
+}
+
+static bool gkcc_pp_file_is_skipped(struct gkcc_pp_file *file) {
+  if (file->guard_macro != NULL &&
+      gkcc_pp_macro_find(file->guard_macro) != NULL) {
+    return true;
+  }
+  for (struct gkcc_pp_once_file *once = once_files; once != NULL;
+       once = once->next) {
+    if (once->file == file) return true;
+  }
+  return false;
+}
+
+static struct gkcc_pp_token *gkcc_pp_include(struct gkcc_pp_token *directive,
+                                             struct gkcc_pp_token *token,
+                                             bool is_next) {
+  if (token->next->at_bol) {
+    gkcc_pp_token_error(directive, "#include expects a header name");
+  }
+  bool is_quoted;
+  const char *name = gkcc_pp_include_operand(token->next, &is_quoted);
+  struct gkcc_pp_token *rest = gkcc_pp_skip_line(token->next);
+
+  struct gkcc_pp_file *file =
+      gkcc_pp_find_include(directive, name, is_quoted, is_next);
+  if (file == NULL) {
+    char buf[(1 << 12) + 1];
+    snprintf(buf, sizeof(buf), "Cannot find included file %s", name);
+    gkcc_pp_token_error(directive, buf);
+  }
+  if (++include_count > GKCC_PP_MAX_INCLUDES) {
+    gkcc_pp_token_error(directive, "Too many #include directives");
+  }
+
+  stats_includes++;
+  if (gkcc_pp_file_is_skipped(file)) {
+    stats_includes_skipped++;
+    return rest;
+  }
+  return gkcc_pp_append(file->tokens, rest);
+}
+
+// ====================
+// === CONDITIONALS ===
+// ====================
+
+static void gkcc_pp_push_conditional(struct gkcc_pp_token *directive,
+                                     bool included) {
+  struct gkcc_pp_conditional *conditional =
+      gkcc_arena_alloc(run_arena, sizeof(*conditional));
+  conditional->context = GKCC_PP_IN_THEN;
+  conditional->directive = directive;
+  conditional->included = included;
+  conditional->next = conditionals;
+  conditionals = conditional;
+}
+
+static bool gkcc_pp_is_conditional_start(struct gkcc_pp_token *token) {
+  return gkcc_pp_token_equal(token, "if") ||
+         gkcc_pp_token_equal(token, "ifdef") ||
+         gkcc_pp_token_equal(token, "ifndef");
+}
+
+// gkcc_pp_skip_nested skips a nested conditional up to its #endif
+static struct gkcc_pp_token *gkcc_pp_skip_nested(struct gkcc_pp_token *token) {
+  while (token->type != GKCC_PP_TOKEN_EOF) {
+    if (gkcc_pp_is_directive(token) &&
+        gkcc_pp_is_conditional_start(token->next)) {
+      token = gkcc_pp_skip_nested(token->next->next);
+      continue;
+    }
+    if (gkcc_pp_is_directive(token) &&
+        gkcc_pp_token_equal(token->next, "endif")) {
+      return token->next->next;
+    }
+    token = token->next;
+  }
+  return token;
+}
+
+// gkcc_pp_skip_group skips a group that is not taken up to the #elif, #else
+// or #endif ending it
+static struct gkcc_pp_token *gkcc_pp_skip_group(struct gkcc_pp_token *token) {
+  while (token->type != GKCC_PP_TOKEN_EOF) {
+    if (gkcc_pp_is_directive(token) &&
+        gkcc_pp_is_conditional_start(token->next)) {
+      token = gkcc_pp_skip_nested(token->next->next);
+      continue;
+    }
+    if (gkcc_pp_is_directive(token) &&
+        (gkcc_pp_token_equal(token->next, "elif") ||
+         gkcc_pp_token_equal(token->next, "else") ||
+         gkcc_pp_token_equal(token->next, "endif"))) {
+      break;
+    }
+    token = token->next;
+  }
+  return token;
+}
+
+// gkcc_pp_read_has_include evaluates __has_include(header-name) starting at
+// the opening parenthesis
+static bool gkcc_pp_read_has_include(struct gkcc_pp_token **rest,
+                                     struct gkcc_pp_token *token,
+                                     bool is_next) {
+  if (!gkcc_pp_token_equal(token, "(")) {
+    gkcc_pp_token_error(token, "Expected '(' after __has_include");
+  }
+  bool is_quoted;
+  const char *name = gkcc_pp_read_include_name(token->next, &is_quoted);
+  if (name == NULL) gkcc_pp_token_error(token, "Expected a header name");
+
+  while (!gkcc_pp_token_equal(token, ")")) {
+    if (token->type == GKCC_PP_TOKEN_EOF) {
+      gkcc_pp_token_error(token, "Expected ')' after __has_include");
+    }
+    token = token->next;
+  }
+  *rest = token->next;
+  return gkcc_pp_find_include(token, name, is_quoted, is_next) != NULL;
+}
+
+// gkcc_pp_read_condition evaluates the controlling expression of #if or #elif
+// starting at token and points rest at the next line
+static bool gkcc_pp_read_condition(struct gkcc_pp_token **rest,
+                                   struct gkcc_pp_token *token) {
+  struct gkcc_pp_token *line = gkcc_pp_copy_line(rest, token);
+  struct gkcc_pp_token head = {0};
+  struct gkcc_pp_token *current = &head;
+
+  // defined and __has_include have to be evaluated before macro expansion
+  while (line->type != GKCC_PP_TOKEN_EOF) {
+    struct gkcc_pp_token *start = line;
+    bool value;
+    if (gkcc_pp_token_equal(line, "defined")) {
+      line = line->next;
+      bool parenthesized = gkcc_pp_token_equal(line, "(");
+      if (parenthesized) line = line->next;
+      if (line->type != GKCC_PP_TOKEN_IDENTIFIER) {
+        gkcc_pp_token_error(start, "Macro name must be an identifier");
+      }
+      value = gkcc_pp_is_defined(line->text);
+      line = line->next;
+      if (parenthesized) {
+        if (!gkcc_pp_token_equal(line, ")")) {
+          gkcc_pp_token_error(start, "Expected ')' after defined");
+        }
+        line = line->next;
+      }
+    } else if (gkcc_pp_token_equal(line, "__has_include") ||
+               gkcc_pp_token_equal(line, "__has_include_next")) {
+      bool is_next = line->length == strlen("__has_include_next");
+      value = gkcc_pp_read_has_include(&line, line->next, is_next);
+    } else {
+      current = current->next = line;
+      line = line->next;
+      continue;
+    }
+    current = current->next = gkcc_pp_number_token(start, value);
+  }
+  current->next = line;
+
+  struct gkcc_pp_token *expanded = gkcc_pp_process(head.next);
+
+  // Calls of unknown function-like operators such as __has_builtin(x) are
+  // left after expansion. Like the identifiers around them they evaluate to
+  // 0.
+  current = &head;
+  struct gkcc_pp_token *t = expanded;
+  while (t->type != GKCC_PP_TOKEN_EOF) {
+    if (t->type == GKCC_PP_TOKEN_IDENTIFIER &&
+        gkcc_pp_token_equal(t->next, "(")) {
+      current = current->next = gkcc_pp_number_token(t, 0);
+      int depth = 0;
+      for (t = t->next; t->type != GKCC_PP_TOKEN_EOF; t = t->next) {
+        if (gkcc_pp_token_equal(t, "(")) depth++;
+        if (gkcc_pp_token_equal(t, ")") && --depth == 0) break;
+      }
+      if (t->type != GKCC_PP_TOKEN_EOF) t = t->next;
+      continue;
+    }
+    current = current->next = t;
+    t = t->next;
+  }
+  current->next = t;
+  return gkcc_pp_evaluate(head.next) != 0;
+}
+
+// ========================
+// === OTHER DIRECTIVES ===
+// ========================
+
+// gkcc_pp_read_line_directive handles #line and the "# N" line markers found
+// in preprocessed files. Both renumber the rest of the current file.
+static struct gkcc_pp_token *gkcc_pp_read_line_directive(
+    struct gkcc_pp_token *directive, struct gkcc_pp_token *token,
+    bool expand) {
+  struct gkcc_pp_token *rest;
+  struct gkcc_pp_token *line = gkcc_pp_copy_line(&rest, token);
+  if (expand) line = gkcc_pp_process(line);
+
+  if (line->type != GKCC_PP_TOKEN_NUMBER) {
+    gkcc_pp_token_error(directive, "#line requires a line number");
+  }
+  long long number = strtoll(gkcc_pp_token_cstr(line), NULL, 10);
+
+  struct gkcc_pp_file *file = directive->file;
+  struct gkcc_pp_file *renamed = file;
+  if (line->next->type == GKCC_PP_TOKEN_STRING) {
+    struct gkcc_pp_token *name = line->next;
+    char *path = gkcc_arena_alloc(run_arena, name->length - 1);
+    memcpy(path, name->text + 1, name->length - 2);
+    renamed = gkcc_pp_file_new_virtual(path);
+  }
+
+  long long delta = number - (directive->line + 1);
+  for (struct gkcc_pp_token *t = rest;
+       t->type != GKCC_PP_TOKEN_EOF && t->file == file; t = t->next) {
+    t->line = (unsigned int)(t->line + delta);
+    t->file = renamed;
+  }
+  return rest;
+}
+
+static struct gkcc_pp_token *gkcc_pp_read_pragma(
+    struct gkcc_pp_token *directive, struct gkcc_pp_token *token) {
+  if (gkcc_pp_token_equal(token, "once") && !token->at_bol) {
+    struct gkcc_pp_once_file *once =
+        gkcc_arena_alloc(run_arena, sizeof(*once));
+    once->file = directive->file;
+    once->next = once_files;
+    once_files = once;
+  }
+  // Other pragmas have no meaning to gkcc and are dropped
+  return gkcc_pp_skip_line(token);
+}
+
+static void gkcc_pp_read_diagnostic(struct gkcc_pp_token *directive,
+                                    struct gkcc_pp_token *token,
+                                    bool is_error) {
+  char message[(1 << 12) + 1];
+  size_t length = 0;
+  for (; !token->at_bol; token = token->next) {
+    int written = snprintf(message + length, sizeof(message) - length, "%s%.*s",
+                           length != 0 && token->has_space ? " " : "",
+                           (int)token->length, token->text);
+    if (written < 0 || (size_t)written >= sizeof(message) - length) break;
+    length += written;
+  }
+  message[length] = '\0';
+
+  if (is_error) gkcc_pp_token_error(directive, message);
+  gkcc_pp_warning(directive, message);
+}
+
+// gkcc_pp_process runs directives and expands macros in token, returning the
+// resulting tokens
+static struct gkcc_pp_token *gkcc_pp_process(struct gkcc_pp_token *token) {
+  struct gkcc_pp_token head = {0};
+  struct gkcc_pp_token *current = &head;
+
+  while (token->type != GKCC_PP_TOKEN_EOF) {
+    if (gkcc_pp_expand_macro(&token, token)) continue;
+
+    if (!gkcc_pp_is_directive(token)) {
+      current = current->next = token;
+      token = token->next;
+      continue;
+    }
+
+    struct gkcc_pp_token *directive = token;
+    token = token->next;
+
+    // The null directive
+    if (token->at_bol) continue;
+
+    if (gkcc_pp_token_equal(token, "include") ||
+        gkcc_pp_token_equal(token, "include_next")) {
+      token = gkcc_pp_include(directive, token,
+                              token->length == strlen("include_next"));
+      continue;
+    }
+
+    if (gkcc_pp_token_equal(token, "define")) {
+      token = gkcc_pp_read_define(token->next);
+      continue;
+    }
+
+    if (gkcc_pp_token_equal(token, "undef")) {
+      token = token->next;
+      if (token->at_bol || token->type != GKCC_PP_TOKEN_IDENTIFIER) {
+        gkcc_pp_token_error(token, "Macro name must be an identifier");
+      }
+      if (gkcc_pp_macro_find(token->text) != NULL) {
+        *gkcc_pp_macro_slot(token->text) = NULL;
+      }
+      token = gkcc_pp_skip_line(token->next);
+      continue;
+    }
+
+    if (gkcc_pp_token_equal(token, "if")) {
+      bool value = gkcc_pp_read_condition(&token, token->next);
+      gkcc_pp_push_conditional(directive, value);
+      if (!value) token = gkcc_pp_skip_group(token);
+      continue;
+    }
+
+    if (gkcc_pp_token_equal(token, "ifdef") ||
+        gkcc_pp_token_equal(token, "ifndef")) {
+      bool is_ifndef = token->length == strlen("ifndef");
+      token = token->next;
+      if (token->at_bol || token->type != GKCC_PP_TOKEN_IDENTIFIER) {
+        gkcc_pp_token_error(token, "Macro name must be an identifier");
+      }
+      bool value = gkcc_pp_is_defined(token->text) != is_ifndef;
+      gkcc_pp_push_conditional(directive, value);
+      token = gkcc_pp_skip_line(token->next);
+      if (!value) token = gkcc_pp_skip_group(token);
+      continue;
+    }
+
+    if (gkcc_pp_token_equal(token, "elif")) {
+      if (conditionals == NULL || conditionals->context == GKCC_PP_IN_ELSE) {
+        gkcc_pp_token_error(directive, "Stray #elif");
+      }
+      conditionals->context = GKCC_PP_IN_ELIF;
+      if (!conditionals->included &&
+          gkcc_pp_read_condition(&token, token->next)) {
+        conditionals->included = true;
+      } else {
+        token = gkcc_pp_skip_group(gkcc_pp_skip_line(token));
+      }
+      continue;
+    }
+
+    if (gkcc_pp_token_equal(token, "else")) {
+      if (conditionals == NULL || conditionals->context == GKCC_PP_IN_ELSE) {
+        gkcc_pp_token_error(directive, "Stray #else");
+      }
+      conditionals->context = GKCC_PP_IN_ELSE;
+      token = gkcc_pp_skip_line(token->next);
+      if (conditionals->included) token = gkcc_pp_skip_group(token);
+      conditionals->included = true;
+      continue;
+    }
+
+    if (gkcc_pp_token_equal(token, "endif")) {
+      if (conditionals == NULL) gkcc_pp_token_error(directive, "Stray #endif");
+      conditionals = conditionals->next;
+      token = gkcc_pp_skip_line(token->next);
+      continue;
+    }
+
+    if (gkcc_pp_token_equal(token, "line")) {
+      token = gkcc_pp_read_line_directive(directive, token->next, true);
+      continue;
+    }
+
+    // Line markers as written by gcc -E and by gkcc_pp_preprocess_file
+    if (token->type == GKCC_PP_TOKEN_NUMBER) {
+      token = gkcc_pp_read_line_directive(directive, token, false);
+      continue;
+    }
+
+    if (gkcc_pp_token_equal(token, "pragma")) {
+      token = gkcc_pp_read_pragma(directive, token->next);
+      continue;
+    }
+
+    if (gkcc_pp_token_equal(token, "error") ||
+        gkcc_pp_token_equal(token, "warning")) {
+      gkcc_pp_read_diagnostic(directive, token->next,
+                              gkcc_pp_token_equal(token, "error"));
+      token = gkcc_pp_skip_line(token->next);
+      continue;
+    }
+
+    gkcc_pp_token_error(token, "Invalid preprocessing directive");
+  }
+
+  current->next = token;
+  return head.next;
+}
+
+// ==============
+// === OUTPUT ===
+// ==============
+
+static void gkcc_pp_output_write(struct gkcc_pp_output *output,
+                                 const char *text, size_t length) {
+  // Two bytes are always left for the NUL bytes flex needs after the input
+  if (output->length + length + 2 > output->capacity) {
+    size_t new_capacity = output->capacity == 0 ? 1 << 16 : output->capacity;
+    while (output->length + length + 2 > new_capacity) new_capacity *= 2;
+    output->buffer = realloc(output->buffer, new_capacity);
+    gkcc_assert(output->buffer != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                "Failed to grow the preprocessor output");
+    output->capacity = new_capacity;
+  }
+  memcpy(output->buffer + output->length, text, length);
+  output->length += length;
+}
+
+static void gkcc_pp_output_line_marker(struct gkcc_pp_output *output,
+                                       struct gkcc_pp_token *token) {
+  if (output->length != 0) gkcc_pp_output_write(output, "\n", 1);
+
+  char buf[32];
+  int length = snprintf(buf, sizeof(buf), "# %u \"", token->line);
+  gkcc_pp_output_write(output, buf, length);
+  for (const char *p = token->file->path; *p != '\0'; p++) {
+    if (*p == '"' || *p == '\\') gkcc_pp_output_write(output, "\\", 1);
+    gkcc_pp_output_write(output, p, 1);
+  }
+  gkcc_pp_output_write(output, "\"\n", 2);
+
+  output->file = token->file;
+  output->line = token->line;
+  output->previous = NULL;
+}
+
+static bool gkcc_pp_is_word(struct gkcc_pp_token *token) {
+  return token->type != GKCC_PP_TOKEN_PUNCTUATOR &&
+         token->type != GKCC_PP_TOKEN_OTHER;
+}
+
+// gkcc_pp_needs_space returns whether previous and token would be lexed as a
+// different token if written next to each other
+static bool gkcc_pp_needs_space(struct gkcc_pp_token *previous,
+                                struct gkcc_pp_token *token) {
+  if (gkcc_pp_is_word(previous) && gkcc_pp_is_word(token)) return true;
+  if (gkcc_pp_is_word(previous) || gkcc_pp_is_word(token)) {
+    // A number followed by . or a sign could continue the number
+    return previous->type == GKCC_PP_TOKEN_NUMBER &&
+           strchr(".+-", token->text[0]) != NULL;
+  }
+  const char *joining = "+-*/%<>=!&|^#.:";
+  return strchr(joining, previous->text[previous->length - 1]) != NULL &&
+         strchr(joining, token->text[0]) != NULL;
+}
+
+// gkcc_pp_output_token writes a token, keeping it on its original line with
+// newlines or a line marker. A space is added between tokens that could
+// otherwise be lexed as one.
+static void gkcc_pp_output_token(struct gkcc_pp_output *output,
+                                 struct gkcc_pp_token *token) {
+  if (token->file != output->file || token->line < output->line ||
+      token->line > output->line + GKCC_PP_MAX_NEWLINES) {
+    gkcc_pp_output_line_marker(output, token);
+  }
+  for (; output->line < token->line; output->line++) {
+    gkcc_pp_output_write(output, "\n", 1);
+    output->previous = NULL;
+  }
+
+  struct gkcc_pp_token *previous = output->previous;
+  if (previous != NULL &&
+      (token->has_space || gkcc_pp_needs_space(previous, token))) {
+    gkcc_pp_output_write(output, " ", 1);
+  }
+  gkcc_pp_output_write(output, token->text, token->length);
+  output->previous = token;
+}
+
+// ===================
+// === ENTRY POINT ===
+// ===================
+
+// gkcc_pp_builtin_tokens tokenizes the predefined macros and those given
+// with gkcc_pp_add_definition as the contents of a virtual file
+static struct gkcc_pp_token *gkcc_pp_builtin_tokens(void) {
+  size_t length = 64;
+  for (size_t i = 0; i < sizeof(GKCC_PP_PREDEFINED_MACROS) /
+                             sizeof(GKCC_PP_PREDEFINED_MACROS[0]);
+       i++) {
+    length += strlen(GKCC_PP_PREDEFINED_MACROS[i]) + 10;
+  }
+  for (size_t i = 0; i < definition_count; i++) {
+    length += strlen(definitions[i]) + 12;
+  }
+
+  char *text = gkcc_arena_alloc(run_arena, length);
+  char *p = text;
+  for (size_t i = 0; i < sizeof(GKCC_PP_PREDEFINED_MACROS) /
+                             sizeof(GKCC_PP_PREDEFINED_MACROS[0]);
+       i++) {
+    p += sprintf(p, "#define %s\n", GKCC_PP_PREDEFINED_MACROS[i]);
+  }
+
+  time_t now = time(NULL);
+  struct tm local;
+  localtime_r(&now, &local);
+  char date[32];
+  strftime(date, sizeof(date), "\"%b %e %Y\"", &local);
+  p += sprintf(p, "#define __DATE__ %s\n", date);
+  strftime(date, sizeof(date), "\"%H:%M:%S\"", &local);
+  p += sprintf(p, "#define __TIME__ %s\n", date);
+
+  for (size_t i = 0; i < definition_count; i++) {
+    const char *equals = strchr(definitions[i], '=');
+    if (equals == NULL) {
+      p += sprintf(p, "#define %s 1\n", definitions[i]);
+    } else {
+      p += sprintf(p, "#define %.*s %s\n", (int)(equals - definitions[i]),
+                   definitions[i], equals + 1);
+    }
+  }
+
+  return gkcc_pp_tokenize(run_arena, gkcc_pp_file_new_virtual("<built-in>"),
+                          text, p - text);
+}
+
+// gkcc_pp_preprocess_file preprocesses the file at path. On success, output
+// is set to a malloc'd buffer holding the result followed by two NUL bytes,
+// which is the form flex's yy_scan_buffer() expects, and length to the length
+// of the result. Returns false if the file cannot be read.
+bool gkcc_pp_preprocess_file(const char *path, char **output, size_t *length) {
+  struct gkcc_pp_file *file = gkcc_pp_file_get(path, -1);
+  if (file == NULL) return false;
+
+  run_arena = gkcc_arena_new();
+  gkcc_pp_process(gkcc_pp_builtin_tokens());
+  gkcc_pp_macro_define(gkcc_intern_cstr("__FILE__"))->handler =
+      gkcc_pp_builtin_file;
+  gkcc_pp_macro_define(gkcc_intern_cstr("__LINE__"))->handler =
+      gkcc_pp_builtin_line;
+  gkcc_pp_macro_define(gkcc_intern_cstr("__COUNTER__"))->handler =
+      gkcc_pp_builtin_counter;
+
+  struct gkcc_pp_token *tokens = gkcc_pp_process(
+      gkcc_pp_append(file->tokens, gkcc_pp_token_new_eof(file->tokens)));
+  if (conditionals != NULL) {
+    gkcc_pp_token_error(conditionals->directive, "Unterminated conditional");
+  }
+
+  struct gkcc_pp_output out = {0};
+  for (; tokens->type != GKCC_PP_TOKEN_EOF; tokens = tokens->next) {
+    gkcc_pp_output_token(&out, tokens);
+  }
+  gkcc_pp_output_write(&out, "\n", 1);
+  out.buffer[out.length] = '\0';
+  out.buffer[out.length + 1] = '\0';
+  *output = out.buffer;
+  *length = out.length;
+
+  gkcc_arena_free(run_arena);
+  run_arena = NULL;
+  memset(macros, 0, macros_capacity * sizeof(struct gkcc_pp_macro *));
+  once_files = NULL;
+  include_count = 0;
+  counter = 0;
+  return true;
+}
+
+void gkcc_pp_print_stats(FILE *out) {
+  fprintf(out,
+          "preprocessor: %zu files cached, %zu includes, %zu skipped by "
+          "include guards, %zu macro expansions\n",
+          gkcc_pp_file_cache_count(), stats_includes, stats_includes_skipped,
+          stats_expansions);
+}
@@ -0,0 +1,129 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GKCC_PREPROCESSOR_H
+#define GKCC_PREPROCESSOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "misc/arena.h"
+#include "misc/misc.h"
+
+#define ENUM_GKCC_PP_TOKEN_TYPE(GEN) \
+  GEN(GKCC_PP_TOKEN_IDENTIFIER)      \
+  GEN(GKCC_PP_TOKEN_NUMBER)          \
+  GEN(GKCC_PP_TOKEN_STRING)          \
+  GEN(GKCC_PP_TOKEN_CHARACTER)       \
+  GEN(GKCC_PP_TOKEN_PUNCTUATOR)      \
+  GEN(GKCC_PP_TOKEN_OTHER)           \
+  GEN(GKCC_PP_TOKEN_EOF)
+
+enum gkcc_pp_token_type { ENUM_GKCC_PP_TOKEN_TYPE(ENUM_VALUES) };
+
+static const char *const GKCC_PP_TOKEN_TYPE_STRING[] = {
+    ENUM_GKCC_PP_TOKEN_TYPE(ENUM_STRINGS)};
+
+// ===========================
+// === struct gkcc_pp_file ===
+// ===========================
+
+// gkcc_pp_file is a source file that has been read and split into
+// preprocessing tokens. Files are cached for the lifetime of the process, so
+// a header included by many translation units is only ever read once. Cached
+// files are shared by every thread and must not be modified.
+struct gkcc_pp_file {
+  // path is an interned handle. It is also the name used in line markers. A
+  // file reached through several spellings of its path keeps the first one.
+  const char *path;
+  char *contents;
+  size_t length;
+  struct gkcc_pp_token *tokens;
+
+  // guard_macro is the interned name of the macro guarding the whole file with
+  // #ifndef/#define/#endif, or NULL if the file is not guarded that way.
+  // While guard_macro is defined, including the file again has no effect.
+  const char *guard_macro;
+
+  // include_dir_index is the index of the include directory the file was
+  // first found in, or -1. #include_next continues searching after it.
+  int include_dir_index;
+};
+
+// ============================
+// === struct gkcc_pp_token ===
+// ============================
+
+struct gkcc_pp_hideset {
+  const char *name;
+  struct gkcc_pp_hideset *next;
+};
+
+struct gkcc_pp_token {
+  enum gkcc_pp_token_type type;
+  // text is the spelling of the token and is not NUL terminated. The text of
+  // identifiers is an interned handle.
+  const char *text;
+  unsigned int length;
+  unsigned int line;
+  // at_bol is set on the first token of a line, but never on tokens made by
+  // macro replacement. has_space is set on tokens preceded by whitespace.
+  bool at_bol;
+  bool has_space;
+  struct gkcc_pp_file *file;
+  // hideset holds the macros that must not be expanded again in this token
+  struct gkcc_pp_hideset *hideset;
+  struct gkcc_pp_token *next;
+};
+
+// ============================
+// === struct gkcc_pp_macro ===
+// ============================
+
+struct gkcc_pp_macro {
+  const char *name;
+  bool is_function_like;
+  bool is_variadic;
+  // parameters are interned handles. The variadic parameter is __VA_ARGS__.
+  const char **parameters;
+  int parameter_count;
+  struct gkcc_pp_token *body;
+  // handler computes the expansion of built in macros such as __LINE__
+  struct gkcc_pp_token *(*handler)(struct gkcc_pp_token *macro_token);
+};
+
+// === FUNCTION DECLARATIONS ===
+
+// preprocessor.c
+void gkcc_pp_add_include_dir(const char *dir);
+void gkcc_pp_add_definition(const char *definition);
+bool gkcc_pp_preprocess_file(const char *path, char **output, size_t *length);
+void gkcc_pp_print_stats(FILE *out);
+
+// preprocessor_tokens.c
+struct gkcc_pp_file *gkcc_pp_file_get(const char *path,
+                                      int include_dir_index);
+struct gkcc_pp_file *gkcc_pp_file_new_virtual(const char *path);
+struct gkcc_pp_token *gkcc_pp_tokenize(struct gkcc_arena *arena,
+                                       struct gkcc_pp_file *file,
+                                       const char *contents, size_t length);
+bool gkcc_pp_token_equal(struct gkcc_pp_token *token, const char *text);
+void gkcc_pp_token_error(struct gkcc_pp_token *token, const char *message);
+size_t gkcc_pp_file_cache_count(void);
+
+// preprocessor_expression.c
+long long gkcc_pp_evaluate(struct gkcc_pp_token *tokens);
+
+#endif  // GKCC_PREPROCESSOR_H
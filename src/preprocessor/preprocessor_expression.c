@@ -0,0 +1,319 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lexical/number_literal.h"
+#include "preprocessor.h"
+
+// Controlling expressions of #if are evaluated in intmax_t or uintmax_t,
+// which are both 64 bits wide.
+struct gkcc_pp_value {
+  long long value;
+  bool is_unsigned;
+};
+
+static struct gkcc_pp_value gkcc_pp_conditional(struct gkcc_pp_token **rest,
+                                                 bool evaluated);
+
+static struct gkcc_pp_value gkcc_pp_value_new(long long value,
+                                              bool is_unsigned) {
+  return (struct gkcc_pp_value){.value = value, .is_unsigned = is_unsigned};
+}
+
+static struct gkcc_pp_token *gkcc_pp_expect(struct gkcc_pp_token *token,
+                                            const char *text) {
+  if (!gkcc_pp_token_equal(token, text)) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "Expected '%s' in #if expression", text);
+    gkcc_pp_token_error(token, buf);
+  }
+  return token->next;
+}
+
+static struct gkcc_pp_value gkcc_pp_number(struct gkcc_pp_token *token) {
+  struct _yynum number;
+  if (!gkcc_decode_integer_literal(token->text, token->length, &number)) {
+    gkcc_pp_token_error(token, "Invalid integer constant in #if expression");
+  }
+  switch (number.type) {
+    case YYNUM_TYPE_INT:
+      return gkcc_pp_value_new(number.is_unsigned
+                                   ? (long long)(unsigned int)number.num.yint
+                                   : number.num.yint,
+                               number.is_unsigned);
+    case YYNUM_TYPE_LONG:
+      return gkcc_pp_value_new(
+          number.is_unsigned ? (long long)(unsigned long)number.num.ylong
+                             : number.num.ylong,
+          number.is_unsigned);
+    case YYNUM_TYPE_LONGLONG:
+      return gkcc_pp_value_new(number.num.ylonglong, number.is_unsigned);
+    default:
+      gkcc_pp_token_error(token, "Floating constant in #if expression");
+  }
+  return gkcc_pp_value_new(0, false);
+}
+
+static struct gkcc_pp_value gkcc_pp_character(struct gkcc_pp_token *token) {
+  const char *p = token->text;
+  while (*p != '\'') p++;
+  p++;
+
+  int value = (unsigned char)*p;
+  if (*p == '\\') {
+    p++;
+    switch (*p) {
+      case 'a':
+        value = '\a';
+        break;
+      case 'b':
+        value = '\b';
+        break;
+      case 'f':
+        value = '\f';
+        break;
+      case 'n':
+        value = '\n';
+        break;
+      case 'r':
+        value = '\r';
+        break;
+      case 't':
+        value = '\t';
+        break;
+      case 'v':
+        value = '\v';
+        break;
+      case 'x':
+        value = strtol(p + 1, NULL, 16);
+        break;
+      default:
+        value = *p >= '0' && *p <= '7' ? strtol(p, NULL, 8) : *p;
+        break;
+    }
+  }
+  // Plain char is signed on the target
+  return gkcc_pp_value_new(token->text[0] == '\'' ? (signed char)value : value,
+                           false);
+}
+
+static struct gkcc_pp_value gkcc_pp_primary(struct gkcc_pp_token **rest,
+                                            bool evaluated) {
+  struct gkcc_pp_token *token = *rest;
+  if (gkcc_pp_token_equal(token, "(")) {
+    struct gkcc_pp_value value = gkcc_pp_conditional(&token->next, evaluated);
+    *rest = gkcc_pp_expect(token->next, ")");
+    return value;
+  }
+
+  *rest = token->next;
+  switch (token->type) {
+    case GKCC_PP_TOKEN_NUMBER:
+      return gkcc_pp_number(token);
+    case GKCC_PP_TOKEN_CHARACTER:
+      return gkcc_pp_character(token);
+    case GKCC_PP_TOKEN_IDENTIFIER:
+      // Identifiers left after macro expansion evaluate to 0
+      return gkcc_pp_value_new(0, false);
+    default:
+      gkcc_pp_token_error(token, "Invalid token in #if expression");
+  }
+  return gkcc_pp_value_new(0, false);
+}
+
+static struct gkcc_pp_value gkcc_pp_unary(struct gkcc_pp_token **rest,
+                                          bool evaluated) {
+  struct gkcc_pp_token *token = *rest;
+  if (token->type != GKCC_PP_TOKEN_PUNCTUATOR ||
+      strchr("+-~!", token->text[0]) == NULL || token->length != 1) {
+    return gkcc_pp_primary(rest, evaluated);
+  }
+
+  *rest = token->next;
+  struct gkcc_pp_value operand = gkcc_pp_unary(rest, evaluated);
+  switch (token->text[0]) {
+    case '-':
+      operand.value = (long long)(0ULL - (unsigned long long)operand.value);
+      break;
+    case '~':
+      operand.value = ~operand.value;
+      break;
+    case '!':
+      return gkcc_pp_value_new(!operand.value, false);
+  }
+  return operand;
+}
+
+// Binary operators from the lowest to the highest precedence
+static const char *const GKCC_PP_BINARY_OPERATORS[][5] = {
+    {"||"},          {"&&"},         {"|"},
+    {"^"},           {"&"},          {"==", "!="},
+    {"<", ">", "<=", ">="}, {"<<", ">>"}, {"+", "-"},
+    {"*", "/", "%"},
+};
+
+#define GKCC_PP_PRECEDENCE_LEVELS \
+  ((int)(sizeof(GKCC_PP_BINARY_OPERATORS) / sizeof(GKCC_PP_BINARY_OPERATORS[0])))
+
+static const char *gkcc_pp_binary_operator(struct gkcc_pp_token *token,
+                                           int level) {
+  for (int i = 0; i < 5 && GKCC_PP_BINARY_OPERATORS[level][i] != NULL; i++) {
+    if (gkcc_pp_token_equal(token, GKCC_PP_BINARY_OPERATORS[level][i])) {
+      return GKCC_PP_BINARY_OPERATORS[level][i];
+    }
+  }
+  return NULL;
+}
+
+static struct gkcc_pp_value gkcc_pp_apply(struct gkcc_pp_token *token,
+                                          const char *op,
+                                          struct gkcc_pp_value left,
+                                          struct gkcc_pp_value right,
+                                          bool evaluated) {
+  // The usual arithmetic conversions make the result unsigned if either
+  // operand is
+  bool is_unsigned = left.is_unsigned || right.is_unsigned;
+  unsigned long long l = left.value;
+  unsigned long long r = right.value;
+  long long result = 0;
+
+  if (strcmp(op, "||") == 0) return gkcc_pp_value_new(l || r, false);
+  if (strcmp(op, "&&") == 0) return gkcc_pp_value_new(l && r, false);
+  if (strcmp(op, "==") == 0) return gkcc_pp_value_new(l == r, false);
+  if (strcmp(op, "!=") == 0) return gkcc_pp_value_new(l != r, false);
+
+  if (strcmp(op, "<") == 0 || strcmp(op, ">") == 0 || strcmp(op, "<=") == 0 ||
+      strcmp(op, ">=") == 0) {
+    int comparison = is_unsigned ? (l > r) - (l < r)
+                                 : (left.value > right.value) -
+                                       (left.value < right.value);
+    switch (op[0] == '<' ? (op[1] == '=' ? 0 : 1) : (op[1] == '=' ? 2 : 3)) {
+      case 0:
+        return gkcc_pp_value_new(comparison <= 0, false);
+      case 1:
+        return gkcc_pp_value_new(comparison < 0, false);
+      case 2:
+        return gkcc_pp_value_new(comparison >= 0, false);
+      default:
+        return gkcc_pp_value_new(comparison > 0, false);
+    }
+  }
+
+  if (strcmp(op, "<<") == 0 || strcmp(op, ">>") == 0) {
+    // The result of a shift has the type of the left operand
+    unsigned int amount = r & 63;
+    if (op[0] == '<') {
+      result = (long long)(l << amount);
+    } else {
+      result = left.is_unsigned ? (long long)(l >> amount)
+                                : left.value >> amount;
+    }
+    return gkcc_pp_value_new(result, left.is_unsigned);
+  }
+
+  switch (op[0]) {
+    case '|':
+      result = l | r;
+      break;
+    case '^':
+      result = l ^ r;
+      break;
+    case '&':
+      result = l & r;
+      break;
+    case '+':
+      result = (long long)(l + r);
+      break;
+    case '-':
+      result = (long long)(l - r);
+      break;
+    case '*':
+      result = (long long)(l * r);
+      break;
+    case '/':
+    case '%':
+      if (r == 0) {
+        if (evaluated) gkcc_pp_token_error(token, "Division by zero in #if");
+        return gkcc_pp_value_new(0, is_unsigned);
+      }
+      if (is_unsigned) {
+        result = op[0] == '/' ? (long long)(l / r) : (long long)(l % r);
+      } else if (right.value == -1) {
+        result = op[0] == '/' ? (long long)(0ULL - l) : 0;
+      } else {
+        result = op[0] == '/' ? left.value / right.value
+                              : left.value % right.value;
+      }
+      break;
+  }
+  return gkcc_pp_value_new(result, is_unsigned);
+}
+
+static struct gkcc_pp_value gkcc_pp_binary(struct gkcc_pp_token **rest,
+                                           int level, bool evaluated) {
+  if (level == GKCC_PP_PRECEDENCE_LEVELS) return gkcc_pp_unary(rest, evaluated);
+
+  struct gkcc_pp_value left = gkcc_pp_binary(rest, level + 1, evaluated);
+  const char *op;
+  while ((op = gkcc_pp_binary_operator(*rest, level)) != NULL) {
+    struct gkcc_pp_token *token = *rest;
+    *rest = token->next;
+
+    // The right operand of || and && is not evaluated if the left decides
+    // the result, so it must not report division by zero either
+    bool right_evaluated = evaluated;
+    if (strcmp(op, "||") == 0) right_evaluated = evaluated && !left.value;
+    if (strcmp(op, "&&") == 0) right_evaluated = evaluated && left.value;
+
+    struct gkcc_pp_value right =
+        gkcc_pp_binary(rest, level + 1, right_evaluated);
+    left = gkcc_pp_apply(token, op, left, right, right_evaluated);
+  }
+  return left;
+}
+
+static struct gkcc_pp_value gkcc_pp_conditional(struct gkcc_pp_token **rest,
+                                                 bool evaluated) {
+  struct gkcc_pp_value condition = gkcc_pp_binary(rest, 0, evaluated);
+  if (!gkcc_pp_token_equal(*rest, "?")) return condition;
+
+  *rest = (*rest)->next;
+  struct gkcc_pp_value then_value =
+      gkcc_pp_conditional(rest, evaluated && condition.value);
+  *rest = gkcc_pp_expect(*rest, ":");
+  struct gkcc_pp_value else_value =
+      gkcc_pp_conditional(rest, evaluated && !condition.value);
+
+  struct gkcc_pp_value result = condition.value ? then_value : else_value;
+  result.is_unsigned = then_value.is_unsigned || else_value.is_unsigned;
+  return result;
+}
+
+// gkcc_pp_evaluate evaluates the controlling expression of #if or #elif. The
+// tokens must already be macro expanded with defined operators replaced.
+long long gkcc_pp_evaluate(struct gkcc_pp_token *tokens) {
+  struct gkcc_pp_token *rest = tokens;
+  if (rest->type == GKCC_PP_TOKEN_EOF) {
+    gkcc_pp_token_error(rest, "#if with no expression");
+  }
+  struct gkcc_pp_value value = gkcc_pp_conditional(&rest, true);
+  if (rest->type != GKCC_PP_TOKEN_EOF) {
+    gkcc_pp_token_error(rest, "Extra tokens in #if expression");
+  }
+  return value.value;
+}
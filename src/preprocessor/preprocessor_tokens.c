@@ -0,0 +1,477 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "misc/arena.h"
+#include "misc/intern.h"
+#include "misc/misc.h"
+#include "preprocessor.h"
+
+// Longer punctuators must come before their prefixes
+static const char *const GKCC_PP_PUNCTUATORS[] = {
+    "<<=", ">>=", "...", "==", "!=", "<=", ">=", "->", "+=", "-=", "*=", "/=",
+    "%=",  "&=",  "|=",  "^=", "++", "--", "&&", "||", "<<", ">>", "##",
+};
+
+// ==================
+// === FILE CACHE ===
+// ==================
+
+// The file cache is indexed by the intern id of the path. Paths that could not
+// be read are remembered as missing_file so they are not tried again either.
+// The cache is shared by every thread and guarded by file_cache_lock. Cached
+// files are never modified after they are added.
+//
+// Different spellings of a path can name the same file, like "o.h" and
+// "./o.h". Files are also kept in file_identities, a hash table keyed by
+// device and inode, so that every spelling of a file gets the same struct
+// gkcc_pp_file and #pragma once and include guards see one file.
+struct gkcc_pp_file_identity {
+  dev_t device;
+  ino_t inode;
+  struct gkcc_pp_file *file;
+};
+
+static struct gkcc_pp_file **file_cache = NULL;
+static unsigned int file_cache_capacity = 0;
+static size_t file_cache_count = 0;
+static struct gkcc_pp_file missing_file;
+static struct gkcc_pp_file_identity *file_identities = NULL;
+static size_t file_identity_capacity = 0;
+static struct gkcc_arena *file_arena = NULL;
+static pthread_mutex_t file_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct gkcc_arena *gkcc_pp_file_arena(void) {
+  if (file_arena == NULL) file_arena = gkcc_arena_new();
+  return file_arena;
+}
+
+static struct gkcc_pp_file **gkcc_pp_file_cache_slot(const char *path) {
+  unsigned int id = gkcc_intern_id(path);
+  if (id < file_cache_capacity) return &file_cache[id];
+
+  unsigned int new_capacity =
+      file_cache_capacity == 0 ? 1024 : file_cache_capacity;
+  while (new_capacity <= id) new_capacity *= 2;
+
+  file_cache =
+      realloc(file_cache, new_capacity * sizeof(struct gkcc_pp_file *));
+  gkcc_assert(file_cache != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to grow the preprocessor file cache");
+  memset(&file_cache[file_cache_capacity], 0,
+         (new_capacity - file_cache_capacity) * sizeof(struct gkcc_pp_file *));
+  file_cache_capacity = new_capacity;
+  return &file_cache[id];
+}
+
+static size_t gkcc_pp_file_identity_hash(dev_t device, ino_t inode) {
+  return ((size_t)device * 0x9e3779b97f4a7c15ULL) ^ (size_t)inode;
+}
+
+// gkcc_pp_file_identity_slot returns the slot of the file with the given
+// device and inode, or the empty slot it would go in
+static struct gkcc_pp_file_identity *gkcc_pp_file_identity_slot(
+    dev_t device, ino_t inode) {
+  size_t mask = file_identity_capacity - 1;
+  size_t i = gkcc_pp_file_identity_hash(device, inode) & mask;
+  while (file_identities[i].file != NULL &&
+         (file_identities[i].device != device ||
+          file_identities[i].inode != inode)) {
+    i = (i + 1) & mask;
+  }
+  return &file_identities[i];
+}
+
+static void gkcc_pp_file_identity_add(dev_t device, ino_t inode,
+                                      struct gkcc_pp_file *file) {
+  // Keep the table at most half full. Every file in it is also counted in
+  // file_cache_count.
+  if (2 * (file_cache_count + 1) > file_identity_capacity) {
+    struct gkcc_pp_file_identity *old = file_identities;
+    size_t old_capacity = file_identity_capacity;
+    file_identity_capacity = old_capacity == 0 ? 256 : old_capacity * 2;
+    file_identities = calloc(file_identity_capacity,
+                             sizeof(struct gkcc_pp_file_identity));
+    gkcc_assert(file_identities != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                "Failed to grow the preprocessor file identity table");
+    for (size_t i = 0; i < old_capacity; i++) {
+      if (old[i].file == NULL) continue;
+      *gkcc_pp_file_identity_slot(old[i].device, old[i].inode) = old[i];
+    }
+    free(old);
+  }
+
+  *gkcc_pp_file_identity_slot(device, inode) =
+      (struct gkcc_pp_file_identity){
+          .device = device, .inode = inode, .file = file};
+}
+
+size_t gkcc_pp_file_cache_count(void) {
+  pthread_mutex_lock(&file_cache_lock);
+  size_t count = file_cache_count;
+  pthread_mutex_unlock(&file_cache_lock);
+  return count;
+}
+
+// gkcc_pp_splice_lines removes backslash newline sequences in place. The
+// removed newlines are added back after the end of the logical line so that
+// tokens keep their physical line numbers.
+static size_t gkcc_pp_splice_lines(char *contents, size_t length) {
+  size_t out = 0;
+  size_t pending_newlines = 0;
+  for (size_t i = 0; i < length;) {
+    if (contents[i] == '\\' && i + 1 < length && contents[i + 1] == '\n') {
+      i += 2;
+      pending_newlines++;
+    } else if (contents[i] == '\\' && i + 2 < length &&
+               contents[i + 1] == '\r' && contents[i + 2] == '\n') {
+      i += 3;
+      pending_newlines++;
+    } else if (contents[i] == '\n') {
+      contents[out++] = contents[i++];
+      for (; pending_newlines > 0; pending_newlines--) contents[out++] = '\n';
+    } else {
+      contents[out++] = contents[i++];
+    }
+  }
+  for (; pending_newlines > 0; pending_newlines--) contents[out++] = '\n';
+  return out;
+}
+
+static bool gkcc_pp_is_directive(struct gkcc_pp_token *token) {
+  return token->at_bol && gkcc_pp_token_equal(token, "#");
+}
+
+static struct gkcc_pp_token *gkcc_pp_skip_line(struct gkcc_pp_token *token) {
+  while (!token->at_bol) token = token->next;
+  return token;
+}
+
+// gkcc_pp_detect_include_guard returns the guard macro if the whole file is
+// wrapped in "#ifndef X" or "#if !defined(X)" and the matching #endif, with no
+// #else or #elif at the top level.
+static const char *gkcc_pp_detect_include_guard(struct gkcc_pp_token *token) {
+  if (!gkcc_pp_is_directive(token)) return NULL;
+  token = token->next;
+
+  const char *guard = NULL;
+  if (gkcc_pp_token_equal(token, "ifndef")) {
+    token = token->next;
+  } else if (gkcc_pp_token_equal(token, "if") &&
+             gkcc_pp_token_equal(token->next, "!") &&
+             gkcc_pp_token_equal(token->next->next, "defined")) {
+    token = token->next->next->next;
+  } else {
+    return NULL;
+  }
+
+  bool parenthesized = gkcc_pp_token_equal(token, "(");
+  if (parenthesized) token = token->next;
+  if (token->type != GKCC_PP_TOKEN_IDENTIFIER) return NULL;
+  guard = token->text;
+  token = token->next;
+  if (parenthesized) {
+    if (!gkcc_pp_token_equal(token, ")")) return NULL;
+    token = token->next;
+  }
+  if (!token->at_bol) return NULL;
+
+  int depth = 1;
+  while (token->type != GKCC_PP_TOKEN_EOF) {
+    if (!gkcc_pp_is_directive(token)) {
+      token = token->next;
+      continue;
+    }
+
+    struct gkcc_pp_token *name = token->next;
+    token = gkcc_pp_skip_line(name);
+    if (gkcc_pp_token_equal(name, "if") || gkcc_pp_token_equal(name, "ifdef") ||
+        gkcc_pp_token_equal(name, "ifndef")) {
+      depth++;
+    } else if (gkcc_pp_token_equal(name, "elif") ||
+               gkcc_pp_token_equal(name, "else")) {
+      if (depth == 1) return NULL;
+    } else if (gkcc_pp_token_equal(name, "endif")) {
+      depth--;
+      if (depth == 0) {
+        return token->type == GKCC_PP_TOKEN_EOF ? guard : NULL;
+      }
+    }
+  }
+  return NULL;
+}
+
+// gkcc_pp_file_get returns the tokenized file at path, reading it only the
+// first time it is asked for. include_dir_index is recorded if this is the
+// first time, so it is the index of the include directory the file was first
+// found in. Returns NULL if the file cannot be read.
+struct gkcc_pp_file *gkcc_pp_file_get(const char *path,
+                                      int include_dir_index) {
+  path = gkcc_intern_cstr(path);
+
+  // The lock is held while the file is read so that concurrent includes of
+  // the same header read and tokenize it only once
+  pthread_mutex_lock(&file_cache_lock);
+  struct gkcc_pp_file **slot = gkcc_pp_file_cache_slot(path);
+  if (*slot != NULL) {
+    struct gkcc_pp_file *file = *slot == &missing_file ? NULL : *slot;
+    pthread_mutex_unlock(&file_cache_lock);
+    return file;
+  }
+
+  FILE *in = fopen(path, "rb");
+  if (in == NULL) {
+    *slot = &missing_file;
+    pthread_mutex_unlock(&file_cache_lock);
+    return NULL;
+  }
+
+  // A file already read under another spelling of its path is not read again
+  struct stat identity;
+  bool has_identity = fstat(fileno(in), &identity) == 0;
+  if (has_identity && file_identity_capacity != 0) {
+    struct gkcc_pp_file *same =
+        gkcc_pp_file_identity_slot(identity.st_dev, identity.st_ino)->file;
+    if (same != NULL) {
+      fclose(in);
+      *slot = same;
+      pthread_mutex_unlock(&file_cache_lock);
+      return same;
+    }
+  }
+
+  struct gkcc_arena *arena = gkcc_pp_file_arena();
+  size_t capacity = 1 << 12;
+  size_t length = 0;
+  char *contents = malloc(capacity);
+  gkcc_assert(contents != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate file buffer");
+  size_t read;
+  while ((read = fread(contents + length, 1, capacity - length, in)) != 0) {
+    length += read;
+    if (length == capacity) {
+      capacity *= 2;
+      contents = realloc(contents, capacity);
+      gkcc_assert(contents != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                  "Failed to grow file buffer");
+    }
+  }
+  fclose(in);
+
+  struct gkcc_pp_file *file = gkcc_arena_alloc(arena, sizeof(*file));
+  file->path = path;
+  file->include_dir_index = include_dir_index;
+  file->contents = gkcc_arena_alloc(arena, length + 1);
+  memcpy(file->contents, contents, length);
+  free(contents);
+  file->length = gkcc_pp_splice_lines(file->contents, length);
+  file->tokens = gkcc_pp_tokenize(arena, file, file->contents, file->length);
+  file->guard_macro = gkcc_pp_detect_include_guard(file->tokens);
+
+  *slot = file;
+  if (has_identity) {
+    gkcc_pp_file_identity_add(identity.st_dev, identity.st_ino, file);
+  }
+  file_cache_count++;
+  pthread_mutex_unlock(&file_cache_lock);
+  return file;
+}
+
+// gkcc_pp_file_new_virtual creates an uncached file without contents. It names
+// built in definitions and the files renamed by #line.
+struct gkcc_pp_file *gkcc_pp_file_new_virtual(const char *path) {
+  path = gkcc_intern_cstr(path);
+  pthread_mutex_lock(&file_cache_lock);
+  struct gkcc_pp_file *file =
+      gkcc_arena_alloc(gkcc_pp_file_arena(), sizeof(*file));
+  pthread_mutex_unlock(&file_cache_lock);
+  file->path = path;
+  file->include_dir_index = -1;
+  return file;
+}
+
+// =================
+// === TOKENIZER ===
+// =================
+
+bool gkcc_pp_token_equal(struct gkcc_pp_token *token, const char *text) {
+  size_t length = strlen(text);
+  return token->type != GKCC_PP_TOKEN_EOF && token->length == length &&
+         memcmp(token->text, text, length) == 0;
+}
+
+static void gkcc_pp_error_at(struct gkcc_pp_file *file, unsigned int line,
+                             const char *message) {
+  char buf[(1 << 12) + 1];
+  snprintf(buf, sizeof(buf), "%s:%u: %s", file->path, line, message);
+  gkcc_error_fatal(GKCC_ERROR_INVALID_CODE, buf);
+}
+
+void gkcc_pp_token_error(struct gkcc_pp_token *token, const char *message) {
+  gkcc_pp_error_at(token->file, token->line, message);
+}
+
+static bool gkcc_pp_is_identifier_start(char c) {
+  return isalpha((unsigned char)c) || c == '_' || c == '$';
+}
+
+static bool gkcc_pp_is_identifier_char(char c) {
+  return isalnum((unsigned char)c) || c == '_' || c == '$';
+}
+
+// gkcc_pp_literal_end returns the end of the string or character literal whose
+// opening quote is at p, or NULL if it is not terminated on the same line
+static const char *gkcc_pp_literal_end(const char *p, const char *end) {
+  char quote = *p++;
+  while (p < end && *p != quote) {
+    if (*p == '\n') return NULL;
+    if (*p == '\\' && p + 1 < end) p++;
+    p++;
+  }
+  return p < end ? p + 1 : NULL;
+}
+
+// gkcc_pp_literal_prefix_length returns the length of the encoding prefix of
+// a string or character literal starting at p, or -1 if there is no literal
+static int gkcc_pp_literal_prefix_length(const char *p, const char *end) {
+  if (end - p >= 3 && p[0] == 'u' && p[1] == '8' && p[2] == '"') return 2;
+  if (end - p >= 2 && (p[0] == 'u' || p[0] == 'U' || p[0] == 'L') &&
+      (p[1] == '"' || p[1] == '\'')) {
+    return 1;
+  }
+  if (*p == '"' || *p == '\'') return 0;
+  return -1;
+}
+
+// gkcc_pp_tokenize splits contents into preprocessing tokens. The returned
+// list always ends with an EOF token and the token text points into contents,
+// which must outlive the tokens.
+struct gkcc_pp_token *gkcc_pp_tokenize(struct gkcc_arena *arena,
+                                       struct gkcc_pp_file *file,
+                                       const char *contents, size_t length) {
+  struct gkcc_pp_token head = {0};
+  struct gkcc_pp_token *current = &head;
+  const char *p = contents;
+  const char *end = contents + length;
+  unsigned int line = 1;
+  bool at_bol = true;
+  bool has_space = false;
+
+  while (p < end) {
+    if (*p == '\n') {
+      p++;
+      line++;
+      at_bol = true;
+      has_space = false;
+      continue;
+    }
+    if (isspace((unsigned char)*p)) {
+      p++;
+      has_space = true;
+      continue;
+    }
+    if (p + 1 < end && p[0] == '/' && p[1] == '/') {
+      while (p < end && *p != '\n') p++;
+      has_space = true;
+      continue;
+    }
+    if (p + 1 < end && p[0] == '/' && p[1] == '*') {
+      unsigned int start_line = line;
+      for (p += 2; p + 1 < end && !(p[0] == '*' && p[1] == '/'); p++) {
+        if (*p == '\n') line++;
+      }
+      if (p + 1 >= end) {
+        gkcc_pp_error_at(file, start_line, "Unterminated comment");
+      }
+      p += 2;
+      has_space = true;
+      continue;
+    }
+
+    const char *start = p;
+    enum gkcc_pp_token_type type;
+    int prefix_length = gkcc_pp_literal_prefix_length(p, end);
+    const char *literal_end =
+        prefix_length >= 0 ? gkcc_pp_literal_end(p + prefix_length, end)
+                           : NULL;
+
+    if (isdigit((unsigned char)*p) ||
+        (*p == '.' && p + 1 < end && isdigit((unsigned char)p[1]))) {
+      // pp-number
+      type = GKCC_PP_TOKEN_NUMBER;
+      for (p++; p < end; p++) {
+        if ((*p == '+' || *p == '-') && strchr("eEpP", p[-1]) != NULL) {
+          continue;
+        }
+        if (!gkcc_pp_is_identifier_char(*p) && *p != '.') break;
+      }
+    } else if (literal_end != NULL) {
+      type = p[prefix_length] == '"' ? GKCC_PP_TOKEN_STRING
+                                     : GKCC_PP_TOKEN_CHARACTER;
+      p = literal_end;
+    } else if (gkcc_pp_is_identifier_start(*p)) {
+      type = GKCC_PP_TOKEN_IDENTIFIER;
+      while (p < end && gkcc_pp_is_identifier_char(*p)) p++;
+    } else {
+      // A lone quote, as in an apostrophe inside #error, is kept as a token
+      // of its own rather than rejected.
+      type = strchr("\"'`@\\", *p) != NULL || (unsigned char)*p >= 0x80
+                 ? GKCC_PP_TOKEN_OTHER
+                 : GKCC_PP_TOKEN_PUNCTUATOR;
+      size_t punctuator_length = 1;
+      for (size_t i = 0; i < sizeof(GKCC_PP_PUNCTUATORS) /
+                                 sizeof(GKCC_PP_PUNCTUATORS[0]);
+           i++) {
+        size_t candidate = strlen(GKCC_PP_PUNCTUATORS[i]);
+        if ((size_t)(end - p) >= candidate &&
+            memcmp(p, GKCC_PP_PUNCTUATORS[i], candidate) == 0) {
+          punctuator_length = candidate;
+          break;
+        }
+      }
+      p += punctuator_length;
+    }
+
+    struct gkcc_pp_token *token = gkcc_arena_alloc(arena, sizeof(*token));
+    token->type = type;
+    token->length = p - start;
+    token->text = type == GKCC_PP_TOKEN_IDENTIFIER
+                      ? gkcc_intern(start, token->length)
+                      : start;
+    token->line = line;
+    token->at_bol = at_bol;
+    token->has_space = has_space;
+    token->file = file;
+    current->next = token;
+    current = token;
+    at_bol = false;
+    has_space = false;
+  }
+
+  struct gkcc_pp_token *eof = gkcc_arena_alloc(arena, sizeof(*eof));
+  eof->type = GKCC_PP_TOKEN_EOF;
+  eof->text = "";
+  eof->line = line;
+  eof->at_bol = true;
+  eof->file = file;
+  current->next = eof;
+  return head.next;
+}
@@ -0,0 +1,801 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "scope/pch.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ast/types.h"
+#include "misc/intern.h"
+#include "misc/misc.h"
+#include "misc/writer.h"
+
+// The kinds of objects that are copied into an image along with what they
+// point to
+enum gkcc_pch_object {
+  GKCC_PCH_OBJECT_SYMBOL_TABLE_SET,
+  GKCC_PCH_OBJECT_SYMBOL_TABLE,
+  GKCC_PCH_OBJECT_SYMBOL,
+  GKCC_PCH_OBJECT_TYPE,
+  GKCC_PCH_OBJECT_AST_NODE,
+  GKCC_PCH_OBJECT_NAME,
+};
+
+static const size_t GKCC_PCH_OBJECT_SIZE[] = {
+    [GKCC_PCH_OBJECT_SYMBOL_TABLE_SET] = sizeof(struct gkcc_symbol_table_set),
+    [GKCC_PCH_OBJECT_SYMBOL_TABLE] = sizeof(struct gkcc_symbol_table),
+    [GKCC_PCH_OBJECT_SYMBOL] = sizeof(struct gkcc_symbol),
+    [GKCC_PCH_OBJECT_TYPE] = sizeof(struct gkcc_type),
+    [GKCC_PCH_OBJECT_AST_NODE] = sizeof(struct ast_node),
+};
+
+// ===============================
+// === struct gkcc_pch_builder ===
+// ===============================
+
+struct gkcc_pch_slot {
+  const void *pointer;
+  uint32_t offset;
+};
+
+struct gkcc_pch_pending {
+  enum gkcc_pch_object kind;
+  const void *object;
+  uint32_t offset;
+};
+
+// gkcc_pch_builder is the state of writing out an image. Like an IR image, it
+// is collected in memory since the header is only known at the end.
+//
+// slots is an open addressing hash table (linear probing) from the address of
+// every object that has been copied into the image to the offset of its copy,
+// which is kept at most half full. Objects are copied as soon as they are
+// found, but the pointers in them are only written once they are taken off
+// pending, so that deep lists and expressions do not recurse.
+struct gkcc_pch_builder {
+  struct gkcc_writer *image;
+  struct gkcc_writer *relocations;
+  struct gkcc_writer *names;
+  struct gkcc_writer *name_uses;
+  struct gkcc_writer *canonical_types;
+
+  struct gkcc_pch_slot *slots;
+  size_t slot_count;
+  size_t slot_capacity;
+
+  struct gkcc_pch_pending *pending;
+  size_t pending_count;
+  size_t pending_capacity;
+};
+
+static size_t gkcc_pch_slot(const void *pointer, size_t capacity) {
+  return (size_t)(((uintptr_t)pointer * 0x9e3779b97f4a7c15ULL) >> 32) &
+         (capacity - 1);
+}
+
+static void gkcc_pch_grow_slots(struct gkcc_pch_builder *builder) {
+  size_t new_capacity =
+      builder->slot_capacity == 0 ? 1024 : builder->slot_capacity * 2;
+  struct gkcc_pch_slot *new_slots =
+      calloc(new_capacity, sizeof(struct gkcc_pch_slot));
+  gkcc_assert(new_slots != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to grow the objects of a precompiled header");
+
+  for (size_t i = 0; i < builder->slot_capacity; i++) {
+    if (builder->slots[i].pointer == NULL) continue;
+
+    size_t slot = gkcc_pch_slot(builder->slots[i].pointer, new_capacity);
+    while (new_slots[slot].pointer != NULL) {
+      slot = (slot + 1) & (new_capacity - 1);
+    }
+    new_slots[slot] = builder->slots[i];
+  }
+  free(builder->slots);
+  builder->slots = new_slots;
+  builder->slot_capacity = new_capacity;
+}
+
+// gkcc_pch_find returns the offset of the copy of object, or 0 after setting
+// *slot to the empty slot it goes in
+static uint32_t gkcc_pch_find(struct gkcc_pch_builder *builder,
+                              const void *object, size_t *slot) {
+  if ((builder->slot_count + 1) * 2 > builder->slot_capacity) {
+    gkcc_pch_grow_slots(builder);
+  }
+
+  for (*slot = gkcc_pch_slot(object, builder->slot_capacity);
+       builder->slots[*slot].pointer != NULL;
+       *slot = (*slot + 1) & (builder->slot_capacity - 1)) {
+    if (builder->slots[*slot].pointer == object) {
+      return builder->slots[*slot].offset;
+    }
+  }
+  return 0;
+}
+
+static void gkcc_pch_push(struct gkcc_pch_builder *builder,
+                          enum gkcc_pch_object kind, const void *object,
+                          uint32_t offset) {
+  if (builder->pending_count == builder->pending_capacity) {
+    builder->pending_capacity =
+        builder->pending_capacity == 0 ? 256 : builder->pending_capacity * 2;
+    builder->pending =
+        realloc(builder->pending,
+                builder->pending_capacity * sizeof(struct gkcc_pch_pending));
+    gkcc_assert(builder->pending != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+                "Failed to grow the objects of a precompiled header");
+  }
+  builder->pending[builder->pending_count++] = (struct gkcc_pch_pending){
+      .kind = kind,
+      .object = object,
+      .offset = offset,
+  };
+}
+
+// ===================
+// === WRITING OUT ===
+// ===================
+
+// gkcc_pch_append appends data to the image at the next multiple of
+// GKCC_PCH_ALIGN and returns its offset
+static uint32_t gkcc_pch_append(struct gkcc_writer *image, const void *data,
+                                size_t length) {
+  static const char padding[GKCC_PCH_ALIGN];
+  gkcc_writer_bytes(image, padding, -image->used & (GKCC_PCH_ALIGN - 1));
+  size_t offset = image->used;
+  gkcc_writer_bytes(image, data, length);
+  gkcc_assert(image->used <= UINT32_MAX, GKCC_ERROR_NOT_YET_IMPLEMENTED,
+              "Precompiled headers larger than 4 GiB are not supported");
+  return offset;
+}
+
+static void gkcc_pch_section_add(struct gkcc_writer *section,
+                                 uint32_t offset) {
+  gkcc_writer_bytes(section, (const char *)&offset, sizeof(offset));
+}
+
+static struct gkcc_pch_section gkcc_pch_write_section(
+    struct gkcc_writer *image, struct gkcc_writer *section) {
+  return (struct gkcc_pch_section){
+      .offset = gkcc_pch_append(image, section->buffer, section->used),
+      .count = section->used / sizeof(uint32_t),
+  };
+}
+
+// gkcc_pch_add returns the offset of the copy of object in the image, copying
+// it there if it is not yet, or 0 if object is NULL. The offset of a name is
+// that of its string, which is what handles point to.
+static uint32_t gkcc_pch_add(struct gkcc_pch_builder *builder,
+                             enum gkcc_pch_object kind, const void *object) {
+  if (object == NULL) return 0;
+
+  size_t slot = 0;
+  uint32_t offset = gkcc_pch_find(builder, object, &slot);
+  if (offset != 0) return offset;
+
+  if (kind == GKCC_PCH_OBJECT_NAME) {
+    const struct gkcc_interned_string *entry =
+        (const void *)((const char *)object -
+                       offsetof(struct gkcc_interned_string, string));
+    uint32_t record = gkcc_pch_append(
+        builder->image, entry,
+        sizeof(struct gkcc_interned_string) + entry->length);
+    gkcc_writer_char(builder->image, '\0');
+    gkcc_pch_section_add(builder->names, record);
+    offset = record + offsetof(struct gkcc_interned_string, string);
+  } else {
+    offset = gkcc_pch_append(builder->image, object,
+                             GKCC_PCH_OBJECT_SIZE[kind]);
+    gkcc_pch_push(builder, kind, object, offset);
+  }
+
+  builder->slots[slot] =
+      (struct gkcc_pch_slot){.pointer = object, .offset = offset};
+  builder->slot_count++;
+  return offset;
+}
+
+// gkcc_pch_add_bytes is gkcc_pch_add for the length bytes of a string
+// constant, which are followed by a NUL byte
+static uint32_t gkcc_pch_add_bytes(struct gkcc_pch_builder *builder,
+                                   const char *bytes, size_t length) {
+  if (bytes == NULL) return 0;
+
+  size_t slot = 0;
+  uint32_t offset = gkcc_pch_find(builder, bytes, &slot);
+  if (offset != 0) return offset;
+
+  offset = gkcc_pch_append(builder->image, bytes, length);
+  gkcc_writer_char(builder->image, '\0');
+  builder->slots[slot] =
+      (struct gkcc_pch_slot){.pointer = bytes, .offset = offset};
+  builder->slot_count++;
+  return offset;
+}
+
+// gkcc_pch_point makes the pointer at field in the image point to the object
+// at target, as it is once the image is mapped at GKCC_PCH_BASE
+static void gkcc_pch_point(struct gkcc_pch_builder *builder, uint32_t field,
+                           uint32_t target) {
+  uintptr_t pointer = target == 0 ? 0 : GKCC_PCH_BASE + target;
+  memcpy(&builder->image->buffer[field], &pointer, sizeof(pointer));
+  if (target != 0) gkcc_pch_section_add(builder->relocations, field);
+}
+
+// gkcc_pch_link copies target into the image if needed and makes the pointer
+// at field_offset in the copy of the object at offset point to it
+static void gkcc_pch_link(struct gkcc_pch_builder *builder, uint32_t offset,
+                          size_t field_offset, enum gkcc_pch_object kind,
+                          const void *target) {
+  uint32_t field = offset + field_offset;
+  uint32_t target_offset = gkcc_pch_add(builder, kind, target);
+  gkcc_pch_point(builder, field, target_offset);
+  if (kind == GKCC_PCH_OBJECT_NAME && target_offset != 0) {
+    gkcc_pch_section_add(builder->name_uses, field);
+  }
+}
+
+// gkcc_pch_add_symbols copies an array of capacity symbol pointers, of which
+// only the first count are in use, and the symbols they point to
+static uint32_t gkcc_pch_add_symbols(struct gkcc_pch_builder *builder,
+                                     struct gkcc_symbol **symbols,
+                                     unsigned int count,
+                                     unsigned int capacity) {
+  if (symbols == NULL) return 0;
+
+  uint32_t offset = gkcc_pch_append(builder->image, symbols,
+                                    capacity * sizeof(struct gkcc_symbol *));
+  for (unsigned int i = 0; i < capacity; i++) {
+    uint32_t symbol =
+        i < count ? gkcc_pch_add(builder, GKCC_PCH_OBJECT_SYMBOL, symbols[i])
+                  : 0;
+    gkcc_pch_point(builder, offset + i * sizeof(struct gkcc_symbol *),
+                   symbol);
+  }
+  return offset;
+}
+
+static void gkcc_pch_write_symbol_table_set(
+    struct gkcc_pch_builder *builder, const struct gkcc_symbol_table_set *set,
+    uint32_t offset) {
+  gkcc_pch_link(builder, offset,
+                offsetof(struct gkcc_symbol_table_set, general_namespace),
+                GKCC_PCH_OBJECT_SYMBOL_TABLE, set->general_namespace);
+  gkcc_pch_link(builder, offset,
+                offsetof(struct gkcc_symbol_table_set, label_namespace),
+                GKCC_PCH_OBJECT_SYMBOL_TABLE, set->label_namespace);
+  gkcc_pch_link(builder, offset,
+                offsetof(struct gkcc_symbol_table_set, tag_namespace),
+                GKCC_PCH_OBJECT_SYMBOL_TABLE, set->tag_namespace);
+  gkcc_pch_link(builder, offset,
+                offsetof(struct gkcc_symbol_table_set, mini_namespace),
+                GKCC_PCH_OBJECT_SYMBOL_TABLE, set->mini_namespace);
+  gkcc_pch_link(builder, offset,
+                offsetof(struct gkcc_symbol_table_set, parent_scope),
+                GKCC_PCH_OBJECT_SYMBOL_TABLE_SET, set->parent_scope);
+}
+
+static void gkcc_pch_write_symbol_table(struct gkcc_pch_builder *builder,
+                                        const struct gkcc_symbol_table *table,
+                                        uint32_t offset) {
+  uint32_t symbols =
+      gkcc_pch_add_symbols(builder, table->symbols, table->symbol_count,
+                           table->symbols_capacity);
+  gkcc_pch_point(builder, offset + offsetof(struct gkcc_symbol_table, symbols),
+                 symbols);
+  uint32_t slots = gkcc_pch_add_symbols(
+      builder, table->slots, table->slots_capacity, table->slots_capacity);
+  gkcc_pch_point(builder, offset + offsetof(struct gkcc_symbol_table, slots),
+                 slots);
+}
+
+static void gkcc_pch_write_symbol(struct gkcc_pch_builder *builder,
+                                  const struct gkcc_symbol *symbol,
+                                  uint32_t offset) {
+  gkcc_pch_link(builder, offset, offsetof(struct gkcc_symbol, symbol_name),
+                GKCC_PCH_OBJECT_NAME, symbol->symbol_name);
+  gkcc_pch_link(builder, offset, offsetof(struct gkcc_symbol, symbol_type),
+                GKCC_PCH_OBJECT_TYPE, symbol->symbol_type);
+  gkcc_pch_link(builder, offset, offsetof(struct gkcc_symbol, location_ast),
+                GKCC_PCH_OBJECT_AST_NODE, symbol->location_ast);
+  gkcc_pch_link(builder, offset, offsetof(struct gkcc_symbol, filename),
+                GKCC_PCH_OBJECT_NAME, symbol->filename);
+  gkcc_pch_link(builder, offset,
+                offsetof(struct gkcc_symbol, symbol_table_set),
+                GKCC_PCH_OBJECT_SYMBOL_TABLE_SET, symbol->symbol_table_set);
+  gkcc_pch_link(builder, offset, offsetof(struct gkcc_symbol, shadowed),
+                GKCC_PCH_OBJECT_SYMBOL, symbol->shadowed);
+}
+
+static void gkcc_pch_write_type(struct gkcc_pch_builder *builder,
+                                const struct gkcc_type *type,
+                                uint32_t offset) {
+  if (type->canonical) gkcc_pch_section_add(builder->canonical_types, offset);
+
+  gkcc_pch_link(builder, offset, offsetof(struct gkcc_type, of),
+                GKCC_PCH_OBJECT_TYPE, type->of);
+  gkcc_pch_link(builder, offset, offsetof(struct gkcc_type, ident),
+                GKCC_PCH_OBJECT_AST_NODE, type->ident);
+  gkcc_pch_link(builder, offset, offsetof(struct gkcc_type, symbol_table_set),
+                GKCC_PCH_OBJECT_SYMBOL_TABLE_SET, type->symbol_table_set);
+
+  switch (type->type) {
+    case GKCC_TYPE_QUALIFIER:
+      gkcc_pch_link(builder, offset, offsetof(struct gkcc_type, qualifier.of),
+                    GKCC_PCH_OBJECT_TYPE, type->qualifier.of);
+      break;
+    case GKCC_TYPE_STORAGE_CLASS_SPECIFIER:
+      gkcc_pch_link(builder, offset,
+                    offsetof(struct gkcc_type, storage_class_specifier.of),
+                    GKCC_PCH_OBJECT_TYPE, type->storage_class_specifier.of);
+      break;
+    case GKCC_TYPE_TYPE_SPECIFIER:
+      gkcc_pch_link(builder, offset,
+                    offsetof(struct gkcc_type, type_specifier.ident),
+                    GKCC_PCH_OBJECT_AST_NODE, type->type_specifier.ident);
+      gkcc_pch_link(builder, offset,
+                    offsetof(struct gkcc_type, type_specifier.of),
+                    GKCC_PCH_OBJECT_TYPE, type->type_specifier.of);
+      break;
+    case GKCC_TYPE_ARRAY:
+      gkcc_pch_link(builder, offset, offsetof(struct gkcc_type, array.size),
+                    GKCC_PCH_OBJECT_AST_NODE, type->array.size);
+      break;
+    case GKCC_TYPE_FUNCTION:
+      gkcc_pch_link(builder, offset,
+                    offsetof(struct gkcc_type, function_declaration.parameters),
+                    GKCC_PCH_OBJECT_AST_NODE,
+                    type->function_declaration.parameters);
+      gkcc_pch_link(
+          builder, offset,
+          offsetof(struct gkcc_type, function_declaration.return_type),
+          GKCC_PCH_OBJECT_TYPE, type->function_declaration.return_type);
+      gkcc_pch_link(builder, offset,
+                    offsetof(struct gkcc_type, function_declaration.statements),
+                    GKCC_PCH_OBJECT_AST_NODE,
+                    type->function_declaration.statements);
+      break;
+    default:
+      break;
+  }
+}
+
+// gkcc_pch_link_node is gkcc_pch_link for a pointer to another AST node
+static void gkcc_pch_link_node(struct gkcc_pch_builder *builder,
+                               uint32_t offset, size_t field_offset,
+                               const struct ast_node *target) {
+  gkcc_pch_link(builder, offset, field_offset, GKCC_PCH_OBJECT_AST_NODE,
+                target);
+}
+
+static void gkcc_pch_write_ast_node(struct gkcc_pch_builder *builder,
+                                    const struct ast_node *node,
+                                    uint32_t offset) {
+  switch (node->type) {
+    case AST_NODE_BINOP:
+      gkcc_pch_link_node(builder, offset, offsetof(struct ast_node, binop.left),
+                         node->binop.left);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, binop.right),
+                         node->binop.right);
+      break;
+    case AST_NODE_CONSTANT:
+      if (node->constant.type == AST_CONSTANT_STRING) {
+        gkcc_pch_point(builder,
+                       offset + offsetof(struct ast_node, constant.ystring.raw),
+                       gkcc_pch_add_bytes(builder, node->constant.ystring.raw,
+                                          node->constant.ystring.length));
+      }
+      break;
+    case AST_NODE_IDENT:
+      gkcc_pch_link(builder, offset, offsetof(struct ast_node, ident.name),
+                    GKCC_PCH_OBJECT_NAME, node->ident.name);
+      gkcc_pch_link(builder, offset,
+                    offsetof(struct ast_node, ident.symbol_table_entry),
+                    GKCC_PCH_OBJECT_SYMBOL, node->ident.symbol_table_entry);
+      break;
+    case AST_NODE_UNARY:
+      gkcc_pch_link_node(builder, offset, offsetof(struct ast_node, unary.of),
+                         node->unary.of);
+      break;
+    case AST_NODE_TERNARY:
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, ternary.condition),
+                         node->ternary.condition);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, ternary.true_expr),
+                         node->ternary.true_expr);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, ternary.false_expr),
+                         node->ternary.false_expr);
+      break;
+    case AST_NODE_GKCC_TYPE:
+      gkcc_pch_link(builder, offset,
+                    offsetof(struct ast_node, gkcc_type.gkcc_type),
+                    GKCC_PCH_OBJECT_TYPE, node->gkcc_type.gkcc_type);
+      break;
+    case AST_NODE_DECLARATION:
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, declaration.type),
+                         node->declaration.type);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, declaration.identifier),
+                         node->declaration.identifier);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, declaration.assignment),
+                         node->declaration.assignment);
+      break;
+    case AST_NODE_LIST:
+      gkcc_pch_link_node(builder, offset, offsetof(struct ast_node, list.node),
+                         node->list.node);
+      gkcc_pch_link_node(builder, offset, offsetof(struct ast_node, list.next),
+                         node->list.next);
+      gkcc_pch_link_node(builder, offset, offsetof(struct ast_node, list.end),
+                         node->list.end);
+      break;
+    case AST_NODE_TOP_LEVEL:
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, top_level.list),
+                         node->top_level.list);
+      break;
+    case AST_NODE_FUNCTION_CALL:
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, function_call.name),
+                         node->function_call.name);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, function_call.parameters),
+                         node->function_call.parameters);
+      break;
+    case AST_NODE_ENUM_DEFINITION:
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, enum_definition.enumerators),
+                         node->enum_definition.enumerators);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, enum_definition.ident),
+                         node->enum_definition.ident);
+      break;
+    case AST_NODE_STRUCT_OR_UNION_SPECIFIER:
+      gkcc_pch_link_node(
+          builder, offset,
+          offsetof(struct ast_node, struct_or_union_specifier.ident),
+          node->struct_or_union_specifier.ident);
+      break;
+    case AST_NODE_FOR_LOOP:
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, for_loop.expr1),
+                         node->for_loop.expr1);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, for_loop.expr2),
+                         node->for_loop.expr2);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, for_loop.expr3),
+                         node->for_loop.expr3);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, for_loop.statements),
+                         node->for_loop.statements);
+      break;
+    case AST_NODE_IF_STATEMENT:
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, if_statement.condition),
+                         node->if_statement.condition);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, if_statement.then_statement),
+                         node->if_statement.then_statement);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, if_statement.else_statement),
+                         node->if_statement.else_statement);
+      break;
+    case AST_NODE_MEMBER_ACCESS:
+      gkcc_pch_link_node(
+          builder, offset,
+          offsetof(struct ast_node, member_access.struct_or_union),
+          node->member_access.struct_or_union);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, member_access.identifier),
+                         node->member_access.identifier);
+      break;
+    case AST_NODE_GOTO_NODE:
+      gkcc_pch_link(builder, offset, offsetof(struct ast_node, goto_node.symbol),
+                    GKCC_PCH_OBJECT_SYMBOL, node->goto_node.symbol);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, goto_node.ident),
+                         node->goto_node.ident);
+      break;
+    case AST_NODE_FUNCTION_RETURN:
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, function_return.to_return),
+                         node->function_return.to_return);
+      break;
+    case AST_NODE_SWITCH_CASE_CASE:
+      gkcc_pch_link_node(
+          builder, offset,
+          offsetof(struct ast_node, switch_case_case.expression),
+          node->switch_case_case.expression);
+      gkcc_pch_link_node(builder, offset,
+                         offsetof(struct ast_node, switch_case_case.statement),
+                         node->switch_case_case.statement);
+      break;
+    case AST_NODE_SWITCH_CASE_SWITCH:
+      gkcc_pch_link_node(
+          builder, offset,
+          offsetof(struct ast_node, switch_case_switch.expression),
+          node->switch_case_switch.expression);
+      gkcc_pch_link_node(
+          builder, offset,
+          offsetof(struct ast_node, switch_case_switch.statements),
+          node->switch_case_switch.statements);
+      break;
+    default:
+      break;
+  }
+}
+
+// gkcc_pch_key makes the key an image of the given prefix is stored under
+static bool gkcc_pch_key(struct gkcc_cache_key *key, const char *prefix,
+                         size_t prefix_length) {
+  gkcc_cache_key_init(key);
+  gkcc_cache_key_add(key, prefix, prefix_length);
+  return gkcc_cache_key_add_build_id(key);
+}
+
+// gkcc_pch_write writes the state of the parser after parsing prefix out to
+// out as an image that gkcc_pch_map() can read back in. top_level is the list
+// of top level declarations parsed, and line_number and filename are where the
+// scanner was left. Returns false if no key can be made for the image.
+bool gkcc_pch_write(FILE *out, const char *prefix, size_t prefix_length,
+                    struct gkcc_symbol_table_set *global_scope,
+                    struct ast_node *top_level, int line_number,
+                    const char *filename) {
+  struct gkcc_pch_header header = {
+      .magic = GKCC_PCH_MAGIC,
+      .prefix_length = prefix_length,
+      .line_number = line_number,
+  };
+  if (!gkcc_pch_key(&header.key, prefix, prefix_length)) return false;
+
+  struct gkcc_pch_builder builder = {
+      .image = gkcc_writer_new(NULL),
+      .relocations = gkcc_writer_new(NULL),
+      .names = gkcc_writer_new(NULL),
+      .name_uses = gkcc_writer_new(NULL),
+      .canonical_types = gkcc_writer_new(NULL),
+  };
+  gkcc_pch_append(builder.image, &header, sizeof(header));
+
+  header.global_scope = gkcc_pch_add(
+      &builder, GKCC_PCH_OBJECT_SYMBOL_TABLE_SET, global_scope);
+  header.top_level =
+      gkcc_pch_add(&builder, GKCC_PCH_OBJECT_AST_NODE, top_level);
+  header.filename = gkcc_pch_add(&builder, GKCC_PCH_OBJECT_NAME, filename) -
+                    offsetof(struct gkcc_interned_string, string);
+
+  while (builder.pending_count > 0) {
+    struct gkcc_pch_pending pending = builder.pending[--builder.pending_count];
+    switch (pending.kind) {
+      case GKCC_PCH_OBJECT_SYMBOL_TABLE_SET:
+        gkcc_pch_write_symbol_table_set(&builder, pending.object,
+                                        pending.offset);
+        break;
+      case GKCC_PCH_OBJECT_SYMBOL_TABLE:
+        gkcc_pch_write_symbol_table(&builder, pending.object, pending.offset);
+        break;
+      case GKCC_PCH_OBJECT_SYMBOL:
+        gkcc_pch_write_symbol(&builder, pending.object, pending.offset);
+        break;
+      case GKCC_PCH_OBJECT_TYPE:
+        gkcc_pch_write_type(&builder, pending.object, pending.offset);
+        break;
+      case GKCC_PCH_OBJECT_AST_NODE:
+        gkcc_pch_write_ast_node(&builder, pending.object, pending.offset);
+        break;
+      case GKCC_PCH_OBJECT_NAME:
+        break;
+    }
+  }
+
+  header.relocations =
+      gkcc_pch_write_section(builder.image, builder.relocations);
+  header.names = gkcc_pch_write_section(builder.image, builder.names);
+  header.name_uses = gkcc_pch_write_section(builder.image, builder.name_uses);
+  header.canonical_types =
+      gkcc_pch_write_section(builder.image, builder.canonical_types);
+  header.size = builder.image->used;
+
+  memcpy(builder.image->buffer, &header, sizeof(header));
+  fwrite(builder.image->buffer, 1, builder.image->used, out);
+
+  gkcc_writer_free(builder.image);
+  gkcc_writer_free(builder.relocations);
+  gkcc_writer_free(builder.names);
+  gkcc_writer_free(builder.name_uses);
+  gkcc_writer_free(builder.canonical_types);
+  free(builder.slots);
+  free(builder.pending);
+  return true;
+}
+
+// ===============
+// === LOADING ===
+// ===============
+
+// gkcc_pch_at returns the offsets in section, or NULL if they do not lie
+// within the image
+static uint32_t *gkcc_pch_at(char *base, size_t size,
+                             struct gkcc_pch_section section) {
+  if (section.offset % GKCC_PCH_ALIGN != 0 || section.offset > size ||
+      (uint64_t)section.count * sizeof(uint32_t) > size - section.offset) {
+    return NULL;
+  }
+  return (uint32_t *)&base[section.offset];
+}
+
+// gkcc_pch_object_ok returns whether an object of the given size can be at
+// offset, past the header
+static bool gkcc_pch_object_ok(size_t size, uint32_t offset,
+                               size_t object_size, size_t align) {
+  return offset >= sizeof(struct gkcc_pch_header) && offset % align == 0 &&
+         offset <= size && object_size <= size - offset;
+}
+
+static bool gkcc_pch_name_ok(char *base, size_t size, uint32_t offset) {
+  if (!gkcc_pch_object_ok(size, offset, sizeof(struct gkcc_interned_string),
+                          GKCC_PCH_ALIGN)) {
+    return false;
+  }
+  struct gkcc_interned_string *entry = (void *)&base[offset];
+  return (uint64_t)entry->length <
+             size - offset - sizeof(struct gkcc_interned_string) &&
+         entry->string[entry->length] == '\0';
+}
+
+// gkcc_pch_pointers_ok returns whether every one of the count pointers at the
+// offsets in fields lies within the image and points into it
+static bool gkcc_pch_pointers_ok(char *base, size_t size, uint32_t *fields,
+                                 uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (!gkcc_pch_object_ok(size, fields[i], sizeof(uintptr_t),
+                            sizeof(uintptr_t))) {
+      return false;
+    }
+    uintptr_t pointer = *(uintptr_t *)&base[fields[i]];
+    if (pointer - GKCC_PCH_BASE >= size) return false;
+  }
+  return true;
+}
+
+// gkcc_pch_load checks that the image at base was made from the start of
+// input and makes its objects part of the translation unit. Nothing outside
+// the image is changed unless the image can be used.
+static struct gkcc_pch *gkcc_pch_load(char *base, size_t size,
+                                      const char *input, size_t input_length) {
+  struct gkcc_pch_header *header = (struct gkcc_pch_header *)base;
+  struct gkcc_cache_key key;
+  if (memcmp(header->magic, GKCC_PCH_MAGIC, sizeof(header->magic)) != 0 ||
+      header->size != size || header->prefix_length > input_length ||
+      !gkcc_pch_key(&key, input, header->prefix_length) ||
+      memcmp(&key, &header->key, sizeof(key)) != 0) {
+    return NULL;
+  }
+
+  uint32_t *relocations = gkcc_pch_at(base, size, header->relocations);
+  uint32_t *names = gkcc_pch_at(base, size, header->names);
+  uint32_t *name_uses = gkcc_pch_at(base, size, header->name_uses);
+  uint32_t *canonical_types =
+      gkcc_pch_at(base, size, header->canonical_types);
+  if (relocations == NULL || names == NULL || name_uses == NULL ||
+      canonical_types == NULL ||
+      !gkcc_pch_pointers_ok(base, size, relocations,
+                            header->relocations.count) ||
+      !gkcc_pch_pointers_ok(base, size, name_uses, header->name_uses.count) ||
+      !gkcc_pch_object_ok(size, header->global_scope,
+                          sizeof(struct gkcc_symbol_table_set),
+                          GKCC_PCH_ALIGN) ||
+      (header->top_level != 0 &&
+       !gkcc_pch_object_ok(size, header->top_level, sizeof(struct ast_node),
+                           GKCC_PCH_ALIGN)) ||
+      !gkcc_pch_name_ok(base, size, header->filename)) {
+    return NULL;
+  }
+  for (uint32_t i = 0; i < header->names.count; i++) {
+    if (!gkcc_pch_name_ok(base, size, names[i])) return NULL;
+  }
+  for (uint32_t i = 0; i < header->canonical_types.count; i++) {
+    if (!gkcc_pch_object_ok(size, canonical_types[i], sizeof(struct gkcc_type),
+                            GKCC_PCH_ALIGN)) {
+      return NULL;
+    }
+  }
+
+  // Images are written as if mapped at GKCC_PCH_BASE
+  uintptr_t delta = (uintptr_t)base - GKCC_PCH_BASE;
+  if (delta != 0) {
+    for (uint32_t i = 0; i < header->relocations.count; i++) {
+      *(uintptr_t *)&base[relocations[i]] += delta;
+    }
+  }
+
+  // A name that was interned before the image was loaded keeps its handle, so
+  // the pointers to the copy of it in the image have to be moved over
+  bool names_moved = false;
+  for (uint32_t i = 0; i < header->names.count; i++) {
+    struct gkcc_interned_string *entry = (void *)&base[names[i]];
+    if (gkcc_intern_adopt(entry) != entry->string) names_moved = true;
+  }
+  if (names_moved) {
+    for (uint32_t i = 0; i < header->name_uses.count; i++) {
+      const char **name = (const char **)&base[name_uses[i]];
+      *name = gkcc_intern(*name, gkcc_intern_length(*name));
+    }
+  }
+
+  // Canonical types are hashed by the names they refer to, so they can only
+  // be adopted once the names have been
+  for (uint32_t i = 0; i < header->canonical_types.count; i++) {
+    gkcc_type_canonical_adopt((struct gkcc_type *)&base[canonical_types[i]]);
+  }
+
+  struct gkcc_interned_string *filename = (void *)&base[header->filename];
+  struct gkcc_pch *pch = malloc(sizeof(struct gkcc_pch));
+  gkcc_assert(pch != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to allocate a precompiled header");
+  *pch = (struct gkcc_pch){
+      .base = base,
+      .size = size,
+      .prefix_length = header->prefix_length,
+      .global_scope =
+          (struct gkcc_symbol_table_set *)&base[header->global_scope],
+      .top_level = header->top_level == 0
+                       ? NULL
+                       : (struct ast_node *)&base[header->top_level],
+      .line_number = header->line_number,
+      .filename = gkcc_intern(filename->string, filename->length),
+  };
+  gkcc_symbol_table_set_push_bindings(pch->global_scope);
+  return pch;
+}
+
+// gkcc_pch_map maps the precompiled header at path into memory and makes the
+// translation unit start out with its global scope, if the header was made
+// from the start of input. Returns NULL if the file cannot be mapped or the
+// header cannot be used, in which case input has to be parsed as a whole.
+//
+// The image is mapped at GKCC_PCH_BASE if that address is free. The mapping
+// is private and writable because the parser adds to the global scope and the
+// code generator fills in the symbols in it.
+struct gkcc_pch *gkcc_pch_map(const char *path, const char *input,
+                              size_t input_length) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < sizeof(struct gkcc_pch_header)) {
+    close(fd);
+    return NULL;
+  }
+  char *base = mmap((void *)GKCC_PCH_BASE, st.st_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return NULL;
+
+  struct gkcc_pch *pch = gkcc_pch_load(base, st.st_size, input, input_length);
+  if (pch == NULL) munmap(base, st.st_size);
+  return pch;
+}
@@ -0,0 +1,116 @@
+// Copyright (C) 2023 Gary Kim <gary@garykim.dev>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GKCC_PCH_H
+#define GKCC_PCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ast/ast.h"
+#include "misc/cache.h"
+#include "scope/scope.h"
+
+// A precompiled header is the state the parser is left in after parsing a
+// prefix of a translation unit, usually the headers it starts with, written
+// out by gkcc_int -emit-pch. A translation unit that starts with the same
+// bytes is compiled with -include-pch by mapping the image into memory,
+// starting out with the global scope and the declarations in it and only
+// parsing the rest of the input.
+//
+// The image holds copies of every symbol table, symbol, type, AST node,
+// string constant and interned name that can be reached from the global scope
+// and from the list of top level declarations, laid out as they are in
+// memory. Every pointer between them is stored as it would be if the image
+// were mapped at GKCC_PCH_BASE, so an image that is mapped there is used
+// without touching most of its pages. Otherwise the pointers listed in the
+// relocation section are moved by where the image ended up instead.
+//
+// An image is made up of a header followed by the objects and these sections,
+// each of which starts at an offset that is a multiple of GKCC_PCH_ALIGN:
+//   - the relocations, as offsets of the pointers in the image
+//   - the interned names, as offsets of gkcc_interned_string
+//   - the uses of the names, as offsets of the pointers to them
+//   - the canonical types, as offsets of gkcc_type
+//
+// Like IR images, precompiled headers can only be read by the build of
+// gkcc_int that wrote them. The header holds a key made from the bytes of the
+// prefix and the build of the compiler, and an image is only used if both
+// match.
+
+#define GKCC_PCH_MAGIC "GKCCPCH1"
+#define GKCC_PCH_ALIGN 16
+#define GKCC_PCH_BASE ((uintptr_t)0x3d0000000000)
+
+// ===============================
+// === struct gkcc_pch_section ===
+// ===============================
+
+struct gkcc_pch_section {
+  uint32_t offset;
+  uint32_t count;
+};
+
+// ==============================
+// === struct gkcc_pch_header ===
+// ==============================
+
+// filename is the offset of a gkcc_interned_string. The other offsets are
+// from the start of the image and are 0 if there is nothing there.
+struct gkcc_pch_header {
+  char magic[8];
+  struct gkcc_cache_key key;
+  uint64_t prefix_length;
+  uint64_t size;
+  // The line and file the scanner was at after the prefix
+  int32_t line_number;
+  uint32_t filename;
+  uint32_t global_scope;
+  // top_level is the list of the top level declarations of the prefix
+  uint32_t top_level;
+  struct gkcc_pch_section relocations;
+  struct gkcc_pch_section names;
+  struct gkcc_pch_section name_uses;
+  struct gkcc_pch_section canonical_types;
+};
+
+// =======================
+// === struct gkcc_pch ===
+// =======================
+
+// gkcc_pch is a precompiled header mapped into memory. Interned names point
+// into base, so it stays mapped for the rest of the process.
+struct gkcc_pch {
+  char *base;
+  size_t size;
+  size_t prefix_length;
+  struct gkcc_symbol_table_set *global_scope;
+  struct ast_node *top_level;
+  int line_number;
+  const char *filename;
+};
+
+// === FUNCTION DECLARATIONS ===
+
+bool gkcc_pch_write(FILE *out, const char *prefix, size_t prefix_length,
+                    struct gkcc_symbol_table_set *global_scope,
+                    struct ast_node *top_level, int line_number,
+                    const char *filename);
+struct gkcc_pch *gkcc_pch_map(const char *path, const char *input,
+                              size_t input_length);
+
+#endif  // GKCC_PCH_H
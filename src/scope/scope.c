@@ -20,24 +20,144 @@
 #include <string.h>
 
 #include "ast/types.h"
+#include "misc/arena.h"
+#include "misc/intern.h"
 
+// binding_stacks maps the intern id of an identifier to the innermost
+// visible symbol in each namespace. Symbols that get shadowed are reachable
+// through gkcc_symbol.shadowed. Symbols of open scopes are pushed here when
+// added and popped again by gkcc_symbol_table_set_exit, so name resolution
+// through every open scope is a single array index. The stacks belong to the
+// translation unit being parsed, so each thread has its own.
+struct gkcc_binding_stack {
+  struct gkcc_symbol *top[GKCC_NAMESPACE_COUNT];
+};
+
+static _Thread_local struct gkcc_binding_stack *binding_stacks = NULL;
+static _Thread_local unsigned int binding_stacks_capacity = 0;
+
+static struct gkcc_binding_stack *gkcc_binding_stack_get(const char *name) {
+  unsigned int id = gkcc_intern_id(name);
+  if (id < binding_stacks_capacity) return &binding_stacks[id];
+
+  unsigned int new_capacity =
+      binding_stacks_capacity == 0 ? 1024 : binding_stacks_capacity;
+  while (new_capacity <= id) new_capacity *= 2;
+
+  binding_stacks =
+      realloc(binding_stacks, new_capacity * sizeof(struct gkcc_binding_stack));
+  gkcc_assert(binding_stacks != NULL, GKCC_ERROR_UNEXPECTED_NULL_VALUE,
+              "Failed to grow the scope binding stacks");
+  memset(&binding_stacks[binding_stacks_capacity], 0,
+         (new_capacity - binding_stacks_capacity) *
+             sizeof(struct gkcc_binding_stack));
+  binding_stacks_capacity = new_capacity;
+  return &binding_stacks[id];
+}
+
+// Struct and union member tables are only ever searched directly so their
+// symbols never go onto the binding stacks.
+static bool gkcc_symbol_table_set_uses_bindings(
+    struct gkcc_symbol_table_set *symbol_table_set) {
+  return symbol_table_set->scope != GKCC_SCOPE_STRUCT_OR_UNION;
+}
+
+// gkcc_symbol_table_set_new returns a new scope. Namespace tables are only
+// allocated once a symbol is added to them.
 struct gkcc_symbol_table_set *gkcc_symbol_table_set_new(
     struct gkcc_symbol_table_set *parent, enum gkcc_scope scope) {
-  struct gkcc_symbol_table_set *table =
-      malloc(sizeof(struct gkcc_symbol_table_set));
-
-  struct gkcc_symbol_table *new_tables =
-      calloc(4, sizeof(struct gkcc_symbol_table));
-  table->general_namespace = &new_tables[0];
-  table->label_namespace = &new_tables[1];
-  table->mini_namespace = &new_tables[2];
-  table->tag_namespace = &new_tables[3];
+  struct gkcc_symbol_table_set *table = gkcc_arena_alloc(
+      gkcc_arena_tu(), sizeof(struct gkcc_symbol_table_set));
 
   table->parent_scope = parent;
   table->scope = scope;
   return table;
 }
 
+// gkcc_symbol_table_set_pop_bindings removes the symbols of the given scope
+// from the binding stacks. The scope must be the innermost open scope.
+void gkcc_symbol_table_set_pop_bindings(
+    struct gkcc_symbol_table_set *symbol_table_set) {
+  if (!gkcc_symbol_table_set_uses_bindings(symbol_table_set)) return;
+
+  for (int ns = 0; ns < GKCC_NAMESPACE_COUNT; ns++) {
+    struct gkcc_symbol_table *st =
+        gkcc_symbol_table_set_get_symbol_table(symbol_table_set, ns);
+    if (st == NULL) continue;
+
+    for (unsigned int i = st->symbol_count; i-- > 0;) {
+      struct gkcc_symbol *symbol = st->symbols[i];
+      struct gkcc_binding_stack *stack =
+          gkcc_binding_stack_get(symbol->symbol_name);
+      gkcc_assert(stack->top[ns] == symbol, GKCC_ERROR_UNEXPECTED_VALUE,
+                  "Scopes were not exited in the order they were entered");
+      stack->top[ns] = symbol->shadowed;
+      symbol->shadowed = NULL;
+    }
+  }
+}
+
+// gkcc_symbol_table_set_push_bindings puts the symbols of the given scope back
+// onto the binding stacks, as if they had just been added to it. It undoes
+// gkcc_symbol_table_set_pop_bindings and is how a scope that was built by
+// another compiler, such as the global scope of a precompiled header, is
+// opened. The scope becomes the innermost open scope.
+void gkcc_symbol_table_set_push_bindings(
+    struct gkcc_symbol_table_set *symbol_table_set) {
+  if (!gkcc_symbol_table_set_uses_bindings(symbol_table_set)) return;
+
+  for (int ns = 0; ns < GKCC_NAMESPACE_COUNT; ns++) {
+    struct gkcc_symbol_table *st =
+        gkcc_symbol_table_set_get_symbol_table(symbol_table_set, ns);
+    if (st == NULL) continue;
+
+    for (unsigned int i = 0; i < st->symbol_count; i++) {
+      struct gkcc_symbol *symbol = st->symbols[i];
+      struct gkcc_binding_stack *stack =
+          gkcc_binding_stack_get(symbol->symbol_name);
+      symbol->shadowed = stack->top[ns];
+      stack->top[ns] = symbol;
+    }
+  }
+}
+
+// gkcc_symbol_table_reserve makes room for at least capacity symbols without
+// another rehash. Old storage is left behind in the arena.
+void gkcc_symbol_table_reserve(struct gkcc_symbol_table *table,
+                               unsigned int capacity) {
+  struct gkcc_arena *arena = gkcc_arena_tu();
+
+  if (capacity > table->symbols_capacity) {
+    struct gkcc_symbol **symbols =
+        gkcc_arena_alloc(arena, capacity * sizeof(struct gkcc_symbol *));
+    if (table->symbol_count != 0) {
+      memcpy(symbols, table->symbols,
+             table->symbol_count * sizeof(struct gkcc_symbol *));
+    }
+    table->symbols = symbols;
+    table->symbols_capacity = capacity;
+  }
+
+  unsigned int slots_capacity = table->slots_capacity;
+  if (slots_capacity == 0) slots_capacity = GKCC_SYMBOL_TABLE_INITIAL_CAPACITY;
+  while (slots_capacity < 2 * capacity) slots_capacity *= 2;
+  if (slots_capacity == table->slots_capacity) return;
+
+  struct gkcc_symbol **slots =
+      gkcc_arena_alloc(arena, slots_capacity * sizeof(struct gkcc_symbol *));
+  unsigned int mask = slots_capacity - 1;
+  for (unsigned int i = 0; i < table->symbol_count; i++) {
+    struct gkcc_symbol *symbol = table->symbols[i];
+    unsigned int slot = gkcc_intern_hash(symbol->symbol_name) & mask;
+    while (slots[slot] != NULL) slot = (slot + 1) & mask;
+    slots[slot] = symbol;
+  }
+  table->slots = slots;
+  table->slots_capacity = slots_capacity;
+}
+
+// gkcc_symbol_table_set_get_symbol_table returns the table of the given
+// namespace or NULL if nothing has been added to that namespace yet.
 struct gkcc_symbol_table *gkcc_symbol_table_set_get_symbol_table(
     struct gkcc_symbol_table_set *table_set, enum gkcc_namespace namespace) {
   switch (namespace) {
@@ -49,29 +169,68 @@ struct gkcc_symbol_table *gkcc_symbol_table_set_get_symbol_table(
       return table_set->tag_namespace;
     case GKCC_NAMESPACE_MINI:
       return table_set->mini_namespace;
+    default:
+      return NULL;
   }
 }
 
+static struct gkcc_symbol_table *gkcc_symbol_table_set_ensure_symbol_table(
+    struct gkcc_symbol_table_set *table_set, enum gkcc_namespace namespace) {
+  struct gkcc_symbol_table *st =
+      gkcc_symbol_table_set_get_symbol_table(table_set, namespace);
+  if (st != NULL) return st;
+
+  st = gkcc_arena_alloc(gkcc_arena_tu(), sizeof(struct gkcc_symbol_table));
+  switch (namespace) {
+    case GKCC_NAMESPACE_GENERAL:
+      table_set->general_namespace = st;
+      break;
+    case GKCC_NAMESPACE_LABEL:
+      table_set->label_namespace = st;
+      break;
+    case GKCC_NAMESPACE_TAG:
+      table_set->tag_namespace = st;
+      break;
+    case GKCC_NAMESPACE_MINI:
+      table_set->mini_namespace = st;
+      break;
+    default:
+      gkcc_error_fatal(GKCC_ERROR_INVALID_ARGUMENTS, "Unknown namespace");
+  }
+
+  // The global scope ends up holding every prototype and typedef pulled in by
+  // headers. Start it off big enough to skip the first few rehashes.
+  if (table_set->scope == GKCC_SCOPE_GLOBAL) {
+    gkcc_symbol_table_reserve(st, GKCC_SYMBOL_TABLE_GLOBAL_INITIAL_CAPACITY);
+  }
+  return st;
+}
+
 // This is not the function you are looking for.
 // Take a look at gkcc_symbol_table_set_add_symbol instead.
 // gkcc_symbol_table_add_symbol adds the given symbol to the given symbol_table
 enum gkcc_error gkcc_symbol_table_add_symbol(struct gkcc_symbol_table *table,
                                              struct gkcc_symbol *symbol) {
-  struct gkcc_symbol *first_symbol = table->symbol_list;
-
-  // Shortcut for the first symbol in the symbol table
-  if (first_symbol == NULL) {
-    table->symbol_list = symbol;
-    return GKCC_ERROR_SUCCESS;
+  if (table->symbol_count == table->symbols_capacity) {
+    gkcc_symbol_table_reserve(
+        table, table->symbols_capacity == 0
+                   ? GKCC_SYMBOL_TABLE_INITIAL_CAPACITY / 2
+                   : 2 * table->symbols_capacity);
   }
 
-  // Check that symbol does not already exist in the given namespace
-  if (gkcc_symbol_table_get_symbol(table, symbol->symbol_name) != NULL)
-    return GKCC_ERROR_SYMBOL_ALREADY_EXISTS;
+  // Find the slot for the symbol while checking that the symbol does not
+  // already exist in the given namespace
+  unsigned int mask = table->slots_capacity - 1;
+  unsigned int slot = gkcc_intern_hash(symbol->symbol_name) & mask;
+  for (struct gkcc_symbol *existing = table->slots[slot]; existing != NULL;
+       existing = table->slots[slot]) {
+    if (existing->symbol_name == symbol->symbol_name)
+      return GKCC_ERROR_SYMBOL_ALREADY_EXISTS;
+    slot = (slot + 1) & mask;
+  }
 
-  // Add symbol onto symbols list
-  symbol->next = first_symbol;
-  table->symbol_list = symbol;
+  table->slots[slot] = symbol;
+  table->symbols[table->symbol_count++] = symbol;
 
   return GKCC_ERROR_SUCCESS;
 }
@@ -91,7 +250,7 @@ enum gkcc_error gkcc_symbol_table_set_add_symbol(
   }
 
   struct gkcc_symbol_table *st =
-      gkcc_symbol_table_set_get_symbol_table(symbol_table_set, namespace);
+      gkcc_symbol_table_set_ensure_symbol_table(symbol_table_set, namespace);
 
   enum gkcc_error err = gkcc_symbol_table_add_symbol(st, symbol);
   if (err != GKCC_ERROR_SUCCESS) {
@@ -99,79 +258,54 @@ enum gkcc_error gkcc_symbol_table_set_add_symbol(
   }
 
   symbol->symbol_table_set = symbol_table_set;
+
+  if (gkcc_symbol_table_set_uses_bindings(symbol_table_set)) {
+    struct gkcc_binding_stack *stack =
+        gkcc_binding_stack_get(symbol->symbol_name);
+    symbol->shadowed = stack->top[namespace];
+    stack->top[namespace] = symbol;
+  }
   return GKCC_ERROR_SUCCESS;
 }
 
 // gkcc_symbol_new returns a new gkcc_symbol
 //
-// the name need not be allocated forever as it will be strcpy(ed)
-// at creation.
-struct gkcc_symbol *gkcc_symbol_new(char *name,
+// the name must be an interned handle (see gkcc_intern) as symbols are
+// looked up by comparing name pointers.
+struct gkcc_symbol *gkcc_symbol_new(const char *name,
                                     enum gkcc_storage_class storage_class,
                                     struct gkcc_type *type, int line_number,
-                                    char *filename) {
-  struct gkcc_symbol *symbol = malloc(sizeof(struct gkcc_symbol));
-  memset(symbol, 0, sizeof(struct gkcc_symbol));
+                                    const char *filename) {
+  struct gkcc_arena *arena = gkcc_arena_tu();
+  struct gkcc_symbol *symbol =
+      gkcc_arena_alloc(arena, sizeof(struct gkcc_symbol));
 
   symbol->storage_class = storage_class;
   symbol->effective_line_number = line_number;
   symbol->symbol_type = type;
 
-  symbol->next = NULL;
-
-  symbol->symbol_name = malloc(strlen(name) + 1);
-  strcpy(symbol->symbol_name, name);
-
-  symbol->filename = malloc(strlen(filename) + 1);
-  strcpy(symbol->filename, filename);
+  symbol->symbol_name = name;
+  symbol->filename = gkcc_intern_cstr(filename);
   return symbol;
 }
 
-void gkcc_symbol_print_string(struct gkcc_symbol *symbol, int depth) {
-  if (symbol == NULL) return;
-
-  for (int i = 0; i < 2 * depth; i++) {
-    printf(" ");
-  }
-  if (symbol->symbol_table_set != NULL) {
-    printf("Symbol '%s' defined at %s:%d (scope=%s, stg_class=%s) of type:\n",
-           symbol->symbol_name, symbol->filename, symbol->effective_line_number,
-           GKCC_SCOPE_STRING[symbol->symbol_table_set->scope],
-           GKCC_STORAGE_CLASS_STRING[symbol->storage_class]);
-  } else {
-    printf("Symbol '%s' defined at %s:%d of type:\n", symbol->symbol_name,
-           symbol->filename, symbol->effective_line_number);
-  }
-
-  ast_gkcc_type_string(symbol->symbol_type, depth + 1, "");
-}
-
-void gkcc_symbol_table_print(struct gkcc_symbol_table *symbol_table,
-                             int depth) {
-  for (struct gkcc_symbol *sl = symbol_table->symbol_list; sl != NULL;
-       sl = sl->next) {
-    for (int i = 0; i < 2 * depth; i++) {
-      printf(" ");
-    }
-
-    printf("Symbol '%s' defined at %s:%d of type:\n", sl->symbol_name,
-           sl->filename, sl->effective_line_number);
-    ast_gkcc_type_string(sl->symbol_type, depth + 1, "");
-  }
-}
-
 // Gets a struct gkcc_symbol from the symbol table.
 // Will not recurse up to the parent scope.
 // Needs to be implemented separately from
 // gkcc_symbol_table_set_get_symbol as that needs to be recursive
 // but this cannot be recursive.
 struct gkcc_symbol *gkcc_symbol_table_get_symbol(
-    struct gkcc_symbol_table *symbol_table, char *name) {
-  for (struct gkcc_symbol *symbol = symbol_table->symbol_list; symbol != NULL;
-       symbol = symbol->next) {
-    if (strcmp(symbol->symbol_name, name) == 0) {
+    struct gkcc_symbol_table *symbol_table, const char *name) {
+  if (symbol_table == NULL || symbol_table->symbol_count == 0) return NULL;
+
+  unsigned int mask = symbol_table->slots_capacity - 1;
+  unsigned int slot = gkcc_intern_hash(name) & mask;
+  for (struct gkcc_symbol *symbol = symbol_table->slots[slot]; symbol != NULL;
+       symbol = symbol_table->slots[slot]) {
+    if (symbol->symbol_name == name) {
       return symbol;
     }
+    slot = (slot + 1) & mask;
   }
 
   return NULL;
@@ -179,24 +313,21 @@ struct gkcc_symbol *gkcc_symbol_table_get_symbol(
 
 // Gets a struct gkcc_symbol from the symbol table set in the given namespace.
 // Will return null if symbol could not be found.
-// NOLINTNEXTLINE(misc-no-recursion)
+//
+// A recursive lookup answers from the binding stacks, so it costs the same no
+// matter how deeply the scope is nested. symbol_table_set must be the
+// innermost open scope in that case.
 struct gkcc_symbol *gkcc_symbol_table_set_get_symbol(
-    struct gkcc_symbol_table_set *symbol_table_set, char *name,
+    struct gkcc_symbol_table_set *symbol_table_set, const char *name,
     enum gkcc_namespace namespace, bool recurse) {
   // Never recurse if this is a struct or union definition scope
-  if (symbol_table_set->scope == GKCC_SCOPE_STRUCT_OR_UNION) recurse = false;
-
-  struct gkcc_symbol_table *symbol_table =
-      gkcc_symbol_table_set_get_symbol_table(symbol_table_set, namespace);
-  for (struct gkcc_symbol *symbol = symbol_table->symbol_list; symbol != NULL;
-       symbol = symbol->next) {
-    if (strcmp(symbol->symbol_name, name) == 0) {
-      return symbol;
-    }
-  }
-  if (recurse && symbol_table_set->parent_scope != NULL) {
-    return gkcc_symbol_table_set_get_symbol(symbol_table_set->parent_scope,
-                                            name, namespace, recurse);
+  if (!recurse || !gkcc_symbol_table_set_uses_bindings(symbol_table_set)) {
+    return gkcc_symbol_table_get_symbol(
+        gkcc_symbol_table_set_get_symbol_table(symbol_table_set, namespace),
+        name);
   }
-  return NULL;
+
+  unsigned int id = gkcc_intern_id(name);
+  if (id >= binding_stacks_capacity) return NULL;
+  return binding_stacks[id].top[namespace];
 }
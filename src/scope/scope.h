@@ -31,7 +31,9 @@
   GEN(GKCC_NAMESPACE_TAG)        \
   GEN(GKCC_NAMESPACE_MINI)
 
-enum gkcc_namespace { ENUM_GKCC_NAMESPACE(ENUM_VALUES) };
+enum gkcc_namespace {
+  ENUM_GKCC_NAMESPACE(ENUM_VALUES) GKCC_NAMESPACE_COUNT
+};
 
 static const char *const GKCC_NAMESPACE_STRING[] = {
     ENUM_GKCC_NAMESPACE(ENUM_STRINGS)};
@@ -75,14 +77,26 @@ static const char *const GKCC_STORAGE_CLASS_STRING[] = {
 // === struct gkcc_symbol_table ===
 // ================================
 
+#define GKCC_SYMBOL_TABLE_INITIAL_CAPACITY 8
+#define GKCC_SYMBOL_TABLE_GLOBAL_INITIAL_CAPACITY 256
+
+// gkcc_symbol_table keeps its symbols in insertion order in symbols and
+// indexes them with an open addressing hash table (linear probing) keyed by
+// the interned symbol name. slots is kept at most half full.
 struct gkcc_symbol_table {
-  struct gkcc_symbol *symbol_list;
+  struct gkcc_symbol **symbols;
+  unsigned int symbol_count;
+  unsigned int symbols_capacity;
+
+  struct gkcc_symbol **slots;
+  unsigned int slots_capacity;
 };
 
 // ====================================
 // === struct gkcc_symbol_table_set ===
 // ====================================
 
+// Namespace tables are NULL until the first symbol is added to them.
 struct gkcc_symbol_table_set {
   enum gkcc_scope scope;
   struct gkcc_symbol_table *general_namespace;
@@ -120,7 +134,8 @@ struct gkcc_symbol_identifier {
 // ===================
 
 struct gkcc_symbol {
-  char *symbol_name;
+  // symbol_name is an interned handle. See misc/intern.h
+  const char *symbol_name;
   enum gkcc_storage_class storage_class;
   struct gkcc_type *symbol_type;
 
@@ -128,24 +143,35 @@ struct gkcc_symbol {
   struct ast_node *location_ast;
   bool fully_defined;
   int effective_line_number;
-  char *filename;
+  const char *filename;
 
-  struct gkcc_symbol *next;
   struct gkcc_symbol_table_set *symbol_table_set;
 
+  // shadowed is the symbol with the same name in the same namespace of an
+  // enclosing scope that this symbol hides while its scope is open.
+  struct gkcc_symbol *shadowed;
+
   // base_pointer_offset stores the offset from the base pointer to access this
   // symbol if this symbol is a local variable. This will be set during the
-  // ir generation stage
+  // ir generation stage. For struct and union members, it is instead the
+  // offset of the member from the start of the object and is set by
+  // gkcc_type_layout()
   int offset;
 };
 
 struct gkcc_symbol_table_set *gkcc_symbol_table_set_new(
     struct gkcc_symbol_table_set *parent, enum gkcc_scope scope);
 
-struct gkcc_symbol *gkcc_symbol_new(char *name,
+void gkcc_symbol_table_set_pop_bindings(
+    struct gkcc_symbol_table_set *symbol_table_set);
+
+void gkcc_symbol_table_set_push_bindings(
+    struct gkcc_symbol_table_set *symbol_table_set);
+
+struct gkcc_symbol *gkcc_symbol_new(const char *name,
                                     enum gkcc_storage_class storage_class,
                                     struct gkcc_type *type, int line_number,
-                                    char *filename);
+                                    const char *filename);
 
 struct gkcc_symbol_table *gkcc_symbol_table_set_get_symbol_table(
     struct gkcc_symbol_table_set *table_set, enum gkcc_namespace namespace);
@@ -153,18 +179,18 @@ struct gkcc_symbol_table *gkcc_symbol_table_set_get_symbol_table(
 enum gkcc_error gkcc_symbol_table_add_symbol(struct gkcc_symbol_table *table,
                                              struct gkcc_symbol *symbol);
 
+void gkcc_symbol_table_reserve(struct gkcc_symbol_table *table,
+                               unsigned int capacity);
+
 struct gkcc_symbol *gkcc_symbol_table_set_get_symbol(
-    struct gkcc_symbol_table_set *symbol_table_set, char *name,
+    struct gkcc_symbol_table_set *symbol_table_set, const char *name,
     enum gkcc_namespace namespace, bool recurse);
 
 struct gkcc_symbol *gkcc_symbol_table_get_symbol(
-    struct gkcc_symbol_table *symbol_table, char *name);
+    struct gkcc_symbol_table *symbol_table, const char *name);
 
 enum gkcc_error gkcc_symbol_table_set_add_symbol(
     struct gkcc_symbol_table_set *symbol_table_set,
     enum gkcc_namespace namespace, struct gkcc_symbol *symbol);
 
-void gkcc_symbol_print_string(struct gkcc_symbol *symbol, int depth);
-
-void gkcc_symbol_table_print(struct gkcc_symbol_table *symbol_table, int depth);
 #endif  // GKCC_SCOPE_H
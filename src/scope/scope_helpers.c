@@ -21,7 +21,7 @@
 // declaration_list should be of type AST_NODE_LIST
 enum gkcc_error gkcc_scope_add_variable_to_scope(
     struct gkcc_symbol_table_set *symbol_table_set,
-    struct ast_node *declaration_list, int line_number, char *file_name) {
+    struct ast_node *declaration_list, int line_number, const char *file_name) {
   gkcc_assert(declaration_list->type == AST_NODE_LIST,
               GKCC_ERROR_INVALID_ARGUMENTS,
               "gkcc_scope_add_variable_to_scope got a declaration_list that is "
@@ -41,6 +41,8 @@ enum gkcc_error gkcc_scope_add_variable_to_scope(
         (symbol_table_set->scope == GKCC_SCOPE_GLOBAL)
             ? GKCC_STORAGE_CLASS_EXTERN
             : GKCC_STORAGE_CLASS_AUTO;
+    decl->declaration.type->gkcc_type.gkcc_type =
+        gkcc_type_canonical(decl->declaration.type->gkcc_type.gkcc_type);
     struct gkcc_symbol *symbol = gkcc_symbol_new(
         decl->declaration.identifier->ident.name, storage_class,
         decl->declaration.type->gkcc_type.gkcc_type, line_number, file_name);
@@ -63,7 +65,7 @@ enum gkcc_error gkcc_scope_add_variable_to_scope(
 
 enum gkcc_error gkcc_scope_add_tag_to_scope(
     struct gkcc_symbol_table_set *symbol_table_set,
-    struct ast_node *struct_or_union_gkcc_type, char *filename,
+    struct ast_node *struct_or_union_gkcc_type, const char *filename,
     int line_number) {
   gkcc_assert(struct_or_union_gkcc_type->type == AST_NODE_GKCC_TYPE,
               GKCC_ERROR_INVALID_ARGUMENTS,
@@ -103,6 +105,14 @@ struct gkcc_symbol_table_set *gkcc_symbol_table_set_get_parent_symbol_table_set(
               "set that does not have a parent.");
   return symbol_table_set->parent_scope;
 }
+
+// gkcc_symbol_table_set_exit closes the given scope and returns its parent.
+// Symbols of the closed scope stop being visible to recursive lookups.
+struct gkcc_symbol_table_set *gkcc_symbol_table_set_exit(
+    struct gkcc_symbol_table_set *symbol_table_set) {
+  gkcc_symbol_table_set_pop_bindings(symbol_table_set);
+  return gkcc_symbol_table_set_get_parent_symbol_table_set(symbol_table_set);
+}
 struct gkcc_symbol_table_set *
 gkcc_symbol_table_set_get_symbol_table_set_of_struct_or_union_node(
     struct ast_node *node) {
@@ -122,8 +132,8 @@ gkcc_symbol_table_set_get_symbol_table_set_of_struct_or_union_node(
 
 enum gkcc_error gkcc_scope_add_label_to_scope(
     struct gkcc_symbol_table_set *symbol_table_set, struct ast_node *goto_node,
-    struct ast_node *pointing_at, char *filename, int line_number) {
-  char *label_name = goto_node->goto_node.ident->ident.name;
+    struct ast_node *pointing_at, const char *filename, int line_number) {
+  const char *label_name = goto_node->goto_node.ident->ident.name;
   // Does the symbol already exist can we point to it?
   struct gkcc_symbol *symbol = gkcc_symbol_table_set_get_symbol(
       symbol_table_set, label_name, GKCC_NAMESPACE_LABEL, true);
@@ -24,11 +24,11 @@
 
 enum gkcc_error gkcc_scope_add_variable_to_scope(
     struct gkcc_symbol_table_set *symbol_table_set,
-    struct ast_node *declaration_list, int line_number, char *file_name);
+    struct ast_node *declaration_list, int line_number, const char *file_name);
 
 enum gkcc_error gkcc_scope_add_tag_to_scope(
     struct gkcc_symbol_table_set *symbol_table_set,
-    struct ast_node *struct_or_union_gkcc_type, char *filename,
+    struct ast_node *struct_or_union_gkcc_type, const char *filename,
     int line_number);
 
 struct gkcc_symbol_table_set *
@@ -38,8 +38,11 @@ gkcc_symbol_table_set_get_symbol_table_set_of_struct_or_union_node(
 struct gkcc_symbol_table_set *gkcc_symbol_table_set_get_parent_symbol_table_set(
     struct gkcc_symbol_table_set *symbol_table_set);
 
+struct gkcc_symbol_table_set *gkcc_symbol_table_set_exit(
+    struct gkcc_symbol_table_set *symbol_table_set);
+
 enum gkcc_error gkcc_scope_add_label_to_scope(
     struct gkcc_symbol_table_set *symbol_table_set, struct ast_node *goto_node,
-    struct ast_node *pointing_at, char *filename, int line_number);
+    struct ast_node *pointing_at, const char *filename, int line_number);
 
 #endif  // GKCC_SCOPE_HELPERS_H
@@ -16,204 +16,339 @@
 #include "x86.h"
 
 #include <memory.h>
-#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
 
+#include "ir/function_cache.h"
+#include "ir/ir_full.h"
 #include "ir/quads.h"
 #include "target_code/x86_inst.h"
 
-char *gkcc_tx86_translate_ir_quad_register(char *buf,
-                                           struct gkcc_ir_quad_register *qr) {
-  switch (qr->register_type) {
+void gkcc_tx86_write_operand(struct gkcc_writer *writer,
+                             struct gkcc_ir_function *fn, int operand) {
+  union gkcc_ir_operand_value *value = &fn->operands.values[operand];
+  switch (fn->operands.kinds[operand]) {
     case GKCC_IR_QUAD_REGISTER_PSEUDOREGISTER:
-      sprintf(buf, "-%d(%%ebp)", qr->pseudoregister.offset);
+      gkcc_writer_char(writer, '-');
+      gkcc_writer_int(writer, value->pseudoregister.offset);
+      gkcc_writer_str(writer, "(%ebp)");
       break;
     case GKCC_IR_QUAD_REGISTER_SYMBOL:
-      if (qr->symbol.is_global) {
-        if (qr->symbol.ystring == NULL) {
-          sprintf(buf, "%s", qr->symbol.symbol->symbol_name);
-        } else {
-          sprintf(buf, "$%s", qr->symbol.symbol->symbol_name);
-        }
+      if (value->symbol.is_global) {
+        if (value->symbol.ystring != NULL) gkcc_writer_char(writer, '$');
+        gkcc_writer_str(writer, value->symbol.symbol->symbol_name);
       } else {
-        sprintf(buf, "-%d(%%ebp)", qr->symbol.symbol->offset);
+        gkcc_writer_char(writer, '-');
+        gkcc_writer_int(writer, value->symbol.symbol->offset);
+        gkcc_writer_str(writer, "(%ebp)");
       }
       break;
     case GKCC_IR_QUAD_REGISTER_CONSTANT:
-      buf[0] = '$';
-      gkcc_ir_quad_register_constant_string(&buf[1], qr);
+      gkcc_writer_char(writer, '$');
+      gkcc_ir_constant_write(writer, value->constant);
       break;
     case GKCC_IR_QUAD_REGISTER_BASIC_BLOCK:
-      sprintf(buf, "%s", qr->basic_block->bb_name);
+      gkcc_writer_str(writer, fn->basic_blocks[value->basic_block]->bb_name);
       break;
   }
-  return buf;
 }
 
-void gkcc_tx86_translate_ir_quad(FILE *out_file, struct gkcc_ir_quad *quad) {
-  static int current_function_push_val = 0;
+// gkcc_tx86_write writes out an instruction template. %o in the template is
+// replaced by the operand of fn with the index given as an int, %s by a string,
+// %d by an int and %% by a percent sign.
+void gkcc_tx86_write(struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+                     const char *template, ...) {
+  va_list args;
+  va_start(args, template);
+
+  const char *literal = template;
+  const char *c = template;
+  for (; *c != '\0'; c++) {
+    if (*c != '%') continue;
+
+    gkcc_writer_bytes(writer, literal, c - literal);
+    c++;
+    switch (*c) {
+      case 'o':
+        gkcc_tx86_write_operand(writer, fn, va_arg(args, int));
+        break;
+      case 's':
+        gkcc_writer_str(writer, va_arg(args, const char *));
+        break;
+      case 'd':
+        gkcc_writer_int(writer, va_arg(args, int));
+        break;
+      case '%':
+        gkcc_writer_char(writer, '%');
+        break;
+      default:
+        gkcc_error_fatal(GKCC_ERROR_INVALID_ARGUMENTS,
+                         "gkcc_tx86_write() got an unknown directive");
+    }
+    literal = c + 1;
+  }
+  gkcc_writer_bytes(writer, literal, c - literal);
+
+  va_end(args);
+}
+
+void gkcc_tx86_translate_ir_quad(struct gkcc_writer *writer,
+                                 struct gkcc_tx86_function_state *state,
+                                 struct gkcc_ir_packed_quad *quad) {
+  struct gkcc_ir_function *fn = state->fn;
   switch (quad->instruction) {
     case GKCC_IR_QUAD_INSTRUCTION_LEA:
       // TODO: Cannot be doing an address to address move
-      gkcc_tx86_translate_ir_quad_instruction_lea(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_lea(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_LOAD:
-      gkcc_tx86_translate_ir_quad_instruction_load(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_load(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_STR:
-      gkcc_tx86_translate_ir_quad_instruction_str(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_str(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_ADD:
-      gkcc_tx86_translate_ir_quad_instruction_add(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_add(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_SUBTRACT:
-      gkcc_tx86_translate_ir_quad_instruction_subtract(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_subtract(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_DIVIDE:
-      gkcc_tx86_translate_ir_quad_instruction_divide(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_divide(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_MULTIPLY:
-      gkcc_tx86_translate_ir_quad_instruction_multiply(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_multiply(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_MOD:
-      gkcc_tx86_translate_ir_quad_instruction_mod(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_mod(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_BRANCH:
-      gkcc_tx86_translate_ir_quad_instruction_branch(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_branch(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_EQUALS:
-      gkcc_tx86_translate_ir_quad_instruction_equals(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_equals(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_BRANCH_IF_TRUE:
-      gkcc_tx86_translate_ir_quad_instruction_branch_if_true(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_branch_if_true(writer, fn,
+                                                             quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_BRANCH_IF_FALSE:
-      gkcc_tx86_translate_ir_quad_instruction_branch_if_false(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_branch_if_false(writer, fn,
+                                                              quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_MOVE:
-      gkcc_tx86_translate_ir_quad_instruction_move(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_move(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_GREATER_THAN:
-      gkcc_tx86_translate_ir_quad_instruction_greater_than(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_greater_than(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_LESS_THAN:
-      gkcc_tx86_translate_ir_quad_instruction_less_than(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_less_than(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_GREATER_THAN_OR_EQUAL_TO:
-      gkcc_tx86_translate_ir_quad_instruction_greater_than_or_equal_to(out_file,
-                                                                       quad);
+      gkcc_tx86_translate_ir_quad_instruction_greater_than_or_equal_to(
+          writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_LESS_THAN_OR_EQUAL_TO:
-      gkcc_tx86_translate_ir_quad_instruction_less_than_or_equal_to(out_file,
+      gkcc_tx86_translate_ir_quad_instruction_less_than_or_equal_to(writer, fn,
                                                                     quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_FUNCTION_CALL:
-      gkcc_tx86_translate_ir_quad_instruction_function_call(out_file, quad);
-      fprintf(out_file, "\taddl $%lu, %%esp\n",
-              current_function_push_val * sizeof(int));
-      current_function_push_val = 0;
+      gkcc_tx86_translate_ir_quad_instruction_function_call(writer, fn, quad);
+      gkcc_tx86_write(writer, fn, "\taddl $%d, %%esp\n",
+                      (int)(state->pushed_arguments * sizeof(int)));
+      state->pushed_arguments = 0;
       break;
     case GKCC_IR_QUAD_INSTRUCTION_FUNCION_ARG:
-      gkcc_tx86_translate_ir_quad_instruction_function_arg(out_file, quad);
-      current_function_push_val++;
+      gkcc_tx86_translate_ir_quad_instruction_function_arg(writer, fn, quad);
+      state->pushed_arguments++;
       break;
     case GKCC_IR_QUAD_INSTRUCTION_LOGICAL_NOT:
-      gkcc_tx86_translate_ir_quad_instruction_logical_not(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_logical_not(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_NEGATE_VALUE:
-      gkcc_tx86_translate_ir_quad_instruction_negate_value(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_negate_value(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_POSTINC:
-      gkcc_tx86_translate_ir_quad_instruction_postinc(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_postinc(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_POSTDEC:
-      gkcc_tx86_translate_ir_quad_instruction_postdec(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_postdec(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_BITWISE_NOT:
-      gkcc_tx86_translate_ir_quad_instruction_bitwise_not(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_bitwise_not(writer, fn, quad);
       break;
     case GKCC_IR_QUAD_INSTRUCTION_RETURN:
-      gkcc_tx86_translate_ir_quad_instruction_return(out_file, quad);
+      gkcc_tx86_translate_ir_quad_instruction_return(writer, fn, quad);
       break;
   }
 }
 
-void gkcc_tx86_function_preamble(FILE *out_file, struct gkcc_ir_function *fn) {
+void gkcc_tx86_function_preamble(struct gkcc_writer *writer,
+                                 struct gkcc_ir_function *fn) {
   int total_stack_space = fn->required_space_for_locals;
   total_stack_space += 16 - (total_stack_space % 16);
-  fprintf(out_file, "\tpushl %%ebp\n");
-  fprintf(out_file, "\tmovl %%esp, %%ebp\n");
-  fprintf(out_file, "\tsubl $%d, %%esp\n", total_stack_space);
+  gkcc_tx86_write(writer, fn, "\tpushl %%ebp\n");
+  gkcc_tx86_write(writer, fn, "\tmovl %%esp, %%ebp\n");
+  gkcc_tx86_write(writer, fn, "\tsubl $%d, %%esp\n", total_stack_space);
   return;
 }
 
-bool gkcc_internal_tx86_is_load_lea_str(struct gkcc_ir_quad_list *ql) {
-  if (ql == NULL || ql->next == NULL || ql->next->next == NULL) return false;
-  if (ql->quad->instruction == GKCC_IR_QUAD_INSTRUCTION_LOAD &&
-      ql->next->quad->instruction == GKCC_IR_QUAD_INSTRUCTION_LEA &&
-      ql->next->next->quad->instruction == GKCC_IR_QUAD_INSTRUCTION_STR) {
+// gkcc_internal_tx86_is_load_lea_str reports whether the quads starting at
+// quad are a (load, lea, str) that can be collapsed into a single store, and
+// makes the store take the address of the load if so. end is the end of the
+// basic block.
+bool gkcc_internal_tx86_is_load_lea_str(struct gkcc_ir_packed_quad *quad,
+                                        struct gkcc_ir_packed_quad *end) {
+  if (end - quad < 3) return false;
+  if (quad[0].instruction == GKCC_IR_QUAD_INSTRUCTION_LOAD &&
+      quad[1].instruction == GKCC_IR_QUAD_INSTRUCTION_LEA &&
+      quad[2].instruction == GKCC_IR_QUAD_INSTRUCTION_STR) {
     // It is a shorten-able instruction
-    ql->next->next->quad->dest = ql->quad->source1;
+    quad[2].dest = quad[0].source1;
 
     return true;
   }
   return false;
 }
 
-void gkcc_tx86_print_bb(FILE *out_file, bool *printed,
+void gkcc_tx86_print_bb(struct gkcc_writer *writer,
+                        struct gkcc_tx86_function_state *state,
                         struct gkcc_basic_block *bb) {
-  if (bb == NULL) return;
-  if (printed[bb->bb_number]) return;
-
-  printed[bb->bb_number] = true;
-  fprintf(out_file, "%s:\n", bb->bb_name);
-  for (struct gkcc_ir_quad_list *ql = bb->quads_in_bb; ql != NULL;
-       ql = ql->next) {
+  gkcc_tx86_write(writer, state->fn, "%s:\n", bb->bb_name);
+  struct gkcc_ir_packed_quad *quad = &state->fn->quads[bb->first_quad];
+  struct gkcc_ir_packed_quad *end = quad + bb->quad_count;
+  for (; quad != end; quad++) {
     // If there is a (load, lea, str), collapse it into a single store
-    if (gkcc_internal_tx86_is_load_lea_str(ql)) {
-      ql = ql->next;
+    if (gkcc_internal_tx86_is_load_lea_str(quad, end)) {
+      quad++;
       continue;
     }
-    gkcc_tx86_translate_ir_quad(out_file, ql->quad);
+    gkcc_tx86_translate_ir_quad(writer, state, quad);
+  }
+}
+
+// gkcc_tx86_print_global declares a global variable or string constant
+static void gkcc_tx86_print_global(struct gkcc_writer *writer,
+                                   struct gkcc_ir_symbol *symbol) {
+  if (symbol->ystring != NULL) {
+    // This is a string
+    gkcc_tx86_write(writer, NULL, "\t.section .rodata\n");
+    gkcc_tx86_write(writer, NULL, "%s:\n", symbol->symbol->symbol_name);
+    gkcc_tx86_write(writer, NULL, "\t.string \"");
+    gkcc_writer_escaped(writer, symbol->ystring->raw, symbol->ystring->length);
+    gkcc_tx86_write(writer, NULL, "\"\n");
+    gkcc_tx86_write(writer, NULL, "\t.text\n");
+    return;
   }
+  struct gkcc_type_layout layout =
+      gkcc_ir_quad_storage_layout(symbol->symbol->symbol_type);
+  gkcc_tx86_write(writer, NULL, ".comm %s, %d, %d\n",
+                  symbol->symbol->symbol_name, layout.size, layout.align);
+}
+
+static void gkcc_tx86_print_function(struct gkcc_writer *writer,
+                                     struct gkcc_ir_function *fn) {
+  struct gkcc_tx86_function_state state = {.fn = fn};
+
+  gkcc_tx86_write(writer, fn, ".globl %s\n%s:\n", fn->function_name,
+                  fn->function_name);
+  gkcc_tx86_function_preamble(writer, fn);
 
-  gkcc_tx86_print_bb(out_file, printed, bb->true_branch);
-  if (bb->true_branch != bb->false_branch)
-    gkcc_tx86_print_bb(out_file, printed, bb->false_branch);
+  // Print all BBs
+  for (int i = 0; i < fn->block_order_count; i++) {
+    gkcc_tx86_print_bb(writer, &state, fn->basic_blocks[fn->block_order[i]]);
+  }
 }
 
-void gkcc_tx86_generate_ir_full(FILE *out_file, struct gkcc_ir_full *ir_full) {
-  // List of printed basic blocks
-  bool printed_bbs[ir_full->gen_state->current_basic_block_number];
-  memset(printed_bbs, 0, sizeof(printed_bbs));
+// gkcc_tx86_function_output holds the assembly of every function. Functions
+// are generated in parallel into writers of their own, which are written out
+// in source order afterwards.
+struct gkcc_tx86_function_output {
+  struct gkcc_ir_function **functions;
+  struct gkcc_writer **writers;
+};
+
+// Functions found in the function cache are spliced in from there instead of
+// being generated
+static void gkcc_tx86_generate_function(void *context, size_t index) {
+  struct gkcc_tx86_function_output *output = context;
+  struct gkcc_ir_function *fn = output->functions[index];
+  output->writers[index] = gkcc_writer_new(NULL);
+  if (fn->cached_assembly != NULL) {
+    gkcc_function_cache_write_assembly(output->writers[index], fn);
+    return;
+  }
+  gkcc_tx86_print_function(output->writers[index], fn);
+}
 
+// gkcc_tx86_generate_definition writes out a function lowered with
+// gkcc_ir_full_lower_definition along with its string constants.
+void gkcc_tx86_generate_definition(
+    struct gkcc_writer *writer, struct gkcc_ir_generation_state *gen_state) {
+  for (struct gkcc_ir_symbol_list *slist = gen_state->string_constants;
+       slist != NULL; slist = slist->next) {
+    gkcc_tx86_print_global(writer, slist->symbol);
+  }
+
+  struct gkcc_ir_function *fn = gen_state->current_function;
+  if (fn->cached_assembly != NULL) {
+    gkcc_function_cache_write_assembly(writer, fn);
+    return;
+  }
+  if (fn->cache_key == NULL) {
+    gkcc_tx86_print_function(writer, fn);
+    return;
+  }
+
+  // The assembly of the function is needed on its own to store it
+  struct gkcc_writer *fn_writer = gkcc_writer_new(NULL);
+  gkcc_tx86_print_function(fn_writer, fn);
+  gkcc_writer_bytes(writer, fn_writer->buffer, fn_writer->used);
+  gkcc_function_cache_store(gen_state->ir_full->cache, fn, fn_writer->buffer,
+                            fn_writer->used);
+  gkcc_writer_free(fn_writer);
+}
+
+void gkcc_tx86_generate_ir_full(struct gkcc_writer *writer,
+                                struct gkcc_ir_full *ir_full) {
   // Print all global declarations
   for (struct gkcc_ir_symbol_list *slist = ir_full->global_symbols;
        slist != NULL; slist = slist->next) {
-    if (slist->symbol->ystring != NULL) {
-      // This is a string
-      char buf[(1 << 12) + 1];
-      sprint_escaped_string(buf, slist->symbol->ystring->raw,
-                            slist->symbol->ystring->length);
-      fprintf(out_file, "\t.section .rodata\n");
-      fprintf(out_file, "%s:\n", slist->symbol->symbol->symbol_name);
-      fprintf(out_file, "\t.string \"%s\"\n", buf);
-      fprintf(out_file, "\t.text\n");
-      continue;
-    }
-    fprintf(out_file, ".comm %s, %d, 4\n", slist->symbol->symbol->symbol_name,
-            gkcc_type_sizeof(slist->symbol->symbol->symbol_type));
+    gkcc_tx86_print_global(writer, slist->symbol);
   }
 
-  fprintf(out_file, "\n");
+  gkcc_writer_char(writer, '\n');
+
+  size_t function_count = 0;
+  for (struct gkcc_ir_function_list *fn_list = ir_full->function_list;
+       fn_list != NULL; fn_list = fn_list->next) {
+    function_count++;
+  }
 
+  struct gkcc_tx86_function_output output = {
+      .functions = malloc(function_count * sizeof(struct gkcc_ir_function *)),
+      .writers = calloc(function_count, sizeof(struct gkcc_writer *)),
+  };
+  size_t index = 0;
   for (struct gkcc_ir_function_list *fn_list = ir_full->function_list;
        fn_list != NULL; fn_list = fn_list->next) {
-    struct gkcc_ir_function *fn = fn_list->fn;
-    fprintf(out_file, ".globl %s\n", fn->function_name);
-    fprintf(out_file, "%s:\n", fn->function_name);
-    gkcc_tx86_function_preamble(out_file, fn);
+    output.functions[index++] = fn_list->fn;
+  }
 
-    // Print all BBs
-    gkcc_tx86_print_bb(out_file, printed_bbs, fn->entrance_basic_block);
+  gkcc_ir_full_parallel_for(function_count, gkcc_tx86_generate_function,
+                            &output);
+
+  for (size_t i = 0; i < function_count; i++) {
+    struct gkcc_ir_function *fn = output.functions[i];
+    gkcc_writer_bytes(writer, output.writers[i]->buffer,
+                      output.writers[i]->used);
+    if (fn->cache_key != NULL && fn->cached_assembly == NULL) {
+      gkcc_function_cache_store(ir_full->cache, fn, output.writers[i]->buffer,
+                                output.writers[i]->used);
+    }
+    gkcc_writer_free(output.writers[i]);
   }
+  free(output.functions);
+  free(output.writers);
 }
@@ -16,22 +16,42 @@
 #ifndef GKCC_X86_H
 #define GKCC_X86_H
 
-#include <stdio.h>
-
 #include "ir/quads.h"
+#include "misc/writer.h"
+
+// =======================================
+// === struct gkcc_tx86_function_state ===
+// =======================================
+
+// gkcc_tx86_function_state is the state of generating code for one function
+struct gkcc_tx86_function_state {
+  struct gkcc_ir_function *fn;
+  // pushed_arguments counts the arguments pushed for the next call
+  int pushed_arguments;
+};
 
 // =============================
 // === FUNCTION DECLARATIONS ===
 // =============================
 
-char *gkcc_tx86_translate_ir_quad_register(char *buf,
-                                           struct gkcc_ir_quad_register *qr);
+void gkcc_tx86_write_operand(struct gkcc_writer *writer,
+                             struct gkcc_ir_function *fn, int operand);
 
-void gkcc_tx86_translate_ir_quad(FILE *out_file, struct gkcc_ir_quad *quad);
+void gkcc_tx86_write(struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+                     const char *template, ...);
 
-void gkcc_tx86_print_bb(FILE *out_file, bool *printed,
+void gkcc_tx86_translate_ir_quad(struct gkcc_writer *writer,
+                                 struct gkcc_tx86_function_state *state,
+                                 struct gkcc_ir_packed_quad *quad);
+
+void gkcc_tx86_print_bb(struct gkcc_writer *writer,
+                        struct gkcc_tx86_function_state *state,
                         struct gkcc_basic_block *bb);
 
-void gkcc_tx86_generate_ir_full(FILE *out_file, struct gkcc_ir_full *ir_full);
+void gkcc_tx86_generate_definition(struct gkcc_writer *writer,
+                                   struct gkcc_ir_generation_state *gen_state);
+
+void gkcc_tx86_generate_ir_full(struct gkcc_writer *writer,
+                                struct gkcc_ir_full *ir_full);
 
 #endif  // GKCC_X86_H
@@ -17,225 +17,263 @@
 
 #include "x86.h"
 
-char buf1[(1 << 12) + 1];
-char buf2[(1 << 12) + 1];
 void gkcc_tx86_translate_ir_quad_load_into_registers(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
   if (quad->source1)
-    fprintf(out_file, "\tmovl %s, %%eax\n",
-            gkcc_tx86_translate_ir_quad_register(buf1, quad->source1));
+    gkcc_tx86_write(writer, fn, "\tmovl %o, %%eax\n", quad->source1);
   if (quad->source2)
-    fprintf(out_file, "\tmovl %s, %%edx\n",
-            gkcc_tx86_translate_ir_quad_register(buf1, quad->source2));
+    gkcc_tx86_write(writer, fn, "\tmovl %o, %%edx\n", quad->source2);
 }
 
-void gkcc_tx86_translate_ir_quad_save_register(FILE *out_file,
-                                               struct gkcc_ir_quad *quad,
+void gkcc_tx86_translate_ir_quad_save_register(struct gkcc_writer *writer,
+                                               struct gkcc_ir_function *fn,
+                                               struct gkcc_ir_packed_quad *quad,
                                                char *from_register) {
   if (quad->dest)
-    fprintf(out_file, "\tmovl %s, %s\n", from_register,
-            gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
+    gkcc_tx86_write(writer, fn, "\tmovl %s, %o\n", from_register, quad->dest);
 }
 
-void gkcc_tx86_translate_ir_quad_instruction_load(FILE *out_file,
-                                                  struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\tmovl (%%eax), %%eax\n");
-  gkcc_tx86_translate_ir_quad_save_register(out_file, quad, "%eax");
+// Loads and stores through a pointer only access the bytes of the type that is
+// pointed to. Everything else is moved as a whole 32-bit word.
+static int gkcc_tx86_memory_access_size(struct gkcc_type *type) {
+  int size = gkcc_type_sizeof(type);
+  return (size == 1 || size == 2) ? size : 4;
 }
-void gkcc_tx86_translate_ir_quad_instruction_return(FILE *out_file,
-                                                    struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
 
-  fprintf(out_file, "\tleave\n");
-  fprintf(out_file, "\tret\n");
+// Qualifiers and storage class specifiers wrap the type they apply to, so
+// they have to be looked through to find out whether it is unsigned.
+static bool gkcc_tx86_type_is_unsigned(struct gkcc_type *type) {
+  while (type != NULL && (type->type == GKCC_TYPE_QUALIFIER ||
+                          type->type == GKCC_TYPE_STORAGE_CLASS_SPECIFIER)) {
+    type = type->of;
+  }
+  return type != NULL && type->type == GKCC_TYPE_UNSIGNED;
 }
-void gkcc_tx86_translate_ir_quad_instruction_add(FILE *out_file,
-                                                 struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\taddl %%edx, %%eax\n");
-  gkcc_tx86_translate_ir_quad_save_register(out_file, quad, "%eax");
+
+void gkcc_tx86_translate_ir_quad_instruction_load(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  struct gkcc_type *type = fn->operands.types[quad->dest];
+  bool is_unsigned = gkcc_tx86_type_is_unsigned(type);
+  switch (gkcc_tx86_memory_access_size(type)) {
+    case 1:
+      gkcc_tx86_write(writer, fn, "\t%s (%%eax), %%eax\n",
+                      is_unsigned ? "movzbl" : "movsbl");
+      break;
+    case 2:
+      gkcc_tx86_write(writer, fn, "\t%s (%%eax), %%eax\n",
+                      is_unsigned ? "movzwl" : "movswl");
+      break;
+    default:
+      gkcc_tx86_write(writer, fn, "\tmovl (%%eax), %%eax\n");
+      break;
+  }
+  gkcc_tx86_translate_ir_quad_save_register(writer, fn, quad, "%eax");
+}
+void gkcc_tx86_translate_ir_quad_instruction_return(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+
+  gkcc_tx86_write(writer, fn, "\tleave\n");
+  gkcc_tx86_write(writer, fn, "\tret\n");
+}
+void gkcc_tx86_translate_ir_quad_instruction_add(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\taddl %%edx, %%eax\n");
+  gkcc_tx86_translate_ir_quad_save_register(writer, fn, quad, "%eax");
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_subtract(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\tsubl %%edx, %%eax\n");
-  gkcc_tx86_translate_ir_quad_save_register(out_file, quad, "%eax");
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\tsubl %%edx, %%eax\n");
+  gkcc_tx86_translate_ir_quad_save_register(writer, fn, quad, "%eax");
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_multiply(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\timull %%edx, %%eax\n");
-  gkcc_tx86_translate_ir_quad_save_register(out_file, quad, "%eax");
-}
-
-void gkcc_tx86_translate_ir_quad_instruction_divide(FILE *out_file,
-                                                    struct gkcc_ir_quad *quad) {
-  fprintf(out_file, "\tmovl %s, %%ecx\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source2));
-  fprintf(out_file, "\tmovl %s, %%eax\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source1));
-  fprintf(out_file, "\tcltd\n");
-  fprintf(out_file, "\tidivl %%ecx\n");
-  gkcc_tx86_translate_ir_quad_save_register(out_file, quad, "%eax");
-}
-
-void gkcc_tx86_translate_ir_quad_instruction_mod(FILE *out_file,
-                                                 struct gkcc_ir_quad *quad) {
-  fprintf(out_file, "\tmovl %s, %%ecx\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source2));
-  fprintf(out_file, "\tmovl %s, %%eax\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source1));
-  fprintf(out_file, "\tcltd\n");
-  fprintf(out_file, "\tidivl %%ecx\n");
-  gkcc_tx86_translate_ir_quad_save_register(out_file, quad, "%edx");
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\timull %%edx, %%eax\n");
+  gkcc_tx86_translate_ir_quad_save_register(writer, fn, quad, "%eax");
+}
+
+void gkcc_tx86_translate_ir_quad_instruction_divide(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_write(writer, fn, "\tmovl %o, %%ecx\n", quad->source2);
+  gkcc_tx86_write(writer, fn, "\tmovl %o, %%eax\n", quad->source1);
+  gkcc_tx86_write(writer, fn, "\tcltd\n");
+  gkcc_tx86_write(writer, fn, "\tidivl %%ecx\n");
+  gkcc_tx86_translate_ir_quad_save_register(writer, fn, quad, "%eax");
+}
+
+void gkcc_tx86_translate_ir_quad_instruction_mod(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_write(writer, fn, "\tmovl %o, %%ecx\n", quad->source2);
+  gkcc_tx86_write(writer, fn, "\tmovl %o, %%eax\n", quad->source1);
+  gkcc_tx86_write(writer, fn, "\tcltd\n");
+  gkcc_tx86_write(writer, fn, "\tidivl %%ecx\n");
+  gkcc_tx86_translate_ir_quad_save_register(writer, fn, quad, "%edx");
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_function_arg(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  fprintf(out_file, "\tpushl %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source1));
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_write(writer, fn, "\tpushl %o\n", quad->source1);
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_function_call(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  fprintf(out_file, "\tcall %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source1));
-  gkcc_tx86_translate_ir_quad_save_register(out_file, quad, "%eax");
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_write(writer, fn, "\tcall %o\n", quad->source1);
+  gkcc_tx86_translate_ir_quad_save_register(writer, fn, quad, "%eax");
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_branch_if_true(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\tmovl %s, %%eax\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source2));
-  fprintf(out_file, "\tcmpl $0, %%eax\n");
-  fprintf(out_file, "\tjne %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source1));
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\tmovl %o, %%eax\n", quad->source2);
+  gkcc_tx86_write(writer, fn, "\tcmpl $0, %%eax\n");
+  gkcc_tx86_write(writer, fn, "\tjne %o\n", quad->source1);
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_branch_if_false(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  fprintf(out_file, "\tmovl %s, %%eax\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source2));
-  fprintf(out_file, "\tcmpl $0, %%eax\n");
-  fprintf(out_file, "\tje %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source1));
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_write(writer, fn, "\tmovl %o, %%eax\n", quad->source2);
+  gkcc_tx86_write(writer, fn, "\tcmpl $0, %%eax\n");
+  gkcc_tx86_write(writer, fn, "\tje %o\n", quad->source1);
 }
 
-void gkcc_tx86_translate_ir_quad_instruction_branch(FILE *out_file,
-                                                    struct gkcc_ir_quad *quad) {
-  fprintf(out_file, "\tjmp %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source1));
+void gkcc_tx86_translate_ir_quad_instruction_branch(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_write(writer, fn, "\tjmp %o\n", quad->source1);
 }
 
-void gkcc_tx86_translate_ir_quad_instruction_equals(FILE *out_file,
-                                                    struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\tmovl $0, %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
-  fprintf(out_file, "\tcmpl %%eax, %%edx\n");
-  fprintf(out_file, "\tsete %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
+void gkcc_tx86_translate_ir_quad_instruction_equals(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\tmovl $0, %o\n", quad->dest);
+  gkcc_tx86_write(writer, fn, "\tcmpl %%eax, %%edx\n");
+  gkcc_tx86_write(writer, fn, "\tsete %o\n", quad->dest);
 }
 
-void gkcc_tx86_translate_ir_quad_instruction_move(FILE *out_file,
-                                                  struct gkcc_ir_quad *quad) {
-  fprintf(out_file, "\tmovl %s, %%eax\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source1));
-  fprintf(out_file, "\tmovl %%eax, %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf2, quad->dest));
+void gkcc_tx86_translate_ir_quad_instruction_move(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_write(writer, fn, "\tmovl %o, %%eax\n", quad->source1);
+  gkcc_tx86_write(writer, fn, "\tmovl %%eax, %o\n", quad->dest);
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_logical_not(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\tmovl $0, %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
-  fprintf(out_file, "\tcmpl $0, %%eax\n");
-  fprintf(out_file, "\tsete %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\tmovl $0, %o\n", quad->dest);
+  gkcc_tx86_write(writer, fn, "\tcmpl $0, %%eax\n");
+  gkcc_tx86_write(writer, fn, "\tsete %o\n", quad->dest);
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_greater_than(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\tmovl $0, %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
-  fprintf(out_file, "\tcmpl %%edx, %%eax\n");
-  fprintf(out_file, "\tsetg %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\tmovl $0, %o\n", quad->dest);
+  gkcc_tx86_write(writer, fn, "\tcmpl %%edx, %%eax\n");
+  gkcc_tx86_write(writer, fn, "\tsetg %o\n", quad->dest);
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_less_than(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\tmovl $0, %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
-  fprintf(out_file, "\tcmpl %%edx, %%eax\n");
-  fprintf(out_file, "\tsetl %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\tmovl $0, %o\n", quad->dest);
+  gkcc_tx86_write(writer, fn, "\tcmpl %%edx, %%eax\n");
+  gkcc_tx86_write(writer, fn, "\tsetl %o\n", quad->dest);
 }
 void gkcc_tx86_translate_ir_quad_instruction_greater_than_or_equal_to(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\tmovl $0, %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
-  fprintf(out_file, "\tcmpl %%edx, %%eax\n");
-  fprintf(out_file, "\tsetge %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\tmovl $0, %o\n", quad->dest);
+  gkcc_tx86_write(writer, fn, "\tcmpl %%edx, %%eax\n");
+  gkcc_tx86_write(writer, fn, "\tsetge %o\n", quad->dest);
 }
 void gkcc_tx86_translate_ir_quad_instruction_less_than_or_equal_to(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\tmovl $0, %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
-  fprintf(out_file, "\tcmpl %%edx, %%eax\n");
-  fprintf(out_file, "\tsetle %s\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\tmovl $0, %o\n", quad->dest);
+  gkcc_tx86_write(writer, fn, "\tcmpl %%edx, %%eax\n");
+  gkcc_tx86_write(writer, fn, "\tsetle %o\n", quad->dest);
 }
 
-void gkcc_tx86_translate_ir_quad_instruction_lea(FILE *out_file,
-                                                 struct gkcc_ir_quad *quad) {
-  fprintf(out_file, "\tleal %s, %%eax\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->source1));
-  gkcc_tx86_translate_ir_quad_save_register(out_file, quad, "%eax");
+void gkcc_tx86_translate_ir_quad_instruction_lea(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_write(writer, fn, "\tleal %o, %%eax\n", quad->source1);
+  gkcc_tx86_translate_ir_quad_save_register(writer, fn, quad, "%eax");
 }
 
-void gkcc_tx86_translate_ir_quad_instruction_str(FILE *out_file,
-                                                 struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\tmovl %s, %%edx\n",
-          gkcc_tx86_translate_ir_quad_register(buf1, quad->dest));
-  fprintf(out_file, "\tmovl %%eax, (%%edx)\n");
+void gkcc_tx86_translate_ir_quad_instruction_str(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\tmovl %o, %%edx\n", quad->dest);
+  struct gkcc_type *type = fn->operands.types[quad->dest];
+  struct gkcc_type *pointed_to = type != NULL ? type->of : NULL;
+  switch (gkcc_tx86_memory_access_size(pointed_to)) {
+    case 1:
+      gkcc_tx86_write(writer, fn, "\tmovb %%al, (%%edx)\n");
+      break;
+    case 2:
+      gkcc_tx86_write(writer, fn, "\tmovw %%ax, (%%edx)\n");
+      break;
+    default:
+      gkcc_tx86_write(writer, fn, "\tmovl %%eax, (%%edx)\n");
+      break;
+  }
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_negate_value(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\tnegl %%eax\n");
-  gkcc_tx86_translate_ir_quad_save_register(out_file, quad, "%eax");
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\tnegl %%eax\n");
+  gkcc_tx86_translate_ir_quad_save_register(writer, fn, quad, "%eax");
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_postinc(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  gkcc_tx86_translate_ir_quad_save_register(out_file, quad, "%eax");
-  fprintf(out_file, "\taddl $1, %%eax\n");
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_translate_ir_quad_save_register(writer, fn, quad, "%eax");
+  gkcc_tx86_write(writer, fn, "\taddl $1, %%eax\n");
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_postdec(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  gkcc_tx86_translate_ir_quad_save_register(out_file, quad, "%eax");
-  fprintf(out_file, "\tsubl $1, %%eax\n");
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_translate_ir_quad_save_register(writer, fn, quad, "%eax");
+  gkcc_tx86_write(writer, fn, "\tsubl $1, %%eax\n");
 }
 
 void gkcc_tx86_translate_ir_quad_instruction_bitwise_not(
-    FILE *out_file, struct gkcc_ir_quad *quad) {
-  gkcc_tx86_translate_ir_quad_load_into_registers(out_file, quad);
-  fprintf(out_file, "\tnotl %%eax\n");
-  gkcc_tx86_translate_ir_quad_save_register(out_file, quad, "%eax");
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad) {
+  gkcc_tx86_translate_ir_quad_load_into_registers(writer, fn, quad);
+  gkcc_tx86_write(writer, fn, "\tnotl %%eax\n");
+  gkcc_tx86_translate_ir_quad_save_register(writer, fn, quad, "%eax");
 }
@@ -16,90 +16,116 @@
 #ifndef GKCC_X86_INST_H
 #define GKCC_X86_INST_H
 
-#include <stdio.h>
-
 #include "ir/quads.h"
+#include "misc/writer.h"
 
-void gkcc_tx86_translate_ir_quad_load_into_registers(FILE *out_file,
-                                                     struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_load_into_registers(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_instruction_load(FILE *out_file,
-                                                  struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_instruction_load(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_instruction_return(FILE *out_file,
-                                                    struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_instruction_return(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_instruction_add(FILE *out_file,
-                                                 struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_instruction_add(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 void gkcc_tx86_translate_ir_quad_instruction_subtract(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 void gkcc_tx86_translate_ir_quad_instruction_multiply(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_instruction_divide(FILE *out_file,
-                                                    struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_instruction_divide(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_instruction_mod(FILE *out_file,
-                                                 struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_instruction_mod(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_save_register(FILE *out_file,
-                                               struct gkcc_ir_quad *quad,
+void gkcc_tx86_translate_ir_quad_save_register(struct gkcc_writer *writer,
+                                               struct gkcc_ir_function *fn,
+                                               struct gkcc_ir_packed_quad *quad,
                                                char *from_register);
 
 void gkcc_tx86_translate_ir_quad_instruction_function_arg(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 void gkcc_tx86_translate_ir_quad_instruction_function_call(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 void gkcc_tx86_translate_ir_quad_instruction_branch_if_true(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 void gkcc_tx86_translate_ir_quad_instruction_branch_if_false(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_instruction_branch(FILE *out_file,
-                                                    struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_instruction_branch(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_instruction_equals(FILE *out_file,
-                                                    struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_instruction_equals(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_instruction_move(FILE *out_file,
-                                                  struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_instruction_move(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 void gkcc_tx86_translate_ir_quad_instruction_logical_not(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 void gkcc_tx86_translate_ir_quad_instruction_greater_than(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 void gkcc_tx86_translate_ir_quad_instruction_less_than(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 void gkcc_tx86_translate_ir_quad_instruction_greater_than_or_equal_to(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 void gkcc_tx86_translate_ir_quad_instruction_less_than_or_equal_to(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_instruction_lea(FILE *out_file,
-                                                 struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_instruction_lea(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_instruction_str(FILE *out_file,
-                                                 struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_instruction_str(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 void gkcc_tx86_translate_ir_quad_instruction_negate_value(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_instruction_postinc(FILE *out_file,
-                                                     struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_instruction_postinc(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
-void gkcc_tx86_translate_ir_quad_instruction_postdec(FILE *out_file,
-                                                     struct gkcc_ir_quad *quad);
+void gkcc_tx86_translate_ir_quad_instruction_postdec(
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 void gkcc_tx86_translate_ir_quad_instruction_bitwise_not(
-    FILE *out_file, struct gkcc_ir_quad *quad);
+    struct gkcc_writer *writer, struct gkcc_ir_function *fn,
+    struct gkcc_ir_packed_quad *quad);
 
 #endif  // GKCC_X86_INST_H
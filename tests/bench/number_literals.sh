@@ -0,0 +1,144 @@
+#!/usr/bin/env bash
+
+# Times the decoding of numeric literals by gkcc_decode_integer_literal() and
+# gkcc_decode_float_literal() against the sscanf() calls the lexer rules used
+# before. The corpus is a table of literals: 50% hex, 30% decimal, 10% octal
+# and 10% decimal floats.
+#
+# Usage: tests/bench/number_literals.sh [literals] [repetitions]
+
+set -euf -o pipefail
+
+# This line will only work in scripts and not sourced bash scripts.
+SCRIPTPATH="$( cd "$(dirname "$0")" ; pwd -P )"
+SRC="$SCRIPTPATH/../../src"
+
+LITERALS="${1:-4000000}"
+REPETITIONS="${2:-3}"
+CC="${CC:-cc}"
+CFLAGS="${CFLAGS:--O2}"
+
+WORKDIR="$(mktemp -d)"
+trap 'rm -rf "$WORKDIR"' EXIT
+
+awk -v count="$LITERALS" 'BEGIN {
+    srand(7)
+    print "int table[] = {"
+    for (i = 0; i < count; i++) {
+        r = rand()
+        if (r < 0.5) {
+            printf "0x%X,\n", int(rand() * 2147483647)
+        } else if (r < 0.8) {
+            printf "%d,\n", int(rand() * 100000)
+        } else if (r < 0.9) {
+            printf "0%o,\n", int(rand() * 4096)
+        } else {
+            printf "%d.%d,\n", int(rand() * 1000), int(rand() * 1000)
+        }
+    }
+    print "};"
+}' > "$WORKDIR/table.c"
+
+cat > "$WORKDIR/bench.c" << 'EOF'
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "number_literal.h"
+
+struct literal {
+  const char *text;
+  size_t length;
+};
+
+static double seconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static bool is_float(struct literal *literal) {
+  return memchr(literal->text, '.', literal->length) != NULL;
+}
+
+// decode_sscanf decodes a literal like the lexer rules did before
+static void decode_sscanf(struct literal *literal, struct _yynum *number) {
+  const char *text = literal->text;
+  if (is_float(literal)) {
+    sscanf(text, "%lf", &number->num.ydouble);
+  } else if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+    sscanf(&text[2], "%x", (unsigned int *)&number->num.yint);
+  } else if (text[0] == '0') {
+    sscanf(text, "%o", (unsigned int *)&number->num.yint);
+  } else {
+    sscanf(text, "%d", &number->num.yint);
+  }
+}
+
+static void decode(struct literal *literal, struct _yynum *number) {
+  if (is_float(literal)) {
+    gkcc_decode_float_literal(literal->text, literal->length, number);
+  } else {
+    gkcc_decode_integer_literal(literal->text, literal->length, number);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) return 1;
+  FILE *file = fopen(argv[1], "r");
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+  char *source = malloc(size + 1);
+  fread(source, 1, size, file);
+  source[size] = '\0';
+  fclose(file);
+  int repetitions = atoi(argv[2]);
+
+  // Every line but the first and last holds one literal followed by a comma.
+  // The comma is replaced by a NUL, as sscanf() got the NUL terminated yytext.
+  size_t count = 0;
+  for (long i = 0; i < size; i++) count += source[i] == '\n';
+  struct literal *literals = malloc(count * sizeof(*literals));
+  count = 0;
+  for (char *p = strchr(source, '\n') + 1; isalnum(*p); p++) {
+    literals[count].text = p;
+    p = strchr(p, ',');
+    *p = '\0';
+    literals[count].length = p - literals[count].text;
+    count++;
+    p = strchr(p + 1, '\n');
+  }
+
+  size_t mismatches = 0;
+  for (size_t i = 0; i < count; i++) {
+    struct _yynum old = {0}, new = {0};
+    decode_sscanf(&literals[i], &old);
+    decode(&literals[i], &new);
+    if (is_float(&literals[i]) ? old.num.ydouble != new.num.ydouble
+                               : old.num.yint != new.num.yint) {
+      mismatches++;
+    }
+  }
+
+  printf("%zu literals, %zu decoded differently\n", count, mismatches);
+  printf("%10s %10s %10s\n", "sscanf", "decoder", "speedup");
+  for (int repetition = 0; repetition < repetitions; repetition++) {
+    struct _yynum number;
+    double start = seconds();
+    for (size_t i = 0; i < count; i++) decode_sscanf(&literals[i], &number);
+    double middle = seconds();
+    for (size_t i = 0; i < count; i++) decode(&literals[i], &number);
+    double end = seconds();
+    printf("%9.3fs %9.3fs %9.1fx\n", middle - start, end - middle,
+           (middle - start) / (end - middle));
+  }
+  return 0;
+}
+EOF
+
+"$CC" $CFLAGS -I"$SRC/lexical" -o "$WORKDIR/bench" "$WORKDIR/bench.c" \
+    "$SRC/lexical/number_literal.c"
+"$WORKDIR/bench" "$WORKDIR/table.c" "$REPETITIONS"
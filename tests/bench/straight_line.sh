@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+
+# Times gkcc_int on a single straight-line function of growing length. The time
+# per statement should stay flat as the function gets longer.
+#
+# Usage: tests/bench/straight_line.sh [path to gkcc_int] [statements...]
+
+set -euf -o pipefail
+
+# This line will only work in scripts and not sourced bash scripts.
+SCRIPTPATH="$( cd "$(dirname "$0")" ; pwd -P )"
+
+GKCC_INT="${1:-$SCRIPTPATH/../../tmp/gkcc_int}"
+shift || true
+SIZES=("$@")
+if [ "${#SIZES[@]}" -eq 0 ]; then
+    SIZES=(12500 25000 50000 100000)
+fi
+
+WORKDIR="$(mktemp -d)"
+trap 'rm -rf "$WORKDIR"' EXIT
+
+printf "%10s %10s %14s\n" "statements" "ms" "ns/statement"
+for size in "${SIZES[@]}"; do
+    source_file="$WORKDIR/straight_line_$size.i"
+    {
+        echo "int g;"
+        echo "int f(void) {"
+        echo "  int a; int b;"
+        echo "  a = g; b = 1;"
+        for ((i = 0; i < size; i++)); do
+            echo "  a = a + b * $i;"
+        done
+        echo "  return a;"
+        echo "}"
+    } > "$source_file"
+
+    start="$(date +%s%N)"
+    "$GKCC_INT" -o /dev/null assembly < "$source_file"
+    end="$(date +%s%N)"
+
+    elapsed_ns=$(( end - start ))
+    printf "%10d %10d %14d\n" "$size" "$(( elapsed_ns / 1000000 ))" \
+        "$(( elapsed_ns / size ))"
+done
@@ -0,0 +1,12 @@
+// __has_include is reported as defined by #ifdef, #ifndef and defined
+#ifdef __has_include
+#if __has_include("has_include.c") && !__has_include("has_include_missing.h")
+int has_include;
+#endif
+#endif
+#ifndef __has_include_next
+int missing_has_include_next;
+#endif
+#if defined(__has_include) && defined __has_include_next
+int defined_has_include;
+#endif
@@ -0,0 +1,7 @@
+// The result of a macro replacement is never run as a directive, even when
+// it starts a line (C17 6.10.3.4p3)
+#define HASH #
+#define EMPTY
+HASH include "macro_directive.h"
+EMPTY # define X 1
+int x = X;